@@ -0,0 +1,237 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ai/LightCost.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "graphics/Math.h"
+#include "graphics/data/Mesh.h"
+#include "physics/Anchors.h"
+#include "scene/Light.h"
+
+static const float STEALTH_LIGHT_COST = 300.0f;
+
+// How far dynamic lights can drift from the state included in the costs
+static const float DYNAMIC_LIGHT_MOVE = 50.f;
+static const float DYNAMIC_LIGHT_CHANGE = 0.25f;
+
+LightCostField::LightState::LightState(const EERIE_LIGHT * light, bool dynamic)
+	// Ignition lights only add the flame to a static light that is already included
+	: active(light && light->exist && (dynamic ? !light->m_isIgnitionLight
+	                                           : light->m_ignitionStatus))
+	, pos(active ? light->pos : Vec3f(0.f))
+	, fallstart(active ? light->fallstart : 0.f)
+	, fallend(active ? light->fallend : 0.f)
+	, strength(active ? STEALTH_LIGHT_COST * light->intensity
+	                    * (light->rgb.r + light->rgb.g + light->rgb.b) * (1.0f / 3) : 0.f)
+{ }
+
+bool LightCostField::LightState::operator==(const LightState & o) const {
+	return active == o.active && pos == o.pos && fallstart == o.fallstart
+	       && fallend == o.fallend && strength == o.strength;
+}
+
+bool LightCostField::LightState::isCloseTo(const LightState & o) const {
+	
+	if(active != o.active) {
+		return false;
+	}
+	
+	if(!active) {
+		return true;
+	}
+	
+	return closerThan(pos, o.pos, DYNAMIC_LIGHT_MOVE)
+	       && std::abs(fallstart - o.fallstart) <= o.fallstart * DYNAMIC_LIGHT_CHANGE
+	       && std::abs(fallend - o.fallend) <= o.fallend * DYNAMIC_LIGHT_CHANGE
+	       && std::abs(strength - o.strength) <= o.strength * DYNAMIC_LIGHT_CHANGE;
+}
+
+float LightCostField::LightState::getCost(const Vec3f & p) const {
+	
+	if(!active) {
+		return 0.f;
+	}
+	
+	float dist = fdist(pos, p);
+	if(dist > fallend) {
+		return 0.f;
+	}
+	
+	if(dist > fallstart) {
+		return strength * ((dist - fallstart) / (fallend - fallstart));
+	}
+	
+	return strength;
+}
+
+LightCostField::LightCostField(const EERIE_BACKGROUND * eb, size_t lightCount,
+                               const EERIE_LIGHT * const * lights, size_t dynamicLightCount,
+                               const EERIE_LIGHT * dynamicLights)
+	: m_anchorCount(eb->nbanchors), m_anchors(eb->anchors),
+	  m_width(std::max(long(eb->Xsize), 1l)), m_depth(std::max(long(eb->Zsize), 1l)),
+	  m_xmul(eb->Xmul), m_zmul(eb->Zmul), m_lightCount(lightCount), m_lights(lights),
+	  m_dynamicLights(dynamicLights), m_states(lightCount + dynamicLightCount),
+	  m_costs(eb->nbanchors, 0.f), m_invalid(eb->nbanchors, 0) {
+	
+	// Counting sort of the anchors by tile
+	std::vector<size_t> tileOf(m_anchorCount);
+	m_tiles.assign(m_width * m_depth + 1, 0);
+	for(size_t i = 0; i < m_anchorCount; i++) {
+		long x = getTileX(m_anchors[i].pos.x);
+		long z = getTileZ(m_anchors[i].pos.z);
+		tileOf[i] = size_t(z * m_width + x);
+		m_tiles[tileOf[i] + 1]++;
+	}
+	for(size_t i = 1; i < m_tiles.size(); i++) {
+		m_tiles[i] += m_tiles[i - 1];
+	}
+	std::vector<size_t> next(m_tiles.begin(), m_tiles.end() - 1);
+	m_tileAnchors.resize(m_anchorCount);
+	for(size_t i = 0; i < m_anchorCount; i++) {
+		m_tileAnchors[next[tileOf[i]]++] = PathFinder::NodeId(i);
+	}
+	
+	for(size_t i = 0; i < m_states.size(); i++) {
+		m_states[i] = LightState(getLight(i), i >= m_lightCount);
+		accumulate(m_states[i], false);
+	}
+	
+}
+
+const EERIE_LIGHT * LightCostField::getLight(size_t i) const {
+	return (i < m_lightCount) ? m_lights[i] : &m_dynamicLights[i - m_lightCount];
+}
+
+LightCostField::TileRect LightCostField::getTiles(const LightState & light) const {
+	
+	// Anchors outside of the background are in the nearest edge tile, which is
+	// included whenever the light range extends past that edge.
+	TileRect rect;
+	rect.x0 = getTileX(light.pos.x - light.fallend);
+	rect.x1 = getTileX(light.pos.x + light.fallend);
+	rect.z0 = getTileZ(light.pos.z - light.fallend);
+	rect.z1 = getTileZ(light.pos.z + light.fallend);
+	
+	return rect;
+}
+
+void LightCostField::invalidate(const LightState & light,
+                                std::vector<PathFinder::NodeId> & changed) {
+	
+	if(!light.active) {
+		return;
+	}
+	
+	TileRect rect = getTiles(light);
+	m_invalidTiles.push_back(rect);
+		
+	for(long z = rect.z0; z <= rect.z1; z++)
+	for(long x = rect.x0; x <= rect.x1; x++) {
+		size_t tile = size_t(z * m_width + x);
+		for(size_t j = m_tiles[tile]; j < m_tiles[tile + 1]; j++) {
+			PathFinder::NodeId i = m_tileAnchors[j];
+			if(!m_invalid[i] && light.getCost(m_anchors[i].pos) != 0.f) {
+				m_invalid[i] = 1;
+				changed.push_back(i);
+			}
+		}
+	}
+	
+}
+
+void LightCostField::accumulate(const LightState & light, bool invalidOnly) {
+	
+	if(!light.active) {
+		return;
+	}
+	
+	TileRect rect = getTiles(light);
+	
+	for(long z = rect.z0; z <= rect.z1; z++)
+	for(long x = rect.x0; x <= rect.x1; x++) {
+		size_t tile = size_t(z * m_width + x);
+		for(size_t j = m_tiles[tile]; j < m_tiles[tile + 1]; j++) {
+			PathFinder::NodeId i = m_tileAnchors[j];
+			if(!invalidOnly || m_invalid[i]) {
+				m_costs[i] += light.getCost(m_anchors[i].pos);
+			}
+		}
+	}
+	
+}
+
+long LightCostField::getTileX(float x) const {
+	return glm::clamp(long(std::floor(x * m_xmul)), 0l, m_width - 1);
+}
+
+long LightCostField::getTileZ(float z) const {
+	return glm::clamp(long(std::floor(z * m_zmul)), 0l, m_depth - 1);
+}
+
+bool LightCostField::update(std::vector<PathFinder::NodeId> & changed) {
+	
+	size_t first = changed.size();
+	m_invalidTiles.clear();
+	
+	for(size_t i = 0; i < m_states.size(); i++) {
+		
+		LightState state(getLight(i), i >= m_lightCount);
+		if(i < m_lightCount ? state == m_states[i] : state.isCloseTo(m_states[i])) {
+			continue;
+		}
+		
+		invalidate(m_states[i], changed);
+		invalidate(state, changed);
+		m_states[i] = state;
+	}
+	
+	if(m_invalidTiles.empty()) {
+		return false;
+	}
+	
+	/*
+	 * Recompute the affected anchors from scratch instead of subtracting the old
+	 * contributions so that rounding errors can not accumulate. Lights are added in
+	 * the same order as in the constructor, giving exactly the same costs as a
+	 * full rebuild.
+	 */
+	for(size_t j = first; j < changed.size(); j++) {
+		m_costs[changed[j]] = 0.f;
+	}
+	for(size_t i = 0; i < m_states.size(); i++) {
+		if(!m_states[i].active) {
+			continue;
+		}
+		TileRect rect = getTiles(m_states[i]);
+		for(size_t j = 0; j < m_invalidTiles.size(); j++) {
+			if(rect.intersects(m_invalidTiles[j])) {
+				accumulate(m_states[i], true);
+				break;
+			}
+		}
+	}
+	for(size_t j = first; j < changed.size(); j++) {
+		m_invalid[changed[j]] = 0;
+	}
+	
+	return true;
+}
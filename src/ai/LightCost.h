@@ -0,0 +1,135 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_AI_LIGHTCOST_H
+#define ARX_AI_LIGHTCOST_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "ai/PathFinder.h"
+#include "math/Types.h"
+
+struct ANCHOR_DATA;
+struct EERIE_BACKGROUND;
+struct EERIE_LIGHT;
+
+/*!
+ * Illumination cost of each anchor used by stealth searches.
+ *
+ * Costs are computed once for all lights and then updated incrementally:
+ * when a light is toggled, moved or otherwise changed, only the costs of the
+ * anchors within its old and new range are recomputed from the lights that reach
+ * them. Anchors are bucketed by background tile so that only the tiles within the
+ * range of a light need to be visited.
+ *
+ * Dynamic lights are included the same way, but as they flicker and move every
+ * frame, they only cause an update once they have drifted noticeably from the
+ * state included in the costs.
+ *
+ * Not thread-safe - pathfinder threads get a copy of the costs.
+ */
+class LightCostField {
+	
+public:
+	
+	LightCostField(const EERIE_BACKGROUND * eb, size_t lightCount,
+	               const EERIE_LIGHT * const * lights, size_t dynamicLightCount,
+	               const EERIE_LIGHT * dynamicLights);
+	
+	/*!
+	 * Apply changes to the lights since the field was created or last updated.
+	 * \param changed Anchors whose cost has changed are appended to this list.
+	 * \return true if any light has changed.
+	 */
+	bool update(std::vector<PathFinder::NodeId> & changed);
+	
+	//! \return the cost for each anchor
+	const std::vector<float> & getCosts() const { return m_costs; }
+	
+private:
+	
+	struct LightState {
+		
+		bool active;
+		Vec3f pos;
+		float fallstart;
+		float fallend;
+		float strength; //!< Cost at full intensity
+		
+		LightState() : active(false), pos(0.f), fallstart(0.f), fallend(0.f), strength(0.f) { }
+		LightState(const EERIE_LIGHT * light, bool dynamic);
+		
+		bool operator==(const LightState & o) const;
+		
+		//! \return true if the difference in cost is too small to be worth an update
+		bool isCloseTo(const LightState & o) const;
+		
+		float getCost(const Vec3f & pos) const;
+		
+	};
+	
+	//! Range of background tiles touched by a light
+	struct TileRect {
+		
+		long x0, z0, x1, z1;
+		
+		bool intersects(const TileRect & o) const {
+			return x0 <= o.x1 && o.x0 <= x1 && z0 <= o.z1 && o.z0 <= z1;
+		}
+		
+	};
+	
+	const EERIE_LIGHT * getLight(size_t i) const;
+	
+	TileRect getTiles(const LightState & light) const;
+	
+	//! Mark the anchors within range of a light to be recomputed
+	void invalidate(const LightState & light, std::vector<PathFinder::NodeId> & changed);
+	
+	//! Add the cost of a light to all anchors in range, or only to the marked ones
+	void accumulate(const LightState & light, bool invalidOnly);
+	
+	long getTileX(float x) const;
+	long getTileZ(float z) const;
+	
+	size_t m_anchorCount;
+	const ANCHOR_DATA * m_anchors;
+	
+	long m_width;
+	long m_depth;
+	float m_xmul;
+	float m_zmul;
+	std::vector<size_t> m_tiles; //!< Index of the first anchor in m_tileAnchors for each tile
+	std::vector<PathFinder::NodeId> m_tileAnchors; //!< Anchors sorted by tile
+	
+	size_t m_lightCount;
+	const EERIE_LIGHT * const * m_lights;
+	const EERIE_LIGHT * m_dynamicLights;
+	
+	//! Light states included in the costs, static lights first
+	std::vector<LightState> m_states;
+	std::vector<float> m_costs;
+	
+	std::vector<char> m_invalid; //!< Anchors whose cost is being recomputed
+	std::vector<TileRect> m_invalidTiles; //!< Tiles touched by the changed lights
+	
+};
+
+#endif // ARX_AI_LIGHTCOST_H
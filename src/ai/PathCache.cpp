@@ -0,0 +1,107 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ai/PathCache.h"
+
+#include <algorithm>
+
+bool PathCache::Key::operator<(const Key & o) const {
+	
+	if(from != o.from) {
+		return from < o.from;
+	}
+	if(to != o.to) {
+		return to < o.to;
+	}
+	if(radius != o.radius) {
+		return radius < o.radius;
+	}
+	if(height != o.height) {
+		return height < o.height;
+	}
+	
+	return stealth < o.stealth;
+}
+
+const PathFinder::Result * PathCache::lookup(const Key & key) {
+	
+	Index::iterator it = m_index.find(key);
+	if(it == m_index.end()) {
+		m_misses++;
+		return NULL;
+	}
+	
+	m_hits++;
+	
+	m_entries.splice(m_entries.begin(), m_entries, it->second);
+	
+	return &it->second->path;
+}
+
+void PathCache::insert(const Key & key, const PathFinder::Result & path, u64 time) {
+	
+	m_searches++;
+	m_searchTime += time;
+	
+	Index::iterator it = m_index.find(key);
+	if(it != m_index.end()) {
+		it->second->path = path;
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		return;
+	}
+	
+	if(m_entries.size() >= m_capacity) {
+		m_index.erase(m_entries.back().key);
+		m_entries.pop_back();
+	}
+	
+	m_entries.push_front(Entry(key, path));
+	m_index[key] = m_entries.begin();
+}
+
+void PathCache::invalidate(const std::vector<PathFinder::NodeId> & anchors) {
+	
+	if(anchors.empty()) {
+		return;
+	}
+	
+	Entries::iterator i = m_entries.begin();
+	while(i != m_entries.end()) {
+		
+		bool used = false;
+		for(PathFinder::Result::const_iterator j = i->path.begin(); j != i->path.end(); ++j) {
+			if(std::binary_search(anchors.begin(), anchors.end(), *j)) {
+				used = true;
+				break;
+			}
+		}
+		
+		if(used) {
+			m_index.erase(i->key);
+			i = m_entries.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
+void PathCache::clear() {
+	m_entries.clear();
+	m_index.clear();
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_AI_PATHCACHE_H
+#define ARX_AI_PATHCACHE_H
+
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "ai/PathFinder.h"
+#include "platform/Platform.h"
+
+/*!
+ * Bounded cache of found paths between two anchors, evicting the least recently used.
+ *
+ * Paths are stored for the exact cylinder size of the NPC - all NPCs of a class
+ * share the same size so this is enough to get hits.
+ * Entries using an anchor must be invalidated when the anchor is blocked or unblocked.
+ *
+ * The cache is not thread-safe - callers must lock.
+ */
+class PathCache {
+	
+public:
+	
+	struct Key {
+		
+		PathFinder::NodeId from;
+		PathFinder::NodeId to;
+		float radius;
+		float height;
+		bool stealth;
+		
+		Key(PathFinder::NodeId _from, PathFinder::NodeId _to, float _radius, float _height,
+		    bool _stealth)
+			: from(_from), to(_to), radius(_radius), height(_height), stealth(_stealth) { }
+		
+		bool operator<(const Key & o) const;
+		
+	};
+	
+	explicit PathCache(size_t capacity) : m_capacity(capacity), m_hits(0), m_misses(0),
+	                                      m_searches(0), m_searchTime(0) { }
+	
+	//! \return the cached path or NULL if there is none
+	const PathFinder::Result * lookup(const Key & key);
+	
+	/*!
+	 * Add a path found by a search.
+	 * \param time how long the search took, used to estimate the time saved by hits
+	 */
+	void insert(const Key & key, const PathFinder::Result & path, u64 time);
+	
+	//! Remove all paths using the given anchors, which must be sorted
+	void invalidate(const std::vector<PathFinder::NodeId> & anchors);
+	
+	//! Remove all paths but keep the statistics
+	void clear();
+	
+	size_t hits() const { return m_hits; }
+	size_t lookups() const { return m_hits + m_misses; }
+	
+	//! \return the average time in microseconds of a search that could have been cached
+	u64 averageSearchTime() const { return m_searches ? m_searchTime / m_searches : 0; }
+	
+private:
+	
+	struct Entry {
+		Key key;
+		PathFinder::Result path;
+		Entry(const Key & _key, const PathFinder::Result & _path) : key(_key), path(_path) { }
+	};
+	
+	typedef std::list<Entry> Entries; // Most recently used first
+	typedef std::map<Key, Entries::iterator> Index;
+	
+	Entries m_entries;
+	Index m_index;
+	size_t m_capacity;
+	
+	size_t m_hits;
+	size_t m_misses;
+	size_t m_searches;
+	u64 m_searchTime;
+	
+};
+
+#endif // ARX_AI_PATHCACHE_H
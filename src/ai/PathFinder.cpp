@@ -48,17 +48,21 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 
 #include <glm/gtx/norm.hpp>
 
+#include "ai/PathHierarchy.h"
 #include "graphics/GraphicsTypes.h"
 #include "graphics/Math.h"
 #include "graphics/data/Mesh.h"
 #include "math/Random.h"
 #include "math/Vector.h"
 #include "platform/Platform.h"
+#include "physics/AnchorIndex.h"
 #include "physics/Anchors.h"
-#include "scene/Light.h"
 
 static const float MIN_RADIUS = 110.0f;
 
+//! Searches between anchors closer than this don't use the hierarchy
+static const float HIERARCHY_MIN_DISTANCE = 2 * PathHierarchy::CELL_SIZE;
+
 #define frnd() (1.0f - 2 * rnd())
 
 const float PathFinder::HEURISTIC_MIN = 0.0f;
@@ -68,24 +72,28 @@ const float PathFinder::HEURISTIC_DEFAULT = 0.5f;
 const float PathFinder::RADIUS_DEFAULT = 0.0f;
 const float PathFinder::HEIGHT_DEFAULT = 0.0f;
 
+static const size_t NO_NODE = size_t(-1);
+static const size_t CLOSED = size_t(-1);
+
 class PathFinder::Node {
 	
 	NodeId id;
-	const Node * parent;
+	size_t parent;
 	
 	float cost;
 	float distance;
 	
 public:
 	
-	Node(long _id, const Node * _parent, float _distance, float _remaining)
+	Node(NodeId _id, size_t _parent, float _distance, float _remaining)
 		: id(_id), parent(_parent), cost(_distance + _remaining), distance(_distance) { }
 	
 	inline NodeId getId() const {
 		return id;
 	}
 	
-	inline const Node * getParent() const {
+	//! \return the index of the parent node in the search state or NO_NODE
+	inline size_t getParent() const {
 		return parent;
 	}
 	
@@ -97,7 +105,7 @@ public:
 		return distance;
 	}
 	
-	inline void newParent(const Node * _parent, float _distance) {
+	inline void newParent(size_t _parent, float _distance) {
 		parent = _parent;
 		cost = cost - distance + _distance;
 		distance = _distance;
@@ -105,96 +113,211 @@ public:
 	
 };
 
-class PathFinder::OpenNodeList {
+/*!
+ * Nodes for one search and the open and closed lists.
+ *
+ * Nodes are stored in a pool that is reused between searches. The open list is a
+ * binary heap of node indices that also tracks the heap position of each node so
+ * that nodes can be updated in place. Anchors are mapped to their node using a table
+ * stamped with a search generation, which avoids clearing the table for each search.
+ */
+class PathFinder::SearchState {
 	
-	typedef std::vector<Node*> NodeList;
+	typedef std::vector<Node> NodeList;
 	NodeList nodes;
 	
+	std::vector<size_t> open; // Heap of node indices
+	std::vector<size_t> position; // Heap position for each node or CLOSED
+	
+	std::vector<unsigned> generations; // Generation in which each anchor was last visited
+	std::vector<size_t> indices; // Node index for each visited anchor
+	unsigned generation;
+	
+	std::vector<char> corridor; // Clusters allowed for the current search
+	PathHierarchy::Scratch corridorScratch; // Storage used to find the corridor
+	
+	size_t expanded; // Number of nodes closed since the last reset
+	
+	/*!
+	 * Order by cost, with ties going to the node that was created first.
+	 * This matches the order of the linear search used previously so that the
+	 * resulting paths do not change.
+	 */
+	bool isBetter(size_t a, size_t b) const {
+		float ca = nodes[a].getCost(), cb = nodes[b].getCost();
+		return ca < cb || (ca == cb && a < b);
+	}
+	
+	void place(size_t pos, size_t node) {
+		open[pos] = node;
+		position[node] = pos;
+	}
+	
+	void siftUp(size_t pos) {
+		size_t node = open[pos];
+		while(pos > 0) {
+			size_t parent = (pos - 1) / 2;
+			if(!isBetter(node, open[parent])) {
+				break;
+			}
+			place(pos, open[parent]);
+			pos = parent;
+		}
+		place(pos, node);
+	}
+	
+	void siftDown(size_t pos) {
+		size_t node = open[pos];
+		size_t count = open.size();
+		while(true) {
+			size_t child = 2 * pos + 1;
+			if(child >= count) {
+				break;
+			}
+			if(child + 1 < count && isBetter(open[child + 1], open[child])) {
+				child++;
+			}
+			if(!isBetter(open[child], node)) {
+				break;
+			}
+			place(pos, open[child]);
+			pos = child;
+		}
+		place(pos, node);
+	}
+	
+	bool isVisited(NodeId id) const {
+		return generations[id] == generation;
+	}
+	
+	size_t createNode(NodeId id, size_t parent, float distance, float remaining) {
+		size_t index = nodes.size();
+		nodes.push_back(Node(id, parent, distance, remaining));
+		position.push_back(CLOSED);
+		generations[id] = generation;
+		indices[id] = index;
+		return index;
+	}
+	
 public:
 	
-	~OpenNodeList() {
-		for(NodeList::iterator i = nodes.begin(); i != nodes.end(); ++i) {
-			delete *i;
+	SearchState() : generation(0), expanded(0) { }
+	
+	//! Start a new search and create the (already closed) start node
+	size_t start(size_t map_size, NodeId from) {
+		
+		nodes.clear();
+		open.clear();
+		position.clear();
+		
+		if(generations.size() != map_size) {
+			generations.assign(map_size, 0);
+			indices.resize(map_size);
+			generation = 0;
+		}
+		
+		if(++generation == 0) {
+			std::fill(generations.begin(), generations.end(), 0);
+			generation = 1;
 		}
+		
+		expanded++;
+		
+		return createNode(from, NO_NODE, 0.0f, 0.0f);
+	}
+	
+	bool isClosed(NodeId id) const {
+		return isVisited(id) && position[indices[id]] == CLOSED;
 	}
 	
 	/*!
-	 * If a node with the same ID exists, update it.
+	 * If an open node with the same ID exists, update it.
 	 * Otherwise add a new node.
 	 * Assumes that remaining never changes for the same node id.
 	 */
-	inline void add(NodeId id, const Node * parent, float distance, float remaining) {
+	void add(NodeId id, size_t parent, float distance, float remaining) {
 		
-		// Check if node is already in open list.
-		for(NodeList::iterator i = nodes.begin(); i != nodes.end(); ++i) {
-			if((*i)->getId() == id) {
-				if((*i)->getDistance() > distance) {
-					(*i)->newParent(parent, distance);
-				}
-				return;
+		if(isVisited(id)) {
+			size_t index = indices[id];
+			arx_assert(position[index] != CLOSED);
+			if(nodes[index].getDistance() > distance) {
+				nodes[index].newParent(parent, distance);
+				siftUp(position[index]);
+				siftDown(position[index]);
 			}
+			return;
 		}
 		
-		nodes.push_back(new Node(id, parent, distance, remaining));
+		size_t index = createNode(id, parent, distance, remaining);
+		open.push_back(index);
+		siftUp(open.size() - 1);
 	}
 	
-	Node * extractBestNode() {
-		// TODO use a better datastructure
+	/*!
+	 * Remove the best node (lowest cost) from the open list and close it.
+	 * \return the index of the node or NO_NODE if the open list is empty
+	 */
+	size_t extractBestNode() {
 		
-		if(nodes.empty()) {
-			return NULL;
+		if(open.empty()) {
+			return NO_NODE;
 		}
 		
-		NodeList::iterator best = nodes.begin();
-		float cost = std::numeric_limits<float>::max();
-		for(NodeList::iterator i = nodes.begin(); i != nodes.end(); ++i) {
-			if((*i)->getCost() < cost) {
-				cost = (*i)->getCost();
-				best = i;
-			}
-		}
+		size_t best = open.front();
+		position[best] = CLOSED;
+		expanded++;
 		
-		Node * node = *best;
-		nodes.erase(best);
+		size_t last = open.back();
+		open.pop_back();
+		if(!open.empty()) {
+			place(0, last);
+			siftDown(0);
+		}
 		
-		return node;
+		return best;
 	}
 	
-};
-
-class PathFinder::ClosedNodeList {
+	std::vector<char> & getCorridor() {
+		return corridor;
+	}
 	
-	typedef std::vector<Node*> NodeList;
-	NodeList nodes;
+	PathHierarchy::Scratch & getCorridorScratch() {
+		return corridorScratch;
+	}
 	
-public:
+	size_t getExpanded() const {
+		return expanded;
+	}
 	
-	~ClosedNodeList() {
-		for(NodeList::iterator i = nodes.begin(); i != nodes.end(); ++i) {
-			delete *i;
-		}
+	void resetExpanded() {
+		expanded = 0;
 	}
 	
-	void add(Node * node) {
-		nodes.push_back(node);
+	const Node & operator[](size_t index) const {
+		return nodes[index];
 	}
 	
-	bool contains(NodeId id) const {
-		// TODO better datastructure: set of closed node ids
-		for(NodeList::const_iterator i = nodes.begin(); i != nodes.end(); ++i) {
-			if((*i)->getId() == id) {
-				return true;
-			}
+	void buildPath(size_t index, Result & rlist) const {
+		
+		size_t s = rlist.size();
+		
+		for(size_t i = index; i != NO_NODE; i = nodes[i].getParent()) {
+			rlist.push_back(nodes[i].getId());
 		}
-		return false;
+		
+		std::reverse(rlist.begin() + s, rlist.end());
 	}
 	
 };
 
-PathFinder::PathFinder(size_t map_size, const ANCHOR_DATA * map_data,
-                       size_t slight_count, const EERIE_LIGHT * const * slight_list)
+PathFinder::PathFinder(size_t map_size, const ANCHOR_DATA * map_data, const float * _light_costs)
 	: radius(RADIUS_DEFAULT), height(HEIGHT_DEFAULT), heuristic(HEURISTIC_DEFAULT),
-	  map_s(map_size), map_d(map_data), slight_c(slight_count), slight_l(slight_list) { }
+	  map_s(map_size), map_d(map_data), light_costs(_light_costs),
+	  hierarchy(NULL), anchor_index(NULL), search(new SearchState) { }
+
+PathFinder::~PathFinder() {
+	delete search;
+}
 
 void PathFinder::setHeuristic(float _heuristic) {
 	if(_heuristic >= HEURISTIC_MAX) {
@@ -211,6 +334,14 @@ void PathFinder::setCylinder(float _radius, float _height) {
 	height = _height;
 }
 
+void PathFinder::setHierarchy(const PathHierarchy * _hierarchy) {
+	hierarchy = _hierarchy;
+}
+
+void PathFinder::setAnchorIndex(const AnchorIndex * index) {
+	anchor_index = index;
+}
+
 bool PathFinder::move(NodeId from, NodeId to, Result & rlist, bool stealth) const {
 	
 	if(from == to) {
@@ -218,25 +349,38 @@ bool PathFinder::move(NodeId from, NodeId to, Result & rlist, bool stealth) cons
 		return true;
 	}
 	
-	// Create start node and put it on open list
-	Node * node = new Node(from, NULL, 0.0f, 0.0f);
-	if(!node) {
-		return false;
+	if(hierarchy && !closerThan(map_d[from].pos, map_d[to].pos, HIERARCHY_MIN_DISTANCE)) {
+		
+		std::vector<char> & corridor = search->getCorridor();
+		if(!hierarchy->getCorridor(from, to, corridor, search->getCorridorScratch())) {
+			// Not connected even if we ignore blocked anchors and the cylinder size
+			return false;
+		}
+		
+		if(findPath(from, to, rlist, stealth, &corridor)) {
+			return true;
+		}
+		
+		// Blocked or narrow anchors may require a detour outside of the corridor
 	}
 	
+	return findPath(from, to, rlist, stealth, NULL);
+}
+
+bool PathFinder::findPath(NodeId from, NodeId to, Result & rlist, bool stealth,
+                          const std::vector<char> * corridor) const {
+	
+	// Create start node, it is closed as we examine it right away
+	size_t node = search->start(map_s, from);
+	
 	// A* main loop
-	OpenNodeList open;
-	ClosedNodeList close;
 	do {
 		
-		// Put node onto close list as we have now examined this node.
-		close.add(node);
-		
-		NodeId nid = node->getId();
+		NodeId nid = (*search)[node].getId();
 		
 		// If it's the goal node then we're done.
 		if(nid == to) {
-			buildPath(*node, rlist);
+			search->buildPath(node, rlist);
 			return true;
 		}
 		
@@ -250,26 +394,30 @@ bool PathFinder::move(NodeId from, NodeId to, Result & rlist, bool stealth) cons
 				continue;
 			}
 			
-			if(close.contains(cid)) {
+			if(corridor && !(*corridor)[hierarchy->getCluster(cid)]) {
+				continue;
+			}
+			
+			if(search->isClosed(cid)) {
 				continue;
 			}
 			
 			// Cost to reach this node.
 			float distance = fdist(map_d[cid].pos, map_d[nid].pos);
 			if(stealth) {
-				distance += getIlluminationCost(map_d[cid].pos);
+				distance += getIlluminationCost(cid);
 			}
 			distance *= heuristic;
-			distance += node->getDistance();
+			distance += (*search)[node].getDistance();
 			
 			// Estimated cost to get from this node to the destination.
 			float remaining = (1.0f - heuristic) * fdist(map_d[cid].pos, map_d[to].pos);
 			
-			open.add(cid, node, distance, remaining);
+			search->add(cid, node, distance, remaining);
 		}
 	
-		node = open.extractBestNode();
-	} while(node);
+		node = search->extractBestNode();
+	} while(node != NO_NODE);
 	
 	// No path found!
 	return false;
@@ -285,27 +433,19 @@ bool PathFinder::flee(NodeId from, const Vec3f & danger, float safeDist, Result
 		return true;
 	}
 	
-	// Create start node and put it on open list
-	Node * node = new Node(from, NULL, 0.0f, 0.0f);
-	if(!node) {
-		return false;
-	}
+	// Create start node, it is closed as we examine it right away
+	size_t node = search->start(map_s, from);
 	
 	// A* main loop
-	OpenNodeList open;
-	ClosedNodeList close;
 	do {
 		
-		// Put node onto close list as we have now examined this node.
-		close.add(node);
-		
 		// If it's the goal node then we're done.
-		if(node->getCost() == node->getDistance()) {
-			buildPath(*node, rlist);
+		if((*search)[node].getCost() == (*search)[node].getDistance()) {
+			search->buildPath(node, rlist);
 			return true;
 		}
 		
-		NodeId nid = node->getId();
+		NodeId nid = (*search)[node].getId();
 		
 		// Otherwise, generate child from current node.
 		for(short i(0); i < map_d[nid].nblinked; i++) {
@@ -317,25 +457,25 @@ bool PathFinder::flee(NodeId from, const Vec3f & danger, float safeDist, Result
 				continue;
 			}
 			
-			if(close.contains(cid)) {
+			if(search->isClosed(cid)) {
 				continue;
 			}
 			
 			// Cost to reach this node.
-			float distance = node->getDistance() + fdist(map_d[cid].pos, map_d[nid].pos);
+			float distance = (*search)[node].getDistance() + fdist(map_d[cid].pos, map_d[nid].pos);
 			if(stealth) {
-				distance += getIlluminationCost(map_d[cid].pos);
+				distance += getIlluminationCost(cid);
 			}
 			
 			// Estimated cost to get from this node to the destination.
 			float remaining = std::max(0.0f, safeDist - fdist(map_d[cid].pos, danger));
 			remaining *= FLEE_DISTANCE_COST;
 			
-			open.add(cid, node, distance, remaining);
+			search->add(cid, node, distance, remaining);
 		}
 		
-		node = open.extractBestNode();
-	} while(node);
+		node = search->extractBestNode();
+	} while(node != NO_NODE);
 	
 	// No path found!
 	return false;
@@ -397,8 +537,21 @@ bool PathFinder::wanderAround(NodeId from, float rad, Result & rlist, bool steal
 	return true;
 }
 
+size_t PathFinder::getExpandedNodes() const {
+	return search->getExpanded();
+}
+
+void PathFinder::resetExpandedNodes() {
+	search->resetExpanded();
+}
+
 PathFinder::NodeId PathFinder::getNearestNode(const Vec3f & pos) const {
 	
+	if(anchor_index) {
+		long nearest = anchor_index->getNearest(pos);
+		return nearest < 0 ? 0 : NodeId(nearest);
+	}
+	
 	NodeId best = 0;
 	float distance = std::numeric_limits<float>::max();
 	
@@ -450,50 +603,3 @@ bool PathFinder::lookFor(NodeId from, const Vec3f & pos, float radius, Result &
 	
 	return true;
 }
-
-void PathFinder::buildPath(const Node & node, Result & rlist) {
-	
-	const Node * next = &node;
-	
-	size_t s = rlist.size();
-	
-	while(next) {
-		rlist.push_back(next->getId());
-		next = next->getParent();
-	}
-	
-	std::reverse(rlist.begin() + s, rlist.end());
-}
-
-float PathFinder::getIlluminationCost(const Vec3f & pos) const {
-	
-	static const float STEALTH_LIGHT_COST = 300.0F;
-	
-	float cost = 0.0f;
-	
-	for(size_t i = 0; i < slight_c; i++) {
-		
-		if(!slight_l[i] || !slight_l[i]->exist || !slight_l[i]->m_ignitionStatus) {
-			continue;
-		}
-		
-		const EERIE_LIGHT & light = *slight_l[i];
-		
-		float dist = fdist(light.pos, pos);
-		
-		if(dist <= light.fallend) {
-			
-			float l_cost = STEALTH_LIGHT_COST;
-			
-			l_cost *= light.intensity * (light.rgb.r + light.rgb.g + light.rgb.b) * (1.0f / 3);
-			
-			if(dist > light.fallstart) {
-				l_cost *= ((dist - light.fallstart) / (light.fallend - light.fallstart));
-			}
-			
-			cost += l_cost;
-		}
-	}
-	
-	return cost;
-}
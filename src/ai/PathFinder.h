@@ -47,13 +47,21 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include <stddef.h>
 #include <vector>
 
+#include <boost/noncopyable.hpp>
+
 #include "math/Types.h"
 
 struct ANCHOR_DATA;
-struct EERIE_LIGHT;
+class AnchorIndex;
+class PathHierarchy;
 
 
-class PathFinder {
+/*!
+ * A* search over the anchor graph.
+ * Memory used by a search is kept for reuse, so an instance must not be used by
+ * more than one thread at a time.
+ */
+class PathFinder : private boost::noncopyable {
 	
 public:
 	
@@ -67,10 +75,12 @@ public:
 	/*!
 	 * Create a PathFinder instance for the provided data.
 	 * The pathfinder instance does not copy the provided data and will not clean it up
-	 * The light data is only used when the stealth parameter is set to true.
+	 * The light costs contain the illumination cost for each anchor and are only used
+	 * when the stealth parameter is set to true. Without them stealth has no effect.
 	 */
-	PathFinder(size_t map_size, const ANCHOR_DATA * map_data,
-	           size_t light_count, const EERIE_LIGHT * const * light_list);
+	PathFinder(size_t map_size, const ANCHOR_DATA * map_data, const float * light_costs = NULL);
+	
+	~PathFinder();
 	
 	typedef unsigned long NodeId;
 	typedef std::vector<NodeId> Result;
@@ -90,6 +100,21 @@ public:
 	 */
 	void setCylinder(float radius, float height);
 	
+	/*!
+	 * Use an abstract graph to restrict long searches to a corridor of clusters.
+	 * Paths found this way may be slightly longer than the optimal path.
+	 * The hierarchy must have been built for the same anchors and is not owned by
+	 * the pathfinder. By default no hierarchy is used.
+	 */
+	void setHierarchy(const PathHierarchy * hierarchy);
+	
+	/*!
+	 * Use a spatial index to find the nearest anchor for lookFor().
+	 * The index must have been built for the same anchors and is not owned by the
+	 * pathfinder. Without an index all anchors are scanned.
+	 */
+	void setAnchorIndex(const AnchorIndex * index);
+	
 	/*!
 	 * Find a path between two nodes.
 	 * \param from The index of the start node into the provided map_data.
@@ -132,17 +157,25 @@ public:
 	 */
 	bool lookFor(NodeId from, const Vec3f & pos, float radius, Result & rlist, bool stealth = false) const;
 	
+	/*!
+	 * Get the number of nodes expanded by all searches since the last call to
+	 * resetExpandedNodes(). This measures search effort independently of timing.
+	 */
+	size_t getExpandedNodes() const;
+	
+	void resetExpandedNodes();
+	
 private:
 	
 	class Node;
-	class OpenNodeList;
-	class ClosedNodeList;
+	class SearchState;
 	
-	/*!
-	 * \return the best node (lowest cost) from open list or NULL if the list is empty
-	 */
-	static void buildPath(const Node & node, Result & rlist);
-	float getIlluminationCost(const Vec3f & pos) const;
+	bool findPath(NodeId from, NodeId to, Result & rlist, bool stealth,
+	              const std::vector<char> * corridor) const;
+	
+	float getIlluminationCost(NodeId id) const {
+		return light_costs ? light_costs[id] : 0.f;
+	}
 	NodeId getNearestNode(const Vec3f & pos) const;
 	
 	float radius;
@@ -151,8 +184,11 @@ private:
 	
 	size_t map_s; // Map size
 	const ANCHOR_DATA * map_d; // Map data
-	size_t slight_c; // Light count
-	const EERIE_LIGHT * const * slight_l; // Light data
+	const float * light_costs; // Illumination cost for each anchor or NULL
+	const PathHierarchy * hierarchy; // Clusters for long searches or NULL
+	const AnchorIndex * anchor_index; // Grid for nearest anchor queries or NULL
+	
+	SearchState * search; // Node storage reused between searches
 	
 };
 
@@ -49,14 +49,23 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include <cstring>
 #include <cstdlib>
 #include <algorithm>
+#include <list>
+#include <vector>
 
+#include "ai/LightCost.h"
+#include "ai/PathCache.h"
 #include "ai/PathFinder.h"
+#include "ai/PathHierarchy.h"
+#include "core/Config.h"
 #include "game/Entity.h"
 #include "game/NPC.h"
+#include "game/Player.h"
 #include "graphics/Math.h"
 #include "platform/Thread.h"
 #include "platform/Lock.h"
+#include "platform/Time.h"
 #include "platform/profiler/Profiler.h"
+#include "physics/AnchorIndex.h"
 #include "physics/Anchors.h"
 #include "scene/Light.h"
 
@@ -68,109 +77,418 @@ static const float PATHFINDER_DISTANCE_MAX = 5000.0f;
 
 // Pathfinder Definitions
 static unsigned long PATHFINDER_UPDATE_INTERVAL = 10;
+static const size_t PATHFINDER_CACHE_SIZE = 256;
+
+// Request scheduling - requests with the highest priority are searched first
+static const float PATHFINDER_PRIORITY_VISIBLE = 4.f; // NPC was drawn in the last frame
+static const float PATHFINDER_PRIORITY_URGENT = 2.f; // Moving to, fleeing from or looking for something
+static const float PATHFINDER_PRIORITY_FIGHT = 2.f;
+static const float PATHFINDER_PRIORITY_NEAR = 2.f; // Next to the player, none at PATHFINDER_DISTANCE_MAX
+static const u64 PATHFINDER_PRIORITY_AGE = 250000; // Waiting time in us worth one priority point
+static const u64 PATHFINDER_MAX_WAIT = 2000000; // Requests waiting longer are served oldest first
+static const size_t PATHFINDER_LATENCY_SAMPLES = 512;
 
 long PATHFINDER_WORKING = 0;
 
-class PathFinderThread : public StoppableThread {
+/*!
+ * Copy of the anchor graph and light costs used by the pathfinder threads.
+ *
+ * Only the anchor flags change while a level is loaded, so the links still point
+ * into ACTIVEBKG. A new snapshot is made when anchors are blocked or unblocked or
+ * when lights change - searches that are already running finish using the old one.
+ */
+struct AnchorSnapshot {
 	
-	void run();
+	std::vector<ANCHOR_DATA> anchors;
+	std::vector<float> lightCosts;
+	long refs; // Protected by the queue mutex
+	
+	explicit AnchorSnapshot(const LightCostField & lights)
+		: anchors(ACTIVEBKG->anchors, ACTIVEBKG->anchors + ACTIVEBKG->nbanchors),
+		  lightCosts(lights.getCosts()), refs(1) { }
 	
 };
 
-static PathFinderThread * pathfinder = NULL;
-static Lock * mutex = NULL;
-
-struct PATHFINDER_QUEUE_ELEMENT {
+//! A request with all entity data needed for the search copied when it was queued
+struct PathFinderSearch {
+	
 	PATHFINDER_REQUEST req;
-	PATHFINDER_QUEUE_ELEMENT * next;
-	long valid;
+	PathFinderHandle handle;
+	
+	Behaviour behavior;
+	float behavior_param;
+	bool npc;
+	float radius;
+	float height;
+	Vec3f pos;
+	Vec3f target;
+	bool stealth;
+	
+	bool visible;
+	float priority; // Without the age bonus
+	u64 queued; // Time the NPC first requested a path
+	
+	PathFinderSearch() { }
+	
+	explicit PathFinderSearch(const PATHFINDER_REQUEST & request)
+		: req(request)
+		, handle(0)
+		, behavior(BEHAVIOUR_NONE)
+		, behavior_param(0.f)
+		, npc(false)
+		, radius(0.f)
+		, height(0.f)
+		, pos(Vec3f_ZERO)
+		, target(Vec3f_ZERO)
+		, stealth(false)
+		, visible(false)
+		, priority(0.f)
+		, queued(platform::getTimeUs())
+	{
+		
+		const Entity * io = request.ioid;
+		if(io) {
+			if(io->_npcdata) {
+				behavior = io->_npcdata->behavior;
+				behavior_param = io->_npcdata->behavior_param;
+			}
+			npc = (io->ioflags & IO_NPC) != 0;
+			radius = io->physics.cyl.radius;
+			height = io->physics.cyl.height;
+			pos = io->pos;
+			target = io->target;
+			visible = (io->bbox2D.max.x >= 0.f);
+		}
+		
+		stealth = (behavior & (BEHAVIOUR_SNEAK | BEHAVIOUR_HIDE)) == (BEHAVIOUR_SNEAK | BEHAVIOUR_HIDE);
+		
+		if(visible) {
+			priority += PATHFINDER_PRIORITY_VISIBLE;
+		}
+		
+		if(behavior & (BEHAVIOUR_MOVE_TO | BEHAVIOUR_FLEE | BEHAVIOUR_LOOK_FOR)) {
+			priority += PATHFINDER_PRIORITY_URGENT;
+		}
+		
+		if(behavior & BEHAVIOUR_FIGHT) {
+			priority += PATHFINDER_PRIORITY_FIGHT;
+		}
+		
+		float distance = fdist(pos, player.pos);
+		if(distance < PATHFINDER_DISTANCE_MAX) {
+			priority += PATHFINDER_PRIORITY_NEAR * (1.f - distance / PATHFINDER_DISTANCE_MAX);
+		}
+		
+	}
+	
+	float getPriority(u64 now) const {
+		return priority + float(now - queued) / float(PATHFINDER_PRIORITY_AGE);
+	}
+	
+	/*!
+	 * Only direct paths between two anchors are cached.
+	 * Stealth paths are invalidated like blocked anchors when lights change.
+	 */
+	bool isCacheable() const {
+		return (behavior & (BEHAVIOUR_MOVE_TO | BEHAVIOUR_GO_HOME)) != 0;
+	}
+	
+	PathCache::Key getCacheKey() const {
+		return PathCache::Key(req.from, req.to, radius, height, stealth);
+	}
+	
 };
 
-static PATHFINDER_QUEUE_ELEMENT * pathfinder_queue_start = NULL;
-
-// An Io can request Pathfinding only once so we insure that it's always the case.
-// A new pathfinder request from the same IO will overwrite the precedent.
-static PATHFINDER_QUEUE_ELEMENT * PATHFINDER_Find_ioid(Entity * io) {
+class PathFinderThread : public StoppableThread {
 	
-	if(!pathfinder_queue_start)
-		return NULL;
-
-	PATHFINDER_QUEUE_ELEMENT * cur = pathfinder_queue_start;
+	AnchorSnapshot * snapshot;
+	PathFinder * pathfinder;
+	PathFinder::Result result; // Reused for all searches
+	
+	void search(const PathFinderSearch & search, PathFinder::Result & result);
+	
+	void run();
+	
+public:
+	
+	// Protected by the queue mutex
+	Entity * current; // Entity whose request is being processed
+	PathFinderHandle handle; // Handle of the request being processed
+	bool cancelled; // The result for the current request is no longer wanted
+	
+	PathFinderThread() : snapshot(NULL), pathfinder(NULL), current(NULL), handle(0),
+	                     cancelled(false) { }
+	
+};
 
-	while(cur) {
-		if(cur->req.ioid == io)
-			return cur->valid ? cur : NULL;
+//! Wait times of the most recently started requests
+class PathFinderLatency {
+	
+	std::vector<u64> samples;
+	size_t next;
+	
+public:
+	
+	PathFinderLatency() : next(0) { }
+	
+	void add(u64 wait) {
+		if(samples.size() < PATHFINDER_LATENCY_SAMPLES) {
+			samples.push_back(wait);
+		} else {
+			samples[next] = wait;
+			next = (next + 1) % samples.size();
+		}
+	}
+	
+	void clear() {
+		samples.clear();
+		next = 0;
+	}
+	
+	PathFinderLatencyStats getStats() const {
 		
-		cur = cur->next;
+		PathFinderLatencyStats stats;
+		stats.count = samples.size();
+		stats.p50 = stats.p90 = stats.p99 = stats.max = 0;
+		if(samples.empty()) {
+			return stats;
+		}
+		
+		std::vector<u64> sorted(samples);
+		std::sort(sorted.begin(), sorted.end());
+		size_t last = sorted.size() - 1;
+		stats.p50 = long(sorted[last * 50 / 100]);
+		stats.p90 = long(sorted[last * 90 / 100]);
+		stats.p99 = long(sorted[last * 99 / 100]);
+		stats.max = long(sorted[last]);
+		
+		return stats;
 	}
+	
+};
 
-	return NULL;
-}
+//! A finished search waiting to be delivered
+struct PathFinderResult {
+	PathFinderHandle handle; // 0 if the request has been cancelled
+	Entity * entity;
+	PathFinder::Result path;
+};
 
-// Adds a Pathfinder Search Element to the pathfinder queue.
-bool EERIE_PATHFINDER_Add_To_Queue(const PATHFINDER_REQUEST & req) {
+/*!
+ * Storage for finished searches.
+ * Entries past count are unused but keep their path storage, so that results can
+ * be published and delivered without allocating memory once the game is running.
+ */
+struct PathFinderResults {
 	
-	if(!pathfinder) {
-		return false;
+	std::vector<PathFinderResult> entries;
+	size_t count;
+	
+	PathFinderResults() : count(0) { }
+	
+	void add(PathFinderHandle handle, Entity * entity, const PathFinder::Result & path) {
+		if(count == entries.size()) {
+			entries.resize(count + 1);
+		}
+		PathFinderResult & result = entries[count++];
+		result.handle = handle;
+		result.entity = entity;
+		result.path.assign(path.begin(), path.end());
 	}
 	
-	Autolock lock(mutex);
+	void cancel(PathFinderHandle handle) {
+		for(size_t i = 0; i < count; i++) {
+			if(entries[i].handle == handle) {
+				entries[i].handle = 0;
+			}
+		}
+	}
+	
+	void cancel(Entity * entity) {
+		for(size_t i = 0; i < count; i++) {
+			if(entries[i].entity == entity) {
+				entries[i].handle = 0;
+			}
+		}
+	}
+	
+	void swap(PathFinderResults & o) {
+		entries.swap(o.entries);
+		std::swap(count, o.count);
+	}
+	
+};
 
-	PATHFINDER_QUEUE_ELEMENT * cur = pathfinder_queue_start;
+typedef std::vector<PathFinderThread *> PathFinderThreads;
+static PathFinderThreads pathfinders;
 
-	PATHFINDER_QUEUE_ELEMENT * temp;
+// The mutex is only held to access the queue and to publish results, not during searches
+static Lock * mutex = NULL;
 
-	// If this NPC is already requesting a Pathfinding then either
-	// try to Override it or add it to queue if it is currently being
-	// processed.
-	temp = PATHFINDER_Find_ioid(req.ioid);
+typedef std::list<PathFinderSearch> PathFinderQueue;
+static PathFinderQueue pathfinder_queue;
 
-	if(temp && temp->valid && temp != pathfinder_queue_start) {
-		temp->valid = 0;
-		temp->req = req;
-		temp->valid = 1;
-		return true;
-	}
+// Protected by the mutex
+static PathFinderLatency queue_latency;
+static PathFinderLatency visible_latency;
+static PathFinderResults finished_results;
 
-	// Create a New element for the queue
-	temp = new PATHFINDER_QUEUE_ELEMENT;
+// Only accessed by the main thread
+static PathFinderResults delivered_results;
+static PathFinderHandle last_handle = 0;
 
-	if(!temp) {
-		return false;
-	}
+static AnchorSnapshot * anchor_snapshot = NULL;
 
-	// Fill this New element with new request
-	temp->req = req;
-	temp->valid = 1;
+// Only depend on anchor positions and links, shared by all threads
+static PathHierarchy * hierarchy = NULL;
+static AnchorIndex * anchor_index = NULL;
 
-	// No queue start ? then this element becomes the queue start
-	if(!cur) {
-		temp->next = NULL;
-		pathfinder_queue_start = temp;
-		
-	} else if((req.ioid->_npcdata->behavior & (BEHAVIOUR_MOVE_TO | BEHAVIOUR_FLEE
-	                                            | BEHAVIOUR_LOOK_FOR)) && cur->next) {
-		// priority: insert as second element of queue
-		temp->next = cur->next;
-		cur->next = temp;
-		
-	} else {
+// Protected by the mutex, only contains paths for the current snapshot
+static PathCache path_cache(PATHFINDER_CACHE_SIZE);
+
+// Only accessed by the main thread
+static LightCostField * light_costs = NULL;
+static bool anchors_changed = false;
+static bool all_anchors_changed = false;
+static std::vector<PathFinder::NodeId> changed_anchors;
+
+static void EERIE_PATHFINDER_Release_Snapshot(AnchorSnapshot * snapshot) {
+	if(snapshot && --snapshot->refs == 0) {
+		delete snapshot;
+	}
+}
+
+// Adds a Pathfinder Search Element to the pathfinder queue.
+PathFinderHandle EERIE_PATHFINDER_Add_To_Queue(const PATHFINDER_REQUEST & req) {
+	
+	if(pathfinders.empty()) {
+		return 0;
+	}
+	
+	// Lights are toggled from many places, so check them for changes here
+	if(light_costs->update(changed_anchors)) {
+		anchors_changed = true;
+	}
+	
+	// Only the main thread modifies anchors, so we can copy them without the lock
+	AnchorSnapshot * snapshot = NULL;
+	if(anchors_changed) {
+		snapshot = new AnchorSnapshot(*light_costs);
+		anchors_changed = false;
+	}
+	
+	PathFinderSearch search(req);
+	if(++last_handle == 0) {
+		last_handle = 1;
+	}
+	search.handle = last_handle;
+	
+	// Results of earlier requests that have not been delivered yet are outdated
+	delivered_results.cancel(req.ioid);
+	
+	Autolock lock(mutex);
+	
+	finished_results.cancel(req.ioid);
+	
+	if(snapshot) {
 		
-		// add to end of queue
-		temp->next = NULL;
+		EERIE_PATHFINDER_Release_Snapshot(anchor_snapshot);
+		anchor_snapshot = snapshot;
 		
-		if(!pathfinder_queue_start) {
-			pathfinder_queue_start = temp;
-			return true;
+		if(all_anchors_changed) {
+			path_cache.clear();
 		} else {
-			while(cur->next) {
-				cur = cur->next;
+			std::sort(changed_anchors.begin(), changed_anchors.end());
+			path_cache.invalidate(changed_anchors);
+		}
+		all_anchors_changed = false;
+		changed_anchors.clear();
+	}
+	
+	// A running search for this NPC is outdated by the new request
+	for(PathFinderThreads::iterator i = pathfinders.begin(); i != pathfinders.end(); ++i) {
+		if((*i)->current == req.ioid) {
+			(*i)->cancelled = true;
+		}
+	}
+	
+	const PathFinder::Result * cached = NULL;
+	if(search.isCacheable()) {
+		cached = path_cache.lookup(search.getCacheKey());
+	}
+	
+	// An Io can request Pathfinding only once so we insure that it's always the case.
+	// A new pathfinder request from the same IO will overwrite the precedent,
+	// but keeps its age so that NPCs requesting often are not starved.
+	for(PathFinderQueue::iterator i = pathfinder_queue.begin(); i != pathfinder_queue.end(); ++i) {
+		if(i->req.ioid == req.ioid) {
+			if(cached) {
+				pathfinder_queue.erase(i);
+				break;
 			}
-			cur->next = temp;
+			search.queued = i->queued;
+			*i = search;
+			return search.handle;
 		}
 	}
 	
-	return true;
+	if(cached) {
+		finished_results.add(search.handle, req.ioid, *cached);
+		return search.handle;
+	}
+	
+	pathfinder_queue.push_back(search);
+	
+	return search.handle;
+}
+
+void EERIE_PATHFINDER_Cancel(PathFinderHandle handle) {
+	
+	if(!handle || pathfinders.empty()) {
+		return;
+	}
+	
+	delivered_results.cancel(handle);
+	
+	Autolock lock(mutex);
+	
+	for(PathFinderQueue::iterator i = pathfinder_queue.begin(); i != pathfinder_queue.end(); ++i) {
+		if(i->handle == handle) {
+			pathfinder_queue.erase(i);
+			break;
+		}
+	}
+	
+	for(PathFinderThreads::iterator i = pathfinders.begin(); i != pathfinders.end(); ++i) {
+		if((*i)->handle == handle) {
+			(*i)->cancelled = true;
+		}
+	}
+	
+	finished_results.cancel(handle);
+}
+
+void EERIE_PATHFINDER_Deliver_Results(PathFinderCallback callback) {
+	
+	if(pathfinders.empty()) {
+		return;
+	}
+	
+	{
+		Autolock lock(mutex);
+		arx_assert(delivered_results.count == 0);
+		finished_results.swap(delivered_results);
+	}
+	
+	// Callbacks may queue or cancel requests, so we can't hold the lock
+	for(size_t i = 0; i < delivered_results.count; i++) {
+		const PathFinderResult & result = delivered_results.entries[i];
+		if(result.handle) {
+			callback(result.entity, result.path);
+		}
+	}
+	
+	delivered_results.count = 0;
 }
 
 long EERIE_PATHFINDER_Get_Queued_Number() {
@@ -179,178 +497,302 @@ long EERIE_PATHFINDER_Get_Queued_Number() {
 
 	Autolock lock(mutex);
 	
-	PATHFINDER_QUEUE_ELEMENT * cur = pathfinder_queue_start;
-
-	long count = 0;
-
-	while (cur) cur = cur->next, count++;
-
-	return count;
+	return pathfinder_queue.size();
 }
 
 static void EERIE_PATHFINDER_Clear_Private() {
 	
-	PATHFINDER_QUEUE_ELEMENT * cur = pathfinder_queue_start;
-	PATHFINDER_QUEUE_ELEMENT * next;
+	pathfinder_queue.clear();
+	finished_results.count = 0;
 	
-	while(cur) {
-		next = cur->next;
-		delete cur;
-		cur = next;
+	for(PathFinderThreads::iterator i = pathfinders.begin(); i != pathfinders.end(); ++i) {
+		if((*i)->current) {
+			(*i)->cancelled = true;
+		}
 	}
 	
-	pathfinder_queue_start = NULL;
-	
 }
 
-
 void EERIE_PATHFINDER_Clear() {
 	
-	if(!pathfinder) {
+	if(pathfinders.empty()) {
 		return;
 	}
 	
+	for(size_t i = 0; i < delivered_results.count; i++) {
+		delivered_results.entries[i].handle = 0;
+	}
+	
 	Autolock lock(mutex);
 	
 	EERIE_PATHFINDER_Clear_Private();
 	
 }
 
-// Retrieves & Removes next Pathfind request from queue
-static bool EERIE_PATHFINDER_Get_Next_Request(PATHFINDER_REQUEST & request) {
+void EERIE_PATHFINDER_Anchors_Changed() {
+	anchors_changed = true;
+	all_anchors_changed = true;
+}
+
+void EERIE_PATHFINDER_Anchor_Changed(long anchor) {
+	anchors_changed = true;
+	changed_anchors.push_back(anchor);
+}
+
+PathFinderQueueStats EERIE_PATHFINDER_Get_Queue_Stats() {
 	
-	if(!pathfinder_queue_start || !pathfinder_queue_start->valid) {
-		return false;
+	if(!mutex) {
+		PathFinderQueueStats stats;
+		stats.all = stats.visible = PathFinderLatency().getStats();
+		return stats;
 	}
 	
-	PATHFINDER_QUEUE_ELEMENT * cur = pathfinder_queue_start;
+	Autolock lock(mutex);
+	
+	PathFinderQueueStats stats;
+	stats.all = queue_latency.getStats();
+	stats.visible = visible_latency.getStats();
+	
+	return stats;
+}
 
-	if ((cur->req.ioid)
-	        && (cur->req.ioid->ioflags & IO_NPC)
-	        && (cur->req.ioid->_npcdata->behavior == BEHAVIOUR_NONE)) {
-		pathfinder_queue_start = cur->next;
-		delete cur;
-		return false;
+PathFinderCacheStats EERIE_PATHFINDER_Get_Cache_Stats() {
+	
+	PathFinderCacheStats stats;
+	stats.hits = stats.lookups = stats.searchTime = 0;
+	
+	if(!mutex) {
+		return stats;
 	}
+	
+	Autolock lock(mutex);
+	
+	stats.hits = path_cache.hits();
+	stats.lookups = path_cache.lookups();
+	stats.searchTime = path_cache.averageSearchTime();
+	
+	return stats;
+}
 
-	request = cur->req;
-	pathfinder_queue_start = cur->next;
-	delete cur;
+const AnchorIndex * EERIE_PATHFINDER_Get_Anchor_Index() {
+	return anchor_index;
+}
 
+/*!
+ * Only uses the entity data copied when the request was queued - this is called
+ * from the pathfinder threads while the main thread may modify the entity.
+ */
+static bool EERIE_PATHFINDER_Is_Valid(const PathFinderSearch & search) {
+	return !(search.npc && search.behavior == BEHAVIOUR_NONE);
+}
+
+/*!
+ * Retrieves & Removes the next Pathfind request from queue.
+ * Requests that have waited longer than PATHFINDER_MAX_WAIT are served oldest first,
+ * otherwise the request with the highest priority is selected.
+ */
+static bool EERIE_PATHFINDER_Get_Next_Request(PathFinderSearch & search) {
+	
+	u64 now = platform::getTimeUs();
+	
+	PathFinderQueue::iterator best = pathfinder_queue.end();
+	float bestPriority = 0.f;
+	bool starving = false;
+	
+	PathFinderQueue::iterator i = pathfinder_queue.begin();
+	while(i != pathfinder_queue.end()) {
+		
+		if(!EERIE_PATHFINDER_Is_Valid(*i)) {
+			i = pathfinder_queue.erase(i);
+			continue;
+		}
+		
+		if(now - i->queued > PATHFINDER_MAX_WAIT) {
+			if(!starving || i->queued < best->queued) {
+				best = i;
+				starving = true;
+			}
+		} else if(!starving) {
+			float priority = i->getPriority(now);
+			if(best == pathfinder_queue.end() || priority > bestPriority) {
+				best = i;
+				bestPriority = priority;
+			}
+		}
+		
+		++i;
+	}
+	
+	if(best == pathfinder_queue.end()) {
+		return false;
+	}
+	
+	search = *best;
+	pathfinder_queue.erase(best);
+	
+	u64 wait = now - search.queued;
+	queue_latency.add(wait);
+	if(search.visible) {
+		visible_latency.add(wait);
+	}
+	
 	return true;
 }
 
+void PathFinderThread::search(const PathFinderSearch & search, PathFinder::Result & result) {
+	
+	ARX_PROFILE_FUNC();
+	
+	const ANCHOR_DATA * anchors = &snapshot->anchors[0];
+	
+	float heuristic(PATHFINDER_HEURISTIC_MAX);
+	
+	pathfinder->setCylinder(search.radius, search.height);
+	
+	bool stealth = search.stealth;
+	
+	if((search.behavior & BEHAVIOUR_MOVE_TO) || (search.behavior & BEHAVIOUR_GO_HOME)) {
+		float distance = fdist(anchors[search.req.from].pos, anchors[search.req.to].pos);
+		
+		if(distance < PATHFINDER_DISTANCE_MAX)
+			heuristic = PATHFINDER_HEURISTIC_MIN + PATHFINDER_HEURISTIC_RANGE * (distance / PATHFINDER_DISTANCE_MAX);
+		
+		pathfinder->setHeuristic(heuristic);
+		pathfinder->move(search.req.from, search.req.to, result, stealth);
+	} else if(search.behavior & BEHAVIOUR_WANDER_AROUND) {
+		if(search.behavior_param < PATHFINDER_DISTANCE_MAX)
+			heuristic = PATHFINDER_HEURISTIC_MIN + PATHFINDER_HEURISTIC_RANGE * (search.behavior_param / PATHFINDER_DISTANCE_MAX);
+		
+		pathfinder->setHeuristic(heuristic);
+		pathfinder->wanderAround(search.req.from, search.behavior_param, result, stealth);
+	} else if(search.behavior & (BEHAVIOUR_FLEE | BEHAVIOUR_HIDE)) {
+		if(search.behavior_param < PATHFINDER_DISTANCE_MAX)
+			heuristic = PATHFINDER_HEURISTIC_MIN
+			            + PATHFINDER_HEURISTIC_RANGE
+			              * (search.behavior_param / PATHFINDER_DISTANCE_MAX);
+		
+		pathfinder->setHeuristic(heuristic);
+		float safedist = search.behavior_param + fdist(search.target, search.pos);
+		
+		pathfinder->flee(search.req.from, search.target, safedist, result, stealth);
+	} else if(search.behavior & BEHAVIOUR_LOOK_FOR) {
+		float distance = fdist(search.pos, search.target);
+		
+		if(distance < PATHFINDER_DISTANCE_MAX)
+			heuristic = PATHFINDER_HEURISTIC_MIN + PATHFINDER_HEURISTIC_RANGE * (distance / PATHFINDER_DISTANCE_MAX);
+		
+		pathfinder->setHeuristic(heuristic);
+		pathfinder->lookFor(search.req.from, search.target, search.behavior_param, result, stealth);
+	}
+	
+}
+
 // Pathfinder Thread
 void PathFinderThread::run() {
 	
-	EERIE_BACKGROUND * eb = ACTIVEBKG;
-	PathFinder pathfinder(eb->nbanchors, eb->anchors, MAX_LIGHTS, (EERIE_LIGHT **)GLight);
-
 	while(!isStopRequested()) {
 		
-		mutex->lock();
-
-		PATHFINDER_WORKING = 1;
-
-		PATHFINDER_REQUEST curpr;
-		if(EERIE_PATHFINDER_Get_Next_Request(curpr) && curpr.isvalid) {
-			
-			ARX_PROFILE_FUNC();
+		PathFinderSearch curpr;
+		AnchorSnapshot * oldSnapshot = NULL;
+		
+		bool found;
+		{
+			Autolock lock(mutex);
 			
-			PATHFINDER_WORKING = 2;
-
-			if(curpr.ioid && curpr.ioid->_npcdata) {
-				float heuristic(PATHFINDER_HEURISTIC_MAX);
-
-				pathfinder.setCylinder(curpr.ioid->physics.cyl.radius, curpr.ioid->physics.cyl.height);
-
-				bool stealth = (curpr.ioid->_npcdata->behavior & (BEHAVIOUR_SNEAK | BEHAVIOUR_HIDE))
-				                == (BEHAVIOUR_SNEAK | BEHAVIOUR_HIDE);
-
+			found = EERIE_PATHFINDER_Get_Next_Request(curpr);
+			if(found) {
 				
-				PathFinder::Result result;
+				current = curpr.req.ioid;
+				handle = curpr.handle;
+				cancelled = false;
+				PATHFINDER_WORKING++;
 				
-				if(   (curpr.ioid->_npcdata->behavior & BEHAVIOUR_MOVE_TO)
-				   || (curpr.ioid->_npcdata->behavior & BEHAVIOUR_GO_HOME)
-				) {
-					float distance = fdist(ACTIVEBKG->anchors[curpr.from].pos, ACTIVEBKG->anchors[curpr.to].pos);
-
-					if(distance < PATHFINDER_DISTANCE_MAX)
-						heuristic = PATHFINDER_HEURISTIC_MIN + PATHFINDER_HEURISTIC_RANGE * (distance / PATHFINDER_DISTANCE_MAX);
-
-					pathfinder.setHeuristic(heuristic);
-					pathfinder.move(curpr.from, curpr.to, result, stealth);
-				} else if(curpr.ioid->_npcdata->behavior & BEHAVIOUR_WANDER_AROUND) {
-					if(curpr.ioid->_npcdata->behavior_param < PATHFINDER_DISTANCE_MAX)
-						heuristic = PATHFINDER_HEURISTIC_MIN + PATHFINDER_HEURISTIC_RANGE * (curpr.ioid->_npcdata->behavior_param / PATHFINDER_DISTANCE_MAX);
-
-					pathfinder.setHeuristic(heuristic);
-					pathfinder.wanderAround(curpr.from, curpr.ioid->_npcdata->behavior_param, result, stealth);
-				} else if(curpr.ioid->_npcdata->behavior & (BEHAVIOUR_FLEE | BEHAVIOUR_HIDE)) {
-					if(curpr.ioid->_npcdata->behavior_param < PATHFINDER_DISTANCE_MAX)
-						heuristic = PATHFINDER_HEURISTIC_MIN
-						            + PATHFINDER_HEURISTIC_RANGE
-						              * (curpr.ioid->_npcdata->behavior_param / PATHFINDER_DISTANCE_MAX);
-
-					pathfinder.setHeuristic(heuristic);
-					float safedist = curpr.ioid->_npcdata->behavior_param
-					                 + fdist(curpr.ioid->target, curpr.ioid->pos);
-
-					pathfinder.flee(curpr.from, curpr.ioid->target, safedist, result, stealth);
-				} else if(curpr.ioid->_npcdata->behavior & BEHAVIOUR_LOOK_FOR) {
-					float distance = fdist(curpr.ioid->pos, curpr.ioid->target);
-
-					if(distance < PATHFINDER_DISTANCE_MAX)
-						heuristic = PATHFINDER_HEURISTIC_MIN + PATHFINDER_HEURISTIC_RANGE * (distance / PATHFINDER_DISTANCE_MAX);
-
-					pathfinder.setHeuristic(heuristic);
-					pathfinder.lookFor(curpr.from, curpr.ioid->target,
-					                   curpr.ioid->_npcdata->behavior_param, result, stealth);
+				if(snapshot != anchor_snapshot) {
+					oldSnapshot = snapshot;
+					snapshot = anchor_snapshot;
+					snapshot->refs++;
+					delete pathfinder, pathfinder = NULL;
 				}
-				
-				if(!result.empty()) {
-					long * list = (long*)malloc(result.size() * sizeof(long));
-					std::copy(result.begin(), result.end(), list);
-					*(curpr.returnlist) = list;
-				}
-				*(curpr.returnnumber) = result.size();
-				
 			}
 		}
-
-		PATHFINDER_WORKING = 0;
-
-		mutex->unlock();
-		sleep(PATHFINDER_UPDATE_INTERVAL);
+		
+		if(!found) {
+			sleep(PATHFINDER_UPDATE_INTERVAL);
+			continue;
+		}
+		
+		result.clear();
+		u64 startTime = platform::getTimeUs();
+		if(!snapshot->anchors.empty()) {
+			if(!pathfinder) {
+				pathfinder = new PathFinder(snapshot->anchors.size(), &snapshot->anchors[0],
+				                            &snapshot->lightCosts[0]);
+				pathfinder->setHierarchy(hierarchy);
+				pathfinder->setAnchorIndex(anchor_index);
+			}
+			search(curpr, result);
+		}
+		u64 time = platform::getElapsedUs(startTime);
+		
+		{
+			Autolock lock(mutex);
+			
+			if(!cancelled) {
+				finished_results.add(curpr.handle, curpr.req.ioid, result);
+			}
+			
+			// Don't cache results for anchor flags that have changed since
+			if(curpr.isCacheable() && !result.empty() && snapshot == anchor_snapshot) {
+				path_cache.insert(curpr.getCacheKey(), result, time);
+			}
+			
+			current = NULL;
+			handle = 0;
+			PATHFINDER_WORKING--;
+			
+			EERIE_PATHFINDER_Release_Snapshot(oldSnapshot);
+		}
 	}
-
-	// fix leaks memory but freeze characters
-	// pathfinder.Clean();
-
-	PATHFINDER_WORKING = 0;
 	
+	delete pathfinder, pathfinder = NULL;
+	
+	Autolock lock(mutex);
+	EERIE_PATHFINDER_Release_Snapshot(snapshot), snapshot = NULL;
 }
 
 void EERIE_PATHFINDER_Release() {
 	
-	if(!pathfinder) {
+	if(pathfinders.empty()) {
 		return;
 	}
 	
 	mutex->lock();
-	
 	EERIE_PATHFINDER_Clear_Private();
+	mutex->unlock();
 	
-	pathfinder->stop();
+	for(PathFinderThreads::iterator i = pathfinders.begin(); i != pathfinders.end(); ++i) {
+		(*i)->stop();
+		delete *i;
+	}
+	pathfinders.clear();
 	
-	delete pathfinder, pathfinder = NULL;
+	// Searches may have finished before the threads stopped
+	finished_results.count = 0;
+	delivered_results.count = 0;
 	
-	mutex->unlock(), delete mutex, mutex = NULL;
+	EERIE_PATHFINDER_Release_Snapshot(anchor_snapshot), anchor_snapshot = NULL;
+	delete hierarchy, hierarchy = NULL;
+	delete anchor_index, anchor_index = NULL;
+	delete light_costs, light_costs = NULL;
+	
+	PATHFINDER_WORKING = 0;
+	
+	delete mutex, mutex = NULL;
 }
 
 void EERIE_PATHFINDER_Create() {
 	
-	if(pathfinder) {
+	if(!pathfinders.empty()) {
 		EERIE_PATHFINDER_Release();
 	}
 	
@@ -358,7 +800,21 @@ void EERIE_PATHFINDER_Create() {
 		mutex = new Lock();
 	}
 	
-	pathfinder = new PathFinderThread();
-	pathfinder->setThreadName("Pathfinder");
-	pathfinder->start();
+	light_costs = new LightCostField(ACTIVEBKG, MAX_LIGHTS, GLight, MAX_DYNLIGHTS, DynLight);
+	anchor_snapshot = new AnchorSnapshot(*light_costs);
+	hierarchy = new PathHierarchy(ACTIVEBKG->nbanchors, ACTIVEBKG->anchors);
+	anchor_index = new AnchorIndex(ACTIVEBKG->nbanchors, ACTIVEBKG->anchors);
+	anchors_changed = all_anchors_changed = false;
+	changed_anchors.clear();
+	path_cache.clear();
+	queue_latency.clear();
+	visible_latency.clear();
+	
+	size_t count = std::max(config.misc.pathfinderThreads, 1);
+	for(size_t i = 0; i < count; i++) {
+		PathFinderThread * pathfinder = new PathFinderThread();
+		pathfinder->setThreadName("Pathfinder");
+		pathfinder->start();
+		pathfinders.push_back(pathfinder);
+	}
 }
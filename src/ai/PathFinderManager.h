@@ -47,27 +47,98 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #ifndef ARX_AI_PATHFINDERMANAGER_H
 #define ARX_AI_PATHFINDERMANAGER_H
 
+#include "ai/PathFinder.h"
 #include "game/GameTypes.h"
 
+class AnchorIndex;
 class Entity;
 
 struct PATHFINDER_REQUEST {
-	bool isvalid;
 	long from;
 	long to;
-	long * returnnumber;			// must point to a -1 value at call time
-	// As soon as returnnumber is no more -1
-	// Pathfinding is considered finished
 	Entity * ioid;
-	long ** returnlist;	//must be NULL
 };
 
+//! Identifies a queued request, 0 is never used
+typedef unsigned long PathFinderHandle;
+
+/*!
+ * Called on the main thread with the result of a search.
+ * The path is empty if no path was found.
+ */
+typedef void (*PathFinderCallback)(Entity * io, const PathFinder::Result & path);
+
+//! Number of pathfinder threads that are currently searching
 extern long PATHFINDER_WORKING;
 
-bool EERIE_PATHFINDER_Add_To_Queue(const PATHFINDER_REQUEST & request);
+/*!
+ * Queue a search for a path between two anchors.
+ * A pending request from the same entity is replaced and its result is never delivered.
+ * \return a handle for the request or 0 if it could not be queued.
+ */
+PathFinderHandle EERIE_PATHFINDER_Add_To_Queue(const PATHFINDER_REQUEST & request);
+
+/*!
+ * Drop a request. If the search is already running its result will be discarded.
+ * Must be called before the requesting entity is destroyed.
+ */
+void EERIE_PATHFINDER_Cancel(PathFinderHandle handle);
+
+/*!
+ * Pass the results of all finished searches to a callback.
+ * Must be called regularly from the main thread. The callback may queue or cancel
+ * requests.
+ */
+void EERIE_PATHFINDER_Deliver_Results(PathFinderCallback callback);
+
 long EERIE_PATHFINDER_Get_Queued_Number();
 void EERIE_PATHFINDER_Clear();
+
+/*!
+ * Start the pathfinder threads for the anchors in ACTIVEBKG.
+ * The number of threads is set by the pathfinder_threads config option.
+ */
 void EERIE_PATHFINDER_Create();
 void EERIE_PATHFINDER_Release();
 
+/*!
+ * Must be called after changing the flags of any anchor.
+ * Searches queued from now on will see the new flags.
+ */
+void EERIE_PATHFINDER_Anchors_Changed();
+
+//! Like \ref EERIE_PATHFINDER_Anchors_Changed() but only for one anchor
+void EERIE_PATHFINDER_Anchor_Changed(long anchor);
+
+struct PathFinderCacheStats {
+	long hits;
+	long lookups;
+	long searchTime; //!< Average time in microseconds saved by each hit
+};
+
+PathFinderCacheStats EERIE_PATHFINDER_Get_Cache_Stats();
+
+//! Time in microseconds that recent requests waited in the queue before being searched
+struct PathFinderLatencyStats {
+	long count;
+	long p50;
+	long p90;
+	long p99;
+	long max;
+};
+
+struct PathFinderQueueStats {
+	PathFinderLatencyStats all;
+	PathFinderLatencyStats visible; //!< Requests from NPCs that were on screen
+};
+
+PathFinderQueueStats EERIE_PATHFINDER_Get_Queue_Stats();
+
+/*!
+ * Spatial index over the anchors in ACTIVEBKG for nearest-anchor queries.
+ * The same index is used by the pathfinder threads.
+ * \return NULL if the pathfinder has not been created for the current level
+ */
+const AnchorIndex * EERIE_PATHFINDER_Get_Anchor_Index();
+
 #endif // ARX_AI_PATHFINDERMANAGER_H
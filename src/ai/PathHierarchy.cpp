@@ -0,0 +1,192 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ai/PathHierarchy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+#include "graphics/Math.h"
+#include "physics/Anchors.h"
+
+const float PathHierarchy::CELL_SIZE = 1000.f;
+
+static const PathHierarchy::ClusterId NO_CLUSTER = PathHierarchy::ClusterId(-1);
+
+namespace {
+
+struct Cell {
+	
+	long x;
+	long z;
+	
+	explicit Cell(const Vec3f & pos)
+		: x(long(std::floor(pos.x / PathHierarchy::CELL_SIZE)))
+		, z(long(std::floor(pos.z / PathHierarchy::CELL_SIZE))) { }
+	
+	bool operator==(const Cell & o) const {
+		return x == o.x && z == o.z;
+	}
+	
+};
+
+} // anonymous namespace
+
+PathHierarchy::PathHierarchy(size_t map_size, const ANCHOR_DATA * map_data)
+	: m_anchorClusters(map_size, NO_CLUSTER) {
+	
+	// Flood-fill the anchor links without leaving the cell of the first anchor
+	std::vector<size_t> stack;
+	for(size_t i = 0; i < map_size; i++) {
+		
+		if(m_anchorClusters[i] != NO_CLUSTER) {
+			continue;
+		}
+		
+		ClusterId cluster = m_clusters.size();
+		Cell cell(map_data[i].pos);
+		Vec3f sum(0.f);
+		size_t count = 0;
+		
+		m_anchorClusters[i] = cluster;
+		stack.push_back(i);
+		while(!stack.empty()) {
+			
+			size_t anchor = stack.back();
+			stack.pop_back();
+			
+			sum += map_data[anchor].pos;
+			count++;
+			
+			for(short j = 0; j < map_data[anchor].nblinked; j++) {
+				size_t linked = map_data[anchor].linked[j];
+				if(m_anchorClusters[linked] == NO_CLUSTER && Cell(map_data[linked].pos) == cell) {
+					m_anchorClusters[linked] = cluster;
+					stack.push_back(linked);
+				}
+			}
+		}
+		
+		Cluster c;
+		c.center = sum / float(count);
+		c.firstEdge = c.edgeCount = 0;
+		m_clusters.push_back(c);
+	}
+	
+	// Collect links between different clusters
+	typedef std::pair<ClusterId, ClusterId> Link;
+	std::vector<Link> links;
+	for(size_t i = 0; i < map_size; i++) {
+		for(short j = 0; j < map_data[i].nblinked; j++) {
+			ClusterId source = m_anchorClusters[i];
+			ClusterId target = m_anchorClusters[map_data[i].linked[j]];
+			if(source != target) {
+				links.push_back(Link(source, target));
+			}
+		}
+	}
+	std::sort(links.begin(), links.end());
+	links.erase(std::unique(links.begin(), links.end()), links.end());
+	
+	// Links are sorted by source cluster, so the edges of each cluster are contiguous
+	m_edges.reserve(links.size());
+	for(size_t i = 0; i < links.size(); i++) {
+		Cluster & source = m_clusters[links[i].first];
+		if(source.edgeCount == 0) {
+			source.firstEdge = m_edges.size();
+		}
+		source.edgeCount++;
+		Edge edge;
+		edge.target = links[i].second;
+		edge.cost = fdist(source.center, m_clusters[edge.target].center);
+		m_edges.push_back(edge);
+	}
+	
+}
+
+bool PathHierarchy::getCorridor(size_t from, size_t to, std::vector<char> & corridor,
+                                Scratch & scratch) const {
+	
+	ClusterId start = m_anchorClusters[from];
+	ClusterId goal = m_anchorClusters[to];
+	const Vec3f & target = m_clusters[goal].center;
+	
+	// Reusing the storage only reallocates if the hierarchy has grown
+	std::vector<float> & distance = scratch.distance;
+	std::vector<ClusterId> & parent = scratch.parent;
+	std::vector<char> & closed = scratch.closed;
+	distance.assign(m_clusters.size(), std::numeric_limits<float>::max());
+	parent.assign(m_clusters.size(), NO_CLUSTER);
+	closed.assign(m_clusters.size(), 0);
+	
+	typedef Scratch::Entry Entry;
+	std::vector<Entry> & open = scratch.open;
+	std::greater<Entry> compare;
+	open.clear();
+	
+	distance[start] = 0.f;
+	open.push_back(Entry(fdist(m_clusters[start].center, target), start));
+	
+	while(!open.empty()) {
+		
+		ClusterId cluster = open.front().second;
+		std::pop_heap(open.begin(), open.end(), compare);
+		open.pop_back();
+		
+		if(cluster == goal) {
+			break;
+		}
+		
+		// Clusters may be in the queue more than once
+		if(closed[cluster]) {
+			continue;
+		}
+		closed[cluster] = 1;
+		
+		const Cluster & c = m_clusters[cluster];
+		for(size_t i = c.firstEdge; i < c.firstEdge + c.edgeCount; i++) {
+			const Edge & edge = m_edges[i];
+			float d = distance[cluster] + edge.cost;
+			if(!closed[edge.target] && d < distance[edge.target]) {
+				distance[edge.target] = d;
+				parent[edge.target] = cluster;
+				open.push_back(Entry(d + fdist(m_clusters[edge.target].center, target), edge.target));
+				std::push_heap(open.begin(), open.end(), compare);
+			}
+		}
+	}
+	
+	if(start != goal && parent[goal] == NO_CLUSTER) {
+		return false;
+	}
+	
+	// Include neighbors so that the refined path can cut corners
+	corridor.assign(m_clusters.size(), 0);
+	for(ClusterId cluster = goal; cluster != NO_CLUSTER; cluster = parent[cluster]) {
+		corridor[cluster] = 1;
+		const Cluster & c = m_clusters[cluster];
+		for(size_t i = c.firstEdge; i < c.firstEdge + c.edgeCount; i++) {
+			corridor[m_edges[i].target] = 1;
+		}
+	}
+	
+	return true;
+}
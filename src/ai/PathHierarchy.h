@@ -0,0 +1,107 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_AI_PATHHIERARCHY_H
+#define ARX_AI_PATHHIERARCHY_H
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "math/Types.h"
+
+struct ANCHOR_DATA;
+
+/*!
+ * Abstract graph over the anchors used to speed up long searches.
+ *
+ * Anchors are grouped into clusters of connected anchors in the same cell of a
+ * horizontal grid, so that separate floors above each other get their own cluster.
+ * Two clusters are neighbors if any anchor in the first links to an anchor in the
+ * second. The cost between neighbors is the distance of the cluster centers and is
+ * computed once when the hierarchy is built.
+ *
+ * Only anchor positions and links are used, which don't change while a level is
+ * loaded. The hierarchy can be shared by any number of threads.
+ */
+class PathHierarchy : private boost::noncopyable {
+	
+public:
+	
+	typedef size_t ClusterId;
+	
+	//! Width and depth of the grid cells anchors are grouped by
+	static const float CELL_SIZE;
+	
+	PathHierarchy(size_t map_size, const ANCHOR_DATA * map_data);
+	
+	size_t getClusterCount() const { return m_clusters.size(); }
+	
+	ClusterId getCluster(size_t anchor) const { return m_anchorClusters[anchor]; }
+	
+	/*!
+	 * Temporary storage for \ref getCorridor() that is reused between searches to
+	 * avoid allocations. Each thread needs its own.
+	 */
+	class Scratch {
+		
+		friend class PathHierarchy;
+		
+		typedef std::pair<float, ClusterId> Entry; // Estimated total cost and cluster
+		
+		std::vector<float> distance;
+		std::vector<ClusterId> parent;
+		std::vector<char> closed;
+		std::vector<Entry> open; // Heap with the lowest cost first
+		
+	};
+	
+	/*!
+	 * Find the clusters that a path between two anchors should pass through.
+	 * Blocked anchors and cylinder sizes are ignored - if this fails there is no
+	 * path between the anchors in the full graph either.
+	 * \param corridor Set to a non-zero value for all clusters on the abstract path
+	 *                 and their neighbors, and to zero for all other clusters.
+	 * \return true if the target cluster can be reached.
+	 */
+	bool getCorridor(size_t from, size_t to, std::vector<char> & corridor,
+	                 Scratch & scratch) const;
+	
+private:
+	
+	struct Cluster {
+		Vec3f center;
+		size_t firstEdge;
+		size_t edgeCount;
+	};
+	
+	struct Edge {
+		ClusterId target;
+		float cost;
+	};
+	
+	std::vector<ClusterId> m_anchorClusters;
+	std::vector<Cluster> m_clusters;
+	std::vector<Edge> m_edges;
+	
+};
+
+#endif // ARX_AI_PATHHIERARCHY_H
@@ -151,6 +151,7 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "scene/Object.h"
 #include "scene/Scene.h"
 
+#include "script/ScriptCache.h"
 #include "script/ScriptEvent.h"
 
 #include "Configure.h"
@@ -756,7 +757,7 @@ static bool HandleGameFlowTransitions() {
 
 Vec3f PUSH_PLAYER_FORCE;
 static EERIE_BACKGROUND DefaultBkg;
-EERIE_CAMERA subj,bookcam,raycam,conversationcamera;
+EERIE_CAMERA subj,bookcam,conversationcamera;
 
 bool ArxGame::initGame()
 {
@@ -883,12 +884,8 @@ bool ArxGame::initGame()
 	SetActiveCamera(&subj);
 
 	bookcam = subj;
-	raycam = subj;
 	conversationcamera = subj;
 	
-	raycam.clip = Rect(0, 0, 640, 640);
-	raycam.center = raycam.clip.center();
-	
 	bookcam.angle = Anglef::ZERO;
 	bookcam.orgTrans.pos = Vec3f_ZERO;
 	bookcam.focal = BASE_FOCAL;
@@ -1164,6 +1161,8 @@ void ArxGame::shutdownGame() {
 	
 	delete[] scr_timer, scr_timer = NULL;
 	
+	releaseScriptCache();
+	
 	//Speech
 	ARX_SPEECH_ClearAll();
 	ARX_Text_Close();
@@ -1181,6 +1180,8 @@ void ArxGame::shutdownGame() {
 	FreeSnapShot();
 	ARX_INPUT_Release();
 	
+	ARX_PHYSICS_ReleaseWorkers();
+	
 	if(getWindow()) {
 		EERIE_PATHFINDER_Release();
 		ARX_INPUT_Release();
@@ -2402,7 +2403,7 @@ void ArxGame::update2DFX()
 				}
 
 				if(ltvv.p.z > fZFar ||
-					EERIELaunchRay3(ACTIVECAM->orgTrans.pos, ee3dlv, &hit, tp, 1) ||
+					EERIELaunchRay3(ACTIVECAM->orgTrans.pos, ee3dlv, &hit, tp) ||
 					GetFirstInterAtPos(ees2dlv, 3, &ee3dlv, pTableIO, &nNbInTableIO )
 					)
 				{
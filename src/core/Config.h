@@ -171,6 +171,8 @@ public:
 		
 		int quicksaveSlots;
 		
+		int pathfinderThreads; //!< Number of threads used for NPC pathfinding
+		
 		std::string debug; //!< Logger debug levels.
 		
 	} misc;
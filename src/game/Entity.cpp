@@ -149,6 +149,8 @@ Entity::Entity(const res::path & classPath, EntityInstance instance)
 	
 	stat_count = 0;
 	stat_sent = 0;
+	heartbeat_time = 0;
+	heartbeat_rate = 0.f;
 	tweakerinfo = NULL;
 	material = MATERIAL_NONE;
 	
@@ -303,6 +303,8 @@ public:
 	EERIE_SCRIPT over_script; // Overriding Script
 	short stat_count;
 	short stat_sent;
+	unsigned long heartbeat_time; // Game time of the last main event
+	float heartbeat_rate; // Achieved main events per second
 	IO_TWEAKER_INFO * tweakerinfo; // optional tweaker infos
 	Material material;
 	
@@ -97,6 +97,7 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "math/Random.h"
 #include "math/Vector.h"
 
+#include "physics/AnchorIndex.h"
 #include "physics/Anchors.h"
 #include "physics/Box.h"
 #include "physics/CollisionShapes.h"
@@ -105,6 +106,7 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 
 #include "platform/Flags.h"
 #include "platform/Platform.h"
+#include "platform/WorkerPool.h"
 #include "platform/profiler/Profiler.h"
 
 #include "scene/Object.h"
@@ -235,8 +237,9 @@ static void ARX_NPC_ReleasePathFindInfo(Entity * io) {
 		return;
 	
 	// Releases data & resets vars
-	free(io->_npcdata->pathfind.list);
-	io->_npcdata->pathfind.list = NULL;
+	EERIE_PATHFINDER_Cancel(io->_npcdata->pathfind.request);
+	io->_npcdata->pathfind.request = 0;
+	io->_npcdata->pathfind.list.clear();
 	io->_npcdata->pathfind.listnb = -1;
 	io->_npcdata->pathfind.listpos = 0;
 	io->_npcdata->pathfind.pathwait = 0;
@@ -508,28 +511,13 @@ static long ARX_NPC_GetNextAttainableNodeIncrement(Entity * io) {
  * \brief Checks for nearest VALID anchor for a cylinder from a position
  */
 static long AnchorData_GetNearest(Vec3f * pos, Cylinder * cyl, long except = -1) {
-	long returnvalue = -1;
-	float distmax = std::numeric_limits<float>::max();
-	EERIE_BACKGROUND * eb = ACTIVEBKG;
-
-	for(long i = 0; i < eb->nbanchors; i++) {
-		if(except != -1 && i == except)
-			continue;
-
-		if(eb->anchors[i].nblinked) {
-			float d = glm::distance2(eb->anchors[i].pos, *pos);
-
-			if ((d < distmax) && (eb->anchors[i].height <= cyl->height)
-			        && (eb->anchors[i].radius >= cyl->radius)
-			        && (!(eb->anchors[i].flags & ANCHOR_FLAG_BLOCKED)))
-			{
-				returnvalue = i;
-				distmax = d;
-			}
-		}
+	
+	const AnchorIndex * index = EERIE_PATHFINDER_Get_Anchor_Index();
+	if(!index) {
+		return -1;
 	}
-
-	return returnvalue;
+	
+	return index->getNearest(*pos, cyl->radius, cyl->height, except);
 }
 
 static long AnchorData_GetNearest_2(float beta, Vec3f * pos, Cylinder * cyl) {
@@ -572,8 +560,7 @@ bool ARX_NPC_LaunchPathfind(Entity * io, EntityHandle target)
 		io->_npcdata->pathfind.listpos = 0;
 		io->_npcdata->pathfind.pathwait = 0;
 		io->_npcdata->pathfind.truetarget = EntityHandle(TARGET_NONE);
-		free(io->_npcdata->pathfind.list);
-		io->_npcdata->pathfind.list = NULL;
+		io->_npcdata->pathfind.list.clear();
 	}
 	
 	Vec3f pos1, pos2;
@@ -700,19 +687,15 @@ wander:
 			io->_npcdata->pathfind.listnb = -1;
 			io->_npcdata->pathfind.listpos = 0;
 			io->_npcdata->pathfind.pathwait = 1;
-
-			free(io->_npcdata->pathfind.list);
-			io->_npcdata->pathfind.list = NULL;
+			io->_npcdata->pathfind.list.clear();
 			
 			PATHFINDER_REQUEST tpr;
 			tpr.from = from;
 			tpr.to = to;
-			tpr.returnlist = &io->_npcdata->pathfind.list;
-			tpr.returnnumber = &io->_npcdata->pathfind.listnb;
 			tpr.ioid = io;
-			tpr.isvalid = true;
-
-			if(EERIE_PATHFINDER_Add_To_Queue(tpr))
+			
+			io->_npcdata->pathfind.request = EERIE_PATHFINDER_Add_To_Queue(tpr);
+			if(io->_npcdata->pathfind.request)
 				return true;
 		}
 	}
@@ -721,7 +704,7 @@ failure:
 	;
 	io->_npcdata->pathfind.pathwait = 0;
 
-	if(io->_npcdata->pathfind.list)
+	if(!io->_npcdata->pathfind.list.empty())
 		ARX_NPC_ReleasePathFindInfo(io);
 
 	io->_npcdata->pathfind.listnb = -2;
@@ -882,23 +865,23 @@ static void ARX_NPC_ManagePoison(Entity * io) {
 /*!
  * \brief Checks if the bottom of an IO is underwater.
  * \param io
+ * \param underwater result of EEIsUnderWater() for the IO position
  * \warning io must be valid (no check !)
  *
  * Plays Water sounds
  * Decrease/stops Ignition of this IO if necessary
  */
-static void CheckUnderWaterIO(Entity * io) {
+static void CheckUnderWaterIO(Entity * io, bool underwater) {
 	
 	Vec3f ppos = io->pos;
-	EERIEPOLY * ep = EEIsUnderWater(ppos);
 
 	if(io->ioflags & IO_UNDERWATER) {
-		if(!ep) {
+		if(!underwater) {
 			io->ioflags &= ~IO_UNDERWATER;
 			ARX_SOUND_PlaySFX(SND_PLOUF, &ppos);
 			ARX_PARTICLES_SpawnWaterSplash(ppos);
 		}
-	} else if(ep) {
+	} else if(underwater) {
 		io->ioflags |= IO_UNDERWATER;
 		ARX_SOUND_PlaySFX(SND_PLOUF, &ppos);
 		ARX_PARTICLES_SpawnWaterSplash(ppos);
@@ -918,20 +901,191 @@ static void CheckUnderWaterIO(Entity * io) {
 	}
 }
 
-static void ManageNPCMovement(Entity * io);
+static void ManageNPCMovement(Entity * io, const CylinderBackgroundTest * gravity);
 
 extern float MAX_ALLOWED_PER_SECOND;
 
+//! Receives paths requested by \ref ARX_NPC_LaunchPathfind()
+static void ARX_NPC_PathfinderResult(Entity * io, const PathFinder::Result & path) {
+	
+	IO_PATHFIND & pathfind = io->_npcdata->pathfind;
+	
+	pathfind.request = 0;
+	pathfind.list.assign(path.begin(), path.end());
+	pathfind.listnb = long(path.size());
+	
+	if(!pathfind.pathwait || IsDeadNPC(io)) {
+		return;
+	}
+	
+	if(pathfind.listnb == 0) { // Not Found
+		SendIOScriptEvent(io, SM_PATHFINDER_FAILURE);
+		pathfind.pathwait = 0;
+		pathfind.listnb = -2;
+	} else { // Found
+		SendIOScriptEvent(io, SM_PATHFINDER_SUCCESS);
+		pathfind.pathwait = 0;
+		pathfind.listpos += (unsigned short)ARX_NPC_GetNextAttainableNodeIncrement(io);
+		if(pathfind.listpos >= pathfind.listnb) {
+			pathfind.listpos = 0;
+		}
+	}
+	
+}
+
+//! Physics boxes simulated ahead of time in each ARX_PHYSICS_Apply() call
+static PhysicsBoxBatch physicsBoxes;
+
+namespace {
+
+//! Number of threads used to prepare entity updates and simulate physics boxes
+const size_t PHYSICS_THREADS = 4;
+
+//! Don't bother using threads for less than this many entities per thread
+const size_t ENTITY_UPDATE_MIN_PARALLEL = 32;
+
+//! Worker threads for ARX_PHYSICS_Apply(), they are kept while a level is loaded
+WorkerPool * physicsWorkers = NULL;
+
+/*!
+ * Level queries for one entity in ARX_PHYSICS_Apply()
+ *
+ * These only depend on the entity state and the level, so they are computed for all
+ * entities in parallel before the serial update. The update only uses them if the
+ * entity has not moved since then.
+ */
+struct EntityUpdate {
+	
+	Entity * io;
+	Vec3f pos;
+	
+	EERIEPOLY * floor; //!< CheckInPoly(pos)
+	bool underwater; //!< EEIsUnderWater(pos) != NULL
+	
+	bool npc;
+	CylinderBackgroundTest gravity; //!< Background part of the gravity test in ManageNPCMovement()
+	
+	void prepare() {
+		
+		floor = CheckInPoly(pos);
+		underwater = (EEIsUnderWater(pos) != NULL);
+		
+		if(npc) {
+			Cylinder cyl;
+			GetIOCyl(io, cyl);
+			cyl.origin.y += 10.f;
+			CheckBackgroundInCylinder(cyl, CFLAG_JUST_TEST | CFLAG_NPC, gravity);
+		}
+	}
+	
+};
+
+struct EntityUpdateTask : public WorkerPool::Task {
+	
+	const std::vector<EntityUpdate *> & m_jobs;
+	
+	explicit EntityUpdateTask(const std::vector<EntityUpdate *> & jobs) : m_jobs(jobs) { }
+	
+	void execute(size_t i) {
+		m_jobs[i]->prepare();
+	}
+	
+};
+
+//! Prepared updates indexed by treatio slot
+std::vector<EntityUpdate> entityUpdates;
+
+//! Updates to prepare in the current frame, kept to reuse the memory
+std::vector<EntityUpdate *> entityUpdateJobs;
+
+void prepareEntityUpdates() {
+	
+	entityUpdates.resize(std::max(TREATZONE_CUR, 0l));
+	
+	std::vector<EntityUpdate *> & jobs = entityUpdateJobs;
+	jobs.clear();
+	for(long i = 1; i < TREATZONE_CUR; i++) {
+		
+		EntityUpdate & update = entityUpdates[i];
+		update.io = NULL;
+		
+		Entity * io = treatio[i].io;
+		if(treatio[i].show != 1 || (treatio[i].ioflags & (IO_FIX | IO_JUST_COLLIDE)) || !io) {
+			continue;
+		}
+		
+		update.io = io;
+		update.pos = io->pos;
+		update.npc = (io->ioflags & IO_NPC) && !(io->ioflags & IO_PHYSICAL_OFF) && !IsDeadNPC(io);
+		jobs.push_back(&update);
+	}
+	
+	if(!physicsWorkers || jobs.size() < 2 * ENTITY_UPDATE_MIN_PARALLEL) {
+		for(size_t i = 0; i < jobs.size(); i++) {
+			jobs[i]->prepare();
+		}
+		return;
+	}
+	
+	EntityUpdateTask task(jobs);
+	physicsWorkers->run(task, jobs.size());
+	
+}
+
+//! \return the prepared update for a treatio slot if the entity has not moved
+const EntityUpdate * getEntityUpdate(long i, const Entity * io) {
+	
+	if(i < 0 || size_t(i) >= entityUpdates.size()) {
+		return NULL;
+	}
+	
+	const EntityUpdate & update = entityUpdates[i];
+	if(update.io != io || update.pos != io->pos) {
+		return NULL;
+	}
+	
+	return &update;
+}
+
+} // anonymous namespace
+
+void ARX_PHYSICS_CreateWorkers() {
+	if(!physicsWorkers) {
+		physicsWorkers = new WorkerPool(PHYSICS_THREADS - 1, "Physics");
+	}
+}
+
+void ARX_PHYSICS_ReleaseWorkers() {
+	delete physicsWorkers, physicsWorkers = NULL;
+}
+
 void ARX_PHYSICS_Apply() {
 	
 	ARX_PROFILE_FUNC();
 	
+	EERIE_PATHFINDER_Deliver_Results(ARX_NPC_PathfinderResult);
+	
+	TREATZONE_UpdateIndex();
+	
 	static long CURRENT_DETECT = 0;
 
 	CURRENT_DETECT++;
 
 	if(CURRENT_DETECT > TREATZONE_CUR)
 		CURRENT_DETECT = 1;
+	
+	// Integrate all physics boxes in parallel, collisions are resolved in the loop below
+	physicsBoxes.clear();
+	for(long i = 1; i < TREATZONE_CUR; i++) {
+		Entity * io = treatio[i].io;
+		if(treatio[i].show == 1 && !(treatio[i].ioflags & (IO_FIX | IO_JUST_COLLIDE))
+		   && io && io->obj && io->obj->pbox && io->obj->pbox->active == 1) {
+			physicsBoxes.add(io->obj->pbox, float(framedelay), io->rubber);
+		}
+	}
+	physicsBoxes.simulate(physicsWorkers);
+	
+	prepareEntityUpdates();
 
 	// We don't manage Player(0) this way
 	for(long i = 1; i < TREATZONE_CUR; i++) {
@@ -973,7 +1127,8 @@ void ARX_PHYSICS_Apply() {
 			continue;
 		}
 
-		EERIEPOLY * ep = CheckInPoly(io->pos);
+		const EntityUpdate * update = getEntityUpdate(i, io);
+		EERIEPOLY * ep = update ? update->floor : CheckInPoly(io->pos);
 
 		if(   ep
 		   && (ep->type & POLY_LAVA)
@@ -988,7 +1143,9 @@ void ARX_PHYSICS_Apply() {
 			}
 		}
 
-		CheckUnderWaterIO(io);
+		// Damage scripts may have moved the entity
+		update = getEntityUpdate(i, io);
+		CheckUnderWaterIO(io, update ? update->underwater : (EEIsUnderWater(io->pos) != NULL));
 		
 		if(io->obj && io->obj->pbox) {
 			io->gameFlags &= ~GFLAG_NOCOMPUTATION;
@@ -996,7 +1153,7 @@ void ARX_PHYSICS_Apply() {
 			if(io->obj->pbox->active == 1) {
 				PHYSICS_CURIO = io;
 
-				ARX_PHYSICS_BOX_ApplyModel(io->obj->pbox, (float)framedelay, io->rubber, treatio[i].num);
+				physicsBoxes.apply(io->obj->pbox, (float)framedelay, io->rubber, treatio[i].num);
 				
 				if(io->soundcount > 12) {
 					io->soundtime = 0;
@@ -1010,6 +1167,7 @@ void ARX_PHYSICS_Apply() {
 				
 				io->requestRoomUpdate = true;
 				io->pos = io->obj->pbox->vert[0].pos;
+				TREATZONE_UpdateIndex(i);
 				
 				continue;
 			}
@@ -1048,26 +1206,9 @@ void ARX_PHYSICS_Apply() {
 					io->_npcdata->climb_count = 0.f;
 			}
 
-			if(io->_npcdata->pathfind.pathwait) { // Waiting For Pathfinder Answer
-				if(io->_npcdata->pathfind.listnb == 0) { // Not Found
-					SendIOScriptEvent(io, SM_PATHFINDER_FAILURE);
-					io->_npcdata->pathfind.pathwait = 0;
-
-					if(io->_npcdata->pathfind.list)
-						ARX_NPC_ReleasePathFindInfo(io);
-
-					io->_npcdata->pathfind.listnb = -2;
-				} else if (io->_npcdata->pathfind.listnb > 0) { // Found
-					SendIOScriptEvent(io, SM_PATHFINDER_SUCCESS);
-					io->_npcdata->pathfind.pathwait = 0;
-					io->_npcdata->pathfind.listpos += (unsigned short)ARX_NPC_GetNextAttainableNodeIncrement(io);
-
-					if(io->_npcdata->pathfind.listpos >= io->_npcdata->pathfind.listnb)
-						io->_npcdata->pathfind.listpos = 0;
-				}
-			}
-
-			ManageNPCMovement(io);
+			update = getEntityUpdate(i, io);
+			ManageNPCMovement(io, (update && update->npc) ? &update->gravity : NULL);
+			TREATZONE_UpdateIndex(i);
 			CheckNPC(io);
 
 			if(CURRENT_DETECT == i)
@@ -1901,7 +2042,10 @@ static void ComputeTolerance(Entity * io, EntityHandle targ, float * dst) {
 //***********************************************************************************************
 //***********************************************************************************************
 
-static void ManageNPCMovement(Entity * io)
+/*!
+ * \param gravity background test for the gravity check computed ahead of time or \c NULL
+ */
+static void ManageNPCMovement(Entity * io, const CylinderBackgroundTest * gravity)
 {
 	ARX_PROFILE_FUNC();
 	
@@ -1966,7 +2110,7 @@ static void ManageNPCMovement(Entity * io)
 		return;
 	}
 
-	if(io->_npcdata->pathfind.listnb > 0 && !io->_npcdata->pathfind.list)
+	if(io->_npcdata->pathfind.listnb > 0 && io->_npcdata->pathfind.list.empty())
 		io->_npcdata->pathfind.listnb = 0;
 
 	// waiting for pathfinder ? or pathfinder failure ? ---> Wait Anim
@@ -2315,7 +2459,7 @@ static void ManageNPCMovement(Entity * io)
 		io->physics.targetpos.y = io->pos.y + io->move.y + ForcedMove.y;
 	} else { // Gravity 'simulation'
 		phys.cyl.origin.y += 10.f;
-		float anything = CheckAnythingInCylinder(phys.cyl, io, CFLAG_JUST_TEST | CFLAG_NPC);
+		float anything = CheckAnythingInCylinder(phys.cyl, io, CFLAG_JUST_TEST | CFLAG_NPC, gravity);
 
 		if(anything >= 0)
 			io->physics.targetpos.y = io->pos.y + (float)framedelay * 1.5f + ForcedMove.y;
@@ -2479,8 +2623,7 @@ static void ManageNPCMovement(Entity * io)
 				io->_npcdata->pathfind.listnb = -1;
 				io->_npcdata->pathfind.pathwait = 0;
 
-				free(io->_npcdata->pathfind.list);
-				io->_npcdata->pathfind.list = NULL;
+				io->_npcdata->pathfind.list.clear();
 
 				if(ause0->cur_anim == alist[ANIM_FIGHT_WALK_FORWARD]) {
 					ause0->flags &= ~EA_LOOP;
@@ -2503,8 +2646,7 @@ static void ManageNPCMovement(Entity * io)
 					io->_npcdata->pathfind.listnb = -1;
 					io->_npcdata->pathfind.pathwait = 0;
 
-					free(io->_npcdata->pathfind.list);
-					io->_npcdata->pathfind.list = NULL;
+					io->_npcdata->pathfind.list.clear();
 					
 					EVENT_SENDER = NULL;
 
@@ -3127,7 +3269,7 @@ void GetTargetPos(Entity * io, unsigned long smoothing) {
 			return;
 		}
 		
-		if(npcData->pathfind.listnb != -1 && npcData->pathfind.list
+		if(npcData->pathfind.listnb != -1 && !npcData->pathfind.list.empty()
 		   && !(npcData->behavior & BEHAVIOUR_FRIENDLY)) { // Targeting Anchors !
 			if(npcData->pathfind.listpos < npcData->pathfind.listnb) {
 				long pos = npcData->pathfind.list[npcData->pathfind.listpos];
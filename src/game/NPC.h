@@ -48,7 +48,9 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #define ARX_GAME_NPC_H
 
 #include <string>
+#include <vector>
 
+#include "ai/PathFinderManager.h"
 #include "game/Entity.h"
 #include "game/GameTypes.h"
 #include "math/Types.h"
@@ -105,18 +107,19 @@ DECLARE_FLAGS_OPERATORS(PathfindFlags)
 struct IO_PATHFIND {
 	PathfindFlags flags;
 	long listnb;
-	long * list;
+	std::vector<long> list; //!< Keeps its capacity so that new paths don't need to allocate
 	unsigned short listpos;
 	short pathwait;
 	EntityHandle truetarget;
+	PathFinderHandle request; //!< Pending pathfinder request or 0
 	
 	IO_PATHFIND()
 		: flags(0)
 		, listnb(0)
-		, list(NULL)
 		, listpos(0)
 		, pathwait(0)
 		, truetarget(0) // TODO is this correct ? use EntityHandle::Invalid ?
+		, request(0)
 	{}
 };
 
@@ -252,6 +255,9 @@ void ManageIgnition_2(Entity * io);
 
 void ARX_NPC_Kill_Spell_Launch(Entity * io);
 
+//! Start the worker threads used by \ref ARX_PHYSICS_Apply()
+void ARX_PHYSICS_CreateWorkers();
+void ARX_PHYSICS_ReleaseWorkers();
 void ARX_PHYSICS_Apply();
 
 void GetTargetPos(Entity * io, unsigned long smoothing = 0);
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "graphics/CullingKernels.h"
+
+#include <boost/static_assert.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARX_CULLING_KERNELS_SSE2 1
+#include <emmintrin.h>
+#else
+#define ARX_CULLING_KERNELS_SSE2 0
+#endif
+
+#if !ARX_CULLING_KERNELS_SSE2 && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define ARX_CULLING_KERNELS_NEON 1
+#include <arm_neon.h>
+#else
+#define ARX_CULLING_KERNELS_NEON 0
+#endif
+
+#include "graphics/data/Mesh.h"
+
+void BoundingSpheres::clear() {
+	x.clear();
+	y.clear();
+	z.clear();
+	radius.clear();
+	m_count = 0;
+}
+
+void BoundingSpheres::add(const Vec3f & center, float _radius) {
+	
+	if(m_count % 4 == 0) {
+		x.resize(m_count + 4, 0.f);
+		y.resize(m_count + 4, 0.f);
+		z.resize(m_count + 4, 0.f);
+		radius.resize(m_count + 4, 0.f);
+	}
+	
+	x[m_count] = center.x;
+	y[m_count] = center.y;
+	z[m_count] = center.z;
+	radius[m_count] = _radius;
+	m_count++;
+}
+
+namespace {
+
+//! Same as IsSphereInFrustrum()
+bool sphereInFrustum(const Vec3f & center, float radius, const EERIE_FRUSTRUM & frustrum) {
+	for(size_t i = 0; i < 4; i++) {
+		if(!(frustrum.plane[i].getDist(center) + radius > 0)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#if ARX_CULLING_KERNELS_SSE2 || ARX_CULLING_KERNELS_NEON
+
+/*
+ * Minimal wrappers around the SSE2 and NEON intrinsics so that the kernels can be
+ * shared. All operations must match the scalar code exactly - no fused multiply-add.
+ */
+
+#if ARX_CULLING_KERNELS_SSE2
+
+typedef __m128 float4;
+typedef __m128 mask4;
+
+inline float4 load(const float * p) { return _mm_loadu_ps(p); }
+inline float4 splat(float f) { return _mm_set1_ps(f); }
+inline float4 add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline mask4 less(float4 a, float4 b) { return _mm_cmplt_ps(a, b); }
+inline mask4 greater(float4 a, float4 b) { return _mm_cmpgt_ps(a, b); }
+inline mask4 maskAnd(mask4 a, mask4 b) { return _mm_and_ps(a, b); }
+inline mask4 maskOr(mask4 a, mask4 b) { return _mm_or_ps(a, b); }
+//! a & ~b
+inline mask4 maskAndNot(mask4 a, mask4 b) { return _mm_andnot_ps(b, a); }
+//! Bit i is set if lane i of the mask is set
+inline int getBits(mask4 m) { return _mm_movemask_ps(m); }
+//! Lane i of the mask is set if bit i is set
+inline mask4 fromBits(int bits) {
+	__m128i lanes = _mm_set_epi32(8, 4, 2, 1);
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), lanes), lanes));
+}
+//! Load the a, b, c and d coefficients of all four planes of a frustum
+inline void loadPlanes(const EERIE_FRUSTRUM & frustrum, float4 & a, float4 & b, float4 & c,
+                       float4 & d) {
+	a = _mm_loadu_ps(&frustrum.plane[0].a);
+	b = _mm_loadu_ps(&frustrum.plane[1].a);
+	c = _mm_loadu_ps(&frustrum.plane[2].a);
+	d = _mm_loadu_ps(&frustrum.plane[3].a);
+	_MM_TRANSPOSE4_PS(a, b, c, d);
+}
+
+#else
+
+typedef float32x4_t float4;
+typedef uint32x4_t mask4;
+
+inline float4 load(const float * p) { return vld1q_f32(p); }
+inline float4 splat(float f) { return vdupq_n_f32(f); }
+inline float4 add(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 sub(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 mul(float4 a, float4 b) { return vmulq_f32(a, b); }
+inline mask4 less(float4 a, float4 b) { return vcltq_f32(a, b); }
+inline mask4 greater(float4 a, float4 b) { return vcgtq_f32(a, b); }
+inline mask4 maskAnd(mask4 a, mask4 b) { return vandq_u32(a, b); }
+inline mask4 maskOr(mask4 a, mask4 b) { return vorrq_u32(a, b); }
+//! a & ~b
+inline mask4 maskAndNot(mask4 a, mask4 b) { return vbicq_u32(a, b); }
+//! Bit i is set if lane i of the mask is set
+inline int getBits(mask4 m) {
+	static const u32 values[4] = { 1, 2, 4, 8 };
+	uint32x4_t bits = vandq_u32(m, vld1q_u32(values));
+	uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+	return int(vget_lane_u32(vpadd_u32(sum, sum), 0));
+}
+//! Lane i of the mask is set if bit i is set
+inline mask4 fromBits(int bits) {
+	static const u32 values[4] = { 1, 2, 4, 8 };
+	return vtstq_u32(vdupq_n_u32(u32(bits)), vld1q_u32(values));
+}
+//! Load the a, b, c and d coefficients of all four planes of a frustum
+inline void loadPlanes(const EERIE_FRUSTRUM & frustrum, float4 & a, float4 & b, float4 & c,
+                       float4 & d) {
+	float32x4x4_t planes = vld4q_f32(&frustrum.plane[0].a);
+	a = planes.val[0], b = planes.val[1], c = planes.val[2], d = planes.val[3];
+}
+
+#endif
+
+BOOST_STATIC_ASSERT(sizeof(EERIE_FRUSTRUM_PLANE) == 4 * sizeof(float));
+BOOST_STATIC_ASSERT(sizeof(EERIE_FRUSTRUM) == 4 * sizeof(EERIE_FRUSTRUM_PLANE));
+
+//! Plane coefficients with each value copied to all lanes
+struct Plane4 {
+	
+	float4 a;
+	float4 b;
+	float4 c;
+	float4 d;
+	
+	Plane4() { }
+	
+	explicit Plane4(const EERIE_FRUSTRUM_PLANE & plane)
+		: a(splat(plane.a)), b(splat(plane.b)), c(splat(plane.c)), d(splat(plane.d)) { }
+	
+	//! Same as EERIE_FRUSTRUM_PLANE::getDist() for each lane
+	float4 getDist(float4 x, float4 y, float4 z) const {
+		return add(add(add(mul(x, a), mul(y, b)), mul(z, c)), d);
+	}
+	
+};
+
+#endif // ARX_CULLING_KERNELS_SSE2 || ARX_CULLING_KERNELS_NEON
+	
+} // anonymous namespace
+
+void cullSpheresScalar(const BoundingSpheres & spheres, const EERIE_FRUSTRUM_DATA & frustrums,
+                       const EERIE_FRUSTRUM_PLANE & near, std::vector<u32> & visible) {
+	
+	for(size_t i = 0; i < spheres.size(); i++) {
+		
+		Vec3f center(spheres.x[i], spheres.y[i], spheres.z[i]);
+		float radius = spheres.radius[i];
+		
+		bool inside = false;
+		for(long j = 0; j < frustrums.nb_frustrums; j++) {
+			if(sphereInFrustum(center, radius, frustrums.frustrums[j])) {
+				inside = true;
+				break;
+			}
+		}
+		
+		if(inside && !(radius < -near.getDist(center))) {
+			visible.push_back(u32(i));
+		}
+	}
+	
+}
+
+bool isSphereInFrustumScalar(const Vec3f & center, float radius,
+                             const EERIE_FRUSTRUM & frustrum) {
+	return sphereInFrustum(center, radius, frustrum);
+}
+
+#if ARX_CULLING_KERNELS_SSE2 || ARX_CULLING_KERNELS_NEON
+
+void cullSpheres(const BoundingSpheres & spheres, const EERIE_FRUSTRUM_DATA & frustrums,
+                 const EERIE_FRUSTRUM_PLANE & near, std::vector<u32> & visible) {
+	
+	arx_assert(frustrums.nb_frustrums >= 0 && frustrums.nb_frustrums <= MAX_FRUSTRUMS);
+	
+	size_t nbplanes = size_t(frustrums.nb_frustrums) * 4;
+	Plane4 planes[MAX_FRUSTRUMS * 4];
+	for(size_t i = 0; i < nbplanes; i++) {
+		planes[i] = Plane4(frustrums.frustrums[i / 4].plane[i % 4]);
+	}
+	
+	Plane4 nearPlane(near);
+	
+	const float4 zero = splat(0.f);
+	const mask4 allLanes = fromBits(15);
+	
+	size_t count = spheres.size();
+	for(size_t i = 0; i < count; i += 4) {
+		
+		float4 x = load(&spheres.x[i]);
+		float4 y = load(&spheres.y[i]);
+		float4 z = load(&spheres.z[i]);
+		float4 r = load(&spheres.radius[i]);
+		
+		// Lanes past the end are padding
+		mask4 lanes = (count - i >= 4) ? allLanes : fromBits((1 << (count - i)) - 1);
+		
+		lanes = maskAndNot(lanes, less(r, sub(zero, nearPlane.getDist(x, y, z))));
+		int remaining = getBits(lanes);
+		
+		mask4 inside = fromBits(0);
+		for(size_t j = 0; j < nbplanes && remaining; j += 4) {
+			mask4 in = greater(add(planes[j].getDist(x, y, z), r), zero);
+			in = maskAnd(in, greater(add(planes[j + 1].getDist(x, y, z), r), zero));
+			in = maskAnd(in, greater(add(planes[j + 2].getDist(x, y, z), r), zero));
+			in = maskAnd(in, greater(add(planes[j + 3].getDist(x, y, z), r), zero));
+			inside = maskOr(inside, in);
+			remaining &= ~getBits(in);
+		}
+		
+		int bits = getBits(maskAnd(lanes, inside));
+		for(size_t lane = 0; bits; lane++, bits >>= 1) {
+			if(bits & 1) {
+				visible.push_back(u32(i + lane));
+			}
+		}
+	}
+	
+}
+
+bool isSphereInFrustum(const Vec3f & center, float radius, const EERIE_FRUSTRUM & frustrum) {
+	
+	float4 a, b, c, d;
+	loadPlanes(frustrum, a, b, c, d);
+	
+	float4 dist = add(add(add(mul(splat(center.x), a), mul(splat(center.y), b)),
+	                      mul(splat(center.z), c)), d);
+	
+	return getBits(greater(add(dist, splat(radius)), splat(0.f))) == 15;
+}
+
+#else
+
+void cullSpheres(const BoundingSpheres & spheres, const EERIE_FRUSTRUM_DATA & frustrums,
+                 const EERIE_FRUSTRUM_PLANE & near, std::vector<u32> & visible) {
+	cullSpheresScalar(spheres, frustrums, near, visible);
+}
+
+bool isSphereInFrustum(const Vec3f & center, float radius, const EERIE_FRUSTRUM & frustrum) {
+	return isSphereInFrustumScalar(center, radius, frustrum);
+}
+
+#endif
+
+const char * getCullingKernelName() {
+#if ARX_CULLING_KERNELS_SSE2
+	return "sse2";
+#elif ARX_CULLING_KERNELS_NEON
+	return "neon";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_GRAPHICS_CULLINGKERNELS_H
+#define ARX_GRAPHICS_CULLINGKERNELS_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "math/Types.h"
+#include "platform/Platform.h"
+
+struct EERIE_FRUSTRUM;
+struct EERIE_FRUSTRUM_DATA;
+struct EERIE_FRUSTRUM_PLANE;
+
+/*!
+ * Bounding spheres stored as a structure of arrays so that four can be tested at once.
+ * The arrays are padded with zeros to a multiple of four entries.
+ */
+struct BoundingSpheres {
+	
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> radius;
+	
+	BoundingSpheres() : m_count(0) { }
+	
+	void clear();
+	
+	void add(const Vec3f & center, float radius);
+	
+	//! \return the number of spheres, not including padding
+	size_t size() const { return m_count; }
+	
+private:
+	
+	size_t m_count;
+	
+};
+
+/*!
+ * Find the spheres that are inside any of the frustums and not completely behind
+ * the near plane.
+ *
+ * This uses SSE2 or NEON where available and otherwise falls back to
+ * \ref cullSpheresScalar(). Both versions return exactly the same results as testing
+ * each sphere with IsSphereInFrustrum() for each frustum and then against the near plane.
+ *
+ * \param visible The indices of the visible spheres are appended to this in increasing order.
+ */
+void cullSpheres(const BoundingSpheres & spheres, const EERIE_FRUSTRUM_DATA & frustrums,
+                 const EERIE_FRUSTRUM_PLANE & near, std::vector<u32> & visible);
+
+//! Scalar version of \ref cullSpheres() that tests one sphere at a time
+void cullSpheresScalar(const BoundingSpheres & spheres, const EERIE_FRUSTRUM_DATA & frustrums,
+                       const EERIE_FRUSTRUM_PLANE & near, std::vector<u32> & visible);
+
+/*!
+ * Test a sphere against all four planes of a frustum at once.
+ *
+ * \return true if the sphere is not completely outside of any plane
+ */
+bool isSphereInFrustum(const Vec3f & center, float radius, const EERIE_FRUSTRUM & frustrum);
+
+//! Scalar version of \ref isSphereInFrustum() that tests one plane at a time
+bool isSphereInFrustumScalar(const Vec3f & center, float radius,
+                             const EERIE_FRUSTRUM & frustrum);
+
+//! \return the instruction set used by the culling kernels: "sse2", "neon" or "scalar"
+const char * getCullingKernelName();
+
+#endif // ARX_GRAPHICS_CULLINGKERNELS_H
@@ -317,7 +317,7 @@ static void drawDebugPathFinding() {
 			continue;
 		}
 		const IO_PATHFIND & pathfind = entity->_npcdata->pathfind;
-		if(pathfind.listnb <= 0 || !pathfind.list) {
+		if(pathfind.listnb <= 0 || pathfind.list.empty()) {
 			continue;
 		}
 		
@@ -51,6 +51,7 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "audio/AudioTypes.h"
 #include "graphics/BaseGraphicsTypes.h"
 #include "graphics/Color.h"
+#include "graphics/CullingKernels.h"
 #include "graphics/Vertex.h"
 
 #include "io/resource/ResourcePath.h"
@@ -441,6 +442,7 @@ struct EERIE_ROOM_DATA {
 	unsigned short * indexBuffer;
 	VertexBuffer<SMY_VERTEX> * pVertexBuffer;
 	std::vector<TextureContainer *> ppTextureContainer;
+	BoundingSpheres spheres; //!< Polygon bounding spheres in the same order as epdata
 
 	EERIE_ROOM_DATA()
 		: nb_portals()
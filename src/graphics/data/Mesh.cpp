@@ -87,45 +87,18 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "io/log/Logger.h"
 
 #include "physics/Anchors.h"
+#include "physics/BackgroundCollision.h"
+#include "physics/Raycast.h"
 
 #include "scene/Scene.h"
 #include "scene/Light.h"
 #include "scene/Interactive.h"
+#include "scene/RoomVisibility.h"
 
 #include "util/String.h"
 
 static void EERIE_PORTAL_Release();
 
-static bool RayIn3DPolyNoCull(const Vec3f & orgn, const Vec3f & dest, EERIEPOLY * epp);
-
-static bool IntersectLinePlane(const Vec3f & l1, const Vec3f & l2, const EERIEPOLY * ep, Vec3f * intersect) {
-	
-	Vec3f v = l2 - l1;
-	
-	float d = glm::dot(v, ep->norm);
-	
-	if(d != 0.0f) {
-		Vec3f v1 = ep->center - l2;
-		d = glm::dot(v1, ep->norm) / d;
-		
-		*intersect = (v * d) + l2;
-		
-		return true;
-	}
-
-	return false;
-}
-
-bool RayCollidingPoly(const Vec3f & orgn, const Vec3f & dest, EERIEPOLY * ep, Vec3f * hit)
-{
-	if(IntersectLinePlane(orgn, dest, ep, hit)) {
-		if(RayIn3DPolyNoCull(orgn, dest, ep))
-			return true;
-	}
-
-	return false;
-}
-
 long MakeTopObjString(Entity * io, std::string & dest) {
 	
 	if(!io) {
@@ -232,27 +205,29 @@ EERIEPOLY * CheckInPoly(const Vec3f & poss, float * needY)
 
 	EERIEPOLY * found = NULL;
 	float foundY = 0.f;
+	
+	const BackgroundCollision & bc = backgroundCollision;
 
 	for(short z = pzi; z <= pza; z++)
 	for(short x = pxi; x <= pxa; x++) {
-			EERIE_BKG_INFO * feg = &ACTIVEBKG->fastdata[x][z];
-
-			for(short k = 0; k < feg->nbpolyin; k++) {
-				EERIEPOLY * ep = feg->polyin[k];
-
-				if(poss.x >= ep->min.x
-				&& poss.x <= ep->max.x
-				&& poss.z >= ep->min.z
-				&& poss.z <= ep->max.z
-				&& !(ep->type & (POLY_WATER | POLY_TRANS | POLY_NOCOL))
-				&& ep->max.y >= poss.y
-				&& ep != found
-				&& PointIn2DPolyXZ(ep, poss.x, poss.z)
-				&& GetTruePolyY(ep, poss, &rz)
+			const BackgroundCollision::Range & polys = bc.getPolysIn(x, z);
+
+			for(size_t k = polys.begin; k < polys.end; k++) {
+				const Vec4f & bounds = bc.boundsXZ[k];
+
+				if(poss.x >= bounds.x
+				&& poss.x <= bounds.z
+				&& poss.z >= bounds.y
+				&& poss.z <= bounds.w
+				&& !(bc.type[k] & (POLY_WATER | POLY_TRANS | POLY_NOCOL))
+				&& bc.maxY[k] >= poss.y
+				&& bc.poly[k] != found
+				&& bc.containsXZ(k, poss.x, poss.z)
+				&& bc.getY(k, poss, &rz)
 				&& rz >= poss.y
 				&& (!found || (found && rz <= foundY))
 				) {
-					found = ep;
+					found = bc.poly[k];
 					foundY = rz;
 				}
 			}
@@ -466,35 +441,6 @@ void EE_RTP(const Vec3f & in, TexturedVertex * out) {
 	EE_P(&out->p, out);
 }
 
-static void camEE_RTP(const Vec3f & in, TexturedVertex * out, EERIE_CAMERA * cam) {
-	
-	const Vec3f rt = Vec3f(cam->orgTrans.worldToView * Vec4f(in, 1.0f));
-	
-	if(rt.z <= 0.f) {
-		out->rhw = 1.f - rt.z;
-	} else {
-		out->rhw = 1.f / rt.z;
-	}
-
-	const float rhw = (cam->focal * g_sizeRatio.x) * out->rhw;
-	out->p.z = rt.z * (1.f / (cam->cdepth * 1.2f));
-	out->p.x = cam->orgTrans.mod.x + (rt.x * rhw);
-	out->p.y = cam->orgTrans.mod.y + (rt.y * rhw) ;
-}
-
-//*************************************************************************************
-//*************************************************************************************
-static void EERIERTPPolyCam(EERIEPOLY * ep, EERIE_CAMERA * cam) {
-	
-	camEE_RTP(ep->v[0].p, &ep->tv[0], cam);
-	camEE_RTP(ep->v[1].p, &ep->tv[1], cam);
-	camEE_RTP(ep->v[2].p, &ep->tv[2], cam);
-
-	if (ep->type & POLY_QUAD)
-		camEE_RTP(ep->v[3].p, &ep->tv[3], cam);
-}
-
-
 //*************************************************************************************
 //*************************************************************************************
 
@@ -516,35 +462,6 @@ long GetVertexPos(Entity * io, long id, Vec3f * pos)
 
 long EERIEDrawnPolys = 0;
 
-//! Check if point (x,y) is in a 2D poly defined by ep
-static int PointIn2DPoly(EERIEPOLY * ep, float x, float y) {
-	
-	int i, j, c = 0;
-
-	for (i = 0, j = 2; i < 3; j = i++)
-	{
-		if ((((ep->tv[i].p.y <= y) && (y < ep->tv[j].p.y)) ||
-				((ep->tv[j].p.y <= y) && (y < ep->tv[i].p.y))) &&
-				(x < (ep->tv[j].p.x - ep->tv[i].p.x) *(y - ep->tv[i].p.y) / (ep->tv[j].p.y - ep->tv[i].p.y) + ep->tv[i].p.x))
-			c = !c;
-	}
-
-	if (c) return c;
-	else if (ep->type & POLY_QUAD)
-		for (i = 1, j = 3; i < 4; j = i++)
-		{
-			if ((((ep->tv[i].p.y <= y) && (y < ep->tv[j].p.y)) ||
-					((ep->tv[j].p.y <= y) && (y < ep->tv[i].p.y))) &&
-					(x < (ep->tv[j].p.x - ep->tv[i].p.x) *(y - ep->tv[i].p.y) / (ep->tv[j].p.y - ep->tv[i].p.y) + ep->tv[i].p.x))
-				c = !c;
-		}
-
-	return c;
-}
-
-//*************************************************************************************
-//*************************************************************************************
-
 float PtIn2DPolyProj(EERIE_3DOBJ * obj, EERIE_FACE * ef, float x, float z) {
 	
 	int i, j, c = 0;
@@ -603,261 +520,33 @@ int PointIn2DPolyXZ(const EERIEPOLY * ep, float x, float z) {
 	return c + d;
 }
 
-extern EERIE_CAMERA raycam;
-
-static bool RayIn3DPolyNoCull(const Vec3f & orgn, const Vec3f & dest, EERIEPOLY * epp) {
-
-	EERIEPOLY ep;
-	memcpy(&ep, epp, sizeof(EERIEPOLY));
-	raycam.orgTrans.pos = orgn;
-	raycam.setTargetCamera(dest);
-	SP_PrepareCamera(&raycam);
-	EERIERTPPolyCam(&ep, &raycam);
-
-	if(PointIn2DPoly(&ep, 320.f, 320.f))
-		return true;
-
-	return false;
-}
-
-int EERIELaunchRay3(const Vec3f & orgn, const Vec3f & dest,  Vec3f * hit, EERIEPOLY * epp, long flag) {
-	
-	Vec3f p; //current ray pos
-	Vec3f i;
-	long lpx, lpz;
-	long voidlast;
-	float pas = 1.5f;
-	
-	long iii = 0;
-	float maxstepp = 20000.f / pas;
-	*hit = p = orgn;
-	
-	voidlast = 0;
-	lpx = lpz = -1;
-	
-	// ray incs
-	Vec3f d = (dest - orgn);
-	// absolute ray incs
-	Vec3f ad = glm::abs(d);
-	
-	if(ad.x >= ad.y && ad.x >= ad.z) {
-		i.x = (ad.x != d.x) ? (-1.f * pas) : (1.f * pas);
-		i.y = d.y / (ad.x / pas);
-		i.z = d.z / (ad.x / pas);
-	} else if(ad.y >= ad.x && ad.y >= ad.z) {
-		i.x = d.x / (ad.y / pas);
-		i.y = (ad.y != d.y) ? (-1.f * pas) : (1.f * pas);
-		i.z = d.z / (ad.y / pas);
-	} else {
-		i.x = d.x / (ad.z / pas);
-		i.y = d.y / (ad.z / pas);
-		i.z = (ad.z != d.z) ? (-1.f * pas) : (1.f * pas);
-	}
+int EERIELaunchRay3(const Vec3f & orgn, const Vec3f & dest, Vec3f * hit, EERIEPOLY * epp) {
 	
-	for(;;) {
-		
-		p += i;
-		
-		if(i.x == -1.f * pas && p.x <= dest.x) {
-			*hit = p;
-			return 0;
-		}
-		
-		if(i.x == 1.f * pas && p.x >= dest.x) {
-			*hit = p;
-			return 0;
-		}
-		
-		if(i.y == -1.f * pas && p.y <= dest.y) {
-			*hit = p;
-			return 0;
-		}
-		
-		if(i.y == 1.f * pas && p.y >= dest.y) {
-			*hit = p;
-			return 0;
-		}
-		
-		if(i.z == -1.f * pas && p.z <= dest.z) {
-			*hit = p;
-			return 0;
-		}
-		
-		if(i.z == 1.f * pas && p.z >= dest.z) {
-			*hit = p;
-			return 0;
-		}
-		
-		iii++;
-		
-		if(iii > maxstepp) {
-			*hit = p;
-			return -1;
-		}
-		
-		long tilex = long(p.x * ACTIVEBKG->Xmul);
-		long tilez = long(p.z * ACTIVEBKG->Zmul);
-		
-		if(tilex < 0 || tilex > ACTIVEBKG->Xsize - 1 || tilez < 0 || tilez > ACTIVEBKG->Zsize - 1) {
-			*hit = p;
-			return -1;
-		}
-		
-		if(lpx == tilex && lpz == tilez && voidlast) {
-			continue;
-		}
-		
-		lpx = tilex;
-		lpz = tilez;
-		voidlast = !flag;
-		long minx = glm::clamp(tilex - 1l, 0l, ACTIVEBKG->Xsize - 1l);
-		long maxx = glm::clamp(tilex + 1l, 0l, ACTIVEBKG->Xsize - 1l);
-		long minz = glm::clamp(tilez - 1l, 0l, ACTIVEBKG->Zsize - 1l);
-		long maxz = glm::clamp(tilez + 1l, 0l, ACTIVEBKG->Zsize - 1l);
-		
-		EERIE_BKG_INFO * eg = &ACTIVEBKG->fastdata[tilex][tilez];
-		if(eg->nbpoly == 0) {
-			*hit = p;
-			return 1;
-		}
-		
-		for(short z = minz; z < maxz; z++)
-		for(short x = minx; x < maxx; x++) {
-			EERIE_BKG_INFO * eg = &ACTIVEBKG->fastdata[x][z];
-			for(long k = 0; k < eg->nbpoly; k++) {
-				EERIEPOLY * ep = &eg->polydata[k];
-				if(ep->type & POLY_TRANS) {
-					continue;
-				}
-				if(   p.y < ep->min.y - 10.f
-				   || p.y > ep->max.y + 10.f
-				   || p.x < ep->min.x - 10.f
-				   || p.x > ep->max.x + 10.f
-				   || p.z < ep->min.z - 10.f
-				   || p.z > ep->max.z + 10.f
-				) {
-					continue;
-				}
-				voidlast = 0;
-				if(RayIn3DPolyNoCull(orgn, dest, ep)) {
-					*hit = p;
-					return (ep == epp) ? 0 : 1;
-				}
-			}
-		}
+	RaycastResult result = raycastBackground(orgn, dest, POLY_TRANS, RaycastStopAtEmptyTiles);
+	
+	*hit = result.pos;
+	
+	switch(result.type) {
+		case RaycastResult::Miss: return 0;
+		case RaycastResult::Polygon: return (result.poly == epp) ? 0 : 1;
+		case RaycastResult::EmptyTile: return 1;
+		case RaycastResult::OutOfBounds: return -1;
 	}
+	
+	ARX_DEAD_CODE();
+	return -1;
 }
 
-// Computes the visibility from a point to another... (sort of...)
-bool Visible(const Vec3f & orgn, const Vec3f & dest, EERIEPOLY * epp, Vec3f * hit)
-{
-	float ix,iy,iz;
-	long px,pz;
-
-	float pas = 35.f;
-
-	Vec3f found_hit = Vec3f_ZERO;
-	EERIEPOLY *found_ep = NULL;
-	float iter,t;
+// Computes the visibility from a point to another
+bool Visible(const Vec3f & orgn, const Vec3f & dest, EERIEPOLY * epp, Vec3f * hit) {
 	
-	//current ray pos
-	float x = orgn.x;
-	float y = orgn.y;
-	float z = orgn.z;
-
-	float distance;
-	float nearest = distance = fdist(orgn, dest);
-
-	if(distance < pas)
-		pas = distance * .5f;
-
-	// ray incs
-	float dx = (dest.x - orgn.x);
-	float dy = (dest.y - orgn.y);
-	float dz = (dest.z - orgn.z);
-
-	// absolute ray incs
-	float adx = glm::abs(dx);
-	float ady = glm::abs(dy);
-	float adz = glm::abs(dz);
-
-	if(adx >= ady && adx >= adz) {
-		if(adx != dx)
-			ix = -pas;
-		else
-			ix = pas;
-
-		iter = adx / pas;
-		t = 1.f / (iter);
-		iy = dy * t;
-		iz = dz * t;
-	} else if(ady >= adx && ady >= adz) {
-		if(ady != dy)
-			iy = -pas;
-		else
-			iy = pas;
-
-		iter = ady / pas;
-		t = 1.f / (iter);
-		ix = dx * t;
-		iz = dz * t;
-	} else {
-		if(adz != dz)
-			iz = -pas;
-		else
-			iz = pas;
-
-		iter = adz / pas;
-		t = 1.f / (iter);
-		ix = dx * t;
-		iy = dy * t;
-	}
-
-	float dd;
-	x -= ix;
-	y -= iy;
-	z -= iz;
-
-	while(iter > 0.f) {
-		iter -= 1.f;
-		x += ix;
-		y += iy;
-		z += iz;
-
-		px = (long)(x * ACTIVEBKG->Xmul);
-		pz = (long)(z * ACTIVEBKG->Zmul);
-
-		if(px < 0 || px > ACTIVEBKG->Xsize - 1 || pz < 0 || pz > ACTIVEBKG->Zsize - 1)
-			break;
-
-		EERIE_BKG_INFO * eg = &ACTIVEBKG->fastdata[px][pz];
-
-		for(long k = 0; k < eg->nbpolyin; k++) {
-			EERIEPOLY * ep = eg->polyin[k];
-
-			if (ep)
-			if ((ep->min.y - pas < y) && (ep->max.y + pas > y))
-			if ((ep->min.x - pas < x) && (ep->max.x + pas > x))
-			if ((ep->min.z - pas < z) && (ep->max.z + pas > z))
-			if (RayCollidingPoly(orgn, dest, ep, hit)) {
-				dd = fdist(orgn, *hit);
-
-				if(dd < nearest) {
-					nearest = dd;
-					found_ep = ep;
-					found_hit = *hit;
-				}
-			}
-		}
-	}
-
-	if(!found_ep)
-		return true;
-
-	if(found_ep == epp)
+	RaycastResult result = raycastBackground(orgn, dest, PolyType());
+	
+	if(result.type != RaycastResult::Polygon || result.poly == epp) {
 		return true;
+	}
 	
-	*hit = found_hit;
+	*hit = result.pos;
 	
 	return false;
 }
@@ -1032,6 +721,10 @@ void ClearBackground(EERIE_BACKGROUND * eb) {
 	
 	AnchorData_ClearAll(eb);
 	
+	if(eb == ACTIVEBKG) {
+		backgroundCollision.clear();
+	}
+	
 	for(long z = 0; z < eb->Zsize; z++)
 	for(long x = 0; x < eb->Xsize; x++) {
 		ReleaseBKG_INFO(&eb->fastdata[x][z]);
@@ -1156,6 +849,8 @@ void EERIEPOLY_Compute_PolyIn()
 			}
 		}
 	}
+	
+	backgroundCollision.build(*ACTIVEBKG);
 }
 
 float GetTileMinY(long i, long j) {
@@ -1257,6 +952,17 @@ static void EERIE_PORTAL_Blend_Portals_And_Rooms() {
 			}
 		}
 	}
+	
+	// Bounding spheres for culling the room polygons in batches
+	for(size_t nroom = 0; nroom < portals->rooms.size(); nroom++) {
+		EERIE_ROOM_DATA & room = portals->rooms[nroom];
+		room.spheres.clear();
+		for(long i = 0; i < room.nb_polys; i++) {
+			const EERIE_BKG_INFO & feg = ACTIVEBKG->fastdata[room.epdata[i].p.x][room.epdata[i].p.y];
+			const EERIEPOLY & ep = feg.polydata[room.epdata[i].idx];
+			room.spheres.add(ep.center, ep.v[0].rhw);
+		}
+	}
 }
 
 static void EERIE_PORTAL_Release() {
@@ -1279,6 +985,9 @@ static void EERIE_PORTAL_Release() {
 		
 	delete portals;
 	portals = NULL;
+	
+	roomVisibility.clear();
+	ARX_PORTALS_InvalidateVisibility();
 }
 
 
@@ -1767,6 +1476,7 @@ static bool loadFastScene(const res::path & file, const char * data, const char
 	
 	EERIE_PATHFINDER_Create();
 	EERIE_PORTAL_Blend_Portals_And_Rooms();
+	RoomVisibility_Create();
 	progressBarAdvance();
 	LoadLevelScreen();
 	
@@ -1908,7 +1618,7 @@ static void ComputeRoomDistance() {
 		}
 	}
 
-	PathFinder pathfinder(NbRoomDistance, ad, 0, NULL);
+	PathFinder pathfinder(NbRoomDistance, ad);
 
 	for(int i = 0; i < NbRoomDistance; i++) {
 		for(long j = 0; j < NbRoomDistance; j++) {
@@ -2538,6 +2248,7 @@ void SceneAddMultiScnToBackground(EERIE_MULTI3DSCENE * ms) {
 		ARX_PrepareBackgroundNRMLs();
 		EERIEPOLY_Compute_PolyIn();
 		EERIE_PORTAL_Blend_Portals_And_Rooms();
+		RoomVisibility_Create();
 		
 		AnchorData_Create(ACTIVEBKG);
 		
@@ -2594,7 +2305,7 @@ struct SINFO_TEXTURE_VERTEX {
 
 void ComputePortalVertexBuffer() {
 	
-	if(!portals) {
+	if(!portals || !GRenderer) {
 		return;
 	}
 	
@@ -129,7 +129,14 @@ EERIEPOLY * GetMaxPoly(const Vec3f & pos);
  
 int PointIn2DPolyXZ(const EERIEPOLY * ep, float x, float z);
 
-int EERIELaunchRay3(const Vec3f & orgn, const Vec3f & dest,  Vec3f * hit, EERIEPOLY * tp, long flag);
+/*!
+ * Check if the segment from orgn to dest crosses any non-transparent background polygon
+ * or a tile without polygons.
+ * \param hit set to where the segment was stopped, or dest
+ * \return 0 if nothing (or epp) was hit, 1 if something was hit and -1 if the segment
+ *         left the level
+ */
+int EERIELaunchRay3(const Vec3f & orgn, const Vec3f & dest, Vec3f * hit, EERIEPOLY * epp);
 
 void EE_RotateY(TexturedVertex *in,TexturedVertex *out,float c, float s);
 
@@ -175,8 +182,6 @@ float PtIn2DPolyProj(EERIE_3DOBJ * obj,EERIE_FACE * ef, float x, float z);
 long GetVertexPos(Entity * io,long id,Vec3f * pos);
 long CountBkgVertex();
 
-bool RayCollidingPoly(const Vec3f & orgn, const Vec3f & dest, EERIEPOLY * ep, Vec3f * hit);
-
 void EERIEPOLY_Compute_PolyIn();
 
 float GetTileMinY(long i,long j);
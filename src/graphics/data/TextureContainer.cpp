@@ -243,6 +243,11 @@ bool TextureContainer::hasColorKey() {
 
 TextureContainer * TextureContainer::Load(const res::path & name, TCFlags flags) {
 	
+	if(!GRenderer) {
+		// Tools may load level and object data without a renderer
+		return NULL;
+	}
+	
 	// Check first to see if the texture is already loaded
 	TextureContainer * newTexture = Find(name);
 	if(newTexture) {
@@ -263,6 +263,16 @@ void ShowInfoText() {
 	miscBox.add("Mouse", Vec2i(DANAEMouse));
 	miscBox.add("Pathfind queue", EERIE_PATHFINDER_Get_Queued_Number());
 	miscBox.add("Pathfind status", (PATHFINDER_WORKING ? "Working" : "Idled"));
+	PathFinderCacheStats pathCache = EERIE_PATHFINDER_Get_Cache_Stats();
+	miscBox.add("Pathfind cache hits", pathCache.hits);
+	miscBox.add("Pathfind cache hit rate",
+	            pathCache.lookups ? double(pathCache.hits) / double(pathCache.lookups) : 0.0);
+	miscBox.add("Pathfind saved (us)", pathCache.searchTime);
+	PathFinderQueueStats pathQueue = EERIE_PATHFINDER_Get_Queue_Stats();
+	miscBox.add("Pathfind wait p50 (us)", pathQueue.all.p50);
+	miscBox.add("Pathfind wait p99 (us)", pathQueue.all.p99);
+	miscBox.add("Pathfind visible p50 (us)", pathQueue.visible.p50);
+	miscBox.add("Pathfind visible p99 (us)", pathQueue.visible.p99);
 	miscBox.print();
 	
 	{
@@ -312,6 +322,7 @@ void ShowInfoText() {
 			entityBox.add("Room", static_cast<long>(io->room));
 			entityBox.add("Move", io->move);
 			entityBox.add("Flags", flagNames(EntityFlagNames, io->ioflags));
+			entityBox.add("Heartbeat rate", double(io->heartbeat_rate));
 			entityBox.print();
 			
 			if(io->ioflags & IO_NPC) {
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "physics/AnchorIndex.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <glm/gtx/norm.hpp>
+
+#include "physics/Anchors.h"
+
+const float AnchorIndex::CELL_SIZE = 200.f;
+
+namespace {
+
+struct AnyAnchor {
+	
+	bool operator()(long /* anchor */) const {
+		return true;
+	}
+	
+};
+
+struct CylinderFits {
+	
+	const ANCHOR_DATA * anchors;
+	float radius;
+	float height;
+	long except;
+	
+	CylinderFits(const ANCHOR_DATA * _anchors, float _radius, float _height, long _except)
+		: anchors(_anchors), radius(_radius), height(_height), except(_except) { }
+	
+	bool operator()(long anchor) const {
+		const ANCHOR_DATA & ad = anchors[anchor];
+		return anchor != except && ad.height <= height && ad.radius >= radius
+		       && !(ad.flags & ANCHOR_FLAG_BLOCKED);
+	}
+	
+};
+
+} // anonymous namespace
+
+AnchorIndex::AnchorIndex(size_t count, const ANCHOR_DATA * anchors)
+	: m_anchors(anchors), m_min(0.f), m_max(0.f), m_width(0), m_depth(0) {
+	
+	for(size_t i = 0; i < count; i++) {
+		if(anchors[i].nblinked) {
+			Entry entry;
+			entry.pos = anchors[i].pos;
+			entry.anchor = long(i);
+			m_entries.push_back(entry);
+		}
+	}
+	
+	if(m_entries.empty()) {
+		return;
+	}
+	
+	m_min = m_max = Vec2f(m_entries[0].pos.x, m_entries[0].pos.z);
+	for(size_t i = 1; i < m_entries.size(); i++) {
+		m_min = glm::min(m_min, Vec2f(m_entries[i].pos.x, m_entries[i].pos.z));
+		m_max = glm::max(m_max, Vec2f(m_entries[i].pos.x, m_entries[i].pos.z));
+	}
+	
+	m_width = long((m_max.x - m_min.x) / CELL_SIZE) + 1;
+	m_depth = long((m_max.y - m_min.y) / CELL_SIZE) + 1;
+	
+	// Counting sort of the entries by cell
+	std::vector<size_t> cellOf(m_entries.size());
+	m_cells.assign(m_width * m_depth + 1, 0);
+	for(size_t i = 0; i < m_entries.size(); i++) {
+		long x = long((m_entries[i].pos.x - m_min.x) / CELL_SIZE);
+		long z = long((m_entries[i].pos.z - m_min.y) / CELL_SIZE);
+		cellOf[i] = size_t(z * m_width + x);
+		m_cells[cellOf[i] + 1]++;
+	}
+	for(size_t i = 1; i < m_cells.size(); i++) {
+		m_cells[i] += m_cells[i - 1];
+	}
+	
+	std::vector<size_t> next(m_cells.begin(), m_cells.end() - 1);
+	std::vector<Entry> sorted(m_entries.size());
+	for(size_t i = 0; i < m_entries.size(); i++) {
+		sorted[next[cellOf[i]]++] = m_entries[i];
+	}
+	m_entries.swap(sorted);
+	
+}
+
+template <class Filter>
+long AnchorIndex::findNearest(const Vec3f & pos, const Filter & filter) const {
+	
+	if(m_entries.empty()) {
+		return -1;
+	}
+	
+	// Clamping to the grid never increases the distance to anchors in the grid,
+	// so the ring bounds below are still valid for positions outside of it.
+	Vec2f p = glm::clamp(Vec2f(pos.x, pos.z), m_min, m_max);
+	long cx = std::min(long((p.x - m_min.x) / CELL_SIZE), m_width - 1);
+	long cz = std::min(long((p.y - m_min.y) / CELL_SIZE), m_depth - 1);
+	
+	long best = -1;
+	float bestDist = std::numeric_limits<float>::max();
+	
+	long maxRing = std::max(m_width, m_depth);
+	for(long ring = 0; ring <= maxRing; ring++) {
+		
+		// Cells in this ring are separated from the start cell by ring - 1 full cells
+		if(ring > 1) {
+			float bound = float(ring - 1) * CELL_SIZE;
+			if(bound * bound > bestDist) {
+				break;
+			}
+		}
+		
+		long z0 = std::max(cz - ring, 0l), z1 = std::min(cz + ring, m_depth - 1);
+		for(long z = z0; z <= z1; z++) {
+			
+			bool edge = (z == cz - ring || z == cz + ring);
+			long step = edge ? 1 : 2 * ring;
+			
+			for(long x = cx - ring; x <= cx + ring; x += step) {
+				
+				if(x < 0 || x >= m_width) {
+					continue;
+				}
+				
+				size_t cell = size_t(z * m_width + x);
+				for(size_t i = m_cells[cell]; i < m_cells[cell + 1]; i++) {
+					
+					const Entry & entry = m_entries[i];
+					
+					float dist = glm::distance2(entry.pos, pos);
+					if(dist > bestDist || (dist == bestDist && entry.anchor > best)) {
+						continue;
+					}
+					
+					if(filter(entry.anchor)) {
+						best = entry.anchor;
+						bestDist = dist;
+					}
+				}
+			}
+		}
+	}
+	
+	return best;
+}
+
+long AnchorIndex::getNearest(const Vec3f & pos) const {
+	return findNearest(pos, AnyAnchor());
+}
+
+long AnchorIndex::getNearest(const Vec3f & pos, float radius, float height, long except) const {
+	return findNearest(pos, CylinderFits(m_anchors, radius, height, except));
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_PHYSICS_ANCHORINDEX_H
+#define ARX_PHYSICS_ANCHORINDEX_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "math/Types.h"
+
+struct ANCHOR_DATA;
+
+/*!
+ * Uniform grid over the horizontal anchor positions for nearest-anchor queries.
+ *
+ * Only anchors with links are indexed. Positions are copied into the grid, but
+ * the blocked state and capacity are read from the anchor data at query time,
+ * so anchors may be blocked and unblocked without rebuilding the index.
+ * The anchor positions and links must not change while the index is in use.
+ *
+ * Queries return the same anchor as a linear scan, with ties going to the lowest
+ * anchor index, and can be run from any number of threads.
+ */
+class AnchorIndex : private boost::noncopyable {
+	
+public:
+	
+	//! Width and depth of each grid cell
+	static const float CELL_SIZE;
+	
+	AnchorIndex(size_t count, const ANCHOR_DATA * anchors);
+	
+	/*!
+	 * Find the nearest anchor with links.
+	 * \return the anchor index or -1 if there are no such anchors
+	 */
+	long getNearest(const Vec3f & pos) const;
+	
+	/*!
+	 * Find the nearest unblocked anchor with links that has room for a cylinder.
+	 * \param except An anchor to ignore or -1.
+	 * \return the anchor index or -1 if there are no such anchors
+	 */
+	long getNearest(const Vec3f & pos, float radius, float height, long except = -1) const;
+	
+private:
+	
+	struct Entry {
+		Vec3f pos;
+		long anchor;
+	};
+	
+	template <class Filter>
+	long findNearest(const Vec3f & pos, const Filter & filter) const;
+	
+	const ANCHOR_DATA * m_anchors;
+	
+	Vec2f m_min;
+	Vec2f m_max;
+	long m_width;
+	long m_depth;
+	
+	std::vector<Entry> m_entries; //!< Anchors sorted by cell
+	std::vector<size_t> m_cells; //!< Index of the first entry for each cell
+	
+};
+
+#endif // ARX_PHYSICS_ANCHORINDEX_H
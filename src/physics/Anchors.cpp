@@ -46,17 +46,30 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 
 #include "physics/Anchors.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/crc.hpp>
 
 #include "ai/PathFinderManager.h"
-#include "game/NPC.h"
-#include "game/Player.h"
+#include "game/Entity.h"
 #include "graphics/Math.h"
+#include "graphics/data/FastSceneFormat.h"
+#include "io/fs/FilePath.h"
+#include "io/fs/FileStream.h"
+#include "io/fs/Filesystem.h"
+#include "io/fs/SystemPaths.h"
 #include "io/log/Logger.h"
+#include "physics/BackgroundCollision.h"
+#include "physics/CollisionKernels.h"
 #include "physics/Collisions.h"
-
-extern float MAX_ALLOWED_PER_SECOND;
-extern bool DIRECT_PATH;
+#include "platform/Lock.h"
+#include "platform/Thread.h"
 
 static EERIEPOLY * ANCHOR_CheckInPolyPrecis(const Vec3f & pos) {
 	
@@ -123,100 +136,6 @@ static EERIEPOLY * ANCHOR_CheckInPoly(const Vec3f & pos) {
 	return found;
 }
 
-extern Vec3f vector2D;
-
-static float ANCHOR_IsPolyInCylinder(const EERIEPOLY & ep, const Cylinder & cyl,
-                                     CollisionFlags flags) {
-	
-	if (!(flags & CFLAG_EXTRA_PRECISION))
-	{
-		if (ep.area < 100.f) return 999999.f;
-	}
-
-	if (PointInCylinder(cyl, &ep.center))
-	{
-		if (ep.norm.y < 0.5f)
-			return ep.min.y;
-
-		return ep.center.y;
-	}
-
-	float minf = std::min(cyl.origin.y, cyl.origin.y + cyl.height);
-	float maxf = std::max(cyl.origin.y, cyl.origin.y + cyl.height);
-
-	if (minf > ep.max.y) return 999999.f;
-
-	if (maxf < ep.min.y) return 999999.f;
-
-	long to = (ep.type & POLY_QUAD) ? 4 : 3;
-
-	long r = to - 1;
-	float anything = 999999.f;
-	Vec3f center;
-	long n;
-
-	for (n = 0; n < to; n++)
-	{
-		if (flags & CFLAG_EXTRA_PRECISION)
-		{
-			for (long o = 0; o < 5; o++)
-			{
-				float p = (float)o * ( 1.0f / 5 );
-				center = ep.v[n].p * p + ep.center * (1.f - p);
-				if(PointInCylinder(cyl, &center)) {
-					anything = std::min(anything, center.y);
-					return anything;
-				}
-			}
-		}
-
-
-		if ((ep.area > 2000.f)
-		        || (flags & CFLAG_EXTRA_PRECISION)
-		   )
-		{
-			center = (ep.v[n].p + ep.v[r].p) * 0.5f;
-			if(PointInCylinder(cyl, &center)) {
-				anything = std::min(anything, center.y);
-				return anything;
-			}
-
-			if ((ep.area > 4000.f) || (flags & CFLAG_EXTRA_PRECISION))
-			{
-				center = (ep.v[n].p + ep.center) * 0.5f;
-				if(PointInCylinder(cyl, &center)) {
-					anything = std::min(anything, center.y);
-					return anything;
-				}
-			}
-
-			if ((ep.area > 6000.f) || (flags & CFLAG_EXTRA_PRECISION))
-			{
-				center = (center + ep.v[n].p) * 0.5f;
-				if(PointInCylinder(cyl, &center)) {
-					anything = std::min(anything, center.y);
-					return anything;
-				}
-			}
-		}
-
-		if(PointInCylinder(cyl, &ep.v[n].p)) {
-			anything = std::min(anything, ep.v[n].p.y);
-			return anything;
-		}
-
-		r++;
-
-		if (r >= to) r = 0;
-
-	}
-
-	if ((anything != 999999.f) && (ep.norm.y < 0.1f) && (ep.norm.y > -0.1f))
-		anything = std::min(anything, ep.min.y);
-
-	return anything;
-}
-
 /*!
  * \brief Check if anything is in a cylinder
  * \param cyl the cylinder to check
@@ -241,21 +160,25 @@ static float ANCHOR_CheckAnythingInCylinder(const Cylinder & cyl, CollisionFlags
 	
 	float anything = 999999.f; 
 	
+	const BackgroundCollision & bc = backgroundCollision;
+	
 	for(short z = pz - rad; z <= pz + rad; z++)
 	for(short x = px - rad; x <= px + rad; x++) {
-		const EERIE_BKG_INFO feg = ACTIVEBKG->fastdata[x][z];
+		const BackgroundCollision::Range & polys = bc.getPolys(x, z);
 		
-		for(long k = 0; k < feg.nbpoly; k++) {
-			const EERIEPOLY ep = feg.polydata[k];
+		for(size_t begin = polys.begin; begin < polys.end; begin += CollisionBatch::MaxSize) {
+			
+			size_t end = std::min(polys.end, begin + CollisionBatch::MaxSize);
 			
-			if(ep.type & (POLY_WATER | POLY_TRANS | POLY_NOCOL))
+			CollisionBatch batch;
+			batchPolyInCylinder(bc, begin, end, cyl, (flags & CFLAG_EXTRA_PRECISION) != 0,
+			                    CylinderTestAnchor, POLY_WATER | POLY_TRANS | POLY_NOCOL, batch);
+			if(!batch.hits)
 				continue;
 			
-			if(ep.min.y < anything) {
-				float minanything = std::min(anything, ANCHOR_IsPolyInCylinder(ep, cyl, flags));
-				
-				if(anything != minanything)
-					anything = minanything;
+			for(size_t k = begin; k < end; k++) {
+				if(bc.minY[k] < anything)
+					anything = std::min(anything, batch.height[k - begin]);
 			}
 		}
 	}
@@ -274,9 +197,11 @@ static float ANCHOR_CheckAnythingInCylinder(const Cylinder & cyl, CollisionFlags
 	return anything;
 }
 
-extern long MOVING_CYLINDER;
-static bool ANCHOR_AttemptValidCylinderPos(Cylinder & cyl, Entity * io,
-	                                         CollisionFlags flags) {
+/*!
+ * Anchor generation runs on several threads, so unlike AttemptValidCylinderPos() this
+ * doesn't use any global state. Set moving when testing a cylinder moving between anchors.
+ */
+static bool ANCHOR_AttemptValidCylinderPos(Cylinder & cyl, bool moving, CollisionFlags flags) {
 	
 	float anything = ANCHOR_CheckAnythingInCylinder(cyl, flags);
 
@@ -304,47 +229,10 @@ static bool ANCHOR_AttemptValidCylinderPos(Cylinder & cyl, Entity * io,
 		anything = tmp.origin.y - cyl.origin.y;
 	}
 
-	if(MOVING_CYLINDER) {
-		if(flags & CFLAG_NPC) {
-			float tolerate;
-
-			if(io
-			   && (io->ioflags & IO_NPC)
-			   && (io->_npcdata->pathfind.listnb > 0)
-			   && (io->_npcdata->pathfind.listpos < io->_npcdata->pathfind.listnb)
-			) {
-				tolerate = -80;
-			} else {
-				tolerate = -45;
-			}
-
-			if(anything < tolerate)
-				return false;
-		}
-
-		if(io && !(flags & CFLAG_JUST_TEST)) {
-			if((flags & CFLAG_PLAYER) && anything < 0.f) {
-				if(player.jumpphase != NotJumping) {
-					io->_npcdata->climb_count = MAX_ALLOWED_PER_SECOND;
-					return false;
-				}
-
-				float dist = std::max(glm::length(vector2D), 1.f);
-				float pente;
-				pente = glm::abs(anything) / dist * ( 1.0f / 2 ); 
-				io->_npcdata->climb_count += pente;
-
-				if(io->_npcdata->climb_count > MAX_ALLOWED_PER_SECOND) {
-					io->_npcdata->climb_count = MAX_ALLOWED_PER_SECOND;
-					return false;
-				}
-
-				if(anything < -55) {
-					io->_npcdata->climb_count = MAX_ALLOWED_PER_SECOND;
-					return false;
-				}
-			}
-		}
+	if(moving) {
+		// Anchors are generated without entities, so use the tolerance for idle NPCs
+		if((flags & CFLAG_NPC) && anything < -45)
+			return false;
 	} else if(anything < -45) {
 		return false;
 	}
@@ -378,23 +266,18 @@ static bool ANCHOR_AttemptValidCylinderPos(Cylinder & cyl, Entity * io,
 }
 
 
-static bool ANCHOR_ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, Entity * io,
-                                               float MOVE_CYLINDER_STEP,
+static bool ANCHOR_ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, float MOVE_CYLINDER_STEP,
                                                CollisionFlags flags) {
 	
-	MOVING_CYLINDER = 1;
-	DIRECT_PATH = true;
 	IO_PHYSICS test;
 
 	if(ip == NULL) {
-		MOVING_CYLINDER = 0;
 		return false;
 	}
 
 	float distance = glm::distance(ip->startpos, ip->targetpos);
 
 	if(distance <= 0.f) {
-		MOVING_CYLINDER = 0;
 		return true; 
 	}
 
@@ -411,16 +294,12 @@ static bool ANCHOR_ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, Entity * io,
 
 		// uses test struct to simulate movement.
 		test.cyl.origin += mvector * curmovedist;
-		
-		vector2D.x = mvector.x * curmovedist;
-		vector2D.y = 0.f;
-		vector2D.z = mvector.z * curmovedist;
 
 		if ((flags & CFLAG_CHECK_VALID_POS)
 		        && (CylinderAboveInvalidZone(test.cyl)))
 			return false;
 
-		if(ANCHOR_AttemptValidCylinderPos(test.cyl, io, flags)) {
+		if(ANCHOR_AttemptValidCylinderPos(test.cyl, true, flags)) {
 			*ip = test;
 
 		} else {
@@ -428,13 +307,12 @@ static bool ANCHOR_ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, Entity * io,
 				test.cyl = ip->cyl;
 				test.cyl.origin.y += mvector.y * curmovedist;
 
-				if(ANCHOR_AttemptValidCylinderPos(test.cyl, io, flags)) {
+				if(ANCHOR_AttemptValidCylinderPos(test.cyl, true, flags)) {
 					*ip = test;
 					goto oki;
 				}
 			}
 
-			DIRECT_PATH = false;
 			// Must Attempt To Slide along collisions
 			Vec3f vecatt;
 			Vec3f rpos = Vec3f_ZERO;
@@ -462,7 +340,7 @@ static bool ANCHOR_ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, Entity * io,
 				vecatt = VRotateY(mvector, t);
 				test.cyl.origin += vecatt * curmovedist;
 
-				if(ANCHOR_AttemptValidCylinderPos(test.cyl, io, flags)) {
+				if(ANCHOR_AttemptValidCylinderPos(test.cyl, true, flags)) {
 					rpos = test.cyl.origin;
 					RFOUND = 1;
 				}
@@ -474,7 +352,7 @@ static bool ANCHOR_ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, Entity * io,
 				vecatt = VRotateY(mvector, t);
 				test.cyl.origin += vecatt * curmovedist;
 
-				if(ANCHOR_AttemptValidCylinderPos(test.cyl, io, flags)) {
+				if(ANCHOR_AttemptValidCylinderPos(test.cyl, true, flags)) {
 					lpos = test.cyl.origin;
 					LFOUND = 1;
 				}
@@ -503,7 +381,6 @@ static bool ANCHOR_ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, Entity * io,
 				distance -= curmovedist;
 			} else { //stopped
 				ip->velocity = Vec3f_ZERO;
-				MOVING_CYLINDER = 0;
 				return false;
 			}
 		}
@@ -512,7 +389,6 @@ static bool ANCHOR_ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, Entity * io,
 		;
 	}
 
-	MOVING_CYLINDER = 0;
 	return true;
 }
 
@@ -588,6 +464,25 @@ bool CylinderAboveInvalidZone(const Cylinder & cyl) {
 
 	return false;
 }
+static void AddAnchor(EERIE_BACKGROUND * eb, EERIE_BKG_INFO * eg, const Cylinder & cyl) {
+	
+	eg->ianchors = (long *)realloc(eg->ianchors, sizeof(long) * (eg->nbianchors + 1));
+
+	eg->ianchors[eg->nbianchors] = eb->nbanchors;
+	eg->nbianchors++;
+
+	eb->anchors = (ANCHOR_DATA *)realloc(eb->anchors, sizeof(ANCHOR_DATA) * (eb->nbanchors + 1));
+
+	ANCHOR_DATA * ad = &eb->anchors[eb->nbanchors];
+	ad->pos = cyl.origin;
+	ad->height = cyl.height;
+	ad->radius = cyl.radius;
+	ad->linked = NULL;
+	ad->nblinked = 0;
+	ad->flags = 0;
+	eb->nbanchors++;
+}
+
 //*************************************************************************************
 // Adds an Anchor... and tries to generate the best possible cylinder for it
 //*************************************************************************************
@@ -616,7 +511,7 @@ static bool DirectAddAnchor_Original_Method(EERIE_BACKGROUND * eb, EERIE_BKG_INF
 		testcyl = currcyl;
 		testcyl.radius += INC_RADIUS;
 
-		if (ANCHOR_AttemptValidCylinderPos(testcyl, NULL, CFLAG_NO_INTERCOL | CFLAG_EXTRA_PRECISION | CFLAG_ANCHOR_GENERATION))
+		if (ANCHOR_AttemptValidCylinderPos(testcyl, false, CFLAG_NO_INTERCOL | CFLAG_EXTRA_PRECISION | CFLAG_ANCHOR_GENERATION))
 		{
 			currcyl = testcyl;
 			found = 1;
@@ -669,25 +564,15 @@ static bool DirectAddAnchor_Original_Method(EERIE_BACKGROUND * eb, EERIE_BKG_INF
 
 	}
 
-	eg->ianchors = (long *)realloc(eg->ianchors, sizeof(long) * (eg->nbianchors + 1));
-
-	eg->ianchors[eg->nbianchors] = eb->nbanchors;
-	eg->nbianchors++;
-
-	eb->anchors = (ANCHOR_DATA *)realloc(eb->anchors, sizeof(ANCHOR_DATA) * (eb->nbanchors + 1));
-
-	ANCHOR_DATA * ad = &eb->anchors[eb->nbanchors];
-	ad->pos = bestcyl.origin;
-	ad->height = bestcyl.height;
-	ad->radius = bestcyl.radius;
-	ad->linked = NULL;
-	ad->nblinked = 0;
-	ad->flags = 0;
-	eb->nbanchors++;
+	AddAnchor(eb, eg, bestcyl);
 	return true;
 }
 
-static bool AddAnchor_Original_Method(EERIE_BACKGROUND * eb, EERIE_BKG_INFO * eg, Vec3f * pos) {
+/*!
+ * Find the best anchor cylinder near a position.
+ * Only reads the background, so this can be called from several threads.
+ */
+static bool FindAnchorCylinder_Original_Method(const Vec3f * pos, Cylinder & bestcyl) {
 	
 	long found = 0;
 	long best = 0;
@@ -696,7 +581,6 @@ static bool AddAnchor_Original_Method(EERIE_BACKGROUND * eb, EERIE_BKG_INFO * eg
 
 	Cylinder testcyl;
 	Cylinder currcyl;
-	Cylinder bestcyl;
 
 	bestcyl.height = 0;
 	bestcyl.radius = 0;
@@ -722,7 +606,7 @@ static bool AddAnchor_Original_Method(EERIE_BACKGROUND * eb, EERIE_BKG_INFO * eg
 				testcyl = currcyl;
 				testcyl.radius += INC_RADIUS;
 
-				if (ANCHOR_AttemptValidCylinderPos(testcyl, NULL, CFLAG_NO_INTERCOL | CFLAG_EXTRA_PRECISION | CFLAG_ANCHOR_GENERATION))
+				if (ANCHOR_AttemptValidCylinderPos(testcyl, false, CFLAG_NO_INTERCOL | CFLAG_EXTRA_PRECISION | CFLAG_ANCHOR_GENERATION))
 				{
 					currcyl = testcyl;
 					found = 1;
@@ -767,43 +651,6 @@ static bool AddAnchor_Original_Method(EERIE_BACKGROUND * eb, EERIE_BKG_INFO * eg
 	if(CylinderAboveInvalidZone(bestcyl))
 		return false;
 
-	// avoid to recreate same anchor twice...
-	if (0)
-		for (long k = 0; k < eb->nbanchors; k++)
-		{
-			ANCHOR_DATA * ad = &eb->anchors[k];
-
-			if ((ad->pos.x == bestcyl.origin.x)
-			        &&	(ad->pos.y == bestcyl.origin.y)
-			        &&	(ad->pos.z == bestcyl.origin.z))
-			{
-				if (ad->radius >= bestcyl.radius)
-					return false;
-
-				if (ad->radius <= bestcyl.radius)
-				{
-					ad->height = bestcyl.height;
-					ad->radius = bestcyl.radius;
-					return false;
-				}
-			}
-		}
-
-	eg->ianchors = (long *)realloc(eg->ianchors, sizeof(long) * (eg->nbianchors + 1));
-
-	eg->ianchors[eg->nbianchors] = eb->nbanchors;
-	eg->nbianchors++;
-
-	eb->anchors = (ANCHOR_DATA *)realloc(eb->anchors, sizeof(ANCHOR_DATA) * (eb->nbanchors + 1));
-
-	ANCHOR_DATA * ad = &eb->anchors[eb->nbanchors];
-	ad->pos = bestcyl.origin;
-	ad->height = bestcyl.height;
-	ad->radius = bestcyl.radius;
-	ad->linked = NULL;
-	ad->nblinked = 0;
-	ad->flags = 0;
-	eb->nbanchors++;
 	return true;
 }
 
@@ -827,145 +674,134 @@ static void AddAnchorLink(EERIE_BACKGROUND * eb, long anchor, long linked) {
 // Generates Links between Anchors for a background
 //**********************************************************************************************
 
-static void AnchorData_Create_Links_Original_Method(EERIE_BACKGROUND * eb) {
-	
-	Vec3f p1, p2; 
-	long count = 0;
-	long per;
-	long lastper = -1;
-	long total = eb->Zsize * eb->Xsize;
+typedef std::pair<long, long> AnchorLink;
 
-	for(long j = 0; j < eb->Zsize; j++)
-	for(long i = 0; i < eb->Xsize; i++) {
-		per = count / total * 100.f;
+/*!
+ * Find the links from the anchors of one tile to the anchors of neighboring tiles.
+ * Only reads the background, so this can be called from several threads.
+ */
+static void AnchorData_Create_Links_Original_Method(const EERIE_BACKGROUND * eb, long i, long j,
+                                                   std::vector<AnchorLink> & links) {
+	
+	Vec3f p1, p2;
+	
+	const EERIE_BKG_INFO * eg = &eb->fastdata[i][j];
+	long precise = 0;
+	
+	for(long kkk = 0; kkk < eg->nbpolyin; kkk++) {
+		EERIEPOLY * ep = eg->polyin[kkk];
 		
-		if(per != lastper) {
-			LogInfo << "Anchor Links Generation: %" << per;
-			lastper = per;
+		if(ep->type & POLY_PRECISE_PATH) {
+			precise = 1;
+			break;
 		}
+	}
+	
+	
+	for(long k = 0; k < eg->nbianchors; k++) {
+		long ii = glm::clamp(i - 2, 0l, eb->Xsize - 1l);
+		long ia = glm::clamp(i + 2, 0l, eb->Xsize - 1l);
+		long ji = glm::clamp(j - 2, 0l, eb->Zsize - 1l);
+		long ja = glm::clamp(j + 2, 0l, eb->Zsize - 1l);
 		
-		count++;
-		EERIE_BKG_INFO * eg = &eb->fastdata[i][j];
-		long precise = 0;
-		
-		for(long kkk = 0; kkk < eg->nbpolyin; kkk++) {
-			EERIEPOLY * ep = eg->polyin[kkk];
+		for(long j2 = ji; j2 <= ja; j2++)
+		for(long i2 = ii; i2 <= ia; i2++) {
+			const EERIE_BKG_INFO * eg2 = &eb->fastdata[i2][j2];
+			long precise2 = 0;
 			
-			if(ep->type & POLY_PRECISE_PATH) {
-				precise = 1;
-				break;
+			for(long kkk = 0; kkk < eg2->nbpolyin; kkk++) {
+				EERIEPOLY * ep2 = eg2->polyin[kkk];
+				
+				if(ep2->type & POLY_PRECISE_PATH) {
+					precise2 = 1;
+					break;
+				}
 			}
-		}
-		
-		
-		for(long k = 0; k < eg->nbianchors; k++) {
-			long ii = glm::clamp(i - 2, 0l, eb->Xsize - 1l);
-			long ia = glm::clamp(i + 2, 0l, eb->Xsize - 1l);
-			long ji = glm::clamp(j - 2, 0l, eb->Zsize - 1l);
-			long ja = glm::clamp(j + 2, 0l, eb->Zsize - 1l);
 			
-			for(long j2 = ji; j2 <= ja; j2++)
-			for(long i2 = ii; i2 <= ia; i2++) {
-				EERIE_BKG_INFO * eg2 = &eb->fastdata[i2][j2];
-				long precise2 = 0;
+			for(long k2 = 0; k2 < eg2->nbianchors; k2++) {
+				// don't treat currently treated anchor
+				if(eg->ianchors[k] == eg2->ianchors[k2])
+					continue;
 				
-				for(long kkk = 0; kkk < eg2->nbpolyin; kkk++) {
-					EERIEPOLY * ep2 = eg2->polyin[kkk];
-					
-					if(ep2->type & POLY_PRECISE_PATH) {
-						precise2 = 1;
-						break;
-					}
-				}
+				p1 = eb->anchors[eg->ianchors[k]].pos;
+				p2 = eb->anchors[eg2->ianchors[k2]].pos;
+				p1.y += 10.f;
+				p2.y += 10.f;
+				long _onetwo = 0;
+				bool treat = true;
+				float _dist = glm::distance(p1, p2);
+				float dd = glm::distance(Vec2f(p1.x, p1.z), Vec2f(p2.x, p2.z));
 				
-				for(long k2 = 0; k2 < eg2->nbianchors; k2++) {
-					// don't treat currently treated anchor
-					if(eg->ianchors[k] == eg2->ianchors[k2])
-						continue;
-					
-					p1 = eb->anchors[eg->ianchors[k]].pos;
-					p2 = eb->anchors[eg2->ianchors[k2]].pos;
-					p1.y += 10.f;
-					p2.y += 10.f;
-					long _onetwo = 0;
-					bool treat = true;
-					float _dist = glm::distance(p1, p2);
-					float dd = glm::distance(Vec2f(p1.x, p1.z), Vec2f(p2.x, p2.z));
-					
-					if(dd < 5.f)
-						continue;
-					
-					if(dd > 200.f)
-						continue; 
-					
-					if(precise || precise2) {
-						if(_dist > 120.f)
-							continue;
-					} else if(_dist > 200.f) {
+				if(dd < 5.f)
+					continue;
+				
+				if(dd > 200.f)
+					continue; 
+				
+				if(precise || precise2) {
+					if(_dist > 120.f)
 						continue;
+				} else if(_dist > 200.f) {
+					continue;
+				}
+				
+				if(glm::abs(p1.y - p2.y) > dd * 0.9f)
+					continue;
+				
+				IO_PHYSICS ip;
+				ip.startpos = ip.cyl.origin = p1;
+				ip.targetpos = p2;
+				
+				ip.cyl.height = eb->anchors[eg->ianchors[k]].height; 
+				ip.cyl.radius = eb->anchors[eg->ianchors[k]].radius;
+				
+				long t = 2;
+				
+				//TODO check for dead code CFLAG_SPECIAL
+				if(ANCHOR_ARX_COLLISION_Move_Cylinder(&ip, 20, CFLAG_CHECK_VALID_POS | CFLAG_NO_INTERCOL | CFLAG_EASY_SLIDING | CFLAG_NPC | CFLAG_JUST_TEST | CFLAG_EXTRA_PRECISION)) {
+					if(fartherThan(Vec2f(ip.cyl.origin.x, ip.cyl.origin.z), Vec2f(ip.targetpos.x, ip.targetpos.z), 25.f)) { 
+						t--;
+					} else {
+						_onetwo = 1;
 					}
+				} else {
+					t--;
+				}
+				
+				if(t == 1) {
+					ip.startpos = ip.cyl.origin = p2;
+					ip.targetpos = p1;
 					
-					if(glm::abs(p1.y - p2.y) > dd * 0.9f)
-						continue;
-					
-					IO_PHYSICS ip;
-					ip.startpos = ip.cyl.origin = p1;
-					ip.targetpos = p2;
-					
-					ip.cyl.height = eb->anchors[eg->ianchors[k]].height; 
-					ip.cyl.radius = eb->anchors[eg->ianchors[k]].radius;
-					
-					long t = 2;
+					ip.cyl.height = eb->anchors[eg2->ianchors[k2]].height;
+					ip.cyl.radius = eb->anchors[eg2->ianchors[k2]].radius; 
 					
-					//TODO check for dead code CFLAG_SPECIAL
-					if(ANCHOR_ARX_COLLISION_Move_Cylinder(&ip, NULL, 20, CFLAG_CHECK_VALID_POS | CFLAG_NO_INTERCOL | CFLAG_EASY_SLIDING | CFLAG_NPC | CFLAG_JUST_TEST | CFLAG_EXTRA_PRECISION)) {
-						if(fartherThan(Vec2f(ip.cyl.origin.x, ip.cyl.origin.z), Vec2f(ip.targetpos.x, ip.targetpos.z), 25.f)) { 
+					//CFLAG_SPECIAL
+					if(ANCHOR_ARX_COLLISION_Move_Cylinder(&ip, 20, CFLAG_CHECK_VALID_POS | CFLAG_NO_INTERCOL | CFLAG_EASY_SLIDING | CFLAG_NPC | CFLAG_JUST_TEST | CFLAG_EXTRA_PRECISION | CFLAG_RETURN_HEIGHT)) {
+						if(fartherThan(Vec2f(ip.cyl.origin.x, ip.cyl.origin.z), Vec2f(ip.targetpos.x, ip.targetpos.z), 25.f)) {
 							t--;
 						} else {
-							_onetwo = 1;
-						}
-					} else {
-						t--;
-					}
-					
-					if(t == 1) {
-						ip.startpos = ip.cyl.origin = p2;
-						ip.targetpos = p1;
-						
-						ip.cyl.height = eb->anchors[eg2->ianchors[k2]].height;
-						ip.cyl.radius = eb->anchors[eg2->ianchors[k2]].radius; 
-						
-						//CFLAG_SPECIAL
-						if(ANCHOR_ARX_COLLISION_Move_Cylinder(&ip, NULL, 20, CFLAG_CHECK_VALID_POS | CFLAG_NO_INTERCOL | CFLAG_EASY_SLIDING | CFLAG_NPC | CFLAG_JUST_TEST | CFLAG_EXTRA_PRECISION | CFLAG_RETURN_HEIGHT)) {
-							if(fartherThan(Vec2f(ip.cyl.origin.x, ip.cyl.origin.z), Vec2f(ip.targetpos.x, ip.targetpos.z), 25.f)) {
-								t--;
-							} else {
-								_onetwo |= 2;
-							}
-						} else {
-							t--;
+							_onetwo |= 2;
 						}
 					} else {
 						t--;
 					}
-					
-					if(t <= 0)
-						treat = false;
-					else
-						treat = true;
-					
-					if(treat) {
-						if(_onetwo) {
-							AddAnchorLink(eb, eg->ianchors[k], eg2->ianchors[k2]);
-							AddAnchorLink(eb, eg2->ianchors[k2], eg->ianchors[k]);
-						}
+				} else {
+					t--;
+				}
+				
+				if(t <= 0)
+					treat = false;
+				else
+					treat = true;
+				
+				if(treat) {
+					if(_onetwo) {
+						links.push_back(AnchorLink(eg->ianchors[k], eg2->ianchors[k2]));
 					}
 				}
 			}
 		}
 	}
-	
-	EERIE_PATHFINDER_Create();
 }
 
 static void AnchorData_Create_Phase_II_Original_Method(EERIE_BACKGROUND * eb) {
@@ -1035,7 +871,7 @@ static void AnchorData_Create_Phase_II_Original_Method(EERIE_BACKGROUND * eb) {
 					if(ep2->type & POLY_NOPATH)
 						continue;
 					
-					if(ANCHOR_AttemptValidCylinderPos(currcyl, NULL, CFLAG_NO_INTERCOL | CFLAG_EXTRA_PRECISION | CFLAG_RETURN_HEIGHT | CFLAG_ANCHOR_GENERATION)) {
+					if(ANCHOR_AttemptValidCylinderPos(currcyl, false, CFLAG_NO_INTERCOL | CFLAG_EXTRA_PRECISION | CFLAG_RETURN_HEIGHT | CFLAG_ANCHOR_GENERATION)) {
 						EERIEPOLY * ep2 = ANCHOR_CheckInPolyPrecis(currcyl.origin + Vec3f(0.f, -10.f, 0.f));
 						
 						if(!ep2)
@@ -1064,136 +900,455 @@ static void AnchorData_Create_Phase_II_Original_Method(EERIE_BACKGROUND * eb) {
 
 }
 
-void AnchorData_Create(EERIE_BACKGROUND * eb) {
+/*!
+ * Find the anchors for one tile.
+ * Only reads the background, so this can be called from several threads.
+ */
+static void AnchorData_Create_Phase_I_Original_Method(const EERIE_BACKGROUND * eb, long i, long j,
+                                                     std::vector<Cylinder> & anchors) {
 	
-	AnchorData_ClearAll(eb);
 	Vec3f pos;
-
-	float count = 0;
-	long lastper	=	-1;
-	long per;
-	float total		=	static_cast<float>(eb->Zsize * eb->Xsize * 9);
-
-	for(long j = 0; j < eb->Zsize; j++)
-	for(long i = 0; i < eb->Xsize; i++) {
-		long LASTFOUND = 0;
+	long LASTFOUND = 0;
+	
+	for(long divv = 0; divv < 9 && !LASTFOUND; divv++) {
+		long divvx = divv % 3;
+		long divvy = divv / 3;
 		
-		for(long divv = 0; divv < 9; divv++) {
-			long divvx, divvy;
-			
-			switch (divv) {
-			case 0:
-				divvx = 0;
-				divvy = 0;
-				break;
-			case 1:
-				divvx = 1;
-				divvy = 0;
-				break;
-			case 2:
-				divvx = 2;
-				divvy = 0;
-				break;
-			case 3:
-				divvx = 0;
-				divvy = 1;
-				break;
-			case 4:
-				divvx = 1;
-				divvy = 1;
-				break;
-			case 5:
-				divvx = 2;
-				divvy = 1;
-				break;
-			case 6:
-				divvx = 0;
-				divvy = 2;
-				break;
-			case 7:
-				divvx = 1;
-				divvy = 2;
-				break;
-			case 8:
-				divvx = 2;
-				divvy = 2;
-				break;
-			}
-			
-			per = count / total * 100.f;
+		pos.x = (float)((float)((float)i + 0.33f * (float)divvx) * (float)eb->Xdiv);
+		pos.y = 0.f;
+		pos.z = (float)((float)((float)j + 0.33f * (float)divvy) * (float)eb->Zdiv);
+		EERIEPOLY * ep = GetMinPoly(pos);
+		Cylinder currcyl;
+		currcyl.radius = 20 - (4.f * divv);
+		currcyl.height = -120.f;
+		currcyl.origin = pos;
+		
+		if(!ep)
+			continue;
+		
+		EERIEPOLY * epmax;
+		epmax = GetMaxPoly(pos);
+		float roof = 9999999.f;
+		
+		roof = ep->min.y - 300;
+		
+		if(epmax)
+			roof = epmax->min.y - 300;
+		
+		float current_y = ep->max.y;
+		
+		while(current_y > roof) {
+			currcyl.origin.y = current_y;
+			EERIEPOLY * ep2 = ANCHOR_CheckInPolyPrecis(currcyl.origin + Vec3f(0.f, -30.f, 0.f));
 			
-			if(per != lastper) {
-				LogInfo << "Anchor Generation: %" << per;
-				lastper = per;
+			if(   ep2
+			   && !(ep2->type & POLY_DOUBLESIDED)
+			   && (ep2->norm.y > 0.f)
+			) {
+				ep2 = NULL;
 			}
 			
-			count += 1.f;
-			
-			if(LASTFOUND)
-				break;
-			
-			EERIE_BKG_INFO * eg = &eb->fastdata[i][j];
-			pos.x = (float)((float)((float)i + 0.33f * (float)divvx) * (float)eb->Xdiv);
-			pos.y = 0.f;
-			pos.z = (float)((float)((float)j + 0.33f * (float)divvy) * (float)eb->Zdiv);
-			EERIEPOLY * ep = GetMinPoly(pos);
-			Cylinder currcyl;
-			currcyl.radius = 20 - (4.f * divv);
-			currcyl.height = -120.f;
-			currcyl.origin = pos;
-			
-			if(ep) {
-				EERIEPOLY * epmax;
-				epmax = GetMaxPoly(pos);
-				float roof = 9999999.f;
+			if(ep2 && !(ep2->type & POLY_NOPATH)) {
+				bool bval = ANCHOR_AttemptValidCylinderPos(currcyl, false, CFLAG_NO_INTERCOL | CFLAG_EXTRA_PRECISION | CFLAG_RETURN_HEIGHT | CFLAG_ANCHOR_GENERATION);
 				
-				roof = ep->min.y - 300;
-				
-				if(epmax)
-					roof = epmax->min.y - 300;
-				
-				float current_y = ep->max.y;
-				
-				while(current_y > roof) {
-					currcyl.origin.y = current_y;
-					EERIEPOLY * ep2 = ANCHOR_CheckInPolyPrecis(currcyl.origin + Vec3f(0.f, -30.f, 0.f));
-					
-					if(   ep2
-					   && !(ep2->type & POLY_DOUBLESIDED)
-					   && (ep2->norm.y > 0.f)
-					) {
-						ep2 = NULL;
-					}
+				if(   bval
+				   && currcyl.origin.y - 10.f <= current_y
+				) {
+					EERIEPOLY * ep2 = ANCHOR_CheckInPolyPrecis(currcyl.origin + Vec3f(0.f, -38.f, 0.f));
+					Cylinder bestcyl;
 					
-					if(ep2 && !(ep2->type & POLY_NOPATH)) {
-						bool bval = ANCHOR_AttemptValidCylinderPos(currcyl, NULL, CFLAG_NO_INTERCOL | CFLAG_EXTRA_PRECISION | CFLAG_RETURN_HEIGHT | CFLAG_ANCHOR_GENERATION);
-						
-						if(   bval
-						   && currcyl.origin.y - 10.f <= current_y
-						) {
-							EERIEPOLY * ep2 = ANCHOR_CheckInPolyPrecis(currcyl.origin + Vec3f(0.f, -38.f, 0.f));
-							
-							if(ep2 && !(ep2->type & POLY_DOUBLESIDED) && (ep2->norm.y > 0.f)) {
-								current_y -= 10.f;
-							} else if ((ep2) && (ep2->type & POLY_NOPATH)) {
-								current_y -= 10.f;
-							} else if (AddAnchor_Original_Method(eb, eg, &currcyl.origin)) {
-								LASTFOUND++;
-								current_y = currcyl.origin.y + currcyl.height;
-							} else {
-								current_y -= 10.f;
-							}
-						} else {
-							current_y -= 10.f;
-						}
+					if(ep2 && !(ep2->type & POLY_DOUBLESIDED) && (ep2->norm.y > 0.f)) {
+						current_y -= 10.f;
+					} else if ((ep2) && (ep2->type & POLY_NOPATH)) {
+						current_y -= 10.f;
+					} else if (FindAnchorCylinder_Original_Method(&currcyl.origin, bestcyl)) {
+						anchors.push_back(bestcyl);
+						LASTFOUND++;
+						current_y = currcyl.origin.y + currcyl.height;
 					} else {
 						current_y -= 10.f;
 					}
+				} else {
+					current_y -= 10.f;
 				}
+			} else {
+				current_y -= 10.f;
+			}
+		}
+	}
+	
+}
+
+//! Number of worker threads used to generate anchors
+static const size_t ANCHOR_GENERATION_THREADS = 4;
+
+/*!
+ * Processes all tiles of a background using worker threads.
+ *
+ * Tiles are handed out in order but may finish in any order, so process() must only
+ * read shared data and store its results per tile. The caller then merges them in tile
+ * order, which makes the result independent of the number of threads.
+ */
+class AnchorTileJob {
+	
+	class Worker : public Thread {
+		
+		AnchorTileJob & m_job;
+		
+	public:
+		
+		explicit Worker(AnchorTileJob & job) : m_job(job) {
+			setThreadName("Anchor Generator");
+		}
+		
+	protected:
+		
+		void run() {
+			long tile;
+			while(m_job.next(tile)) {
+				m_job.process(tile % m_job.m_width, tile / m_job.m_width);
+			}
+		}
+		
+	};
+	
+	const char * m_name;
+	long m_width;
+	long m_count;
+	long m_next;
+	long m_percent;
+	Lock m_lock;
+	
+	friend class Worker;
+	
+	bool next(long & tile) {
+		
+		Autolock lock(m_lock);
+		
+		if(m_next == m_count) {
+			return false;
+		}
+		
+		tile = m_next++;
+		
+		long percent = tile * 100 / m_count;
+		if(percent != m_percent) {
+			LogInfo << m_name << ": %" << percent;
+			m_percent = percent;
+		}
+		
+		return true;
+	}
+	
+protected:
+	
+	virtual void process(long i, long j) = 0;
+	
+public:
+	
+	AnchorTileJob(const char * name, const EERIE_BACKGROUND * eb)
+		: m_name(name), m_width(eb->Xsize), m_count(eb->Xsize * eb->Zsize), m_next(0),
+		  m_percent(-1) { }
+	
+	virtual ~AnchorTileJob() { }
+	
+	void run() {
+		
+		std::vector<Worker *> workers;
+		for(size_t i = 0; i < ANCHOR_GENERATION_THREADS; i++) {
+			workers.push_back(new Worker(*this));
+			workers.back()->start();
+		}
+		
+		for(size_t i = 0; i < workers.size(); i++) {
+			workers[i]->waitForCompletion();
+			delete workers[i];
+		}
+		
+	}
+	
+};
+
+class AnchorCreateJob : public AnchorTileJob {
+	
+	const EERIE_BACKGROUND * m_eb;
+	
+protected:
+	
+	void process(long i, long j) {
+		AnchorData_Create_Phase_I_Original_Method(m_eb, i, j, anchors[j * m_eb->Xsize + i]);
+	}
+	
+public:
+	
+	std::vector< std::vector<Cylinder> > anchors; //!< Anchors found for each tile
+	
+	explicit AnchorCreateJob(const EERIE_BACKGROUND * eb)
+		: AnchorTileJob("Anchor Generation", eb), m_eb(eb), anchors(eb->Xsize * eb->Zsize) { }
+	
+};
+
+class AnchorLinkJob : public AnchorTileJob {
+	
+	const EERIE_BACKGROUND * m_eb;
+	
+protected:
+	
+	void process(long i, long j) {
+		AnchorData_Create_Links_Original_Method(m_eb, i, j, links[j * m_eb->Xsize + i]);
+	}
+	
+public:
+	
+	std::vector< std::vector<AnchorLink> > links; //!< Links found for each tile
+	
+	explicit AnchorLinkJob(const EERIE_BACKGROUND * eb)
+		: AnchorTileJob("Anchor Links Generation", eb), m_eb(eb), links(eb->Xsize * eb->Zsize) { }
+	
+};
+
+//! Increment when anchor generation changes to invalidate existing cache files
+static const u32 ANCHOR_CACHE_VERSION = 1;
+
+#pragma pack(push,1)
+
+struct ANCHOR_CACHE_HEADER {
+	u32 version;
+	u32 hash;
+	s32 sizex;
+	s32 sizez;
+	s32 nb_anchors;
+};
+
+#pragma pack(pop)
+
+//! Hash everything anchor generation depends on
+static u32 AnchorData_GetGeometryHash(const EERIE_BACKGROUND * eb) {
+	
+	boost::crc_32_type crc;
+	
+	s32 size[2] = { s32(eb->Xsize), s32(eb->Zsize) };
+	crc.process_bytes(size, sizeof(size));
+	f32 div[2] = { f32(eb->Xdiv), f32(eb->Zdiv) };
+	crc.process_bytes(div, sizeof(div));
+	
+	for(long j = 0; j < eb->Zsize; j++)
+	for(long i = 0; i < eb->Xsize; i++) {
+		const EERIE_BKG_INFO & eg = eb->fastdata[i][j];
+		for(long k = 0; k < eg.nbpoly; k++) {
+			const EERIEPOLY & ep = eg.polydata[k];
+			s32 type = ep.type;
+			crc.process_bytes(&type, sizeof(type));
+			long count = (ep.type & POLY_QUAD) ? 4 : 3;
+			for(long n = 0; n < count; n++) {
+				f32 p[3] = { ep.v[n].p.x, ep.v[n].p.y, ep.v[n].p.z };
+				crc.process_bytes(p, sizeof(p));
 			}
 		}
 	}
+	
+	return crc.checksum();
+}
+
+static fs::path AnchorData_GetCachePath(u32 hash) {
+	
+	if(fs::paths.user.empty()) {
+		return fs::path();
+	}
+	
+	std::ostringstream oss;
+	oss << std::hex << std::setfill('0') << std::setw(8) << hash << ".anchors";
+	
+	return fs::paths.user / "cache" / "anchors" / oss.str();
+}
+
+template <typename T>
+static const T * AnchorCache_Read(const char * & data, const char * end, size_t n = 1) {
+	
+	size_t toread = sizeof(T) * n;
+	if(size_t(end - data) < toread) {
+		return NULL;
+	}
+	
+	const T * result = reinterpret_cast<const T *>(data);
+	data += toread;
+	
+	return result;
+}
+
+//! \return true if all n indices are valid anchor indices
+static bool AnchorCache_CheckIndices(const s32 * indices, size_t n, long nbanchors) {
+	
+	for(size_t k = 0; k < n; k++) {
+		if(indices[k] < 0 || indices[k] >= nbanchors) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static bool AnchorData_LoadCache(EERIE_BACKGROUND * eb, const fs::path & file, u32 hash) {
+	
+	std::string buffer = fs::read(file);
+	const char * data = buffer.data();
+	const char * end = data + buffer.size();
+	
+	const ANCHOR_CACHE_HEADER * header = AnchorCache_Read<ANCHOR_CACHE_HEADER>(data, end);
+	if(!header || header->version != ANCHOR_CACHE_VERSION || header->hash != hash
+	   || header->sizex != eb->Xsize || header->sizez != eb->Zsize || header->nb_anchors < 0) {
+		return false;
+	}
+	
+	eb->nbanchors = header->nb_anchors;
+	eb->anchors = (ANCHOR_DATA *)malloc(sizeof(ANCHOR_DATA) * std::max(eb->nbanchors, 1l));
+	for(long i = 0; i < eb->nbanchors; i++) {
+		eb->anchors[i].linked = NULL;
+		eb->anchors[i].nblinked = 0;
+	}
+	
+	for(long j = 0; j < eb->Zsize; j++)
+	for(long i = 0; i < eb->Xsize; i++) {
+		
+		const s32 * count = AnchorCache_Read<s32>(data, end);
+		if(!count || *count < 0 || *count > eb->nbanchors) {
+			return false;
+		}
+		
+		const s32 * ianchors = AnchorCache_Read<s32>(data, end, *count);
+		if(!ianchors || !AnchorCache_CheckIndices(ianchors, *count, eb->nbanchors)) {
+			return false;
+		}
+		
+		EERIE_BKG_INFO & eg = eb->fastdata[i][j];
+		if(*count > 0) {
+			eg.ianchors = (long *)malloc(sizeof(long) * *count);
+			eg.nbianchors = short(*count);
+			std::copy(ianchors, ianchors + *count, eg.ianchors);
+		}
+	}
+	
+	for(long i = 0; i < eb->nbanchors; i++) {
+		
+		const FAST_ANCHOR_DATA * fad = AnchorCache_Read<FAST_ANCHOR_DATA>(data, end);
+		if(!fad || fad->nb_linked < 0 || fad->nb_linked > eb->nbanchors) {
+			return false;
+		}
+		
+		const s32 * links = AnchorCache_Read<s32>(data, end, fad->nb_linked);
+		if(!links || !AnchorCache_CheckIndices(links, fad->nb_linked, eb->nbanchors)) {
+			return false;
+		}
+		
+		ANCHOR_DATA & ad = eb->anchors[i];
+		ad.pos = fad->pos.toVec3();
+		ad.radius = fad->radius;
+		ad.height = fad->height;
+		ad.flags = AnchorFlags::load(fad->flags);
+		if(fad->nb_linked > 0) {
+			ad.linked = (long *)malloc(sizeof(long) * fad->nb_linked);
+			ad.nblinked = fad->nb_linked;
+			std::copy(links, links + fad->nb_linked, ad.linked);
+		}
+	}
+	
+	return data == end;
+}
+
+static bool AnchorData_SaveCache(const EERIE_BACKGROUND * eb, const fs::path & file, u32 hash) {
+	
+	if(!fs::create_directories(file.parent())) {
+		return false;
+	}
+	
+	fs::ofstream ofs(file, fs::fstream::out | fs::fstream::binary | fs::fstream::trunc);
+	if(!ofs.is_open()) {
+		return false;
+	}
+	
+	ANCHOR_CACHE_HEADER header;
+	header.version = ANCHOR_CACHE_VERSION;
+	header.hash = hash;
+	header.sizex = eb->Xsize;
+	header.sizez = eb->Zsize;
+	header.nb_anchors = eb->nbanchors;
+	ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	
+	for(long j = 0; j < eb->Zsize; j++)
+	for(long i = 0; i < eb->Xsize; i++) {
+		const EERIE_BKG_INFO & eg = eb->fastdata[i][j];
+		s32 count = eg.nbianchors;
+		ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+		for(long k = 0; k < eg.nbianchors; k++) {
+			s32 anchor = eg.ianchors[k];
+			ofs.write(reinterpret_cast<const char *>(&anchor), sizeof(anchor));
+		}
+	}
+	
+	for(long i = 0; i < eb->nbanchors; i++) {
+		const ANCHOR_DATA & ad = eb->anchors[i];
+		FAST_ANCHOR_DATA fad;
+		fad.pos = ad.pos;
+		fad.radius = ad.radius;
+		fad.height = ad.height;
+		fad.nb_linked = ad.nblinked;
+		fad.flags = ad.flags;
+		ofs.write(reinterpret_cast<const char *>(&fad), sizeof(fad));
+		for(long k = 0; k < ad.nblinked; k++) {
+			s32 link = ad.linked[k];
+			ofs.write(reinterpret_cast<const char *>(&link), sizeof(link));
+		}
+	}
+	
+	return !ofs.fail();
+}
 
+void AnchorData_Create(EERIE_BACKGROUND * eb) {
+	
+	AnchorData_ClearAll(eb);
+	
+	u32 hash = AnchorData_GetGeometryHash(eb);
+	fs::path cache = AnchorData_GetCachePath(hash);
+	if(!cache.empty() && fs::is_regular_file(cache)) {
+		if(AnchorData_LoadCache(eb, cache, hash)) {
+			LogInfo << "Loaded " << eb->nbanchors << " anchors from " << cache;
+			EERIE_PATHFINDER_Create();
+			return;
+		}
+		LogWarning << "Ignoring invalid anchor cache " << cache;
+		AnchorData_ClearAll(eb);
+	}
+	
+	{
+		AnchorCreateJob job(eb);
+		job.run();
+		for(long j = 0; j < eb->Zsize; j++)
+		for(long i = 0; i < eb->Xsize; i++) {
+			const std::vector<Cylinder> & anchors = job.anchors[j * eb->Xsize + i];
+			for(size_t k = 0; k < anchors.size(); k++) {
+				AddAnchor(eb, &eb->fastdata[i][j], anchors[k]);
+			}
+		}
+	}
+	
+	// Depends on the anchors added before, so this can't be done in parallel
 	AnchorData_Create_Phase_II_Original_Method(eb);
-	AnchorData_Create_Links_Original_Method(eb);
+	
+	{
+		AnchorLinkJob job(eb);
+		job.run();
+		for(size_t tile = 0; tile < job.links.size(); tile++) {
+			const std::vector<AnchorLink> & links = job.links[tile];
+			for(size_t k = 0; k < links.size(); k++) {
+				AddAnchorLink(eb, links[k].first, links[k].second);
+				AddAnchorLink(eb, links[k].second, links[k].first);
+			}
+		}
+	}
+	
+	if(!cache.empty() && !AnchorData_SaveCache(eb, cache, hash)) {
+		LogWarning << "Could not save anchor cache " << cache;
+	}
+	
+	EERIE_PATHFINDER_Create();
 }
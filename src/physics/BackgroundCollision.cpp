@@ -0,0 +1,220 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "physics/BackgroundCollision.h"
+
+#include <algorithm>
+
+#include "graphics/data/Mesh.h"
+
+BackgroundCollision backgroundCollision;
+
+namespace {
+
+const BackgroundCollision::Range emptyRange = { 0, 0, 0.f, -1.f };
+
+} // anonymous namespace
+
+void BackgroundCollision::add(EERIEPOLY * ep) {
+	
+	type.push_back(ep->type);
+	minY.push_back(ep->min.y);
+	maxY.push_back(ep->max.y);
+	boundsXZ.push_back(Vec4f(ep->min.x, ep->min.z, ep->max.x, ep->max.z));
+	poly.push_back(ep);
+	
+	for(size_t n = 0; n < 4; n++) {
+		geometry.x[n].push_back(ep->v[n].p.x);
+		geometry.y[n].push_back(ep->v[n].p.y);
+		geometry.z[n].push_back(ep->v[n].p.z);
+	}
+	geometry.centerX.push_back(ep->center.x);
+	geometry.centerY.push_back(ep->center.y);
+	geometry.centerZ.push_back(ep->center.z);
+	geometry.area.push_back(ep->area);
+	geometry.normY.push_back(ep->norm.y);
+	
+	// Same computation as GetTruePolyY() so that the results are identical
+	Vec3f s21 = ep->v[1].p - ep->v[0].p;
+	Vec3f s31 = ep->v[2].p - ep->v[0].p;
+	Vec4f plane;
+	plane.y = (s21.z * s31.x) - (s21.x * s31.z);
+	plane.x = (s21.y * s31.z) - (s21.z * s31.y);
+	plane.z = (s21.x * s31.y) - (s21.y * s31.x);
+	plane.w = ep->v[0].p.x * plane.x + ep->v[0].p.y * plane.y + ep->v[0].p.z * plane.z;
+	geometry.plane.push_back(plane);
+}
+
+void BackgroundCollision::computeBoundsY(Range & range) const {
+	
+	range.minY = 0.f;
+	range.maxY = -1.f;
+	
+	if(range.begin == range.end) {
+		return;
+	}
+	
+	range.minY = *std::min_element(minY.begin() + range.begin, minY.begin() + range.end);
+	range.maxY = *std::max_element(maxY.begin() + range.begin, maxY.begin() + range.end);
+}
+
+void BackgroundCollision::pad() {
+	
+	minY.resize(poly.size() + PADDING, 0.f);
+	maxY.resize(poly.size() + PADDING, 0.f);
+	
+	for(size_t n = 0; n < 4; n++) {
+		geometry.x[n].resize(poly.size() + PADDING, 0.f);
+		geometry.y[n].resize(poly.size() + PADDING, 0.f);
+		geometry.z[n].resize(poly.size() + PADDING, 0.f);
+	}
+	geometry.centerX.resize(poly.size() + PADDING, 0.f);
+	geometry.centerY.resize(poly.size() + PADDING, 0.f);
+	geometry.centerZ.resize(poly.size() + PADDING, 0.f);
+	geometry.area.resize(poly.size() + PADDING, 0.f);
+	geometry.normY.resize(poly.size() + PADDING, 0.f);
+	
+}
+
+void BackgroundCollision::build(const EERIE_BACKGROUND & bkg) {
+	
+	clear();
+	
+	size_t count = 0;
+	for(long x = 0; x < bkg.Xsize; x++) {
+		for(long z = 0; z < bkg.Zsize; z++) {
+			count += bkg.fastdata[x][z].nbpoly + bkg.fastdata[x][z].nbpolyin;
+		}
+	}
+	
+	type.reserve(count);
+	minY.reserve(count + PADDING);
+	maxY.reserve(count + PADDING);
+	boundsXZ.reserve(count);
+	poly.reserve(count);
+	for(size_t n = 0; n < 4; n++) {
+		geometry.x[n].reserve(count + PADDING);
+		geometry.y[n].reserve(count + PADDING);
+		geometry.z[n].reserve(count + PADDING);
+	}
+	geometry.centerX.reserve(count + PADDING);
+	geometry.centerY.reserve(count + PADDING);
+	geometry.centerZ.reserve(count + PADDING);
+	geometry.area.reserve(count + PADDING);
+	geometry.normY.reserve(count + PADDING);
+	geometry.plane.reserve(count);
+	
+	m_depth = bkg.Zsize;
+	m_polys.resize(size_t(bkg.Xsize) * size_t(bkg.Zsize));
+	m_polysIn.resize(m_polys.size());
+	
+	for(long x = 0; x < bkg.Xsize; x++) {
+		for(long z = 0; z < bkg.Zsize; z++) {
+			
+			const EERIE_BKG_INFO & eg = bkg.fastdata[x][z];
+			
+			Range & polys = m_polys[x * m_depth + z];
+			polys.begin = poly.size();
+			for(long i = 0; i < eg.nbpoly; i++) {
+				add(&eg.polydata[i]);
+			}
+			polys.end = poly.size();
+			computeBoundsY(polys);
+			
+			Range & polysIn = m_polysIn[x * m_depth + z];
+			polysIn.begin = poly.size();
+			for(long i = 0; i < eg.nbpolyin; i++) {
+				add(eg.polyin[i]);
+			}
+			polysIn.end = poly.size();
+			computeBoundsY(polysIn);
+			
+		}
+	}
+	
+	pad();
+	
+}
+
+void BackgroundCollision::clear() {
+	type.clear();
+	minY.clear();
+	maxY.clear();
+	boundsXZ.clear();
+	geometry = Geometry();
+	poly.clear();
+	m_depth = 0;
+	m_polys.clear();
+	m_polysIn.clear();
+}
+
+const BackgroundCollision::Range & BackgroundCollision::getRange(const std::vector<Range> & ranges,
+                                                                 long x, long z) const {
+	size_t i = size_t(x * m_depth + z);
+	return (i < ranges.size()) ? ranges[i] : emptyRange;
+}
+
+int BackgroundCollision::containsXZ(size_t i, float x, float z) const {
+	
+	float vx[4], vz[4];
+	for(size_t n = 0; n < 4; n++) {
+		vx[n] = geometry.x[n][i];
+		vz[n] = geometry.z[n][i];
+	}
+	
+	int c = 0, d = 0;
+	
+	for(int k = 0, l = 2; k < 3; l = k++) {
+		if((((vz[k] <= z) && (z < vz[l])) || ((vz[l] <= z) && (z < vz[k])))
+		   && (x < (vx[l] - vx[k]) * (z - vz[k]) / (vz[l] - vz[k]) + vx[k])) {
+			c = !c;
+		}
+	}
+	
+	if(type[i] & POLY_QUAD) {
+		for(int k = 1, l = 3; k < 4; l = k++) {
+			if((((vz[k] <= z) && (z < vz[l])) || ((vz[l] <= z) && (z < vz[k])))
+			   && (x < (vx[l] - vx[k]) * (z - vz[k]) / (vz[l] - vz[k]) + vx[k])) {
+				d = !d;
+			}
+		}
+	}
+	
+	return c + d;
+}
+
+bool BackgroundCollision::getY(size_t i, const Vec3f & pos, float * ret) const {
+	
+	const Vec4f & plane = geometry.plane[i];
+	
+	if(plane.y == 0.f) {
+		return false;
+	}
+	
+	float y = (plane.w - (plane.x * pos.x) - (plane.z * pos.z)) / plane.y;
+	
+	if(y < minY[i]) {
+		y = minY[i];
+	} else if(y > maxY[i]) {
+		y = maxY[i];
+	}
+	
+	*ret = y;
+	return true;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_PHYSICS_BACKGROUNDCOLLISION_H
+#define ARX_PHYSICS_BACKGROUNDCOLLISION_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "graphics/GraphicsTypes.h"
+#include "math/Types.h"
+
+struct EERIE_BACKGROUND;
+
+/*!
+ * Collision-only copy of the background polygons, stored as a structure of arrays.
+ *
+ * \ref EERIEPOLY also holds transformed vertices, texture coordinates, vertex normals
+ * and other render data, so collision queries touch several cache lines for each
+ * polygon they look at. Here the fields used to reject polygons are kept in separate
+ * packed arrays, and the geometry is only read for polygons that pass these tests.
+ *
+ * Each tile has two ranges of polygons: copies of \ref EERIE_BKG_INFO::polydata and
+ * copies of \ref EERIE_BKG_INFO::polyin, both in the same order as the originals.
+ * The data must be rebuilt whenever the background polygons change.
+ */
+struct BackgroundCollision {
+	
+	/*!
+	 * Number of unused entries at the end of \ref minY, \ref maxY and the \ref Geometry
+	 * arrays so that kernels can always load four consecutive entries
+	 */
+	static const size_t PADDING = 3;
+	
+	/*!
+	 * Polygon geometry that is only needed once the cheap rejection tests passed
+	 *
+	 * Each component is stored in its own array so that the batch kernels in
+	 * CollisionKernels.h can load it for several consecutive polygons at once.
+	 */
+	struct Geometry {
+		
+		std::vector<float> x[4]; //!< X coordinate of each vertex
+		std::vector<float> y[4]; //!< Y coordinate of each vertex
+		std::vector<float> z[4]; //!< Z coordinate of each vertex
+		std::vector<float> centerX;
+		std::vector<float> centerY;
+		std::vector<float> centerZ;
+		std::vector<float> area;
+		std::vector<float> normY; //!< Y component of \ref EERIEPOLY::norm
+		std::vector<Vec4f> plane; //!< Unnormalized plane normal and distance for height queries
+		
+		Vec3f vertex(size_t i, size_t n) const { return Vec3f(x[n][i], y[n][i], z[n][i]); }
+		
+		Vec3f center(size_t i) const { return Vec3f(centerX[i], centerY[i], centerZ[i]); }
+		
+	};
+	
+	//! Polygons [begin, end) in the arrays
+	struct Range {
+		size_t begin;
+		size_t end;
+		float minY; //!< Smallest \ref minY of the polygons in the range
+		float maxY; //!< Largest \ref maxY of the polygons in the range, less than minY if empty
+	};
+	
+	std::vector<PolyType> type;
+	std::vector<float> minY;
+	std::vector<float> maxY;
+	std::vector<Vec4f> boundsXZ; //!< min.x, min.z, max.x and max.z
+	Geometry geometry;
+	std::vector<EERIEPOLY *> poly; //!< Original polygon for each entry
+	
+	BackgroundCollision() : m_depth(0) { }
+	
+	//! Copy the polygons of all tiles
+	void build(const EERIE_BACKGROUND & bkg);
+	
+	void clear();
+	
+	/*!
+	 * Copies of \ref EERIE_BKG_INFO::polydata for a tile
+	 * The range is empty if the data has not been built for the current background.
+	 */
+	const Range & getPolys(long x, long z) const { return getRange(m_polys, x, z); }
+	
+	//! Copies of \ref EERIE_BKG_INFO::polyin for a tile
+	const Range & getPolysIn(long x, long z) const { return getRange(m_polysIn, x, z); }
+	
+	//! Same as \ref PointIn2DPolyXZ() for the original polygon
+	int containsXZ(size_t i, float x, float z) const;
+	
+	//! Same as \ref GetTruePolyY() for the original polygon
+	bool getY(size_t i, const Vec3f & pos, float * ret) const;
+	
+private:
+	
+	void add(EERIEPOLY * ep);
+	
+	void computeBoundsY(Range & range) const;
+	
+	void pad();
+	
+	const Range & getRange(const std::vector<Range> & ranges, long x, long z) const;
+	
+	long m_depth;
+	std::vector<Range> m_polys;
+	std::vector<Range> m_polysIn;
+	
+};
+
+//! Collision data for \ref ACTIVEBKG, rebuilt by \ref EERIEPOLY_Compute_PolyIn()
+extern BackgroundCollision backgroundCollision;
+
+#endif // ARX_PHYSICS_BACKGROUNDCOLLISION_H
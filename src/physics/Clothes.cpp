@@ -46,7 +46,11 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 
 #include "physics/Clothes.h"
 
+#include <algorithm>
 #include <cstring>
+#include <set>
+#include <utility>
+#include <vector>
 
 #include <glm/gtx/norm.hpp>
 
@@ -78,17 +82,18 @@ void MOLLESS_Clear(EERIE_3DOBJ * obj, long flag) {
 	}
 }
 
-static void AddSpring(EERIE_3DOBJ * obj, short vert1, short vert2, float constant,
-                      float damping, long type) {
+//! Clothes vertex pairs that are already connected by a spring, smaller index first
+typedef std::set< std::pair<short, short> > SpringSet;
+
+static void AddSpring(EERIE_3DOBJ * obj, SpringSet & added, short vert1, short vert2,
+                      float constant, float damping, long type) {
 	
 	if(vert1 == -1 || vert2 == -1 || vert1 == vert2) {
 		return;
 	}
 	
-	for(std::vector<EERIE_SPRINGS>::const_iterator i = obj->cdata->springs.begin(); i < obj->cdata->springs.end(); ++i) {
-		if((i->startidx == vert1 && i->endidx == vert2) || (i->startidx == vert2 && i->endidx == vert1)) {
-			return;
-		}
+	if(!added.insert(std::make_pair(std::min(vert1, vert2), std::max(vert1, vert2))).second) {
+		return;
 	}
 	
 	EERIE_SPRINGS newSpring;
@@ -102,15 +107,35 @@ static void AddSpring(EERIE_3DOBJ * obj, short vert1, short vert2, float constan
 	obj->cdata->springs.push_back(newSpring);
 }
 
-static short GetIDXVert(EERIE_3DOBJ * obj, short num) {
-
-	for(short i = 0; i < obj->cdata->nb_cvert; i++) {
-		if(obj->cdata->cvert[i].idx == num)
-			return i;
+/*!
+ * Maps mesh vertices to clothes vertices
+ *
+ * Looking up the selection and clothes vertex lists for each neighbour would make
+ * creating the springs quadratic in the number of vertices.
+ */
+class ClothesVertexMap {
+	
+	std::vector<short> m_index;
+	
+public:
+	
+	explicit ClothesVertexMap(const EERIE_3DOBJ * obj)
+		: m_index(obj->vertexlist.size(), -1) {
+		// Keep the first clothes vertex for each mesh vertex, like a linear search would
+		for(short i = obj->cdata->nb_cvert - 1; i >= 0; i--) {
+			short idx = obj->cdata->cvert[i].idx;
+			if(idx >= 0 && size_t(idx) < m_index.size()) {
+				m_index[idx] = i;
+			}
+		}
 	}
-
-	return -1;
-}
+	
+	//! \return the clothes vertex for a mesh vertex or -1 if it is not in the selection
+	short operator[](short vert) const {
+		return (vert >= 0 && size_t(vert) < m_index.size()) ? m_index[vert] : -1;
+	}
+	
+};
 
 //*************************************************************************************
 // Creates Clothes Data Structure for an object.
@@ -166,12 +191,15 @@ void EERIEOBJECT_AddClothesData(EERIE_3DOBJ * obj) {
 			obj->cdata->cvert[i].coll = -1;
 		}
 
+		ClothesVertexMap clothes(obj);
+		SpringSet springs;
+
 		for(int i = 0; i < obj->cdata->nb_cvert; i++) {
 			for(long j = 0; j < obj->ndata[obj->cdata->cvert[i].idx].nb_Nvertex; j++) {
 				short vert = obj->ndata[obj->cdata->cvert[i].idx].Nvertex[j];
 
-				if(IsInSelection(obj, vert, sel) >= 0) {
-					AddSpring(obj, (short)i, (short)GetIDXVert(obj, vert), 11.f, 0.3f, 0); 
+				if(clothes[vert] >= 0) {
+					AddSpring(obj, springs, (short)i, clothes[vert], 11.f, 0.3f, 0); 
 				} else {
 					obj->cdata->cvert[i].flags |= CLOTHES_FLAG_FIX;
 					obj->cdata->cvert[i].coll = -2;
@@ -188,7 +216,7 @@ void EERIEOBJECT_AddClothesData(EERIE_3DOBJ * obj) {
 				if(vert == obj->cdata->cvert[i].idx)
 					continue; // Cannot add a spring between 1 node :p
 
-				if(IsInSelection(obj, vert, sel) >= 0) {
+				if(clothes[vert] >= 0) {
 					float distance = glm::distance2(obj->vertexlist[obj->cdata->cvert[i].idx].v,
 					                         obj->vertexlist[vert].v) * square(1.2f);
 
@@ -196,7 +224,7 @@ void EERIEOBJECT_AddClothesData(EERIE_3DOBJ * obj) {
 					for(long k = 0; k < obj->ndata[vert].nb_Nvertex; k++) {
 						short ver = obj->ndata[vert].Nvertex[k];
 
-						if(IsInSelection(obj, ver, sel) >= 0) { // This time we have one !
+						if(clothes[ver] >= 0) { // This time we have one !
 							if(ver == obj->cdata->cvert[i].idx)
 								continue;
 
@@ -204,7 +232,7 @@ void EERIEOBJECT_AddClothesData(EERIE_3DOBJ * obj) {
 							                          obj->vertexlist[ver].v);
 
 							if(distance2 < distance) {
-								AddSpring(obj, (short)i, (short)GetIDXVert(obj, ver), 4.2f, 0.7f, 1); 
+								AddSpring(obj, springs, (short)i, clothes[ver], 4.2f, 0.7f, 1); 
 							}
 						}
 					}
@@ -220,12 +248,12 @@ void EERIEOBJECT_AddClothesData(EERIE_3DOBJ * obj) {
 				if(vert == obj->cdata->cvert[i].idx)
 					continue; // Cannot add a spring between 1 node :p
 
-				if(IsInSelection(obj, vert, sel) >= 0) {
+				if(clothes[vert] >= 0) {
 					// We springed it in the previous part of code
 					for(long k = 0; k < obj->ndata[vert].nb_Nvertex; k++) {
 						short ver = obj->ndata[vert].Nvertex[k];
 
-						if(IsInSelection(obj, ver, sel) >= 0) { // This time we have one !
+						if(clothes[ver] >= 0) { // This time we have one !
 							float distance = glm::distance2(obj->vertexlist[obj->cdata->cvert[i].idx].v,
 							                         obj->vertexlist[ver].v) * square(1.2f);
 
@@ -235,16 +263,16 @@ void EERIEOBJECT_AddClothesData(EERIE_3DOBJ * obj) {
 								if(ve == vert)
 									continue;
 
-								if(IsInSelection(obj, ve, sel) >= 0) { // This time we have one !
+								if(clothes[ve] >= 0) { // This time we have one !
 
-									if(obj->cdata->cvert[(short)GetIDXVert(obj, ve)].flags & CLOTHES_FLAG_FIX)
+									if(obj->cdata->cvert[clothes[ve]].flags & CLOTHES_FLAG_FIX)
 										continue;
 
 									float distance2 = glm::distance2(obj->vertexlist[obj->cdata->cvert[i].idx].v,
 									                          obj->vertexlist[ve].v);
 
 									if(distance2 > distance && distance2 < distance * square(2.f)) {
-										AddSpring(obj, (short)i, (short)GetIDXVert(obj, ve), 2.2f, 0.9f, 2);
+										AddSpring(obj, springs, (short)i, clothes[ve], 2.2f, 0.9f, 2);
 									}
 								}
 							}
@@ -0,0 +1,817 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "physics/CollisionKernels.h"
+
+#include <algorithm>
+
+#include <boost/static_assert.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARX_COLLISION_KERNELS_SSE2 1
+#include <emmintrin.h>
+#else
+#define ARX_COLLISION_KERNELS_SSE2 0
+#endif
+
+#if !ARX_COLLISION_KERNELS_SSE2 && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define ARX_COLLISION_KERNELS_NEON 1
+#include <arm_neon.h>
+#else
+#define ARX_COLLISION_KERNELS_NEON 0
+#endif
+
+#include "graphics/Math.h"
+#include "physics/BackgroundCollision.h"
+
+namespace {
+
+/*
+ * Scalar tests for a single polygon.
+ *
+ * These are the original IsPolyInCylinder(), ANCHOR_IsPolyInCylinder() and
+ * IsPolyInSphere() functions working on the compact collision data.
+ * The SIMD kernels below must return exactly the same results.
+ */
+
+float polyInCylinder(const BackgroundCollision & bc, size_t i, const Cylinder & cyl,
+                     bool precise, bool & hit) {
+	
+	hit = false;
+	
+	float minf = cyl.origin.y + cyl.height;
+	float maxf = cyl.origin.y;
+	if(minf > bc.maxY[i] || maxf < bc.minY[i]) {
+		return 999999.f;
+	}
+	
+	const BackgroundCollision::Geometry & geo = bc.geometry;
+	
+	long to = (bc.type[i] & POLY_QUAD) ? 4 : 3;
+	
+	Vec3f v[4];
+	float nearest = 99999999.f;
+	for(long n = 0; n < to; n++) {
+		v[n] = geo.vertex(i, n);
+		float dd = fdist(Vec2f(v[n].x, v[n].z), Vec2f(cyl.origin.x, cyl.origin.z));
+		if(dd < nearest) {
+			nearest = dd;
+		}
+	}
+	
+	if(nearest > std::max(82.f, cyl.radius)) {
+		return 999999.f;
+	}
+	
+	float area = geo.area[i];
+	
+	if(cyl.radius < 30.f || cyl.height > -80.f || area > 5000.f) {
+		precise = true;
+	}
+	
+	if(!precise && area < 100.f) {
+		return 999999.f;
+	}
+	
+	float anything = 999999.f;
+	
+	Vec3f center = geo.center(i);
+	if(PointInCylinder(cyl, &center)) {
+		hit = true;
+		anything = std::min(anything, (geo.normY[i] < 0.5f) ? bc.minY[i] : center.y);
+		if(!precise) {
+			return anything;
+		}
+	}
+	
+	long r = to - 1;
+	Vec3f pos;
+	for(long n = 0; n < to; n++) {
+		
+		if(precise) {
+			for(long o = 0; o < 5; o++) {
+				float p = (float)o * (1.f/5);
+				pos = v[n] * p + center * (1.f - p);
+				if(PointInCylinder(cyl, &pos)) {
+					anything = std::min(anything, pos.y);
+					hit = true;
+				}
+			}
+		}
+		
+		if(area > 2000.f || precise) {
+			pos = (v[n] + v[r]) * 0.5f;
+			if(PointInCylinder(cyl, &pos)) {
+				anything = std::min(anything, pos.y);
+				hit = true;
+				if(!precise) {
+					return anything;
+				}
+			}
+			if(area > 4000.f || precise) {
+				pos = (v[n] + center) * 0.5f;
+				if(PointInCylinder(cyl, &pos)) {
+					anything = std::min(anything, pos.y);
+					hit = true;
+					if(!precise) {
+						return anything;
+					}
+				}
+			}
+			if(area > 6000.f || precise) {
+				pos = (pos + v[n]) * 0.5f;
+				if(PointInCylinder(cyl, &pos)) {
+					anything = std::min(anything, pos.y);
+					hit = true;
+					if(!precise) {
+						return anything;
+					}
+				}
+			}
+		}
+		
+		if(PointInCylinder(cyl, &v[n])) {
+			anything = std::min(anything, v[n].y);
+			hit = true;
+			if(!precise) {
+				return anything;
+			}
+		}
+		
+		r++;
+		if(r >= to) {
+			r = 0;
+		}
+	}
+	
+	if(anything != 999999.f && geo.normY[i] < 0.1f && geo.normY[i] > -0.1f) {
+		anything = std::min(anything, bc.minY[i]);
+	}
+	
+	return anything;
+}
+
+float anchorPolyInCylinder(const BackgroundCollision & bc, size_t i, const Cylinder & cyl,
+                           bool precise) {
+	
+	const BackgroundCollision::Geometry & geo = bc.geometry;
+	
+	float area = geo.area[i];
+	
+	if(!precise && area < 100.f) {
+		return 999999.f;
+	}
+	
+	Vec3f center = geo.center(i);
+	if(PointInCylinder(cyl, &center)) {
+		return (geo.normY[i] < 0.5f) ? bc.minY[i] : center.y;
+	}
+	
+	float minf = std::min(cyl.origin.y, cyl.origin.y + cyl.height);
+	float maxf = std::max(cyl.origin.y, cyl.origin.y + cyl.height);
+	if(minf > bc.maxY[i] || maxf < bc.minY[i]) {
+		return 999999.f;
+	}
+	
+	long to = (bc.type[i] & POLY_QUAD) ? 4 : 3;
+	
+	Vec3f v[4];
+	for(long n = 0; n < to; n++) {
+		v[n] = geo.vertex(i, n);
+	}
+	
+	long r = to - 1;
+	Vec3f pos;
+	for(long n = 0; n < to; n++) {
+		
+		if(precise) {
+			for(long o = 0; o < 5; o++) {
+				float p = (float)o * (1.f/5);
+				pos = v[n] * p + center * (1.f - p);
+				if(PointInCylinder(cyl, &pos)) {
+					return pos.y;
+				}
+			}
+		}
+		
+		if(area > 2000.f || precise) {
+			pos = (v[n] + v[r]) * 0.5f;
+			if(PointInCylinder(cyl, &pos)) {
+				return pos.y;
+			}
+			if(area > 4000.f || precise) {
+				pos = (v[n] + center) * 0.5f;
+				if(PointInCylinder(cyl, &pos)) {
+					return pos.y;
+				}
+			}
+			if(area > 6000.f || precise) {
+				pos = (pos + v[n]) * 0.5f;
+				if(PointInCylinder(cyl, &pos)) {
+					return pos.y;
+				}
+			}
+		}
+		
+		if(PointInCylinder(cyl, &v[n])) {
+			return v[n].y;
+		}
+		
+		r++;
+		if(r >= to) {
+			r = 0;
+		}
+	}
+	
+	return 999999.f;
+}
+
+bool polyInSphere(const BackgroundCollision & bc, size_t i, const Sphere & sph) {
+	
+	const BackgroundCollision::Geometry & geo = bc.geometry;
+	
+	float area = geo.area[i];
+	
+	if(area < 100.f) {
+		return false;
+	}
+	
+	long to = (bc.type[i] & POLY_QUAD) ? 4 : 3;
+	
+	Vec3f v[4];
+	for(long n = 0; n < to; n++) {
+		v[n] = geo.vertex(i, n);
+	}
+	
+	long r = to - 1;
+	Vec3f pos;
+	for(long n = 0; n < to; n++) {
+		if(area > 2000.f) {
+			pos = (v[n] + v[r]) * 0.5f;
+			if(sph.contains(pos)) {
+				return true;
+			}
+			if(area > 4000.f) {
+				pos = (v[n] + geo.center(i)) * 0.5f;
+				if(sph.contains(pos)) {
+					return true;
+				}
+			}
+			if(area > 6000.f) {
+				pos = (pos + v[n]) * 0.5f;
+				if(sph.contains(pos)) {
+					return true;
+				}
+			}
+		}
+		if(sph.contains(v[n])) {
+			return true;
+		}
+		r++;
+		if(r >= to) {
+			r = 0;
+		}
+	}
+	
+	return false;
+}
+
+#if ARX_COLLISION_KERNELS_SSE2 || ARX_COLLISION_KERNELS_NEON
+
+/*
+ * Minimal wrappers around the SSE2 and NEON intrinsics so that the kernels can be
+ * shared. All operations must match the scalar code exactly, including the handling of
+ * equal values in min() - no fused multiply-add, reciprocal or approximate sqrt.
+ */
+
+#if ARX_COLLISION_KERNELS_SSE2
+
+typedef __m128 float4;
+typedef __m128 mask4;
+
+inline float4 load(const float * p) { return _mm_loadu_ps(p); }
+inline void store(float * p, float4 v) { _mm_storeu_ps(p, v); }
+inline float4 splat(float f) { return _mm_set1_ps(f); }
+inline float4 add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+//! Same as std::min(a, b) for each lane
+inline float4 min(float4 a, float4 b) { return _mm_min_ps(b, a); }
+inline mask4 less(float4 a, float4 b) { return _mm_cmplt_ps(a, b); }
+inline mask4 greater(float4 a, float4 b) { return _mm_cmpgt_ps(a, b); }
+inline mask4 notEqual(float4 a, float4 b) { return _mm_cmpneq_ps(a, b); }
+inline mask4 maskAnd(mask4 a, mask4 b) { return _mm_and_ps(a, b); }
+inline mask4 maskOr(mask4 a, mask4 b) { return _mm_or_ps(a, b); }
+//! a & ~b
+inline mask4 maskAndNot(mask4 a, mask4 b) { return _mm_andnot_ps(b, a); }
+inline float4 select(mask4 m, float4 a, float4 b) {
+	return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+//! Bit i is set if lane i of the mask is set
+inline int getBits(mask4 m) { return _mm_movemask_ps(m); }
+//! Lane i of the mask is set if bit i is set
+inline mask4 fromBits(int bits) {
+	__m128i lanes = _mm_set_epi32(8, 4, 2, 1);
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), lanes), lanes));
+}
+//! Same as ffsqrt() for each lane
+inline float4 ffsqrt(float4 f) {
+	__m128i one = _mm_set1_epi32(0x3f800000);
+	__m128i i = _mm_castps_si128(f);
+	return _mm_castsi128_ps(_mm_add_epi32(_mm_srli_epi32(_mm_sub_epi32(i, one), 1), one));
+}
+
+#else
+
+typedef float32x4_t float4;
+typedef uint32x4_t mask4;
+
+inline float4 load(const float * p) { return vld1q_f32(p); }
+inline void store(float * p, float4 v) { vst1q_f32(p, v); }
+inline float4 splat(float f) { return vdupq_n_f32(f); }
+inline float4 add(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 sub(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 mul(float4 a, float4 b) { return vmulq_f32(a, b); }
+//! Same as std::min(a, b) for each lane - vminq_f32() orders -0 before +0
+inline float4 min(float4 a, float4 b) { return vbslq_f32(vcltq_f32(b, a), b, a); }
+inline mask4 less(float4 a, float4 b) { return vcltq_f32(a, b); }
+inline mask4 greater(float4 a, float4 b) { return vcgtq_f32(a, b); }
+inline mask4 notEqual(float4 a, float4 b) { return vmvnq_u32(vceqq_f32(a, b)); }
+inline mask4 maskAnd(mask4 a, mask4 b) { return vandq_u32(a, b); }
+inline mask4 maskOr(mask4 a, mask4 b) { return vorrq_u32(a, b); }
+//! a & ~b
+inline mask4 maskAndNot(mask4 a, mask4 b) { return vbicq_u32(a, b); }
+inline float4 select(mask4 m, float4 a, float4 b) { return vbslq_f32(m, a, b); }
+//! Bit i is set if lane i of the mask is set
+inline int getBits(mask4 m) {
+	static const u32 values[4] = { 1, 2, 4, 8 };
+	uint32x4_t bits = vandq_u32(m, vld1q_u32(values));
+	uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+	return int(vget_lane_u32(vpadd_u32(sum, sum), 0));
+}
+//! Lane i of the mask is set if bit i is set
+inline mask4 fromBits(int bits) {
+	static const u32 values[4] = { 1, 2, 4, 8 };
+	return vtstq_u32(vdupq_n_u32(u32(bits)), vld1q_u32(values));
+}
+//! Same as ffsqrt() for each lane
+inline float4 ffsqrt(float4 f) {
+	uint32x4_t one = vdupq_n_u32(0x3f800000);
+	uint32x4_t i = vreinterpretq_u32_f32(f);
+	return vreinterpretq_f32_u32(vaddq_u32(vshrq_n_u32(vsubq_u32(i, one), 1), one));
+}
+
+#endif
+
+const mask4 noLanes = fromBits(0);
+const mask4 allLanes = fromBits(15);
+
+struct Point4 {
+	
+	float4 x;
+	float4 y;
+	float4 z;
+	
+	Point4() { }
+	
+	Point4(float4 _x, float4 _y, float4 _z) : x(_x), y(_y), z(_z) { }
+	
+	Point4 operator+(const Point4 & o) const {
+		return Point4(add(x, o.x), add(y, o.y), add(z, o.z));
+	}
+	
+	Point4 operator*(float4 f) const { return Point4(mul(x, f), mul(y, f), mul(z, f)); }
+	
+};
+
+Point4 loadVertex(const BackgroundCollision::Geometry & geo, size_t i, size_t n) {
+	return Point4(load(&geo.x[n][i]), load(&geo.y[n][i]), load(&geo.z[n][i]));
+}
+
+Point4 select(mask4 m, const Point4 & a, const Point4 & b) {
+	return Point4(select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z));
+}
+
+/*!
+ * Lane state for the cylinder kernel
+ *
+ * Lanes in \ref first stop at the first point inside the cylinder, like the scalar
+ * tests that return early. The other lanes keep the minimum height of all points.
+ */
+struct CylinderLanes {
+	
+	float4 originX;
+	float4 originZ;
+	float4 bottom; //!< Lowest y coordinate in the cylinder
+	float4 top; //!< Highest y coordinate in the cylinder
+	float4 radius2;
+	
+	mask4 first;
+	mask4 hit;
+	float4 height;
+	
+	//! PointInCylinder() for the active lanes
+	mask4 contains(mask4 active, const Point4 & p) const {
+		float4 dx = sub(originX, p.x);
+		float4 dz = sub(originZ, p.z);
+		float4 distance2 = add(mul(dx, dx), mul(dz, dz));
+		mask4 outside = maskOr(maskOr(less(p.y, bottom), greater(p.y, top)),
+		                       greater(distance2, radius2));
+		return maskAndNot(active, outside);
+	}
+	
+	//! Test a point and update the height of lanes where it is inside the cylinder
+	void test(mask4 active, const Point4 & p, float4 y) {
+		mask4 inside = contains(maskAndNot(active, maskAnd(hit, first)), p);
+		height = select(inside, min(height, y), height);
+		hit = maskOr(hit, inside);
+	}
+	
+	void test(mask4 active, const Point4 & p) { test(active, p, p.y); }
+	
+	//! Lanes that still need to be tested
+	mask4 remaining(mask4 active) const { return maskAndNot(active, maskAnd(hit, first)); }
+	
+};
+
+//! Test four polygons starting at i
+float4 cylinderBlock(const BackgroundCollision & bc, size_t i, int valid, int quad,
+                     const Cylinder & cyl, bool precise, CylinderTestMode mode, int & hits) {
+	
+	const BackgroundCollision::Geometry & geo = bc.geometry;
+	
+	mask4 active = fromBits(valid);
+	mask4 quads = fromBits(quad);
+	
+	float4 minY = load(&bc.minY[i]);
+	float4 maxY = load(&bc.maxY[i]);
+	float4 area = load(&geo.area[i]);
+	
+	float pos1 = cyl.origin.y + cyl.height;
+	
+	CylinderLanes lanes;
+	lanes.originX = splat(cyl.origin.x);
+	lanes.originZ = splat(cyl.origin.z);
+	lanes.bottom = splat(std::min(cyl.origin.y, pos1));
+	lanes.top = splat(std::max(cyl.origin.y, pos1));
+	lanes.radius2 = splat(cyl.radius * cyl.radius);
+	lanes.hit = noLanes;
+	lanes.height = splat(999999.f);
+	
+	mask4 preciseLanes;
+	if(mode == CylinderTestCollision) {
+		
+		float4 minf = splat(cyl.origin.y + cyl.height);
+		float4 maxf = splat(cyl.origin.y);
+		active = maskAndNot(active, maskOr(greater(minf, maxY), less(maxf, minY)));
+		if(!getBits(active)) {
+			hits = 0;
+			return lanes.height;
+		}
+		
+		float4 nearest = splat(99999999.f);
+		for(size_t n = 0; n < 4; n++) {
+			float4 dx = sub(load(&geo.x[n][i]), lanes.originX);
+			float4 dz = sub(load(&geo.z[n][i]), lanes.originZ);
+			float4 dd = ffsqrt(add(mul(dx, dx), mul(dz, dz)));
+			mask4 closer = less(dd, nearest);
+			if(n == 3) {
+				closer = maskAnd(closer, quads);
+			}
+			nearest = select(closer, dd, nearest);
+		}
+		active = maskAndNot(active, greater(nearest, splat(std::max(82.f, cyl.radius))));
+		
+		if(precise || cyl.radius < 30.f || cyl.height > -80.f) {
+			preciseLanes = allLanes;
+		} else {
+			preciseLanes = greater(area, splat(5000.f));
+		}
+		
+		lanes.first = maskAndNot(allLanes, preciseLanes);
+		
+	} else {
+		preciseLanes = precise ? allLanes : noLanes;
+		lanes.first = allLanes;
+	}
+	
+	active = maskAndNot(active, maskAndNot(less(area, splat(100.f)), preciseLanes));
+	
+	if(getBits(active)) {
+		
+		Point4 center(load(&geo.centerX[i]), load(&geo.centerY[i]), load(&geo.centerZ[i]));
+		float4 normY = load(&geo.normY[i]);
+		lanes.test(active, center, select(less(normY, splat(0.5f)), minY, center.y));
+		
+		if(mode == CylinderTestAnchor) {
+			mask4 outside = maskOr(greater(lanes.bottom, maxY), less(lanes.top, minY));
+			active = maskAndNot(active, maskAndNot(outside, lanes.hit));
+		}
+		
+		mask4 lanes2000 = maskOr(preciseLanes, greater(area, splat(2000.f)));
+		mask4 lanes4000 = maskOr(preciseLanes, greater(area, splat(4000.f)));
+		mask4 lanes6000 = maskOr(preciseLanes, greater(area, splat(6000.f)));
+		float4 half = splat(0.5f);
+		
+		Point4 previous = select(quads, loadVertex(geo, i, 3), loadVertex(geo, i, 2));
+		for(size_t n = 0; n < 4; n++) {
+			
+			mask4 remaining = lanes.remaining(active);
+			if(n == 3) {
+				remaining = maskAnd(remaining, quads);
+			}
+			if(!getBits(remaining)) {
+				break;
+			}
+			
+			Point4 v = loadVertex(geo, i, n);
+			
+			if(getBits(maskAnd(remaining, preciseLanes))) {
+				for(long o = 0; o < 5; o++) {
+					float p = (float)o * (1.f/5);
+					Point4 pos = v * splat(p) + center * splat(1.f - p);
+					lanes.test(maskAnd(remaining, preciseLanes), pos);
+				}
+			}
+			
+			mask4 edges = maskAnd(remaining, lanes2000);
+			if(getBits(edges)) {
+				lanes.test(edges, (v + previous) * half);
+				Point4 pos = (v + center) * half;
+				lanes.test(maskAnd(edges, lanes4000), pos);
+				lanes.test(maskAnd(edges, lanes6000), (pos + v) * half);
+			}
+			
+			lanes.test(remaining, v);
+			
+			previous = v;
+		}
+		
+		if(mode == CylinderTestCollision) {
+			mask4 flat = maskAnd(less(normY, splat(0.1f)), greater(normY, splat(-0.1f)));
+			mask4 adjust = maskAnd(maskAnd(preciseLanes, flat),
+			                       notEqual(lanes.height, splat(999999.f)));
+			lanes.height = select(adjust, min(lanes.height, minY), lanes.height);
+		}
+		
+	}
+	
+	if(mode == CylinderTestAnchor) {
+		// The anchor test has no separate hit flag
+		hits = getBits(notEqual(lanes.height, splat(999999.f)));
+	} else {
+		hits = getBits(lanes.hit);
+	}
+	
+	return lanes.height;
+}
+
+//! Lane state for the sphere kernel - each lane stops at the first point inside the sphere
+struct SphereLanes {
+	
+	float4 originX;
+	float4 originY;
+	float4 originZ;
+	float4 radius2;
+	
+	mask4 hit;
+	
+	//! Sphere::contains() for the lanes that have no hit yet
+	void test(mask4 active, const Point4 & p) {
+		float4 dx = sub(originX, p.x);
+		float4 dy = sub(originY, p.y);
+		float4 dz = sub(originZ, p.z);
+		float4 distance2 = add(add(mul(dx, dx), mul(dy, dy)), mul(dz, dz));
+		hit = maskOr(hit, maskAnd(maskAndNot(active, hit), less(distance2, radius2)));
+	}
+	
+};
+
+//! Test four polygons starting at i
+int sphereBlock(const BackgroundCollision & bc, size_t i, int valid, int quad,
+                const Sphere & sphere) {
+	
+	const BackgroundCollision::Geometry & geo = bc.geometry;
+	
+	mask4 active = fromBits(valid);
+	mask4 quads = fromBits(quad);
+	
+	float4 area = load(&geo.area[i]);
+	active = maskAndNot(active, less(area, splat(100.f)));
+	if(!getBits(active)) {
+		return 0;
+	}
+	
+	SphereLanes lanes;
+	lanes.originX = splat(sphere.origin.x);
+	lanes.originY = splat(sphere.origin.y);
+	lanes.originZ = splat(sphere.origin.z);
+	lanes.radius2 = splat(sphere.radius * sphere.radius);
+	lanes.hit = noLanes;
+	
+	mask4 lanes2000 = greater(area, splat(2000.f));
+	mask4 lanes4000 = greater(area, splat(4000.f));
+	mask4 lanes6000 = greater(area, splat(6000.f));
+	float4 half = splat(0.5f);
+	
+	Point4 center(load(&geo.centerX[i]), load(&geo.centerY[i]), load(&geo.centerZ[i]));
+	
+	Point4 previous = select(quads, loadVertex(geo, i, 3), loadVertex(geo, i, 2));
+	for(size_t n = 0; n < 4; n++) {
+		
+		mask4 remaining = maskAndNot(active, lanes.hit);
+		if(n == 3) {
+			remaining = maskAnd(remaining, quads);
+		}
+		if(!getBits(remaining)) {
+			break;
+		}
+		
+		Point4 v = loadVertex(geo, i, n);
+		
+		mask4 edges = maskAnd(remaining, lanes2000);
+		if(getBits(edges)) {
+			lanes.test(edges, (v + previous) * half);
+			mask4 inner = maskAnd(edges, lanes4000);
+			if(getBits(inner)) {
+				Point4 pos = (v + center) * half;
+				lanes.test(inner, pos);
+				lanes.test(maskAnd(inner, lanes6000), (pos + v) * half);
+			}
+		}
+		
+		lanes.test(remaining, v);
+		
+		previous = v;
+	}
+	
+	return getBits(lanes.hit);
+}
+
+//! Get the lanes that are in [begin, end) and not ignored as well as the quads
+void getLanes(const BackgroundCollision & bc, size_t i, size_t end, PolyType ignore,
+              int & valid, int & quad) {
+	int validBits = 0;
+	int quadBits = 0;
+	size_t count = std::min(end - i, size_t(4));
+	for(size_t l = 0; l < count; l++) {
+		// Branchless as the polygon types are mixed and hard to predict
+		PolyType type = bc.type[i + l];
+		validBits |= int(!(type & ignore)) << l;
+		quadBits |= int((type & POLY_QUAD) != 0) << l;
+	}
+	valid = validBits;
+	quad = quadBits & validBits;
+}
+
+#endif // ARX_COLLISION_KERNELS_SSE2 || ARX_COLLISION_KERNELS_NEON
+	
+} // anonymous namespace
+
+void batchPolyInCylinderScalar(const BackgroundCollision & bc, size_t begin, size_t end,
+                               const Cylinder & cyl, bool precise, CylinderTestMode mode,
+                               PolyType ignore, CollisionBatch & result) {
+	
+	arx_assert(begin <= end && end - begin <= CollisionBatch::MaxSize);
+	
+	u64 hits = 0;
+	float minHeight = 999999.f;
+	
+	for(size_t i = begin; i < end; i++) {
+		
+		float height = 999999.f;
+		bool hit = false;
+		if(!(bc.type[i] & ignore)) {
+			if(mode == CylinderTestAnchor) {
+				height = anchorPolyInCylinder(bc, i, cyl, precise);
+				hit = (height != 999999.f);
+			} else {
+				height = polyInCylinder(bc, i, cyl, precise, hit);
+			}
+		}
+		
+		result.height[i - begin] = height;
+		minHeight = std::min(minHeight, height);
+		if(hit) {
+			hits |= u64(1) << (i - begin);
+		}
+	}
+	
+	result.hits = hits;
+	result.minHeight = minHeight;
+	
+}
+
+void batchPolyInSphereScalar(const BackgroundCollision & bc, size_t begin, size_t end,
+                             const Sphere & sphere, PolyType ignore, CollisionBatch & result) {
+	
+	arx_assert(begin <= end && end - begin <= CollisionBatch::MaxSize);
+	
+	u64 hits = 0;
+	
+	for(size_t i = begin; i < end; i++) {
+		if(!(bc.type[i] & ignore) && polyInSphere(bc, i, sphere)) {
+			hits |= u64(1) << (i - begin);
+		}
+	}
+	
+	result.hits = hits;
+	
+}
+
+#if ARX_COLLISION_KERNELS_SSE2 || ARX_COLLISION_KERNELS_NEON
+
+void batchPolyInCylinder(const BackgroundCollision & bc, size_t begin, size_t end,
+                         const Cylinder & cyl, bool precise, CylinderTestMode mode,
+                         PolyType ignore, CollisionBatch & result) {
+	
+	arx_assert(begin <= end && end - begin <= CollisionBatch::MaxSize);
+	
+	BOOST_STATIC_ASSERT(CollisionBatch::MaxSize % 4 == 0);
+	
+	u64 hits = 0;
+	float4 minHeight = splat(999999.f);
+	
+	for(size_t i = begin; i < end; i += 4) {
+		
+		int valid, quad;
+		getLanes(bc, i, end, ignore, valid, quad);
+		
+		float4 height = splat(999999.f);
+		int blockHits = 0;
+		if(valid) {
+			height = cylinderBlock(bc, i, valid, quad, cyl, precise, mode, blockHits);
+		}
+		
+		// Lanes past the end are not valid and always have the default height
+		store(&result.height[i - begin], height);
+		minHeight = min(minHeight, height);
+		hits |= u64(blockHits) << (i - begin);
+	}
+	
+	float lanes[4];
+	store(lanes, minHeight);
+	result.minHeight = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+	result.hits = hits;
+	
+}
+
+void batchPolyInSphere(const BackgroundCollision & bc, size_t begin, size_t end,
+                       const Sphere & sphere, PolyType ignore, CollisionBatch & result) {
+	
+	arx_assert(begin <= end && end - begin <= CollisionBatch::MaxSize);
+	
+	u64 hits = 0;
+	
+	for(size_t i = begin; i < end; i += 4) {
+		int valid, quad;
+		getLanes(bc, i, end, ignore, valid, quad);
+		if(valid) {
+			hits |= u64(sphereBlock(bc, i, valid, quad, sphere)) << (i - begin);
+		}
+	}
+	
+	result.hits = hits;
+	
+}
+
+#else
+
+void batchPolyInCylinder(const BackgroundCollision & bc, size_t begin, size_t end,
+                         const Cylinder & cyl, bool precise, CylinderTestMode mode,
+                         PolyType ignore, CollisionBatch & result) {
+	batchPolyInCylinderScalar(bc, begin, end, cyl, precise, mode, ignore, result);
+}
+
+void batchPolyInSphere(const BackgroundCollision & bc, size_t begin, size_t end,
+                       const Sphere & sphere, PolyType ignore, CollisionBatch & result) {
+	batchPolyInSphereScalar(bc, begin, end, sphere, ignore, result);
+}
+
+#endif
+
+const char * getCollisionKernelName() {
+#if ARX_COLLISION_KERNELS_SSE2
+	return "sse2";
+#elif ARX_COLLISION_KERNELS_NEON
+	return "neon";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_PHYSICS_COLLISIONKERNELS_H
+#define ARX_PHYSICS_COLLISIONKERNELS_H
+
+#include <stddef.h>
+
+#include "graphics/GraphicsTypes.h"
+#include "platform/Platform.h"
+
+struct BackgroundCollision;
+struct Cylinder;
+struct Sphere;
+
+/*!
+ * Results of testing a volume against consecutive polygons [begin, end)
+ * of a \ref BackgroundCollision
+ */
+struct CollisionBatch {
+	
+	//! Maximum number of polygons that can be tested in one call
+	static const size_t MaxSize = 64;
+	
+	u64 hits; //!< Bit i is set if polygon begin + i touches the volume
+	float minHeight; //!< Smallest of all heights - only set by cylinder tests
+	float height[MaxSize]; //!< Height for each polygon or 999999.f - only set by cylinder tests
+	
+};
+
+enum CylinderTestMode {
+	CylinderTestCollision, //!< Same results as the polygon test in CheckAnythingInCylinder()
+	CylinderTestAnchor     //!< Same results as the simpler polygon test used for anchors
+};
+
+/*!
+ * Test a cylinder against up to \ref CollisionBatch::MaxSize polygons at once.
+ *
+ * This uses SSE2 or NEON where available and otherwise falls back to
+ * \ref batchPolyInCylinderScalar(). Both versions return exactly the same results.
+ *
+ * \param precise test more points of each polygon, like \ref CFLAG_EXTRA_PRECISION
+ * \param ignore  polygons with any of these types are skipped and never hit
+ */
+void batchPolyInCylinder(const BackgroundCollision & bc, size_t begin, size_t end,
+                         const Cylinder & cyl, bool precise, CylinderTestMode mode,
+                         PolyType ignore, CollisionBatch & result);
+
+//! Test a sphere against up to \ref CollisionBatch::MaxSize polygons at once
+void batchPolyInSphere(const BackgroundCollision & bc, size_t begin, size_t end,
+                       const Sphere & sphere, PolyType ignore, CollisionBatch & result);
+
+//! Scalar version of \ref batchPolyInCylinder() that tests one polygon at a time
+void batchPolyInCylinderScalar(const BackgroundCollision & bc, size_t begin, size_t end,
+                               const Cylinder & cyl, bool precise, CylinderTestMode mode,
+                               PolyType ignore, CollisionBatch & result);
+
+//! Scalar version of \ref batchPolyInSphere() that tests one polygon at a time
+void batchPolyInSphereScalar(const BackgroundCollision & bc, size_t begin, size_t end,
+                             const Sphere & sphere, PolyType ignore, CollisionBatch & result);
+
+//! \return the instruction set used by the batch kernels: "sse2", "neon" or "scalar"
+const char * getCollisionKernelName();
+
+#endif // ARX_PHYSICS_COLLISIONKERNELS_H
@@ -46,6 +46,9 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 
 #include "physics/Collisions.h"
 
+#include <boost/noncopyable.hpp>
+
+#include "ai/PathFinderManager.h"
 #include "core/GameTime.h"
 #include "core/Core.h"
 #include "game/Damage.h"
@@ -54,6 +57,9 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "game/Player.h"
 #include "graphics/Math.h"
 #include "physics/Anchors.h"
+#include "physics/BackgroundCollision.h"
+#include "physics/CollisionKernels.h"
+#include "physics/Raycast.h"
 #include "platform/profiler/Profiler.h"
 #include "scene/Interactive.h"
 
@@ -64,211 +70,12 @@ long ON_PLATFORM=0;
 size_t EXCEPTIONS_LIST_Pos = 0;
 short EXCEPTIONS_LIST[MAX_IN_SPHERE + 1];
 
-static long POLYIN = 0;
 long COLLIDED_CLIMB_POLY=0;
 long MOVING_CYLINDER=0;
  
 Vec3f vector2D;
 bool DIRECT_PATH=true;
 
-//-----------------------------------------------------------------------------
-// Added immediate return (return anything;)
-inline float IsPolyInCylinder(EERIEPOLY * ep, const Cylinder & cyl, long flag) {
-
-	long flags = flag;
-	POLYIN = 0;
-	float minf = cyl.origin.y + cyl.height;
-	float maxf = cyl.origin.y;
-
-	if(minf > ep->max.y || maxf < ep->min.y)
-		return 999999.f;
-	
-	long to = (ep->type & POLY_QUAD) ? 4 : 3;
-
-	float nearest = 99999999.f;
-
-	for(long num = 0; num < to; num++) {
-		float dd = fdist(Vec2f(ep->v[num].p.x, ep->v[num].p.z), Vec2f(cyl.origin.x, cyl.origin.z));
-
-		if(dd < nearest) {
-			nearest = dd;
-		}		
-	}
-
-	if(nearest > std::max(82.f, cyl.radius))
-		return 999999.f;
-
-	if(cyl.radius < 30.f
-	   || cyl.height > -80.f
-	   || ep->area > 5000.f
-	) {
-		flags |= CFLAG_EXTRA_PRECISION;
-	}
-
-	if(!(flags & CFLAG_EXTRA_PRECISION)) {
-		if(ep->area < 100.f)
-			return 999999.f;
-	}
-	
-	float anything = 999999.f;
-
-	if(PointInCylinder(cyl, &ep->center)) {
-		POLYIN = 1;
-		
-		if(ep->norm.y < 0.5f)
-			anything = std::min(anything, ep->min.y);
-		else
-			anything = std::min(anything, ep->center.y);
-
-		if(!(flags & CFLAG_EXTRA_PRECISION))
-			return anything;
-	}
-
-	
-	long r = to - 1;
-	
-	Vec3f center;
-	long n;
-	
-	for(n = 0; n < to; n++) {
-		if(flags & CFLAG_EXTRA_PRECISION) {
-			for(long o = 0; o < 5; o++) {
-				float p = (float)o * (1.f/5);
-				center = ep->v[n].p * p + ep->center * (1.f - p);
-				if(PointInCylinder(cyl, &center)) {
-					anything = std::min(anything, center.y);
-					POLYIN = 1;
-
-					if(!(flags & CFLAG_EXTRA_PRECISION))
-						return anything;
-				}
-			}
-		}
-
-		if(ep->area > 2000.f || (flags & CFLAG_EXTRA_PRECISION)) {
-			center = (ep->v[n].p + ep->v[r].p) * 0.5f;
-			if(PointInCylinder(cyl, &center)) {
-				anything = std::min(anything, center.y);
-				POLYIN = 1;
-
-				if(!(flags & CFLAG_EXTRA_PRECISION))
-					return anything;
-			}
-
-			if(ep->area > 4000.f || (flags & CFLAG_EXTRA_PRECISION)) {
-				center = (ep->v[n].p + ep->center) * 0.5f;
-				if(PointInCylinder(cyl, &center)) {
-					anything = std::min(anything, center.y);
-					POLYIN = 1;
-
-					if(!(flags & CFLAG_EXTRA_PRECISION))
-						return anything;
-				}
-			}
-
-			if(ep->area > 6000.f || (flags & CFLAG_EXTRA_PRECISION)) {
-				center = (center + ep->v[n].p) * 0.5f;
-				if(PointInCylinder(cyl, &center)) {
-					anything = std::min(anything, center.y);
-					POLYIN = 1;
-
-					if(!(flags & CFLAG_EXTRA_PRECISION))
-						return anything;
-				}
-			}
-		}
-
-		if(PointInCylinder(cyl, &ep->v[n].p)) {
-			
-			anything = std::min(anything, ep->v[n].p.y);
-			POLYIN = 1;
-
-			if(!(flags & CFLAG_EXTRA_PRECISION))
-				return anything;
-		}
-
-		r++;
-
-		if(r >= to)
-			r=0;
-	}
-
-
-//	To Add "more" precision
-
-/*if (flags & CFLAG_EXTRA_PRECISION)
-{
-
-	for (long j=0;j<360;j+=90)
-	{
-		float xx=-std::sin(radians((float)j))*cyl.radius;
-		float yy=std::cos(radians((float)j))*cyl.radius;
-		EERIE_3D pos;
-		pos.x=cyl.origin.x+xx;
-
-		pos.z=cyl.origin.z+yy;
-		//EERIEPOLY * epp;
-
-		if (PointIn2DPolyXZ(ep, pos.x, pos.z)) 
-		{
-			if (GetTruePolyY(ep,&pos,&xx))
-			{				
-				anything=min(anything,xx);
-				return anything;
-			}
-		}
-	} 
-//}*/
-	if(anything != 999999.f && ep->norm.y < 0.1f && ep->norm.y > -0.1f)
-		anything = std::min(anything, ep->min.y);
-
-	return anything;
-}
-
-inline bool IsPolyInSphere(const EERIEPOLY & ep, const Sphere & sph) {
-	
-	if(ep.area < 100.f)
-		return false;
-
-	long to = (ep.type & POLY_QUAD) ? 4 : 3;
-
-	long r = to - 1;
-	Vec3f center;
-
-	for(long n = 0; n < to; n++) {
-		if(ep.area > 2000.f) {
-			center = (ep.v[n].p + ep.v[r].p) * 0.5f;
-			if(sph.contains(center)) {
-				return true;
-			}
-			if(ep.area > 4000.f) {
-				center = (ep.v[n].p + ep.center) * 0.5f;
-				if(sph.contains(center)) {
-					return true;
-				}
-			}
-			if(ep.area > 6000.f) {
-				center = (center + ep.v[n].p) * 0.5f;
-				if(sph.contains(center)) {
-					return true;
-				}
-			}
-		}
-		
-		Vec3f v(ep.v[n].p.x, ep.v[n].p.y, ep.v[n].p.z);
-
-		if(sph.contains(v)) {
-			return true;
-		}
-
-		r++;
-
-		if(r >= to)
-			r = 0;
-	}
-
-	return false;
-}
 
 bool IsCollidingIO(Entity * io,Entity * ioo) {
 
@@ -427,6 +234,37 @@ float CylinderPlatformCollide(Cylinder * cyl, Entity * io) {
 
 static long NPC_IN_CYLINDER = 0;
 
+namespace {
+
+//! Treat zone slots returned by the entity index, kept between queries to avoid allocations
+std::vector<long> nearbyBuffer;
+
+/*!
+ * Borrows the shared slot buffer for the duration of a collision query.
+ *
+ * Queries can be nested through script events sent from the cylinder check.
+ * A nested query gets an empty buffer and the larger one is kept afterwards.
+ */
+class NearbySlots : private boost::noncopyable {
+	
+public:
+	
+	std::vector<long> slots;
+	
+	NearbySlots() {
+		slots.swap(nearbyBuffer);
+	}
+	
+	~NearbySlots() {
+		if(slots.capacity() > nearbyBuffer.capacity()) {
+			slots.swap(nearbyBuffer);
+		}
+	}
+	
+};
+
+} // anonymous namespace
+
 inline void EE_RotateY(TexturedVertex *in,TexturedVertex *out,float c, float s)
 {
 	out->p.x = (in->p.x*c) + (in->p.z*s);
@@ -476,11 +314,14 @@ static bool CollidedFromBack(Entity * io,Entity * ioo) {
 	return false;
 }
 
-// Returns 0 if nothing in cyl
-// Else returns Y Offset to put cylinder in a proper place
-float CheckAnythingInCylinder(const Cylinder & cyl, Entity * ioo, long flags) {
+void CheckBackgroundInCylinder(const Cylinder & cyl, long flags,
+                               CylinderBackgroundTest & result) {
 	
-	NPC_IN_CYLINDER = 0;
+	result.cyl = cyl;
+	result.flags = flags;
+	result.outside = true;
+	result.climb = false;
+	result.anything = 0.f;
 	
 	long rad = (cyl.radius + 100) * ACTIVEBKG->Xmul;
 
@@ -488,20 +329,22 @@ float CheckAnythingInCylinder(const Cylinder & cyl, Entity * ioo, long flags) {
 	long pz = cyl.origin.z*ACTIVEBKG->Zmul;
 
 	if(px > ACTIVEBKG->Xsize-2-rad)
-		return 0.f;
+		return;
 
 	if(px < 1+rad)
-		return 0.f;
+		return;
 	
 	if(pz > ACTIVEBKG->Zsize-2-rad)
-		return 0.f;
+		return;
 
 	if(pz < 1+rad)
-		return 0.f;
+		return;
+	
+	result.outside = false;
 
 	float anything = 999999.f; 
 	
-	EERIEPOLY * ep;
+	const BackgroundCollision & bc = backgroundCollision;
 	
 	for(short z = pz - rad; z <= pz + rad; z++)
 	for(short x = px - rad; x <= px + rad; x++) {
@@ -530,19 +373,24 @@ float CheckAnythingInCylinder(const Cylinder & cyl, Entity * ioo, long flags) {
 			continue;
 
 
-		EERIE_BKG_INFO * feg = &ACTIVEBKG->fastdata[x][z];
-		for(long k = 0; k < feg->nbpoly; k++) {
-			ep = &feg->polydata[k];
-
-			if(ep->type & (POLY_WATER | POLY_TRANS | POLY_NOCOL))
+		const BackgroundCollision::Range & polys = bc.getPolys(x, z);
+		for(size_t begin = polys.begin; begin < polys.end; begin += CollisionBatch::MaxSize) {
+			
+			size_t end = std::min(polys.end, begin + CollisionBatch::MaxSize);
+			
+			CollisionBatch batch;
+			batchPolyInCylinder(bc, begin, end, cyl, (flags & CFLAG_EXTRA_PRECISION) != 0,
+			                    CylinderTestCollision, POLY_WATER | POLY_TRANS | POLY_NOCOL, batch);
+			if(!batch.hits) {
 				continue;
-
-			if(ep->min.y < anything) {
-				anything = std::min(anything, IsPolyInCylinder(ep, cyl, flags));
-
-				if(POLYIN) {
-					if(ep->type & POLY_CLIMB)
-						COLLIDED_CLIMB_POLY = 1;
+			}
+			
+			// Merge in the original order - whether a polygon counts depends on the previous ones
+			for(size_t k = begin; k < end; k++) {
+				if(bc.minY[k] < anything) {
+					anything = std::min(anything, batch.height[k - begin]);
+					if((batch.hits & (u64(1) << (k - begin))) && (bc.type[k] & POLY_CLIMB))
+						result.climb = true;
 				}
 			}
 		}
@@ -550,11 +398,42 @@ float CheckAnythingInCylinder(const Cylinder & cyl, Entity * ioo, long flags) {
 
 	float tempo;
 	
-	ep = CheckInPoly(cyl.origin + Vec3f(0.f, cyl.height, 0.f), &tempo);
+	EERIEPOLY * ep = CheckInPoly(cyl.origin + Vec3f(0.f, cyl.height, 0.f), &tempo);
 	
 	if(ep) {
 		anything = std::min(anything, tempo);
 	}
+	
+	result.anything = anything;
+}
+
+bool CylinderBackgroundTest::matches(const Cylinder & _cyl, long _flags) const {
+	return _cyl.origin == cyl.origin && _cyl.radius == cyl.radius && _cyl.height == cyl.height
+	       && _flags == flags;
+}
+
+// Returns 0 if nothing in cyl
+// Else returns Y Offset to put cylinder in a proper place
+float CheckAnythingInCylinder(const Cylinder & cyl, Entity * ioo, long flags,
+                              const CylinderBackgroundTest * background) {
+	
+	NPC_IN_CYLINDER = 0;
+	
+	CylinderBackgroundTest test;
+	if(!background || !background->matches(cyl, flags)) {
+		CheckBackgroundInCylinder(cyl, flags, test);
+		background = &test;
+	}
+	
+	if(background->outside) {
+		return 0.f;
+	}
+	
+	if(background->climb) {
+		COLLIDED_CLIMB_POLY = 1;
+	}
+	
+	float anything = background->anything;
 
 	if(!(flags & CFLAG_NO_INTERCOL)) {
 		Entity * io;
@@ -569,7 +448,15 @@ float CheckAnythingInCylinder(const Cylinder & cyl, Entity * ioo, long flags) {
 			AMOUNT = entities.size();
 		}
 
-		for(long i = 0; i < AMOUNT; i++) {
+		NearbySlots nearbySlots;
+		std::vector<long> & nearby = nearbySlots.slots;
+		if(!FULL_TEST) {
+			TREATZONE_GetNearby(cyl.origin, 1000.f, nearby);
+			AMOUNT = long(nearby.size());
+		}
+
+		for(long n = 0; n < AMOUNT; n++) {
+			const long i = FULL_TEST ? n : nearby[n];
 			const EntityHandle handle = EntityHandle(i);
 			
 			if(FULL_TEST) {
@@ -685,8 +572,7 @@ float CheckAnythingInCylinder(const Cylinder & cyl, Entity * ioo, long flags) {
 									io->_npcdata->pathfind.listpos = 0;
 									io->_npcdata->pathfind.listnb = -1;
 
-									free(io->_npcdata->pathfind.list);
-									io->_npcdata->pathfind.list = NULL;
+									io->_npcdata->pathfind.list.clear();
 
 									SendIOScriptEvent(io, SM_NULL, "", "pathfinder_end");
 								}
@@ -857,9 +743,19 @@ bool CheckEverythingInSphere(const Sphere & sphere, long source, EntityHandle ta
 	float sr40 = sphere.radius + 30.f;
 	float sr180 = sphere.radius + 500.f;
 
-	for(long i = 0; i < TREATZONE_CUR; i++) {
+	// A specific target is checked once, as long as the treat zone is not empty
+	NearbySlots nearbySlots;
+	std::vector<long> & nearby = nearbySlots.slots;
+	size_t count = 0;
+	if(targ > -1) {
+		count = (TREATZONE_CUR > 0) ? 1 : 0;
+	} else {
+		TREATZONE_GetNearby(sphere.origin, sr180, nearby);
+		count = nearby.size();
+	}
+
+	for(size_t n = 0; n < count; n++) {
 		if(targ > -1) {
-			i = TREATZONE_CUR;
 			io = entities[targ];
 
 			if(!io
@@ -874,6 +770,11 @@ bool CheckEverythingInSphere(const Sphere & sphere, long source, EntityHandle ta
 
 			ret_idx = targ;
 		} else {
+			long i = nearby[n];
+			if(i >= TREATZONE_CUR) {
+				break;
+			}
+			
 			if(treatio[i].show != 1
 			   || treatio[i].io == NULL
 			   || treatio[i].num == source
@@ -996,19 +897,23 @@ const EERIEPOLY * CheckBackgroundInSphere(const Sphere & sphere) {
 	short minz = std::max(tilez - radius, 0);
 	short maxz = std::min(tilez + radius, ACTIVEBKG->Zsize - 1);
 
+	const BackgroundCollision & bc = backgroundCollision;
+	
 	for(short z = minz; z <= maxz; z++)
 	for(short x = minx; x <= maxx; x++) {
-		const EERIE_BKG_INFO & feg = ACTIVEBKG->fastdata[x][z];
-
-		for(long k = 0; k < feg.nbpoly; k++) {
-			const EERIEPOLY & ep = feg.polydata[k];
-
-			if(ep.type & (POLY_WATER | POLY_TRANS | POLY_NOCOL))
-				continue;
-
-			if(IsPolyInSphere(ep, sphere)) {
-				return &ep;
-			}			
+		const BackgroundCollision::Range & polys = bc.getPolys(x, z);
+		for(size_t begin = polys.begin; begin < polys.end; begin += CollisionBatch::MaxSize) {
+			
+			size_t end = std::min(polys.end, begin + CollisionBatch::MaxSize);
+			
+			CollisionBatch batch;
+			batchPolyInSphere(bc, begin, end, sphere, POLY_WATER | POLY_TRANS | POLY_NOCOL, batch);
+			
+			for(size_t k = begin; k < end; k++) {
+				if(batch.hits & (u64(1) << (k - begin))) {
+					return bc.poly[k];
+				}
+			}
 		}
 	}	
 	
@@ -1034,16 +939,18 @@ bool CheckAnythingInSphere(const Sphere & sphere, EntityHandle source, CASFlags
 		short minz = std::max(tilez - radius, 0);
 		short maxz = std::min(tilez + radius, ACTIVEBKG->Zsize - 1);
 
+		const BackgroundCollision & bc = backgroundCollision;
+		
 		for(short z = minz; z <= maxz; z++)
 		for(short x = minx; x <= maxx; x++) {
-			const EERIE_BKG_INFO & feg = ACTIVEBKG->fastdata[x][z];
-			for(long k = 0; k < feg.nbpoly; k++) {
-				const EERIEPOLY & ep = feg.polydata[k];
-
-				if(ep.type & (POLY_WATER | POLY_TRANS | POLY_NOCOL))
-					continue;
-
-				if(IsPolyInSphere(ep, sphere))
+			const BackgroundCollision::Range & polys = bc.getPolys(x, z);
+			for(size_t begin = polys.begin; begin < polys.end; begin += CollisionBatch::MaxSize) {
+				
+				size_t end = std::min(polys.end, begin + CollisionBatch::MaxSize);
+				
+				CollisionBatch batch;
+				batchPolyInSphere(bc, begin, end, sphere, POLY_WATER | POLY_TRANS | POLY_NOCOL, batch);
+				if(batch.hits)
 					return true;
 			}
 		}	
@@ -1061,7 +968,16 @@ bool CheckAnythingInSphere(const Sphere & sphere, EntityHandle source, CASFlags
 	float sr40 = sphere.radius + 30.f;
 	float sr180 = sphere.radius + 500.f;
 
-	for(long i = 0; i < TREATZONE_CUR; i++) {
+	NearbySlots nearbySlots;
+	std::vector<long> & nearby = nearbySlots.slots;
+	TREATZONE_GetNearby(sphere.origin, sr180, nearby);
+
+	for(size_t n = 0; n < nearby.size(); n++) {
+		
+		long i = nearby[n];
+		if(i >= TREATZONE_CUR) {
+			break;
+		}
 		
 		if(treatio[i].show != 1 || !treatio[i].io || treatio[i].num == source)
 			continue;
@@ -1576,144 +1492,45 @@ bool ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, Entity * io, float MOVE_CYLIND
 bool IO_Visible(const Vec3f & orgn, const Vec3f & dest, EERIEPOLY * epp, Vec3f * hit)
 {
 	ARX_PROFILE_FUNC();
-
-	float ix,iy,iz;
-	long px,pz;
-
-	float pas = 35.f;
- 
-	Vec3f found_hit = Vec3f_ZERO;
-	EERIEPOLY *found_ep = NULL;
-	float iter,t;
-
-	//current ray pos
-	float x = orgn.x;
-	float y = orgn.y;
-	float z = orgn.z;
-
-	float distance;
-	float nearest = distance = fdist(orgn, dest);
-
-	if(distance < pas)
-		pas = distance * .5f;
-
-	// ray incs
-	float dx = (dest.x - orgn.x);
-	float dy = (dest.y - orgn.y);
-	float dz = (dest.z - orgn.z);
-
-	// absolute ray incs
-	float adx = glm::abs(dx);
-	float ady = glm::abs(dy);
-	float adz = glm::abs(dz);
-
-	if(adx >= ady && adx >= adz) {
-		if(adx != dx)
-			ix = -pas;
-		else
-			ix = pas;
-
-		iter = adx / pas;
-		t = 1.f / (iter);
-		iy = dy * t;
-		iz = dz * t;
-	} else if(ady >= adx && ady >= adz) {
-		if(ady != dy)
-			iy = -pas;
-		else
-			iy = pas;
-
-		iter = ady / pas;
-		t = 1.f / (iter);
-		ix = dx * t;
-		iz = dz * t;
-	} else {
-		if(adz != dz)
-			iz = -pas;
-		else
-			iz = pas;
-
-		iter = adz / pas;
-		t = 1.f / (iter);
-		ix = dx * t;
-		iy = dy * t;
-	}
-
-	float dd;
-	x -= ix;
-	y -= iy;
-	z -= iz;
-
-	while(iter > 0.f) {
-		iter -= 1.f;
-		x += ix;
-		y += iy;
-		z += iz;
-
-		Sphere sphere;
-		sphere.origin.x=x;
-		sphere.origin.y=y;
-		sphere.origin.z=z;
-		sphere.radius=65.f;
-
-		for(size_t num = 0; num < entities.size(); num++) {
-			const EntityHandle handle = EntityHandle(num);
-			Entity * io = entities[handle];
-
-			if(io && (io->gameFlags & GFLAG_VIEW_BLOCKER)) {
-				if(CheckIOInSphere(sphere, handle)) {
-					dd = fdist(orgn, sphere.origin);
-
-					if(dd < nearest) {
-						hit->x=x;
-						hit->y=y;
-						hit->z=z;
-						return false;
-					}
-				}
-			}
+	
+	RaycastResult result = raycastBackground(orgn, dest, POLY_WATER | POLY_TRANS | POLY_NOCOL);
+	
+	// Entities that block the view only count in front of the background hit
+	std::vector<EntityHandle> blockers;
+	for(size_t num = 0; num < entities.size(); num++) {
+		const EntityHandle handle = EntityHandle(num);
+		Entity * io = entities[handle];
+		if(io && (io->gameFlags & GFLAG_VIEW_BLOCKER)) {
+			blockers.push_back(handle);
 		}
-
-		px = (long)(x * ACTIVEBKG->Xmul);
-		pz = (long)(z * ACTIVEBKG->Zmul);
-
-		if(px < 0 || px >= ACTIVEBKG->Xsize || pz < 0 || pz >= ACTIVEBKG->Zsize)
-			goto fini;
-
-			EERIE_BKG_INFO * feg = &ACTIVEBKG->fastdata[px][pz];
-
-			for(long k = 0; k < feg->nbpolyin; k++) {
-				EERIEPOLY * ep = feg->polyin[k];
-
-				if(!(ep->type & (POLY_WATER | POLY_TRANS | POLY_NOCOL)))
-				if((ep->min.y - pas < y) && (ep->max.y + pas > y))
-				if((ep->min.x - pas < x) && (ep->max.x + pas > x))
-				if((ep->min.z - pas < z) && (ep->max.z + pas > z))
-				{
-					if(RayCollidingPoly(orgn, dest, ep, hit)) {
-						dd = fdist(orgn, *hit);
-						if(dd < nearest) {
-							nearest = dd;
-							found_ep = ep;
-							found_hit = *hit;
-						}
-					}
+	}
+	
+	if(!blockers.empty()) {
+		
+		float length = fdist(orgn, dest);
+		float distance = fdist(orgn, result.pos);
+		float pas = std::min(35.f, length * .5f);
+		Vec3f step = (dest - orgn) * (pas / length);
+		
+		Sphere sphere(orgn, 65.f);
+		
+		for(float dd = 0.f; dd < distance; dd += pas, sphere.origin += step) {
+			for(size_t i = 0; i < blockers.size(); i++) {
+				if(CheckIOInSphere(sphere, blockers[i])) {
+					*hit = sphere.origin;
+					return false;
 				}
 			}
-			
 		}
 		
-fini:
-	;
+	}
 	
-	if(!found_ep)
-		return true;
-
-	if(found_ep == epp)
+	if(result.type != RaycastResult::Polygon || result.poly == epp) {
 		return true;
+	}
+	
+	*hit = result.pos;
 	
-	*hit = found_hit;
-
 	return false;
 }
 
@@ -1728,6 +1545,8 @@ void ANCHOR_BLOCK_Clear() {
 		ANCHOR_DATA * ad = &eb->anchors[k];
 		ad->flags &= ~ANCHOR_FLAG_BLOCKED;
 	}
+	
+	EERIE_PATHFINDER_Anchors_Changed();
 }
 
 void ANCHOR_BLOCK_By_IO(Entity * io, long status) {
@@ -1765,12 +1584,16 @@ void ANCHOR_BLOCK_By_IO(Entity * io, long status) {
 				}
 
 				if(PointIn2DPolyXZ(&ep, ad->pos.x, ad->pos.z)) {
+					AnchorFlags flags = ad->flags;
 					if(status)
 						ad->flags |= ANCHOR_FLAG_BLOCKED;
 					else
 						ad->flags &= ~ANCHOR_FLAG_BLOCKED;
+					if(ad->flags != flags) {
+						EERIE_PATHFINDER_Anchor_Changed(k);
+					}
 				}
 			}
 		}
-	}					
+	}
 }
@@ -83,7 +83,36 @@ extern short EXCEPTIONS_LIST[MAX_IN_SPHERE + 1];
 extern bool DIRECT_PATH;
 
 bool ARX_COLLISION_Move_Cylinder(IO_PHYSICS * ip, Entity * io, float MOVE_CYLINDER_STEP, CollisionFlags flags = 0);
-float CheckAnythingInCylinder(const Cylinder & cyl, Entity * ioo, long flags = 0);
+/*!
+ * Result of testing a cylinder against the background only
+ *
+ * This is the part of \ref CheckAnythingInCylinder() that does not depend on
+ * entities. It only reads the level and can be computed ahead of time on any thread.
+ */
+struct CylinderBackgroundTest {
+	
+	Cylinder cyl;
+	long flags;
+	
+	bool outside; //!< The cylinder is too close to the edge of the level to be tested
+	bool climb; //!< The cylinder touches a climbable polygon
+	float anything; //!< Height of the background in the cylinder or 999999.f if nothing was hit
+	
+	//! \return true if this is the result for the given parameters
+	bool matches(const Cylinder & cyl, long flags) const;
+	
+};
+
+void CheckBackgroundInCylinder(const Cylinder & cyl, long flags,
+                               CylinderBackgroundTest & result);
+
+/*!
+ * \param background result of \ref CheckBackgroundInCylinder() computed earlier.
+ *                   It is only used if it \ref CylinderBackgroundTest::matches() the
+ *                   cylinder and flags.
+ */
+float CheckAnythingInCylinder(const Cylinder & cyl, Entity * ioo, long flags = 0,
+                              const CylinderBackgroundTest * background = NULL);
 
 enum CheckAnythingInSphereFlag {
 	 CAS_NO_NPC_COL        = (1<<0),
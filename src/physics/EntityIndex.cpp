@@ -0,0 +1,144 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "physics/EntityIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+const float EntityIndex::CELL_SIZE = 500.f;
+
+namespace {
+
+//! Number of hash buckets - must be a power of two
+const size_t ENTITY_INDEX_BUCKETS = 1024;
+
+} // anonymous namespace
+
+EntityIndex::EntityIndex() : m_buckets(ENTITY_INDEX_BUCKETS), m_count(0) { }
+
+long EntityIndex::getCell(float coord) {
+	return long(std::floor(coord / CELL_SIZE));
+}
+
+size_t EntityIndex::getBucket(long x, long z) {
+	u32 hash = (u32(x) * 73856093u) ^ (u32(z) * 19349663u);
+	return size_t(hash) & (ENTITY_INDEX_BUCKETS - 1);
+}
+
+void EntityIndex::update(long id, const Vec3f & pos) {
+	
+	arx_assert(id >= 0);
+	
+	long x = getCell(pos.x);
+	long z = getCell(pos.z);
+	
+	if(size_t(id) >= m_slots.size()) {
+		Slot unused = { false, 0, 0 };
+		m_slots.resize(size_t(id) + 1, unused);
+	}
+	
+	Slot & slot = m_slots[id];
+	if(slot.used) {
+		if(slot.x == x && slot.z == z) {
+			return;
+		}
+		remove(id);
+	}
+	
+	slot.used = true;
+	slot.x = x;
+	slot.z = z;
+	
+	Entry entry = { id, x, z };
+	m_buckets[getBucket(x, z)].push_back(entry);
+	m_count++;
+}
+
+void EntityIndex::remove(long id) {
+	
+	if(id < 0 || size_t(id) >= m_slots.size() || !m_slots[id].used) {
+		return;
+	}
+	
+	Slot & slot = m_slots[id];
+	Bucket & bucket = m_buckets[getBucket(slot.x, slot.z)];
+	for(Bucket::iterator it = bucket.begin(); it != bucket.end(); ++it) {
+		if(it->id == id) {
+			*it = bucket.back();
+			bucket.pop_back();
+			break;
+		}
+	}
+	
+	slot.used = false;
+	m_count--;
+}
+
+void EntityIndex::clear() {
+	
+	if(m_count == 0) {
+		return;
+	}
+	
+	for(size_t i = 0; i < m_buckets.size(); i++) {
+		m_buckets[i].clear();
+	}
+	m_slots.clear();
+	m_count = 0;
+}
+
+void EntityIndex::query(const Vec3f & pos, float radius, std::vector<long> & result) const {
+	
+	result.clear();
+	
+	if(m_count == 0) {
+		return;
+	}
+	
+	long x0 = getCell(pos.x - radius), x1 = getCell(pos.x + radius);
+	long z0 = getCell(pos.z - radius), z1 = getCell(pos.z + radius);
+	
+	if(size_t(x1 - x0 + 1) * size_t(z1 - z0 + 1) > m_count) {
+		
+		// Cheaper to check the cell of every entry than to visit all buckets
+		for(size_t id = 0; id < m_slots.size(); id++) {
+			const Slot & slot = m_slots[id];
+			if(slot.used && slot.x >= x0 && slot.x <= x1 && slot.z >= z0 && slot.z <= z1) {
+				result.push_back(long(id));
+			}
+		}
+		
+		return;
+	}
+	
+	for(long z = z0; z <= z1; z++) {
+		for(long x = x0; x <= x1; x++) {
+			// Buckets are shared between cells, so only take entries from this cell
+			const Bucket & bucket = m_buckets[getBucket(x, z)];
+			for(Bucket::const_iterator it = bucket.begin(); it != bucket.end(); ++it) {
+				if(it->x == x && it->z == z) {
+					result.push_back(it->id);
+				}
+			}
+		}
+	}
+	
+	std::sort(result.begin(), result.end());
+}
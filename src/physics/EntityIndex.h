@@ -0,0 +1,93 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_PHYSICS_ENTITYINDEX_H
+#define ARX_PHYSICS_ENTITYINDEX_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "math/Types.h"
+#include "platform/Platform.h"
+
+/*!
+ * Spatial hash over the horizontal positions of entities for proximity queries.
+ *
+ * Entries are identified by small non-negative ids (such as treat zone slots) and
+ * are only moved between cells when their position crosses a cell boundary, so
+ * updating every entry once per frame is cheap. The index only knows about the
+ * positions it was given - callers must update entries as their entities move.
+ */
+class EntityIndex : private boost::noncopyable {
+	
+public:
+	
+	//! Width and depth of each grid cell
+	static const float CELL_SIZE;
+	
+	EntityIndex();
+	
+	//! Add an entry or move an existing entry to a new position
+	void update(long id, const Vec3f & pos);
+	
+	//! Remove an entry if it exists
+	void remove(long id);
+	
+	//! Remove all entries
+	void clear();
+	
+	/*!
+	 * Find all entries whose indexed position may be within a horizontal distance.
+	 *
+	 * The result can also contain entries that are farther away, so callers must
+	 * still check the actual distance.
+	 *
+	 * \param result Receives the ids of the entries, sorted in ascending order.
+	 *               Existing contents are discarded.
+	 */
+	void query(const Vec3f & pos, float radius, std::vector<long> & result) const;
+	
+private:
+	
+	struct Entry {
+		long id;
+		long x;
+		long z;
+	};
+	
+	struct Slot {
+		bool used;
+		long x;
+		long z;
+	};
+	
+	typedef std::vector<Entry> Bucket;
+	
+	static long getCell(float coord);
+	static size_t getBucket(long x, long z);
+	
+	std::vector<Bucket> m_buckets;
+	std::vector<Slot> m_slots; //!< Cell of each entry, indexed by id
+	size_t m_count;
+	
+};
+
+#endif // ARX_PHYSICS_ENTITYINDEX_H
@@ -47,6 +47,9 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "physics/Physics.h"
 
 #include <stddef.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 #include "graphics/GraphicsTypes.h"
 #include "graphics/data/Mesh.h"
@@ -62,38 +65,14 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 
 #include "physics/Box.h"
 #include "physics/Collisions.h"
+#include "physics/SpringKernels.h"
+
+#include "platform/WorkerPool.h"
 
 extern Material CUR_COLLISION_MATERIAL;
 
 static const float VELOCITY_THRESHOLD = 400.f;
 
-static void ARX_ApplySpring(PHYSVERT * phys, long k, long l, float PHYSICS_constant,
-                            float PHYSICS_Damp) {
-	
-	Vec3f deltaP, deltaV, springforce;
-	PHYSVERT * pv_k = &phys[k];
-	PHYSVERT * pv_l = &phys[l];
-	float Dterm, Hterm;
-
-	float restlength = glm::distance(pv_k->initpos, pv_l->initpos);
-	// Computes Spring Magnitude
-	deltaP = pv_k->pos - pv_l->pos;
-	float dist = glm::length(deltaP); // Magnitude of delta
-	dist = std::max(dist, 0.000001f); //TODO workaround for division by zero
-	float divdist = 1.f / dist;
-	Hterm = (dist - restlength) * PHYSICS_constant;
-
-	deltaV = pv_k->velocity - pv_l->velocity; // Delta Velocity Vector
-	Dterm = glm::dot(deltaV, deltaP) * PHYSICS_Damp * divdist; // Damping Term
-	Dterm = (-(Hterm + Dterm));
-	divdist *= Dterm;
-	springforce = deltaP * divdist; // Normalize Distance Vector & Calc Force
-
-	pv_k->force += springforce; // + force on particle 1
-
-	pv_l->force -= springforce; // - force on particle 2
-}
-
 static void ComputeForces(PHYSVERT * phys, long nb) {
 	
 	const Vec3f PHYSICS_Gravity(0.f, 65.f, 0.f);
@@ -125,72 +104,50 @@ static void ComputeForces(PHYSVERT * phys, long nb) {
 		pv->force += pv->velocity * -PHYSICS_Damping;
 	}
 
-	for(int k = 0; k < nb; k++) {
-		// Now Resolves Spring System
+	// Now Resolves Spring System
+	SpringForces springs;
+	computeSpringForces(phys, nb, 15.f, 0.99f, springs);
+	
+	// Accumulate in the same order as when applying each spring separately
+	for(long k = 0; k < nb; k++) {
 		for(long l = 0; l < nb; l++) {
 			if(l != k) {
-				ARX_ApplySpring(phys, l, k, 15.f, 0.99f);
+				Vec3f springforce = springs.get(l, k);
+				phys[l].force += springforce;
+				phys[k].force -= springforce;
 			}
 		}
 	}
 }
 
-//! Calculate new Positions and Velocities given a deltatime
-//! \param DeltaTime that has passed since last iteration
+/*!
+ * Calculate new Positions and Velocities given a deltatime
+ *
+ * All four RK4 samples use the forces at the start of the step, so the
+ * intermediate states don't need to be computed.
+ *
+ * \param DeltaTime that has passed since last iteration
+ */
 static void RK4Integrate(PHYSICS_BOX_DATA * pbox, float DeltaTime) {
 	
-	PHYSVERT * source, * target, * accum1, * accum2, * accum3, * accum4;
-	float halfDeltaT, sixthDeltaT;
-	halfDeltaT = DeltaTime * .5f; // some time values i will need
-	sixthDeltaT = ( 1.0f / 6 );
-
-	PHYSVERT m_TempSys[5][32];
-
-	for(long jj = 0; jj < 4; jj++) {
-
-		arx_assert(size_t(pbox->nb_physvert) <= ARRAY_SIZE(m_TempSys[jj + 1]));
-		memcpy(m_TempSys[jj + 1], pbox->vert, sizeof(PHYSVERT) * pbox->nb_physvert);
-
-		if(jj == 3) {
-			halfDeltaT = DeltaTime;
-		}
-
-		for(long kk = 0; kk < pbox->nb_physvert; kk++) {
-
-			source = &pbox->vert[kk];
-			accum1 = &m_TempSys[jj + 1][kk];
-			target = &m_TempSys[0][kk];
-
-			accum1->force = source->force * (source->mass * halfDeltaT);
-			accum1->velocity = source->velocity * halfDeltaT;
-
-			// determine the new velocity for the particle over 1/2 time
-			target->velocity = source->velocity + accum1->force;
-			target->mass = source->mass;
-
-			// set the new position
-			target->pos = source->pos + accum1->velocity;
-		}
-
-		ComputeForces(m_TempSys[0], pbox->nb_physvert); // compute the new forces
-	}
+	float halfDeltaT = DeltaTime * .5f;
+	float sixthDeltaT = (1.0f / 6);
 
 	for(long kk = 0; kk < pbox->nb_physvert; kk++) {
 
-		source = &pbox->vert[kk]; // current state of particle
-		target = &pbox->vert[kk];
-		accum1 = &m_TempSys[1][kk];
-		accum2 = &m_TempSys[2][kk];
-		accum3 = &m_TempSys[3][kk];
-		accum4 = &m_TempSys[4][kk];
+		PHYSVERT * pv = &pbox->vert[kk];
+		
+		Vec3f halfForce = pv->force * (pv->mass * halfDeltaT);
+		Vec3f fullForce = pv->force * (pv->mass * DeltaTime);
+		Vec3f halfVelocity = pv->velocity * halfDeltaT;
+		Vec3f fullVelocity = pv->velocity * DeltaTime;
 
 		// determine the new velocity for the particle using rk4 formula
-		Vec3f dv = accum1->force + ((accum2->force + accum3->force) * 2.f) + accum4->force;
-		target->velocity = source->velocity + (dv * sixthDeltaT);
+		Vec3f dv = halfForce + ((halfForce + halfForce) * 2.f) + fullForce;
+		pv->velocity = pv->velocity + (dv * sixthDeltaT);
 		// determine the new position for the particle using rk4 formula
-		Vec3f dp = accum1->velocity + ((accum2->velocity + accum3->velocity) * 2.f)
-				   + accum4->velocity;
-		target->pos = source->pos + (dp * sixthDeltaT * 1.2f);
+		Vec3f dp = halfVelocity + ((halfVelocity + halfVelocity) * 2.f) + fullVelocity;
+		pv->pos = pv->pos + (dp * sixthDeltaT * 1.2f);
 	}
 
 }
@@ -254,16 +211,17 @@ static bool IsObjectVertexCollidingPoly(PHYSICS_BOX_DATA * pbox, const EERIEPOLY
 	return false;
 }
 
-static void polyTypeToCollisionMaterial(const EERIEPOLY & ep) {
-	if (ep.type & POLY_METAL) CUR_COLLISION_MATERIAL = MATERIAL_METAL;
-	else if (ep.type & POLY_WOOD) CUR_COLLISION_MATERIAL = MATERIAL_WOOD;
-	else if (ep.type & POLY_STONE) CUR_COLLISION_MATERIAL = MATERIAL_STONE;
-	else if (ep.type & POLY_GRAVEL) CUR_COLLISION_MATERIAL = MATERIAL_GRAVEL;
-	else if (ep.type & POLY_WATER) CUR_COLLISION_MATERIAL = MATERIAL_WATER;
-	else if (ep.type & POLY_EARTH) CUR_COLLISION_MATERIAL = MATERIAL_EARTH;
-	else CUR_COLLISION_MATERIAL = MATERIAL_STONE;
+static Material polyTypeToCollisionMaterial(const EERIEPOLY & ep) {
+	if (ep.type & POLY_METAL) return MATERIAL_METAL;
+	else if (ep.type & POLY_WOOD) return MATERIAL_WOOD;
+	else if (ep.type & POLY_STONE) return MATERIAL_STONE;
+	else if (ep.type & POLY_GRAVEL) return MATERIAL_GRAVEL;
+	else if (ep.type & POLY_WATER) return MATERIAL_WATER;
+	else if (ep.type & POLY_EARTH) return MATERIAL_EARTH;
+	else return MATERIAL_STONE;
 }
 
+//! Test the box against the background - this only reads the level and is thread-safe
 static bool IsFULLObjectVertexInValidPosition(PHYSICS_BOX_DATA * pbox, EERIEPOLY *& collisionPoly) {
 
 	bool ret = true;
@@ -307,8 +265,6 @@ static bool IsFULLObjectVertexInValidPosition(PHYSICS_BOX_DATA * pbox, EERIEPOLY
 					) {
 						collisionPoly = &ep;
 						
-						polyTypeToCollisionMaterial(ep);
-						
 						return false;
 					}
 					
@@ -327,8 +283,6 @@ static bool IsFULLObjectVertexInValidPosition(PHYSICS_BOX_DATA * pbox, EERIEPOLY
 							) {
 								collisionPoly = &ep;
 
-								polyTypeToCollisionMaterial(ep);
-								
 								return false;
 							}
 						}
@@ -339,8 +293,6 @@ static bool IsFULLObjectVertexInValidPosition(PHYSICS_BOX_DATA * pbox, EERIEPOLY
 					
 					collisionPoly = &ep;
 					
-					polyTypeToCollisionMaterial(ep);
-					
 					return false;
 				}
 			}
@@ -350,11 +302,12 @@ static bool IsFULLObjectVertexInValidPosition(PHYSICS_BOX_DATA * pbox, EERIEPOLY
 	return ret;
 }
 
-static bool ARX_EERIE_PHYSICS_BOX_Compute(PHYSICS_BOX_DATA * pbox, float framediff, EntityHandle source) {
 
-	Vec3f oldpos[32];
-	long COUNT = 0;
-	COUNT++;
+//! Integrate one step - this only modifies the box and is thread-safe
+static void ARX_EERIE_PHYSICS_BOX_Integrate(PHYSICS_BOX_DATA * pbox, float framediff,
+                                            Vec3f * oldpos) {
+	
+	ComputeForces(pbox->vert, pbox->nb_physvert);
 
 	for(long kk = 0; kk < pbox->nb_physvert; kk++) {
 		PHYSVERT *pv = &pbox->vert[kk];
@@ -366,58 +319,66 @@ static bool ARX_EERIE_PHYSICS_BOX_Compute(PHYSICS_BOX_DATA * pbox, float framedi
 		pv->velocity.z = glm::clamp(pv->velocity.z, -VELOCITY_THRESHOLD, VELOCITY_THRESHOLD);
 	}
 
-	CUR_COLLISION_MATERIAL = MATERIAL_STONE;
-
 	RK4Integrate(pbox, framediff);
+}
 
-	Sphere sphere;
-	PHYSVERT *pv = &pbox->vert[0];
-	sphere.origin = pv->pos;
-	sphere.radius = pbox->radius;
-	long colidd = 0;
-	EERIEPOLY * collisionPoly = NULL;
+//! Move the box back and bounce off the collision polygon if there is one
+static void ARX_EERIE_PHYSICS_BOX_Bounce(PHYSICS_BOX_DATA * pbox, const Vec3f * oldpos,
+                                         const EERIEPOLY * collisionPoly) {
+
+	if(!collisionPoly) {
+		for(long k = 0; k < pbox->nb_physvert; k++) {
+			PHYSVERT * pv = &pbox->vert[k];
 	
-	if(   !IsFULLObjectVertexInValidPosition(pbox, collisionPoly)
-	   || ARX_INTERACTIVE_CheckFULLCollision(pbox, source)
-	   || colidd
-	   || IsObjectInField(pbox)
-	) {
-		colidd = 1;
+			pv->velocity.x *= -0.3f;
+			pv->velocity.z *= -0.3f;
+			pv->velocity.y *= -0.4f;
+			
+			pv->pos = oldpos[k];
+		}
+	} else {
+		for(long k = 0; k < pbox->nb_physvert; k++) {
+			PHYSVERT * pv = &pbox->vert[k];
+			
+			float t = glm::dot(collisionPoly->norm, pv->velocity);
+			pv->velocity -= collisionPoly->norm * (2.f * t);
+			
+			pv->velocity.x *= 0.3f;
+			pv->velocity.z *= 0.3f;
+			pv->velocity.y *= 0.4f;
+			
+			pv->pos = oldpos[k];
+		}
+	}
+}
+
+/*!
+ * Handle the collisions of an integrated step
+ *
+ * \param collisionPoly the background polygon hit by the box or \c NULL
+ * \return true if the box hit something other than the background
+ */
+static bool ARX_EERIE_PHYSICS_BOX_Collide(PHYSICS_BOX_DATA * pbox, const Vec3f * oldpos,
+                                          const EERIEPOLY * collisionPoly, EntityHandle source) {
+	
+	CUR_COLLISION_MATERIAL = collisionPoly ? polyTypeToCollisionMaterial(*collisionPoly)
+	                                       : MATERIAL_STONE;
+	
+	bool otherCollision = !collisionPoly
+	                      && (ARX_INTERACTIVE_CheckFULLCollision(pbox, source)
+	                          || IsObjectInField(pbox));
+	
+	if(collisionPoly || otherCollision) {
+		
 		float power = (glm::abs(pbox->vert[0].velocity.x)
 					   + glm::abs(pbox->vert[0].velocity.y)
 					   + glm::abs(pbox->vert[0].velocity.z)) * .01f;
 
-
 		if(!(ValidIONum(source) && (entities[source]->ioflags & IO_BODY_CHUNK)))
 			ARX_TEMPORARY_TrySound(0.4f + power);
 
-		if(!collisionPoly) {
-			for(long k = 0; k < pbox->nb_physvert; k++) {
-				pv = &pbox->vert[k];
-
-				pv->velocity.x *= -0.3f;
-				pv->velocity.z *= -0.3f;
-				pv->velocity.y *= -0.4f;
+		ARX_EERIE_PHYSICS_BOX_Bounce(pbox, oldpos, collisionPoly);
 
-				pv->pos = oldpos[k];
-			}
-		} else {
-			for(long k = 0; k < pbox->nb_physvert; k++) {
-				pv = &pbox->vert[k];
-
-				float t = glm::dot(collisionPoly->norm, pv->velocity);
-				pv->velocity -= collisionPoly->norm * (2.f * t);
-
-				pv->velocity.x *= 0.3f;
-				pv->velocity.z *= 0.3f;
-				pv->velocity.y *= 0.4f;
-
-				pv->pos = oldpos[k];
-			}
-		}
-	}
-
-	if(colidd) {
 		pbox->stopcount += 1;
 	} else {
 		pbox->stopcount -= 2;
@@ -426,10 +387,102 @@ static bool ARX_EERIE_PHYSICS_BOX_Compute(PHYSICS_BOX_DATA * pbox, float framedi
 			pbox->stopcount = 0;
 	}
 
-	return true;
+	return otherCollision;
 }
 
-long ARX_PHYSICS_BOX_ApplyModel(PHYSICS_BOX_DATA * pbox, float framediff, float rubber, EntityHandle source) {
+static void ARX_EERIE_PHYSICS_BOX_Compute(PHYSICS_BOX_DATA * pbox, float framediff, EntityHandle source) {
+	
+	arx_assert(size_t(pbox->nb_physvert) <= SpringForces::MaxVertices);
+	
+	Vec3f oldpos[SpringForces::MaxVertices];
+	ARX_EERIE_PHYSICS_BOX_Integrate(pbox, framediff, oldpos);
+	
+	EERIEPOLY * collisionPoly = NULL;
+	IsFULLObjectVertexInValidPosition(pbox, collisionPoly);
+	
+	ARX_EERIE_PHYSICS_BOX_Collide(pbox, oldpos, collisionPoly, source);
+}
+
+//! Simulated time per step
+static const float PHYSICS_BOX_STEP = 0.18f;
+
+static float getPhysicsBoxTiming(const PHYSICS_BOX_DATA * pbox, float framediff, float rubber) {
+	return pbox->storedtiming + framediff * rubber * 0.0055f;
+}
+
+//! Physics box steps precomputed by a \ref PhysicsBoxBatch
+struct PhysicsBoxJob {
+	
+	PHYSICS_BOX_DATA * pbox;
+	float framediff;
+	float rubber;
+	
+	PHYSICS_BOX_DATA state; //!< Box parameters when the job was added
+	std::vector<PHYSVERT> initial; //!< Box vertices when the job was added
+	
+	std::vector<PHYSVERT> vertices; //!< Box vertices after integrating each step
+	std::vector<Vec3f> oldpos; //!< Vertex positions before each step
+	std::vector<const EERIEPOLY *> collisions; //!< Background polygon hit in each step
+	
+	//! Simulate all steps assuming that the box only hits the background
+	void simulate() {
+		
+		size_t count = initial.size();
+		std::vector<PHYSVERT> current = initial;
+		PHYSICS_BOX_DATA box = state;
+		box.vert = &current[0];
+		
+		for(size_t k = 0; k < count; k++) {
+			current[k].temp = current[k].pos;
+		}
+		
+		vertices.clear();
+		oldpos.clear();
+		collisions.clear();
+		
+		float timing = getPhysicsBoxTiming(&box, framediff, rubber);
+		while(timing >= PHYSICS_BOX_STEP) {
+			
+			Vec3f old[SpringForces::MaxVertices];
+			ARX_EERIE_PHYSICS_BOX_Integrate(&box, std::min(0.11f, timing * 10), old);
+			
+			EERIEPOLY * collisionPoly = NULL;
+			IsFULLObjectVertexInValidPosition(&box, collisionPoly);
+			
+			vertices.insert(vertices.end(), current.begin(), current.end());
+			oldpos.insert(oldpos.end(), old, old + count);
+			collisions.push_back(collisionPoly);
+			
+			if(collisionPoly) {
+				ARX_EERIE_PHYSICS_BOX_Bounce(&box, old, collisionPoly);
+			}
+			
+			timing -= PHYSICS_BOX_STEP;
+		}
+		
+	}
+	
+	//! \return true if the box has not changed since the job was added
+	bool matches(const PHYSICS_BOX_DATA * box, float _framediff, float _rubber) const {
+		return box == pbox && _framediff == framediff && _rubber == rubber
+		       && box->vert == state.vert
+		       && box->nb_physvert == state.nb_physvert
+		       && box->active == state.active
+		       && box->stopcount == state.stopcount
+		       && box->radius == state.radius
+		       && box->storedtiming == state.storedtiming
+		       && !std::memcmp(box->vert, &initial[0], sizeof(PHYSVERT) * initial.size());
+	}
+	
+};
+
+/*!
+ * Simulate a box for one frame
+ *
+ * \param job precomputed steps for the box or \c NULL
+ */
+static long ARX_PHYSICS_BOX_ApplyModel(PHYSICS_BOX_DATA * pbox, float framediff, float rubber,
+                                       EntityHandle source, const PhysicsBoxJob * job) {
 
 	long ret = 0;
 
@@ -448,24 +501,35 @@ long ARX_PHYSICS_BOX_ApplyModel(PHYSICS_BOX_DATA * pbox, float framediff, float
 		pv.temp = pv.pos;
 	}
 
-	float timing = pbox->storedtiming + framediff * rubber * 0.0055f;
-	float t_threshold = 0.18f;
+	float timing = getPhysicsBoxTiming(pbox, framediff, rubber);
 
-	if(timing < t_threshold) {
+	if(timing < PHYSICS_BOX_STEP) {
 		pbox->storedtiming = timing;
 		return 1;
-	} else {
-		while(timing >= t_threshold) {
-			ComputeForces(pbox->vert, pbox->nb_physvert);
-
-			if(!ARX_EERIE_PHYSICS_BOX_Compute(pbox, std::min(0.11f, timing * 10), source))
-				ret = 1;
+	}
 
-			timing -= t_threshold;
+	size_t step = 0;
+	while(timing >= PHYSICS_BOX_STEP) {
+
+		if(job) {
+			arx_assert(step < job->collisions.size());
+			size_t offset = step * size_t(pbox->nb_physvert);
+			std::copy(job->vertices.begin() + offset,
+			          job->vertices.begin() + offset + pbox->nb_physvert, pbox->vert);
+			if(ARX_EERIE_PHYSICS_BOX_Collide(pbox, &job->oldpos[offset],
+			                                 job->collisions[step], source)) {
+				// The following steps depend on the entity collision
+				job = NULL;
+			}
+		} else {
+			ARX_EERIE_PHYSICS_BOX_Compute(pbox, std::min(0.11f, timing * 10), source);
 		}
 
-		pbox->storedtiming = timing;
+		timing -= PHYSICS_BOX_STEP;
+		step++;
 	}
+	
+	pbox->storedtiming = timing;
 
 	if(pbox->stopcount < 16)
 		return ret;
@@ -481,3 +545,90 @@ long ARX_PHYSICS_BOX_ApplyModel(PHYSICS_BOX_DATA * pbox, float framediff, float
 	return ret;
 }
 
+long ARX_PHYSICS_BOX_ApplyModel(PHYSICS_BOX_DATA * pbox, float framediff, float rubber, EntityHandle source) {
+	return ARX_PHYSICS_BOX_ApplyModel(pbox, framediff, rubber, source, NULL);
+}
+
+namespace {
+
+//! Don't bother using threads for less than this many boxes per thread
+const size_t PHYSICS_BOX_MIN_PARALLEL = 8;
+
+struct PhysicsBoxTask : public WorkerPool::Task {
+	
+	const std::vector<PhysicsBoxJob *> & m_jobs;
+	
+	explicit PhysicsBoxTask(const std::vector<PhysicsBoxJob *> & jobs) : m_jobs(jobs) { }
+	
+	void execute(size_t i) {
+		m_jobs[i]->simulate();
+	}
+	
+};
+
+} // anonymous namespace
+
+PhysicsBoxBatch::~PhysicsBoxBatch() {
+	for(size_t i = 0; i < m_jobs.size(); i++) {
+		delete m_jobs[i];
+	}
+}
+
+void PhysicsBoxBatch::clear() {
+	m_count = 0;
+	m_next = 0;
+}
+
+void PhysicsBoxBatch::add(PHYSICS_BOX_DATA * pbox, float framediff, float rubber) {
+	
+	// Boxes that are not simulated in this frame are cheap to handle in apply()
+	if(!pbox || pbox->active == 2 || framediff == 0.f
+	   || getPhysicsBoxTiming(pbox, framediff, rubber) < PHYSICS_BOX_STEP
+	   || pbox->nb_physvert <= 0 || size_t(pbox->nb_physvert) > SpringForces::MaxVertices) {
+		return;
+	}
+	
+	if(m_count == m_jobs.size()) {
+		m_jobs.push_back(new PhysicsBoxJob);
+	}
+	
+	PhysicsBoxJob & job = *m_jobs[m_count++];
+	job.pbox = pbox;
+	job.framediff = framediff;
+	job.rubber = rubber;
+	job.state = *pbox;
+	job.initial.assign(pbox->vert, pbox->vert + pbox->nb_physvert);
+	job.collisions.clear();
+	
+}
+
+void PhysicsBoxBatch::simulate(WorkerPool * workers) {
+	
+	if(!workers || m_count < 2 * PHYSICS_BOX_MIN_PARALLEL) {
+		for(size_t i = 0; i < m_count; i++) {
+			m_jobs[i]->simulate();
+		}
+		return;
+	}
+	
+	PhysicsBoxTask task(m_jobs);
+	workers->run(task, m_count);
+	
+}
+
+long PhysicsBoxBatch::apply(PHYSICS_BOX_DATA * pbox, float framediff, float rubber,
+                            EntityHandle source) {
+	
+	const PhysicsBoxJob * job = NULL;
+	for(size_t i = m_next; i < m_count; i++) {
+		if(m_jobs[i]->pbox == pbox) {
+			if(m_jobs[i]->matches(pbox, framediff, rubber)) {
+				job = m_jobs[i];
+			}
+			m_next = i + 1;
+			break;
+		}
+	}
+	
+	return ARX_PHYSICS_BOX_ApplyModel(pbox, framediff, rubber, source, job);
+}
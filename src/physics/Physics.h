@@ -47,11 +47,59 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #ifndef ARX_PHYSICS_PHYSICS_H
 #define ARX_PHYSICS_PHYSICS_H
 
+#include <stddef.h>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
 #include "game/GameTypes.h"
 #include "graphics/GraphicsTypes.h"
 
 struct EERIEPOLY;
+struct PhysicsBoxJob;
+class WorkerPool;
 
 long ARX_PHYSICS_BOX_ApplyModel(PHYSICS_BOX_DATA * pbox, float framediff, float rubber, EntityHandle source);
 
+/*!
+ * Simulates the physics boxes of many entities ahead of time on worker threads.
+ *
+ * \ref simulate() integrates all added boxes in parallel and only tests them against
+ * the background. \ref apply() must then be called for each box instead of
+ * \ref ARX_PHYSICS_BOX_ApplyModel(), in the same order. It tests the boxes against
+ * entities and fields and plays the collision sounds. The precomputed steps are used
+ * until the box hits anything other than the background, and not at all if the box
+ * was modified after it was added. The results are always exactly the same as those of
+ * \ref ARX_PHYSICS_BOX_ApplyModel().
+ */
+class PhysicsBoxBatch : private boost::noncopyable {
+	
+public:
+	
+	PhysicsBoxBatch() : m_count(0), m_next(0) { }
+	~PhysicsBoxBatch();
+	
+	//! Remove all boxes - the memory is kept for the next frame
+	void clear();
+	
+	//! Add a box to be simulated with the parameters that will be passed to \ref apply()
+	void add(PHYSICS_BOX_DATA * pbox, float framediff, float rubber);
+	
+	//! Simulate all added boxes, on the worker threads if there are enough of them
+	void simulate(WorkerPool * workers = NULL);
+	
+	//! Same as \ref ARX_PHYSICS_BOX_ApplyModel() but uses the precomputed steps if possible
+	long apply(PHYSICS_BOX_DATA * pbox, float framediff, float rubber, EntityHandle source);
+	
+	//! \return the number of boxes that need to be simulated
+	size_t size() const { return m_count; }
+	
+private:
+	
+	std::vector<PhysicsBoxJob *> m_jobs;
+	size_t m_count;
+	size_t m_next; //!< Index of the job expected in the next \ref apply() call
+	
+};
+
 #endif // ARX_PHYSICS_PHYSICS_H
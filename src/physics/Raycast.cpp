@@ -0,0 +1,239 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "physics/Raycast.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+#include "graphics/data/Mesh.h"
+#include "physics/BackgroundCollision.h"
+
+namespace {
+
+//! Number of polygons filtered at once before running the exact tests
+const size_t RAYCAST_BATCH_SIZE = 64;
+
+//! Tolerance for the bounds tests so that hits on tile borders are not lost to rounding
+const float RAYCAST_MARGIN = 1.f;
+
+//! Position along the segment for hits and tile borders that are never reached
+const float RAYCAST_NEVER = std::numeric_limits<float>::max();
+
+/*!
+ * Double-sided segment-triangle intersection
+ * \return the position of the hit along the segment in [0, 1], or \ref RAYCAST_NEVER
+ */
+float intersectTriangle(const Vec3f & start, const Vec3f & dir,
+                        const Vec3f & a, const Vec3f & b, const Vec3f & c) {
+	
+	Vec3f e1 = b - a;
+	Vec3f e2 = c - a;
+	
+	Vec3f p = glm::cross(dir, e2);
+	float det = glm::dot(e1, p);
+	if(det == 0.f) {
+		return RAYCAST_NEVER;
+	}
+	float inv = 1.f / det;
+	
+	Vec3f s = start - a;
+	float u = glm::dot(s, p) * inv;
+	if(u < 0.f || u > 1.f) {
+		return RAYCAST_NEVER;
+	}
+	
+	Vec3f q = glm::cross(s, e1);
+	float v = glm::dot(dir, q) * inv;
+	if(v < 0.f || u + v > 1.f) {
+		return RAYCAST_NEVER;
+	}
+	
+	float t = glm::dot(e2, q) * inv;
+	if(t < 0.f || t > 1.f) {
+		return RAYCAST_NEVER;
+	}
+	
+	return t;
+}
+
+/*!
+ * Test the polygons of a tile whose bounds overlap the box [min, max] around the part
+ * of the segment that crosses the tile. The box already includes \ref RAYCAST_MARGIN.
+ *
+ * \param nearest position of the nearest hit so far, updated if a nearer one is found
+ * \param hit     index of the polygon for nearest
+ */
+void testPolygons(const BackgroundCollision & bc, const BackgroundCollision::Range & range,
+                  const Vec3f & start, const Vec3f & dir, const Vec3f & min, const Vec3f & max,
+                  PolyType ignored, float & nearest, size_t & hit) {
+	
+	const BackgroundCollision::Geometry & geo = bc.geometry;
+	
+	size_t candidates[RAYCAST_BATCH_SIZE];
+	
+	for(size_t begin = range.begin; begin < range.end; begin += RAYCAST_BATCH_SIZE) {
+		size_t end = std::min(range.end, begin + RAYCAST_BATCH_SIZE);
+		
+		// Filter the whole batch without branches using only the packed bounds
+		size_t count = 0;
+		for(size_t i = begin; i < end; i++) {
+			const Vec4f & bounds = bc.boundsXZ[i];
+			bool overlaps = !(bc.type[i] & ignored)
+			                & (bc.minY[i] <= max.y) & (bc.maxY[i] >= min.y)
+			                & (bounds.x <= max.x) & (bounds.z >= min.x)
+			                & (bounds.y <= max.z) & (bounds.w >= min.z);
+			candidates[count] = i;
+			count += overlaps ? 1 : 0;
+		}
+		
+		for(size_t j = 0; j < count; j++) {
+			size_t i = candidates[j];
+			
+			Vec3f v0 = geo.vertex(i, 0);
+			Vec3f v1 = geo.vertex(i, 1);
+			Vec3f v2 = geo.vertex(i, 2);
+			
+			float t = intersectTriangle(start, dir, v0, v1, v2);
+			if(bc.type[i] & POLY_QUAD) {
+				t = std::min(t, intersectTriangle(start, dir, v1, geo.vertex(i, 3), v2));
+			}
+			
+			if(t < nearest) {
+				nearest = t;
+				hit = i;
+			}
+		}
+		
+	}
+	
+}
+
+} // anonymous namespace
+
+RaycastResult raycastBackground(const Vec3f & start, const Vec3f & end, PolyType ignored,
+                                RaycastFlags flags) {
+	
+	const EERIE_BACKGROUND & bkg = *ACTIVEBKG;
+	const BackgroundCollision & bc = backgroundCollision;
+	
+	RaycastResult result;
+	result.type = RaycastResult::Miss;
+	result.poly = NULL;
+	result.pos = end;
+	
+	float sizeX = float(bkg.Xsize) * bkg.Xdiv;
+	float sizeZ = float(bkg.Zsize) * bkg.Zdiv;
+	
+	if(start.x < 0.f || start.x >= sizeX || start.z < 0.f || start.z >= sizeZ) {
+		result.type = RaycastResult::OutOfBounds;
+		result.pos = start;
+		return result;
+	}
+	
+	Vec3f dir = end - start;
+	
+	// Part of the segment that is inside the tile grid
+	float last = 1.f;
+	if(dir.x > 0.f) {
+		last = std::min(last, (sizeX - start.x) / dir.x);
+	} else if(dir.x < 0.f) {
+		last = std::min(last, -start.x / dir.x);
+	}
+	if(dir.z > 0.f) {
+		last = std::min(last, (sizeZ - start.z) / dir.z);
+	} else if(dir.z < 0.f) {
+		last = std::min(last, -start.z / dir.z);
+	}
+	
+	long x = std::min(long(start.x * bkg.Xmul), bkg.Xsize - 1l);
+	long z = std::min(long(start.z * bkg.Zmul), bkg.Zsize - 1l);
+	
+	// Position along the segment where it crosses the next tile border in each direction
+	long stepX = (dir.x < 0.f) ? -1 : 1;
+	long stepZ = (dir.z < 0.f) ? -1 : 1;
+	float deltaX = (dir.x != 0.f) ? float(bkg.Xdiv) / glm::abs(dir.x) : RAYCAST_NEVER;
+	float deltaZ = (dir.z != 0.f) ? float(bkg.Zdiv) / glm::abs(dir.z) : RAYCAST_NEVER;
+	float nextX = RAYCAST_NEVER;
+	if(dir.x != 0.f) {
+		nextX = (float((dir.x > 0.f) ? x + 1 : x) * bkg.Xdiv - start.x) / dir.x;
+	}
+	float nextZ = RAYCAST_NEVER;
+	if(dir.z != 0.f) {
+		nextZ = (float((dir.z > 0.f) ? z + 1 : z) * bkg.Zdiv - start.z) / dir.z;
+	}
+	
+	float enter = 0.f;
+	float nearest = RAYCAST_NEVER;
+	size_t hit = 0;
+	
+	for(;;) {
+		
+		float exit = std::min(std::min(nextX, nextZ), last);
+		
+		if((flags & RaycastStopAtEmptyTiles) && bkg.fastdata[x][z].nbpoly == 0) {
+			// Hits found so far are all beyond this tile, or the walk would have stopped
+			result.type = RaycastResult::EmptyTile;
+			result.pos = start + dir * enter;
+			return result;
+		}
+		
+		Vec3f a = start + dir * enter;
+		Vec3f b = start + dir * exit;
+		Vec3f min = glm::min(a, b) - Vec3f(RAYCAST_MARGIN);
+		Vec3f max = glm::max(a, b) + Vec3f(RAYCAST_MARGIN);
+		
+		const BackgroundCollision::Range & range = bc.getPolysIn(x, z);
+		if(range.minY <= max.y && range.maxY >= min.y) {
+			testPolygons(bc, range, start, dir, min, max, ignored, nearest, hit);
+		}
+		
+		// Any polygon hit inside this tile is also in its polyin list
+		if(nearest <= exit || exit >= last) {
+			break;
+		}
+		
+		if(nextX < nextZ) {
+			x += stepX;
+			enter = nextX;
+			nextX += deltaX;
+		} else {
+			z += stepZ;
+			enter = nextZ;
+			nextZ += deltaZ;
+		}
+		
+		if(x < 0 || x >= bkg.Xsize || z < 0 || z >= bkg.Zsize) {
+			break;
+		}
+	}
+	
+	if(nearest != RAYCAST_NEVER) {
+		result.type = RaycastResult::Polygon;
+		result.poly = bc.poly[hit];
+		result.pos = start + dir * nearest;
+	} else if(last < 1.f) {
+		result.type = RaycastResult::OutOfBounds;
+		result.pos = start + dir * last;
+	}
+	
+	return result;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_PHYSICS_RAYCAST_H
+#define ARX_PHYSICS_RAYCAST_H
+
+#include "graphics/GraphicsTypes.h"
+#include "math/Types.h"
+#include "platform/Flags.h"
+
+struct EERIEPOLY;
+
+enum RaycastFlag {
+	RaycastStopAtEmptyTiles = (1<<0) //!< Treat tiles without any polygons as solid
+};
+DECLARE_FLAGS(RaycastFlag, RaycastFlags)
+DECLARE_FLAGS_OPERATORS(RaycastFlags)
+
+struct RaycastResult {
+	
+	enum Type {
+		Miss,        //!< Nothing was hit before the end of the segment
+		Polygon,     //!< The segment hit \ref poly
+		EmptyTile,   //!< The segment entered a tile without polygons
+		OutOfBounds  //!< The segment started or left outside of the background tiles
+	};
+	
+	Type type;
+	EERIEPOLY * poly; //!< Polygon that was hit or \c NULL
+	Vec3f pos; //!< Point where the segment was stopped, or its end for \ref Miss
+	
+};
+
+/*!
+ * Find the first background polygon crossed by the segment from start to end.
+ *
+ * Only the tiles crossed by the segment are visited, in order, with a 2D DDA on the
+ * tile grid. Tiles are skipped if the segment passes above or below all of their
+ * polygons, and the polygons of each tile are first filtered by their bounds in one
+ * batch before the exact segment-triangle tests.
+ * The walk stops at the first tile that contains a hit.
+ *
+ * This uses the collision data in \ref backgroundCollision for \ref ACTIVEBKG.
+ *
+ * \param ignored polygons with any of these types are never hit
+ */
+RaycastResult raycastBackground(const Vec3f & start, const Vec3f & end, PolyType ignored,
+                                RaycastFlags flags = 0);
+
+#endif // ARX_PHYSICS_RAYCAST_H
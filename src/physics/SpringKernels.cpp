@@ -0,0 +1,214 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "physics/SpringKernels.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARX_SPRING_KERNELS_SSE2 1
+#include <emmintrin.h>
+#else
+#define ARX_SPRING_KERNELS_SSE2 0
+#endif
+
+// 32-bit ARM NEON has no exact division or square root
+#if !ARX_SPRING_KERNELS_SSE2 && defined(__aarch64__)
+#define ARX_SPRING_KERNELS_NEON 1
+#include <arm_neon.h>
+#else
+#define ARX_SPRING_KERNELS_NEON 0
+#endif
+
+#include "graphics/GraphicsTypes.h"
+#include "platform/Platform.h"
+
+namespace {
+
+//! Minimum distance between two vertices to avoid dividing by zero
+const float MIN_SPRING_LENGTH = 0.000001f;
+
+} // anonymous namespace
+
+void computeSpringForcesScalar(const PHYSVERT * vert, size_t count, float stiffness,
+                               float damping, SpringForces & result) {
+	
+	arx_assert(count <= SpringForces::MaxVertices);
+	
+	for(size_t i = 0; i < count; i++) {
+		for(size_t j = i + 1; j < count; j++) {
+			
+			float restlength = glm::distance(vert[i].initpos, vert[j].initpos);
+			
+			Vec3f deltaP = vert[i].pos - vert[j].pos;
+			float dist = std::max(glm::length(deltaP), MIN_SPRING_LENGTH);
+			float divdist = 1.f / dist;
+			float hterm = (dist - restlength) * stiffness;
+			
+			Vec3f deltaV = vert[i].velocity - vert[j].velocity;
+			float dterm = glm::dot(deltaV, deltaP) * damping * divdist;
+			dterm = -(hterm + dterm);
+			divdist *= dterm;
+			Vec3f force = deltaP * divdist;
+			
+			result.x[i][j] = force.x;
+			result.y[i][j] = force.y;
+			result.z[i][j] = force.z;
+		}
+	}
+	
+}
+
+#if ARX_SPRING_KERNELS_SSE2 || ARX_SPRING_KERNELS_NEON
+
+namespace {
+
+/*
+ * Minimal wrappers around the SSE2 and NEON intrinsics. All operations must match the
+ * scalar code exactly - no fused multiply-add, reciprocal or approximate sqrt.
+ */
+
+#if ARX_SPRING_KERNELS_SSE2
+
+typedef __m128 float4;
+
+inline float4 load(const float * p) { return _mm_loadu_ps(p); }
+inline void store(float * p, float4 v) { _mm_storeu_ps(p, v); }
+inline float4 splat(float f) { return _mm_set1_ps(f); }
+inline float4 add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline float4 div(float4 a, float4 b) { return _mm_div_ps(a, b); }
+inline float4 sqrt(float4 f) { return _mm_sqrt_ps(f); }
+//! Same as -f for each lane, including the sign of zero
+inline float4 neg(float4 f) { return _mm_xor_ps(f, _mm_set1_ps(-0.f)); }
+//! Same as std::max(a, b) for each lane
+inline float4 max(float4 a, float4 b) {
+	__m128 m = _mm_cmplt_ps(a, b);
+	return _mm_or_ps(_mm_and_ps(m, b), _mm_andnot_ps(m, a));
+}
+
+#else
+
+typedef float32x4_t float4;
+
+inline float4 load(const float * p) { return vld1q_f32(p); }
+inline void store(float * p, float4 v) { vst1q_f32(p, v); }
+inline float4 splat(float f) { return vdupq_n_f32(f); }
+inline float4 add(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 sub(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 mul(float4 a, float4 b) { return vmulq_f32(a, b); }
+inline float4 div(float4 a, float4 b) { return vdivq_f32(a, b); }
+inline float4 sqrt(float4 f) { return vsqrtq_f32(f); }
+//! Same as -f for each lane, including the sign of zero
+inline float4 neg(float4 f) { return vnegq_f32(f); }
+//! Same as std::max(a, b) for each lane - vmaxq_f32() handles NaN differently
+inline float4 max(float4 a, float4 b) { return vbslq_f32(vcltq_f32(a, b), b, a); }
+
+#endif
+
+//! Same as glm::dot() for each lane
+inline float4 dot(float4 ax, float4 ay, float4 az, float4 bx, float4 by, float4 bz) {
+	return add(add(mul(ax, bx), mul(ay, by)), mul(az, bz));
+}
+
+} // anonymous namespace
+
+void computeSpringForces(const PHYSVERT * vert, size_t count, float stiffness, float damping,
+                         SpringForces & result) {
+	
+	arx_assert(count <= SpringForces::MaxVertices);
+	
+	// Copy the vertices to a structure of arrays, padded with zeros for the last block
+	const size_t size = SpringForces::RowSize;
+	float px[size], py[size], pz[size];
+	float vx[size], vy[size], vz[size];
+	float ix[size], iy[size], iz[size];
+	for(size_t i = 0; i < size; i++) {
+		const PHYSVERT * pv = (i < count) ? &vert[i] : NULL;
+		px[i] = pv ? pv->pos.x : 0.f;
+		py[i] = pv ? pv->pos.y : 0.f;
+		pz[i] = pv ? pv->pos.z : 0.f;
+		vx[i] = pv ? pv->velocity.x : 0.f;
+		vy[i] = pv ? pv->velocity.y : 0.f;
+		vz[i] = pv ? pv->velocity.z : 0.f;
+		ix[i] = pv ? pv->initpos.x : 0.f;
+		iy[i] = pv ? pv->initpos.y : 0.f;
+		iz[i] = pv ? pv->initpos.z : 0.f;
+	}
+	
+	const float4 k = splat(stiffness);
+	const float4 d = splat(damping);
+	const float4 one = splat(1.f);
+	const float4 minLength = splat(MIN_SPRING_LENGTH);
+	
+	for(size_t i = 0; i < count; i++) {
+		
+		const float4 pix = splat(px[i]), piy = splat(py[i]), piz = splat(pz[i]);
+		const float4 vix = splat(vx[i]), viy = splat(vy[i]), viz = splat(vz[i]);
+		const float4 iix = splat(ix[i]), iiy = splat(iy[i]), iiz = splat(iz[i]);
+		
+		// Lanes past the vertex count compute garbage that is never read
+		for(size_t j = i + 1; j < count; j += 4) {
+			
+			float4 rx = sub(iix, load(&ix[j]));
+			float4 ry = sub(iiy, load(&iy[j]));
+			float4 rz = sub(iiz, load(&iz[j]));
+			float4 restlength = sqrt(dot(rx, ry, rz, rx, ry, rz));
+			
+			float4 dpx = sub(pix, load(&px[j]));
+			float4 dpy = sub(piy, load(&py[j]));
+			float4 dpz = sub(piz, load(&pz[j]));
+			float4 dist = max(sqrt(dot(dpx, dpy, dpz, dpx, dpy, dpz)), minLength);
+			float4 divdist = div(one, dist);
+			float4 hterm = mul(sub(dist, restlength), k);
+			
+			float4 dvx = sub(vix, load(&vx[j]));
+			float4 dvy = sub(viy, load(&vy[j]));
+			float4 dvz = sub(viz, load(&vz[j]));
+			float4 dterm = mul(mul(dot(dvx, dvy, dvz, dpx, dpy, dpz), d), divdist);
+			dterm = neg(add(hterm, dterm));
+			divdist = mul(divdist, dterm);
+			
+			store(&result.x[i][j], mul(dpx, divdist));
+			store(&result.y[i][j], mul(dpy, divdist));
+			store(&result.z[i][j], mul(dpz, divdist));
+		}
+	}
+	
+}
+
+#else
+
+void computeSpringForces(const PHYSVERT * vert, size_t count, float stiffness, float damping,
+                         SpringForces & result) {
+	computeSpringForcesScalar(vert, count, stiffness, damping, result);
+}
+
+#endif
+
+const char * getSpringKernelName() {
+#if ARX_SPRING_KERNELS_SSE2
+	return "sse2";
+#elif ARX_SPRING_KERNELS_NEON
+	return "neon";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_PHYSICS_SPRINGKERNELS_H
+#define ARX_PHYSICS_SPRINGKERNELS_H
+
+#include <stddef.h>
+
+#include "math/Types.h"
+
+struct PHYSVERT;
+
+/*!
+ * Spring forces between all pairs of vertices of a physics box.
+ *
+ * The force values are stored as a structure of arrays so that the kernels can
+ * compute four springs at once. Rows are padded so that the last block of a row
+ * can be written without checking the vertex count.
+ */
+struct SpringForces {
+	
+	//! Maximum number of vertices in a physics box
+	static const size_t MaxVertices = 32;
+	
+	static const size_t RowSize = MaxVertices + 4;
+	
+	float x[MaxVertices][RowSize];
+	float y[MaxVertices][RowSize];
+	float z[MaxVertices][RowSize];
+	
+	/*!
+	 * \return the force applied to vertex i by the spring between i and j.
+	 *         Vertex j gets the opposite force.
+	 */
+	Vec3f get(size_t i, size_t j) const {
+		return (i < j) ? Vec3f(x[i][j], y[i][j], z[i][j]) : -Vec3f(x[j][i], y[j][i], z[j][i]);
+	}
+	
+};
+
+/*!
+ * Compute the forces of the springs that keep the vertices of a physics box at their
+ * initial distances to each other.
+ *
+ * This uses SSE2 or NEON where available and otherwise falls back to
+ * \ref computeSpringForcesScalar(). Both versions return exactly the same results as
+ * evaluating each spring on its own.
+ *
+ * \param stiffness force per unit of distance from the rest length
+ * \param damping   force per unit of relative velocity along the spring
+ */
+void computeSpringForces(const PHYSVERT * vert, size_t count, float stiffness, float damping,
+                         SpringForces & result);
+
+//! Scalar version of \ref computeSpringForces() that computes one spring at a time
+void computeSpringForcesScalar(const PHYSVERT * vert, size_t count, float stiffness,
+                               float damping, SpringForces & result);
+
+//! \return the instruction set used by the spring kernel: "sse2", "neon" or "scalar"
+const char * getSpringKernelName();
+
+#endif // ARX_PHYSICS_SPRINGKERNELS_H
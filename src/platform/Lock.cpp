@@ -19,6 +19,8 @@
 
 #include "platform/Lock.h"
 
+#include <climits>
+
 #if ARX_HAVE_PTHREADS
 
 Lock::Lock() : locked(false) {
@@ -53,6 +55,39 @@ void Lock::unlock() {
 	pthread_mutex_unlock(&mutex);
 }
 
+Semaphore::Semaphore(unsigned _count) : count(_count) {
+	const pthread_mutex_t mutex_init = PTHREAD_MUTEX_INITIALIZER;
+	mutex = mutex_init;
+	const pthread_cond_t cond_init = PTHREAD_COND_INITIALIZER;
+	cond = cond_init;
+}
+
+Semaphore::~Semaphore() {
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+void Semaphore::wait() {
+	
+	pthread_mutex_lock(&mutex);
+	
+	while(count == 0) {
+		int rc = pthread_cond_wait(&cond, &mutex);
+		arx_assert(rc == 0);
+		ARX_UNUSED(rc);
+	}
+	
+	count--;
+	pthread_mutex_unlock(&mutex);
+}
+
+void Semaphore::post() {
+	pthread_mutex_lock(&mutex);
+	count++;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
 #elif ARX_PLATFORM == ARX_PLATFORM_WIN32
 
 Lock::Lock() {
@@ -74,4 +109,22 @@ void Lock::unlock() {
 	ReleaseMutex(mutex);
 }
 
+Semaphore::Semaphore(unsigned count) {
+	semaphore = CreateSemaphore(NULL, LONG(count), LONG_MAX, NULL);
+}
+
+Semaphore::~Semaphore() {
+	CloseHandle(semaphore);
+}
+
+void Semaphore::wait() {
+	DWORD rc = WaitForSingleObject(semaphore, INFINITE);
+	arx_assert(rc == WAIT_OBJECT_0);
+	ARX_UNUSED(rc);
+}
+
+void Semaphore::post() {
+	ReleaseSemaphore(semaphore, 1, NULL);
+}
+
 #endif
@@ -76,4 +76,30 @@ public:
 	
 };
 
+//! Counting semaphore to let threads sleep until there is work for them
+class Semaphore {
+	
+private:
+	
+#if ARX_HAVE_PTHREADS
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned count;
+#elif ARX_PLATFORM == ARX_PLATFORM_WIN32
+	HANDLE semaphore;
+#endif
+	
+public:
+	
+	explicit Semaphore(unsigned count = 0);
+	~Semaphore();
+	
+	//! Wait until the count is positive and then decrement it
+	void wait();
+	
+	//! Increment the count, waking up one waiting thread
+	void post();
+	
+};
+
 #endif // ARX_PLATFORM_LOCK_H
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "platform/WorkerPool.h"
+
+#include "platform/Thread.h"
+
+class WorkerPool::Worker : public Thread {
+	
+	WorkerPool & m_pool;
+	
+public:
+	
+	Worker(WorkerPool & pool, const std::string & name) : m_pool(pool) {
+		setThreadName(name);
+	}
+	
+protected:
+	
+	void run() {
+		while(true) {
+			
+			m_pool.m_start.wait();
+			
+			{
+				Autolock lock(m_pool.m_lock);
+				if(m_pool.m_stop) {
+					return;
+				}
+			}
+			
+			m_pool.work();
+			
+			m_pool.m_done.post();
+		}
+	}
+	
+};
+
+WorkerPool::WorkerPool(size_t threadCount, const std::string & name)
+	: m_task(NULL), m_count(0), m_next(0), m_stop(false) {
+	
+	for(size_t i = 0; i < threadCount; i++) {
+		m_threads.push_back(new Worker(*this, name));
+		m_threads.back()->start();
+	}
+	
+}
+
+WorkerPool::~WorkerPool() {
+	
+	{
+		Autolock lock(m_lock);
+		m_stop = true;
+	}
+	
+	for(size_t i = 0; i < m_threads.size(); i++) {
+		m_start.post();
+	}
+	
+	for(size_t i = 0; i < m_threads.size(); i++) {
+		m_threads[i]->waitForCompletion();
+		delete m_threads[i];
+	}
+	
+}
+
+bool WorkerPool::next(size_t & i) {
+	
+	Autolock lock(m_lock);
+	
+	if(m_next == m_count) {
+		return false;
+	}
+	
+	i = m_next++;
+	return true;
+}
+
+void WorkerPool::work() {
+	size_t i;
+	while(next(i)) {
+		m_task->execute(i);
+	}
+}
+
+void WorkerPool::run(Task & task, size_t count) {
+	
+	{
+		Autolock lock(m_lock);
+		m_task = &task;
+		m_count = count;
+		m_next = 0;
+	}
+	
+	for(size_t i = 0; i < m_threads.size(); i++) {
+		m_start.post();
+	}
+	
+	work();
+	
+	/*
+	 * A worker may wake up more than once if the others are slow to do so, but every
+	 * wake-up is followed by exactly one post once that worker has finished the
+	 * iterations it claimed. After as many posts as wake-ups have been queued, no
+	 * worker is still running an iteration.
+	 */
+	for(size_t i = 0; i < m_threads.size(); i++) {
+		m_done.wait();
+	}
+	
+	m_task = NULL;
+}
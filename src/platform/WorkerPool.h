@@ -0,0 +1,95 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_PLATFORM_WORKERPOOL_H
+#define ARX_PLATFORM_WORKERPOOL_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "platform/Lock.h"
+
+/*!
+ * Persistent worker threads that run the iterations of a loop in parallel.
+ *
+ * The threads are started once and then sleep until there is work for them, so
+ * the pool is cheap enough to be used for short tasks every frame.
+ */
+class WorkerPool : private boost::noncopyable {
+	
+public:
+	
+	//! Loop body run by the pool
+	class Task {
+		
+	public:
+		
+		virtual void execute(size_t i) = 0;
+		
+	protected:
+		
+		~Task() { }
+		
+	};
+	
+	/*!
+	 * Start the worker threads.
+	 * \param threadCount Number of threads in addition to the thread calling \ref run().
+	 */
+	WorkerPool(size_t threadCount, const std::string & name);
+	
+	//! Stop and join the worker threads
+	~WorkerPool();
+	
+	/*!
+	 * Call task.execute(i) for all i in [0, count) and wait until all calls have returned.
+	 * The calling thread also runs iterations. Must not be called by more than one thread
+	 * at a time.
+	 */
+	void run(Task & task, size_t count);
+	
+	size_t getThreadCount() const { return m_threads.size(); }
+	
+private:
+	
+	class Worker;
+	
+	//! Claim the next iteration to run, \return false if there are none left
+	bool next(size_t & i);
+	
+	//! Run iterations until there are none left
+	void work();
+	
+	std::vector<Worker *> m_threads;
+	
+	Semaphore m_start; //!< One post per worker for each \ref run() call or to stop
+	Semaphore m_done; //!< Posted by each worker that has woken up once it is done
+	
+	Lock m_lock;
+	Task * m_task;
+	size_t m_count;
+	size_t m_next;
+	bool m_stop;
+	
+};
+
+#endif // ARX_PLATFORM_WORKERPOOL_H
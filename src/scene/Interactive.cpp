@@ -104,8 +104,8 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "physics/CollisionShapes.h"
 #include "physics/Box.h"
 #include "physics/Clothes.h"
+#include "physics/EntityIndex.h"
 
-#include "platform/Thread.h"
 #include "platform/profiler/Profiler.h"
 
 #include "scene/ChangeLevel.h"
@@ -232,12 +232,7 @@ void ARX_INTERACTIVE_DestroyDynamicInfo(Entity * io)
 	}
 	
 	if(io->ioflags & IO_NPC) {
-		// to check again later...
-		long count = 50;
-		while((io->_npcdata->pathfind.pathwait == 1) && count--) {
-			Thread::sleep(1);
-		}
-		free(io->_npcdata->pathfind.list);
+		EERIE_PATHFINDER_Cancel(io->_npcdata->pathfind.request);
 		io->_npcdata->pathfind = IO_PATHFIND();
 	}
 	
@@ -411,8 +406,19 @@ TREATZONE_IO * treatio = NULL;
 long TREATZONE_CUR = 0;
 static long TREATZONE_MAX = 0;
 
+//! Treat zone slots by entity position
+static EntityIndex treatzoneIndex;
+
+/*!
+ * How far entities may move between index updates without being missed by queries.
+ * Entities moved by the physics are updated immediately, this only needs to cover
+ * other movement during a single frame.
+ */
+static const float TREATZONE_INDEX_TOLERANCE = 200.f;
+
 void TREATZONE_Clear() {
 	TREATZONE_CUR = 0;
+	treatzoneIndex.clear();
 }
 
 void TREATZONE_Release() {
@@ -420,6 +426,7 @@ void TREATZONE_Release() {
 	treatio = NULL;
 	TREATZONE_MAX = 0;
 	TREATZONE_CUR = 0;
+	treatzoneIndex.clear();
 }
 
 void TREATZONE_RemoveIO(Entity * io)
@@ -430,6 +437,7 @@ void TREATZONE_RemoveIO(Entity * io)
 				treatio[i].io = NULL;
 				treatio[i].ioflags = 0;
 				treatio[i].show = 0;
+				treatzoneIndex.remove(i);
 			}
 		}
 	}
@@ -456,9 +464,26 @@ void TREATZONE_AddIO(Entity * io, long flag)
 
 	treatio[TREATZONE_CUR].show = io->show;
 	treatio[TREATZONE_CUR].num = io->index();
+	treatzoneIndex.update(TREATZONE_CUR, io->pos);
 	TREATZONE_CUR++;
 }
 
+void TREATZONE_UpdateIndex() {
+	for(long i = 0; i < TREATZONE_CUR; i++) {
+		TREATZONE_UpdateIndex(i);
+	}
+}
+
+void TREATZONE_UpdateIndex(long i) {
+	if(i < TREATZONE_CUR && treatio[i].io) {
+		treatzoneIndex.update(i, treatio[i].io->pos);
+	}
+}
+
+void TREATZONE_GetNearby(const Vec3f & pos, float radius, std::vector<long> & slots) {
+	treatzoneIndex.query(pos, radius + TREATZONE_INDEX_TOLERANCE, slots);
+}
+
 void CheckSetAnimOutOfTreatZone(Entity * io, long num)
 {
 	arx_assert(io);
@@ -800,8 +825,7 @@ static void ARX_INTERACTIVE_ClearIODynData_II(Entity * io) {
 	ARX_EQUIPMENT_ReleaseAll(io);
 	
 	if(io->ioflags & IO_NPC) {
-		free(io->_npcdata->pathfind.list);
-		io->_npcdata->pathfind.list = NULL;
+		EERIE_PATHFINDER_Cancel(io->_npcdata->pathfind.request);
 		io->_npcdata->pathfind = IO_PATHFIND();
 		io->_npcdata->pathfind.truetarget = EntityHandle::Invalid;
 		io->_npcdata->pathfind.listnb = -1;
@@ -1279,6 +1303,13 @@ void ARX_INTERACTIVE_Teleport(Entity * io, const Vec3f & target, bool flag) {
 	
 	MOLLESS_Clear(io->obj, 1);
 	ResetVVPos(io);
+	
+	// Teleports can move entities farther than the treat zone index tolerance
+	for(long i = 0; i < TREATZONE_CUR; i++) {
+		if(treatio[i].io == io) {
+			TREATZONE_UpdateIndex(i);
+		}
+	}
 }
 
 Entity * AddInteractive(const res::path & classPath, EntityInstance instance, AddInteractiveFlags flags) {
@@ -1653,7 +1684,7 @@ IO_NPCDATA::IO_NPCDATA() {
 
 IO_NPCDATA::~IO_NPCDATA() {
 	delete ex_rotate;
-	free(pathfind.list);
+	EERIE_PATHFINDER_Cancel(pathfind.request);
 }
 
 Entity * AddNPC(const res::path & classPath, EntityInstance instance, AddInteractiveFlags flags) {
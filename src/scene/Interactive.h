@@ -49,6 +49,7 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 
 #include <stddef.h>
 #include <string>
+#include <vector>
 
 #include "game/Entity.h"
 #include "game/EntityId.h"
@@ -171,6 +172,19 @@ void TREATZONE_Clear();
 void TREATZONE_Release();
 void TREATZONE_AddIO(Entity * io, long flag = 0);
 void TREATZONE_RemoveIO(Entity * io);
+
+//! Update the indexed positions of all treat zone entities
+void TREATZONE_UpdateIndex();
+
+//! Update the indexed position of the entity in treat zone slot i
+void TREATZONE_UpdateIndex(long i);
+
+/*!
+ * Get the treat zone slots of entities that may be within a horizontal distance.
+ * Callers must still check the actual distance of each entity.
+ * \param slots Receives indices into \ref treatio in ascending order.
+ */
+void TREATZONE_GetNearby(const Vec3f & pos, float radius, std::vector<long> & slots);
 bool IsSameObject(Entity * io, Entity * ioo);
 void ARX_INTERACTIVE_ClearAllDynData();
 bool HaveCommonGroup(Entity * io, Entity * ioo);
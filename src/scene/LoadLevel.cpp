@@ -50,6 +50,7 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include <ctime>
 #include <iomanip>
 #include <sstream>
+#include <vector>
 
 #include <boost/algorithm/string/case_conv.hpp>
 
@@ -61,8 +62,10 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "core/Config.h"
 #include "core/Core.h"
 
+#include "game/EntityId.h"
 #include "game/EntityManager.h"
 #include "game/Levels.h"
+#include "game/NPC.h"
 #include "game/Player.h"
 
 #include "gui/LoadLevelScreen.h"
@@ -94,6 +97,8 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "scene/LevelFormat.h"
 #include "scene/Light.h"
 
+#include "script/ScriptCache.h"
+
 #include "util/String.h"
 
 
@@ -475,6 +480,40 @@ Entity * LoadInter_Ex(const res::path & classPath, EntityInstance instance,
 	return io;
 }
 
+static res::path getClassPath(const DANAE_LS_INTER & dli) {
+	
+	std::string pathstr = boost::to_lower_copy(util::loadString(dli.name));
+	
+	size_t pos = pathstr.find("graph");
+	if(pos != std::string::npos) {
+		pathstr = pathstr.substr(pos);
+	}
+	
+	return res::path::load(pathstr).remove_ext();
+}
+
+/*!
+ * Load and preprocess the class and instance scripts for all entities in the level
+ * in parallel, so that entities sharing a class don't each load their own copy.
+ */
+static void preloadEntityScripts(const DANAE_LS_INTER * inter, long count) {
+	
+	std::vector<PakFile *> files;
+	files.reserve(count * 2);
+	
+	for(long i = 0; i < count; i++) {
+		
+		res::path classPath = getClassPath(inter[i]);
+		files.push_back(resources->getFile(classPath + ".asl"));
+		
+		// Same as Entity::instancePath()
+		EntityId id(classPath, inter[i].ident);
+		files.push_back(resources->getFile(classPath.parent() / id.string() / (id.className() + ".asl")));
+	}
+	
+	preloadScripts(files);
+}
+
 static ColorBGRA savedColorConversion(u32 bgra) {
 	return ColorBGRA(bgra);
 }
@@ -544,6 +583,8 @@ bool DanaeLoadLevel(const res::path & file, bool loadEntities) {
 		return false;
 	}
 	
+	ARX_PHYSICS_CreateWorkers();
+	
 	LogDebug("Loading Scene");
 	
 	// Loading Scene
@@ -613,6 +654,10 @@ bool DanaeLoadLevel(const res::path & file, bool loadEntities) {
 		LoadLevelScreen();
 	}
 	
+	if(loadEntities && dlh.nb_inter > 0) {
+		preloadEntityScripts(reinterpret_cast<const DANAE_LS_INTER *>(dat + pos), dlh.nb_inter);
+	}
+	
 	for(long i = 0 ; i < dlh.nb_inter ; i++) {
 		
 		progressBarAdvance(increment);
@@ -622,16 +667,7 @@ bool DanaeLoadLevel(const res::path & file, bool loadEntities) {
 		pos += sizeof(DANAE_LS_INTER);
 		
 		if(loadEntities) {
-			
-			std::string pathstr = boost::to_lower_copy(util::loadString(dli->name));
-			
-			size_t pos = pathstr.find("graph");
-			if(pos != std::string::npos) {
-				pathstr = pathstr.substr(pos);
-			}
-			
-			res::path classPath = res::path::load(pathstr).remove_ext();
-			LoadInter_Ex(classPath, dli->ident, dli->pos.toVec3(), dli->angle, trans);
+			LoadInter_Ex(getClassPath(*dli), dli->ident, dli->pos.toVec3(), dli->angle, trans);
 		}
 	}
 	
@@ -963,6 +999,7 @@ void DanaeClearLevel(long flag)
 	FlyingOverIO = NULL;
 
 	EERIE_PATHFINDER_Release();
+	ARX_PHYSICS_ReleaseWorkers();
 
 	InitBkg(ACTIVEBKG, MAX_BKGX, MAX_BKGZ, BKG_SIZX, BKG_SIZZ);
 	
@@ -0,0 +1,469 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "scene/RoomVisibility.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include <boost/crc.hpp>
+
+#include "graphics/GraphicsTypes.h"
+#include "graphics/data/Mesh.h"
+#include "io/fs/FilePath.h"
+#include "io/fs/FileStream.h"
+#include "io/fs/Filesystem.h"
+#include "io/fs/SystemPaths.h"
+#include "io/log/Logger.h"
+#include "platform/Time.h"
+
+RoomVisibility roomVisibility;
+
+namespace {
+
+//! Increment when the visibility computation changes to invalidate existing cache files
+const u32 ROOM_VISIBILITY_CACHE_VERSION = 1;
+
+//! How far the camera may be outside of the room polygons for the visible rooms to apply
+const float VIEWER_MARGIN = 50.f;
+
+//! Tolerance for the camera being on the wrong side of a portal
+const float PORTAL_EPSILON = 1.f;
+
+//! Number of different viewer bounds to track per portal before merging them
+const size_t MAX_VIEWER_BOUNDS = 16;
+
+//! Number of merges after which the viewer bounds for a portal are no longer restricted
+const size_t MAX_VIEWER_MERGES = 8;
+
+bool contains(const EERIE_3D_BBOX & a, const EERIE_3D_BBOX & b) {
+	return a.min.x <= b.min.x && a.min.y <= b.min.y && a.min.z <= b.min.z
+	       && a.max.x >= b.max.x && a.max.y >= b.max.y && a.max.z >= b.max.z;
+}
+
+/*!
+ * Get the bounds of the part of a box for which dot(normal, pos) >= dist
+ *
+ * \return false if no part of the box is on that side of the plane
+ */
+bool clipBox(const EERIE_3D_BBOX & box, const Vec3f & normal, float dist,
+             EERIE_3D_BBOX & result) {
+	
+	Vec3f corners[8];
+	float dists[8];
+	for(size_t i = 0; i < 8; i++) {
+		corners[i] = Vec3f((i & 1) ? box.max.x : box.min.x,
+		                   (i & 2) ? box.max.y : box.min.y,
+		                   (i & 4) ? box.max.z : box.min.z);
+		dists[i] = glm::dot(normal, corners[i]) - dist + PORTAL_EPSILON;
+	}
+	
+	result.reset();
+	
+	for(size_t i = 0; i < 8; i++) {
+		
+		if(dists[i] >= 0.f) {
+			result.add(corners[i]);
+		}
+		
+		// Add where the box edges cross the plane
+		for(size_t bit = 1; bit < 8; bit <<= 1) {
+			size_t j = i | bit;
+			if(j != i && (dists[i] >= 0.f) != (dists[j] >= 0.f)) {
+				float t = dists[i] / (dists[i] - dists[j]);
+				result.add(corners[i] + (corners[j] - corners[i]) * t);
+			}
+		}
+		
+	}
+	
+	return result.valid();
+}
+
+//! Viewer bounds for which the rooms behind a portal have already been processed
+struct ExploredPortal {
+	
+	std::vector<EERIE_3D_BBOX> bounds;
+	size_t merges;
+	
+	ExploredPortal() : merges(0) { }
+	
+	/*!
+	 * Check if the rooms behind the portal need to be processed for the given viewer bounds.
+	 * The bounds may be enlarged, which only makes the result more conservative.
+	 */
+	bool add(EERIE_3D_BBOX & viewer, const EERIE_3D_BBOX & limit) {
+		
+		for(size_t i = 0; i < bounds.size(); i++) {
+			if(contains(bounds[i], viewer)) {
+				return false;
+			}
+		}
+		
+		if(bounds.size() >= MAX_VIEWER_BOUNDS || (!bounds.empty() && merges > 0)) {
+			if(merges >= MAX_VIEWER_MERGES) {
+				viewer = limit;
+			} else {
+				for(size_t i = 0; i < bounds.size(); i++) {
+					viewer.add(bounds[i].min);
+					viewer.add(bounds[i].max);
+				}
+			}
+			merges++;
+			bounds.clear();
+		} else {
+			std::vector<EERIE_3D_BBOX>::iterator end;
+			end = std::remove_if(bounds.begin(), bounds.end(), ContainedIn(viewer));
+			bounds.erase(end, bounds.end());
+		}
+		
+		bounds.push_back(viewer);
+		
+		return true;
+	}
+	
+private:
+	
+	struct ContainedIn {
+		
+		const EERIE_3D_BBOX & m_box;
+		
+		explicit ContainedIn(const EERIE_3D_BBOX & box) : m_box(box) { }
+		
+		bool operator()(const EERIE_3D_BBOX & other) const {
+			return contains(m_box, other);
+		}
+		
+	};
+	
+};
+
+struct ViewerState {
+	
+	size_t room;
+	EERIE_3D_BBOX viewer; //!< Camera positions that can see into the room
+	
+	ViewerState(size_t _room, const EERIE_3D_BBOX & _viewer) : room(_room), viewer(_viewer) { }
+	
+};
+
+template <typename T>
+const T * readCache(const char * & data, const char * end, size_t n = 1) {
+	
+	size_t toread = sizeof(T) * n;
+	if(size_t(end - data) < toread) {
+		return NULL;
+	}
+	
+	const T * result = reinterpret_cast<const T *>(data);
+	data += toread;
+	
+	return result;
+}
+
+#pragma pack(push,1)
+
+struct ROOM_VISIBILITY_CACHE_HEADER {
+	u32 version;
+	u32 hash;
+	u32 nb_rooms;
+};
+
+#pragma pack(pop)
+
+fs::path getCachePath(u32 hash) {
+	
+	if(fs::paths.user.empty()) {
+		return fs::path();
+	}
+	
+	std::ostringstream oss;
+	oss << std::hex << std::setfill('0') << std::setw(8) << hash << ".pvs";
+	
+	return fs::paths.user / "cache" / "pvs" / oss.str();
+}
+
+} // anonymous namespace
+
+void RoomVisibility::computeBounds(const EERIE_PORTAL_DATA & portals,
+                                   const EERIE_BACKGROUND & bkg) {
+	
+	m_rooms = portals.rooms.size();
+	m_bounds.resize(m_rooms);
+	
+	for(size_t i = 0; i < m_rooms; i++) {
+		
+		const EERIE_ROOM_DATA & room = portals.rooms[i];
+		EERIE_3D_BBOX & bounds = m_bounds[i];
+		
+		bounds.reset();
+		for(long j = 0; j < room.nb_polys; j++) {
+			const EERIE_BKG_INFO & feg = bkg.fastdata[room.epdata[j].p.x][room.epdata[j].p.y];
+			const EERIEPOLY & ep = feg.polydata[room.epdata[j].idx];
+			bounds.add(ep.min);
+			bounds.add(ep.max);
+		}
+		
+		if(bounds.valid()) {
+			bounds.min -= Vec3f(VIEWER_MARGIN);
+			bounds.max += Vec3f(VIEWER_MARGIN);
+		}
+		
+	}
+	
+	m_visible.assign(m_rooms * m_rooms, true);
+}
+
+void RoomVisibility::compute(const EERIE_PORTAL_DATA & portals) {
+	
+	arx_assert(m_rooms == portals.rooms.size());
+	
+	m_visible.assign(m_rooms * m_rooms, false);
+	
+	std::vector<ExploredPortal> explored;
+	std::vector<ViewerState> stack;
+	
+	for(size_t source = 0; source < m_rooms; source++) {
+		
+		m_visible[source * m_rooms + source] = true;
+		
+		if(!m_bounds[source].valid()) {
+			// The camera can never be inside this room
+			continue;
+		}
+		
+		explored.assign(portals.portals.size(), ExploredPortal());
+		
+		stack.push_back(ViewerState(source, m_bounds[source]));
+		while(!stack.empty()) {
+			
+			ViewerState state = stack.back();
+			stack.pop_back();
+			
+			const EERIE_ROOM_DATA & room = portals.rooms[state.room];
+			for(long i = 0; i < room.nb_portals; i++) {
+				
+				size_t index = size_t(room.portals[i]);
+				const EERIE_PORTALS & portal = portals.portals[index];
+				if(portal.room_1 == portal.room_2) {
+					continue;
+				}
+				
+				// The camera must be on the side of the portal that faces the current room
+				Vec3f normal = portal.poly.norm;
+				size_t next;
+				if(portal.room_1 == state.room) {
+					next = portal.room_2;
+				} else if(portal.room_2 == state.room) {
+					next = portal.room_1;
+					normal = -normal;
+				} else {
+					continue;
+				}
+				
+				EERIE_3D_BBOX viewer;
+				if(!clipBox(state.viewer, normal, glm::dot(normal, portal.poly.center), viewer)) {
+					continue;
+				}
+				
+				if(!explored[index].add(viewer, m_bounds[source])) {
+					continue;
+				}
+				
+				m_visible[source * m_rooms + next] = true;
+				stack.push_back(ViewerState(next, viewer));
+			}
+			
+		}
+		
+	}
+	
+}
+
+u32 RoomVisibility::getHash(const EERIE_PORTAL_DATA & portals) const {
+	
+	boost::crc_32_type crc;
+	
+	u32 counts[2] = { u32(m_rooms), u32(portals.portals.size()) };
+	crc.process_bytes(counts, sizeof(counts));
+	
+	for(size_t i = 0; i < m_rooms; i++) {
+		const EERIE_3D_BBOX & bounds = m_bounds[i];
+		f32 box[6] = {
+			bounds.min.x, bounds.min.y, bounds.min.z, bounds.max.x, bounds.max.y, bounds.max.z
+		};
+		crc.process_bytes(box, sizeof(box));
+		const EERIE_ROOM_DATA & room = portals.rooms[i];
+		for(long j = 0; j < room.nb_portals; j++) {
+			s32 portal = room.portals[j];
+			crc.process_bytes(&portal, sizeof(portal));
+		}
+	}
+	
+	for(size_t i = 0; i < portals.portals.size(); i++) {
+		const EERIE_PORTALS & portal = portals.portals[i];
+		u32 rooms[2] = { u32(portal.room_1), u32(portal.room_2) };
+		crc.process_bytes(rooms, sizeof(rooms));
+		const EERIEPOLY & ep = portal.poly;
+		f32 plane[6] = { ep.center.x, ep.center.y, ep.center.z, ep.norm.x, ep.norm.y, ep.norm.z };
+		crc.process_bytes(plane, sizeof(plane));
+	}
+	
+	return crc.checksum();
+}
+
+bool RoomVisibility::load(const fs::path & file, u32 hash) {
+	
+	std::string buffer = fs::read(file);
+	const char * data = buffer.data();
+	const char * end = data + buffer.size();
+	
+	const ROOM_VISIBILITY_CACHE_HEADER * header;
+	header = readCache<ROOM_VISIBILITY_CACHE_HEADER>(data, end);
+	if(!header || header->version != ROOM_VISIBILITY_CACHE_VERSION || header->hash != hash
+	   || header->nb_rooms != m_rooms) {
+		return false;
+	}
+	
+	std::vector<bool> visible(m_rooms * m_rooms, false);
+	
+	for(size_t i = 0; i < m_rooms; i++) {
+		
+		const u32 * count = readCache<u32>(data, end);
+		if(!count || *count > m_rooms) {
+			return false;
+		}
+		
+		const u32 * rooms = readCache<u32>(data, end, *count);
+		if(!rooms) {
+			return false;
+		}
+		
+		for(u32 j = 0; j < *count; j++) {
+			if(rooms[j] >= m_rooms) {
+				return false;
+			}
+			visible[i * m_rooms + rooms[j]] = true;
+		}
+	}
+	
+	if(data != end) {
+		return false;
+	}
+	
+	m_visible.swap(visible);
+	
+	return true;
+}
+
+bool RoomVisibility::save(const fs::path & file, u32 hash) const {
+	
+	if(!fs::create_directories(file.parent())) {
+		return false;
+	}
+	
+	fs::ofstream ofs(file, fs::fstream::out | fs::fstream::binary | fs::fstream::trunc);
+	if(!ofs.is_open()) {
+		return false;
+	}
+	
+	ROOM_VISIBILITY_CACHE_HEADER header;
+	header.version = ROOM_VISIBILITY_CACHE_VERSION;
+	header.hash = hash;
+	header.nb_rooms = u32(m_rooms);
+	ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	
+	std::vector<u32> rooms;
+	for(size_t i = 0; i < m_rooms; i++) {
+		
+		rooms.clear();
+		for(size_t j = 0; j < m_rooms; j++) {
+			if(m_visible[i * m_rooms + j]) {
+				rooms.push_back(u32(j));
+			}
+		}
+		
+		u32 count = u32(rooms.size());
+		ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+		if(count > 0) {
+			ofs.write(reinterpret_cast<const char *>(&rooms[0]), sizeof(u32) * count);
+		}
+	}
+	
+	return !ofs.fail();
+}
+
+void RoomVisibility::clear() {
+	m_rooms = 0;
+	m_bounds.clear();
+	m_visible.clear();
+}
+
+bool RoomVisibility::isCameraInside(size_t room, const Vec3f & pos) const {
+	
+	if(room >= m_rooms) {
+		return false;
+	}
+	
+	const EERIE_3D_BBOX & bounds = m_bounds[room];
+	return pos.x >= bounds.min.x && pos.y >= bounds.min.y && pos.z >= bounds.min.z
+	       && pos.x <= bounds.max.x && pos.y <= bounds.max.y && pos.z <= bounds.max.z;
+}
+
+size_t RoomVisibility::getVisibleCount(size_t room) const {
+	
+	if(room >= m_rooms) {
+		return 0;
+	}
+	
+	std::vector<bool>::const_iterator begin = m_visible.begin() + room * m_rooms;
+	return size_t(std::count(begin, begin + m_rooms, true));
+}
+
+void RoomVisibility_Create() {
+	
+	roomVisibility.clear();
+	
+	if(!portals) {
+		return;
+	}
+	
+	roomVisibility.computeBounds(*portals, *ACTIVEBKG);
+	
+	u32 hash = roomVisibility.getHash(*portals);
+	fs::path cache = getCachePath(hash);
+	if(!cache.empty() && fs::is_regular_file(cache)) {
+		if(roomVisibility.load(cache, hash)) {
+			LogDebug("Loaded room visibility from " << cache);
+			return;
+		}
+		LogWarning << "Ignoring invalid room visibility cache " << cache;
+	}
+	
+	u64 start = platform::getTimeUs();
+	roomVisibility.compute(*portals);
+	LogInfo << "Computed room visibility for " << roomVisibility.getRoomCount() << " rooms in "
+	        << (platform::getElapsedUs(start) / 1000) << " ms";
+	
+	if(!cache.empty() && !roomVisibility.save(cache, hash)) {
+		LogWarning << "Could not save room visibility cache " << cache;
+	}
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_SCENE_ROOMVISIBILITY_H
+#define ARX_SCENE_ROOMVISIBILITY_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "graphics/BaseGraphicsTypes.h"
+#include "math/Types.h"
+#include "platform/Platform.h"
+
+struct EERIE_BACKGROUND;
+struct EERIE_PORTAL_DATA;
+namespace fs { class path; }
+
+/*!
+ * Potentially visible set (PVS) of rooms for each room of a level.
+ *
+ * The portal traversal in ARX_SCENE_Update() only passes a portal if the camera is on
+ * the side of it that faces the current room. A room is potentially visible from
+ * another room if there is a chain of portals leading to it for which some camera
+ * position inside the viewer bounds of the first room is on the correct side of every
+ * portal. Frustum and distance clipping are ignored, so the traversal can never reach a
+ * room that is not in the set while the camera is inside the viewer bounds.
+ */
+class RoomVisibility {
+	
+	size_t m_rooms;
+	std::vector<EERIE_3D_BBOX> m_bounds; //!< Viewer bounds for each room
+	std::vector<bool> m_visible; //!< m_rooms x m_rooms matrix indexed by [from * m_rooms + to]
+	
+public:
+	
+	RoomVisibility() : m_rooms(0) { }
+	
+	/*!
+	 * Compute the viewer bounds from the room polygons.
+	 * All rooms are marked as visible from each other until compute() or load() is called.
+	 */
+	void computeBounds(const EERIE_PORTAL_DATA & portals, const EERIE_BACKGROUND & bkg);
+	
+	//! Compute the visible rooms from the portals - computeBounds() must be called first
+	void compute(const EERIE_PORTAL_DATA & portals);
+	
+	//! Hash of all portal data and viewer bounds the visible rooms depend on
+	u32 getHash(const EERIE_PORTAL_DATA & portals) const;
+	
+	bool load(const fs::path & file, u32 hash);
+	bool save(const fs::path & file, u32 hash) const;
+	
+	void clear();
+	
+	size_t getRoomCount() const { return m_rooms; }
+	
+	//! Camera positions for which the visible rooms apply - may be invalid for empty rooms
+	const EERIE_3D_BBOX & getViewerBounds(size_t room) const { return m_bounds[room]; }
+	
+	//! \return true if the visible rooms of a room apply to a camera at the given position
+	bool isCameraInside(size_t room, const Vec3f & pos) const;
+	
+	bool isVisible(size_t from, size_t to) const {
+		return from < m_rooms && to < m_rooms && m_visible[from * m_rooms + to];
+	}
+	
+	size_t getVisibleCount(size_t room) const;
+	
+	bool operator==(const RoomVisibility & other) const {
+		return m_rooms == other.m_rooms && m_visible == other.m_visible;
+	}
+	
+};
+
+extern RoomVisibility roomVisibility;
+
+/*!
+ * Create the potentially visible rooms for the loaded portals.
+ * The result is cached in the user directory as it only depends on the level geometry.
+ */
+void RoomVisibility_Create();
+
+#endif // ARX_SCENE_ROOMVISIBILITY_H
@@ -725,7 +725,6 @@ struct SavedPathfindTarget {
 		IO_PATHFIND a;
 		a.flags = 0;
 		a.listnb = a.listpos = a.pathwait = 0;
-		a.list = NULL;
 		a.truetarget = EntityHandle(truetarget);
 		return a;
 	}
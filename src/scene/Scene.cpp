@@ -66,6 +66,7 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "gui/Interface.h"
 #include "gui/Cursor.h"
 
+#include "graphics/CullingKernels.h"
 #include "graphics/Draw.h"
 #include "graphics/DrawLine.h"
 #include "graphics/GraphicsModes.h"
@@ -83,6 +84,7 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 
 #include "scene/Light.h"
 #include "scene/Interactive.h"
+#include "scene/RoomVisibility.h"
 
 #include "physics/Projectile.h"
 
@@ -189,6 +191,9 @@ static std::vector<EERIEPOLY*> vPolyLava;
 std::vector<PORTAL_ROOM_DRAW> RoomDraw;
 std::vector<long> RoomDrawList;
 
+//! Indices of the room polygons that are inside the room frustums
+static std::vector<u32> visiblePolys;
+
 //*************************************************************************************
 //*************************************************************************************
 Vec2f getWaterFxUvOffset(const Vec3f & odtv, float power)
@@ -299,63 +304,6 @@ bool VisibleSphere(const Vec3f & pos, float radius) {
 	return true;
 }
 
-static bool IsBBoxInFrustrum(const EERIE_3D_BBOX & bbox, const EERIE_FRUSTRUM & frustrum) {
-	
-	Vec3f point = bbox.min;
-	if(IsSphereInFrustrum(point, frustrum)) {
-		return true;
-	}
-	
-	point = Vec3f(bbox.max.x, bbox.min.y, bbox.min.z);
-	if(IsSphereInFrustrum(point, frustrum)) {
-		return true;
-	}
-	
-	point = Vec3f(bbox.max.x, bbox.max.y, bbox.min.z);
-	if(IsSphereInFrustrum(point, frustrum)) {
-		return true;
-	}
-	
-	point = Vec3f(bbox.min.x, bbox.max.y, bbox.min.z);
-	if(IsSphereInFrustrum(point, frustrum)) {
-		return true;
-	}
-	
-	point = Vec3f(bbox.min.x, bbox.min.y, bbox.max.z);
-	if(IsSphereInFrustrum(point, frustrum)) {
-		return true;
-	}
-	
-	point = Vec3f(bbox.max.x, bbox.min.y, bbox.max.z);
-	if(IsSphereInFrustrum(point, frustrum)) {
-		return true;
-	}
-	
-	point = bbox.max;
-	if(IsSphereInFrustrum(point, frustrum)) {
-		return true;
-	}
-	
-	point = Vec3f(bbox.min.x, bbox.max.y, bbox.max.z);
-	if(IsSphereInFrustrum(point, frustrum)) {
-		return true;
-	}
-	
-	return	false;
-}
-
-static bool FrustrumsClipBBox3D(const EERIE_FRUSTRUM_DATA & frustrums,
-                                const EERIE_3D_BBOX & bbox) {
-	
-	for(long i = 0; i < frustrums.nb_frustrums; i++)
-	{
-		if(IsBBoxInFrustrum(bbox, frustrums.frustrums[i]))
-			return false;
-	}
-
-	return false;
-}
-
 // USAGE/FUNCTION
 //   io can be NULL if io is valid io->bbox3D contains 3D world-bbox
 //   bboxmin & bboxmax ARE in fact 2D-screen BBOXes using only (x,y).
@@ -409,9 +357,7 @@ bool ARX_SCENE_PORTAL_ClipIO(Entity * io, const Vec3f & position) {
 
 				EERIE_FRUSTRUM_DATA & frustrums = RoomDraw[room_num].frustrum;
 
-				if(FrustrumsClipSphere(frustrums, sphere) ||
-				   FrustrumsClipBBox3D(frustrums, io->bbox3D)
-				) {
+				if(FrustrumsClipSphere(frustrums, sphere)) {
 					io->bbox2D.min = Vec2f(-1.f, -1.f);
 					io->bbox2D.max = Vec2f(-1.f, -1.f);
 					return true;
@@ -635,26 +581,10 @@ static void ARX_PORTALS_InitDrawnRooms() {
 	
 	arx_assert(portals);
 
-	for(size_t i = 0; i < portals->portals.size(); i++) {
-		EERIE_PORTALS *ep = &portals->portals[i];
-
-		ep->useportal = 0;
-	}
-
 	for(size_t i = 0; i < portals->rooms.size(); i++) {
 		ARX_PORTALS_Frustrum_ClearIndexCount(i);
 	}
 
-	RoomDraw.resize(portals->rooms.size());
-
-	for(size_t i = 0; i < RoomDraw.size(); i++) {
-		RoomDraw[i].count=0;
-		RoomDraw[i].flags=0;
-		RoomDraw[i].frustrum.nb_frustrums=0;
-	}
-
-	RoomDrawList.clear();
-
 	vPolyWater.clear();
 	vPolyLava.clear();
 
@@ -664,32 +594,8 @@ static void ARX_PORTALS_InitDrawnRooms() {
 	}
 }
 
-bool IsSphereInFrustrum(const Vec3f & point, const EERIE_FRUSTRUM & frustrum, float radius)
-{
-	float dists[4];
-	dists[0]=frustrum.plane[0].getDist(point);
-	dists[1]=frustrum.plane[1].getDist(point);
-	dists[2]=frustrum.plane[2].getDist(point);
-	dists[3]=frustrum.plane[3].getDist(point);
-
-	if (	(dists[0]+radius>0)
-		&&	(dists[1]+radius>0)
-		&&	(dists[2]+radius>0)
-		&&	(dists[3]+radius>0) )
-		return true;
-
-	return false;
-}
-
-static bool FrustrumsClipPoly(const EERIE_FRUSTRUM_DATA & frustrums,
-                              const EERIEPOLY & ep) {
-	
-	for(long i=0; i<frustrums.nb_frustrums; i++) {
-		if(IsSphereInFrustrum(ep.center, frustrums.frustrums[i], ep.v[0].rhw))
-			return false;
-	}
-
-	return true;
+bool IsSphereInFrustrum(const Vec3f & point, const EERIE_FRUSTRUM & frustrum, float radius) {
+	return isSphereInFrustum(point, radius, frustrum);
 }
 
 static void Frustrum_Set(EERIE_FRUSTRUM * fr, long plane,
@@ -792,9 +698,178 @@ static void CreateScreenFrustrum(EERIE_FRUSTRUM * frustrum) {
 	efpPlaneNear.d=d*n;
 }
 
+namespace {
+
+//! Maximum camera movement for which the cached room visibility is reused
+const float PORTAL_VISIBILITY_MAX_MOVE = 8.f;
+
+//! Maximum change of the screen frustum plane normals for reusing the room visibility
+const float PORTAL_VISIBILITY_MAX_TURN = 0.01f;
+
+/*!
+ * Upper bound for the distance between the camera and any point that is not completely
+ * fogged, as a multiple of the far clip distance from the near plane.
+ * Holds for horizontal and vertical fields of view up to 120 degrees.
+ */
+const float PORTAL_VISIBILITY_RANGE = 2.f;
+
+/*!
+ * Camera state for which the rooms in RoomDrawList and their frustums were computed.
+ *
+ * The portal graph is static, so the visible rooms only depend on the camera.
+ * While the camera stays in the same room and close to this state, the portal
+ * frustums are reused instead of clipping all portals again.
+ * The frustums are widened when they are computed so that they still contain
+ * everything visible from any camera within the thresholds above.
+ */
+class PortalVisibilityCache {
+	
+	bool m_valid;
+	size_t m_room;
+	long m_cameraRoom;
+	Vec3f m_pos;
+	EERIE_FRUSTRUM m_frustrum;
+	EERIE_FRUSTRUM_PLANE m_nearPlane;
+	float m_farClip;
+	
+	static bool similar(const EERIE_FRUSTRUM_PLANE & a, const EERIE_FRUSTRUM_PLANE & b) {
+		Vec3f diff(a.a - b.a, a.b - b.b, a.c - b.c);
+		return glm::dot(diff, diff) < PORTAL_VISIBILITY_MAX_TURN * PORTAL_VISIBILITY_MAX_TURN;
+	}
+	
+public:
+	
+	PortalVisibilityCache() : m_valid(false), m_room(0), m_cameraRoom(-1), m_farClip(0.f) { }
+	
+	bool matches(size_t room, long cameraRoom, const Vec3f & pos,
+	             const EERIE_FRUSTRUM & frustrum, float farClip) const {
+		
+		if(!m_valid || room != m_room || cameraRoom != m_cameraRoom || farClip != m_farClip) {
+			return false;
+		}
+		
+		if(!closerThan(pos, m_pos, PORTAL_VISIBILITY_MAX_MOVE)) {
+			return false;
+		}
+		
+		for(size_t i = 0; i < ARRAY_SIZE(frustrum.plane); i++) {
+			if(!similar(frustrum.plane[i], m_frustrum.plane[i])) {
+				return false;
+			}
+		}
+		
+		return similar(efpPlaneNear, m_nearPlane);
+	}
+	
+	void update(size_t room, long cameraRoom, const Vec3f & pos,
+	            const EERIE_FRUSTRUM & frustrum, float farClip) {
+		m_valid = true;
+		m_room = room;
+		m_cameraRoom = cameraRoom;
+		m_pos = pos;
+		m_frustrum = frustrum;
+		m_nearPlane = efpPlaneNear;
+		m_farClip = farClip;
+	}
+	
+	void invalidate() {
+		m_valid = false;
+	}
+	
+} portalVisibility;
+
+//! Cleared while computing the visible rooms if they can't be reused for a moving camera
+bool portalVisibilityReusable;
+
+} // anonymous namespace
+
+static void ARX_PORTALS_ResetVisibility() {
+	
+	arx_assert(portals);
+	
+	for(size_t i = 0; i < portals->portals.size(); i++) {
+		EERIE_PORTALS *ep = &portals->portals[i];
+
+		ep->useportal = 0;
+	}
+	
+	RoomDraw.resize(portals->rooms.size());
+
+	for(size_t i = 0; i < RoomDraw.size(); i++) {
+		RoomDraw[i].count=0;
+		RoomDraw[i].flags=0;
+		RoomDraw[i].frustrum.nb_frustrums=0;
+	}
+
+	RoomDrawList.clear();
+}
+
+void ARX_PORTALS_InvalidateVisibility() {
+	portalVisibility.invalidate();
+}
+
 void RoomDrawRelease() {
 	RoomDrawList.resize(0);
 	RoomDraw.resize(0);
+	portalVisibility.invalidate();
+}
+
+//! Distance from the near plane after which portals are ignored
+static float ARX_PORTALS_GetFarClip() {
+	return ACTIVECAM->cdepth * (fZFogEnd*1.1f);
+}
+
+/*!
+ * Distance by which the screen frustum, near and far planes are moved outward.
+ *
+ * Moving the camera by up to PORTAL_VISIBILITY_MAX_MOVE changes the distance of any
+ * point to these planes by the same amount. Turning it changes the distance by at
+ * most the change of the plane normal times the distance to the camera.
+ */
+static float ARX_PORTALS_GetScreenMargin(float farClip) {
+	return PORTAL_VISIBILITY_MAX_MOVE
+	       + PORTAL_VISIBILITY_MAX_TURN * PORTAL_VISIBILITY_RANGE * farClip;
+}
+
+/*!
+ * Move the planes of a portal frustum outward so that it contains everything visible
+ * through the portal from any camera within PORTAL_VISIBILITY_MAX_MOVE of pos.
+ *
+ * Each plane contains a portal edge and rotates around it when the camera moves.
+ * For a camera at distance h from the edge, moving by m rotates the plane by at most
+ * asin(m / (h - m)) <= pi / 2 * m / (h - m), which moves points at distance r from the
+ * edge by at most r times that angle.
+ *
+ * \return false if the camera is too close to an edge to bound the rotation.
+ */
+static bool WidenPortalFrustrum(EERIE_FRUSTRUM & frustrum, const Vec3f & pos,
+                                const EERIEPOLY & ep, float farClip) {
+	
+	// Edges used for each plane by CreateFrustrum()
+	static const size_t edges[4][2] = { { 0, 1 }, { 2, 3 }, { 1, 3 }, { 0, 2 } };
+	
+	const float move = PORTAL_VISIBILITY_MAX_MOVE;
+	
+	for(size_t i = 0; i < ARRAY_SIZE(edges); i++) {
+		
+		const Vec3f & p1 = ep.v[edges[i][0]].p;
+		const Vec3f & p2 = ep.v[edges[i][1]].p;
+		
+		float length = glm::length(p2 - p1);
+		if(length <= 0.f) {
+			return false;
+		}
+		
+		float h = glm::length(glm::cross(p1 - pos, p2 - pos)) / length;
+		if(h <= 2.f * move) {
+			return false;
+		}
+		
+		float r = PORTAL_VISIBILITY_RANGE * farClip + h;
+		frustrum.plane[i].d += r * (PI / 2.f) * move / (h - move);
+	}
+	
+	return true;
 }
 
 static void RoomFrustrumAdd(size_t num, const EERIE_FRUSTRUM & fr) {
@@ -1067,6 +1142,7 @@ static void ARX_PORTALS_Frustrum_RenderRoomTCullSoft(long room_num, const EERIE_
 
 	EP_DATA *pEPDATA = &room.epdata[0];
 
+	// Tile lights are needed for all polygons, even if they are culled
 	for(long lll=0; lll<room.nb_polys; lll++, pEPDATA++) {
 		EERIE_BKG_INFO *feg = &ACTIVEBKG->fastdata[pEPDATA->p.x][pEPDATA->p.y];
 
@@ -1091,7 +1167,16 @@ static void ARX_PORTALS_Frustrum_RenderRoomTCullSoft(long room_num, const EERIE_
 				}
 			}
 		}
+	}
 
+	arx_assert(room.spheres.size() == size_t(room.nb_polys));
+
+	visiblePolys.clear();
+	cullSpheres(room.spheres, frustrums, efpPlaneNear, visiblePolys);
+
+	for(size_t i = 0; i < visiblePolys.size(); i++) {
+		pEPDATA = &room.epdata[visiblePolys[i]];
+		EERIE_BKG_INFO *feg = &ACTIVEBKG->fastdata[pEPDATA->p.x][pEPDATA->p.y];
 		EERIEPOLY *ep = &feg->polydata[pEPDATA->idx];
 
 		if(!ep->tex) {
@@ -1102,14 +1187,6 @@ static void ARX_PORTALS_Frustrum_RenderRoomTCullSoft(long room_num, const EERIE_
 			continue;
 		}
 
-		if(FrustrumsClipPoly(frustrums, *ep)) {
-			continue;
-		}
-
-		if(ep->v[0].rhw < -efpPlaneNear.getDist(ep->center)) {
-			continue;
-		}
-
 		Vec3f nrm = ep->v[2].p - ACTIVECAM->orgTrans.pos;
 		int to = (ep->type & POLY_QUAD) ? 4 : 3;
 
@@ -1345,8 +1422,14 @@ static void ARX_PORTALS_Frustrum_RenderRoom_TransparencyTSoftCull(long room_num)
 	}
 }
 
+/*!
+ * Add a room and all rooms visible through its portals to RoomDrawList
+ *
+ * \param cameraRoom Room whose potentially visible set applies to the camera or -1.
+ */
 static void ARX_PORTALS_Frustrum_ComputeRoom(size_t roomIndex,
-                                             const EERIE_FRUSTRUM & frustrum) {
+                                             const EERIE_FRUSTRUM & frustrum,
+                                             long cameraRoom) {
 	
 	if(RoomDraw[roomIndex].count == 0) {
 		RoomDrawList.push_back(roomIndex);
@@ -1355,7 +1438,8 @@ static void ARX_PORTALS_Frustrum_ComputeRoom(size_t roomIndex,
 	RoomFrustrumAdd(roomIndex, frustrum);
 	RoomDraw[roomIndex].count++;
 
-	float fClippZFar = ACTIVECAM->cdepth * (fZFogEnd*1.1f);
+	float fClippZFar = ARX_PORTALS_GetFarClip();
+	float margin = ARX_PORTALS_GetScreenMargin(fClippZFar);
 	
 	EERIE_ROOM_DATA & room = portals->rooms[roomIndex];
 	
@@ -1366,6 +1450,12 @@ static void ARX_PORTALS_Frustrum_ComputeRoom(size_t roomIndex,
 		if(po->useportal)
 			continue;
 		
+		// Skip rooms that can't be seen from anywhere in the camera room before clipping
+		size_t otherRoom = (po->room_1 == roomIndex) ? po->room_2 : po->room_1;
+		if(cameraRoom >= 0 && !roomVisibility.isVisible(size_t(cameraRoom), otherRoom)) {
+			continue;
+		}
+		
 		EERIEPOLY & epp = po->poly;
 	
 		//clipp NEAR & FAR
@@ -1375,9 +1465,9 @@ static void ARX_PORTALS_Frustrum_ComputeRoom(size_t roomIndex,
 		for(size_t i=0; i<ARRAY_SIZE(epp.v); i++) {
 			float fDist0 = efpPlaneNear.getDist(epp.v[i].p);
 
-			if(fDist0 < 0.f)
+			if(fDist0 < -margin)
 				ucVisibilityNear++;
-			if(fDist0 > fClippZFar)
+			if(fDist0 > fClippZFar + margin)
 				ucVisibilityFar++;
 		}
 
@@ -1397,8 +1487,16 @@ static void ARX_PORTALS_Frustrum_ComputeRoom(size_t roomIndex,
 
 		bool Cull = !(fRes<0.f);
 		
+		// A moving camera could end up on the other side of the portal
+		if(glm::abs(fRes) <= PORTAL_VISIBILITY_MAX_MOVE) {
+			portalVisibilityReusable = false;
+		}
+		
 		EERIE_FRUSTRUM fd;
 		CreateFrustrum(fd, ACTIVECAM->orgTrans.pos, epp, Cull);
+		if(!WidenPortalFrustrum(fd, ACTIVECAM->orgTrans.pos, epp, fClippZFar)) {
+			portalVisibilityReusable = false;
+		}
 
 		size_t roomToCompute = 0;
 		bool computeRoom = false;
@@ -1413,7 +1511,7 @@ static void ARX_PORTALS_Frustrum_ComputeRoom(size_t roomIndex,
 
 		if(computeRoom) {
 			po->useportal=1;
-			ARX_PORTALS_Frustrum_ComputeRoom(roomToCompute, fd);
+			ARX_PORTALS_Frustrum_ComputeRoom(roomToCompute, fd, cameraRoom);
 		}
 	}
 }
@@ -1463,7 +1561,27 @@ void ARX_SCENE_Update() {
 		size_t roomIndex = static_cast<size_t>(room_num);
 		EERIE_FRUSTRUM frustrum;
 		CreateScreenFrustrum(&frustrum);
-		ARX_PORTALS_Frustrum_ComputeRoom(roomIndex, frustrum);
+		
+		const Vec3f & pos = ACTIVECAM->orgTrans.pos;
+		float farClip = ARX_PORTALS_GetFarClip();
+		long cameraRoom = roomVisibility.isCameraInside(roomIndex, pos) ? room_num : -1;
+		if(!portalVisibility.matches(roomIndex, cameraRoom, pos, frustrum, farClip)) {
+			
+			EERIE_FRUSTRUM widened = frustrum;
+			float margin = ARX_PORTALS_GetScreenMargin(farClip);
+			for(size_t i = 0; i < ARRAY_SIZE(widened.plane); i++) {
+				widened.plane[i].d += margin;
+			}
+			
+			portalVisibilityReusable = true;
+			ARX_PORTALS_ResetVisibility();
+			ARX_PORTALS_Frustrum_ComputeRoom(roomIndex, widened, cameraRoom);
+			if(portalVisibilityReusable) {
+				portalVisibility.update(roomIndex, cameraRoom, pos, frustrum, farClip);
+			} else {
+				portalVisibility.invalidate();
+			}
+		}
 
 		for(size_t i = 0; i < RoomDrawList.size(); i++) {
 			ARX_PORTALS_Frustrum_RenderRoomTCullSoft(RoomDrawList[i], RoomDraw[RoomDrawList[i]].frustrum, tim);
@@ -58,6 +58,9 @@ void ARX_SCENE_Render();
 bool ARX_SCENE_PORTAL_ClipIO(Entity * io, const Vec3f & position);
 void RoomDrawRelease();
 
+//! Recompute the visible rooms in the next frame - must be called when the portals change
+void ARX_PORTALS_InvalidateVisibility();
+
 bool VisibleSphere(const Vec3f & pos, float radius);
 
 #endif // ARX_SCENE_SCENE_H
@@ -79,11 +79,13 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 #include "io/resource/PakReader.h"
 #include "io/log/Logger.h"
 
+#include "platform/Time.h"
 #include "platform/profiler/Profiler.h"
 
 #include "scene/Scene.h"
 #include "scene/Interactive.h"
 
+#include "script/ScriptCache.h"
 #include "script/ScriptEvent.h"
 
 
@@ -227,10 +229,67 @@ void ARX_SCRIPT_ResetAll(bool init) {
 	}
 }
 
+// Main event heartbeat scheduling
+// Entities close to the player want a heartbeat every HEARTBEAT_INTERVAL_MIN ms,
+// the desired interval grows with distance up to HEARTBEAT_INTERVAL_MAX ms.
+static const float HEARTBEAT_INTERVAL_MIN = 50.f;
+static const float HEARTBEAT_INTERVAL_MAX = 1000.f;
+static const float HEARTBEAT_INTERVAL_PER_DISTANCE = 0.1f;
+// Time budget for all main events in one frame, in microseconds
+static const u64 HEARTBEAT_BUDGET = 2000;
+// Number of due entities that are always run, even if the budget is exceeded
+static const size_t HEARTBEAT_MIN_COUNT = 4;
+
+namespace {
+
+struct HeartbeatCandidate {
+	
+	EntityHandle handle;
+	float overdue; //!< Time since the last heartbeat relative to the desired interval
+	
+	HeartbeatCandidate(EntityHandle handle_, float overdue_)
+		: handle(handle_), overdue(overdue_) { }
+	
+	//! Sort the most overdue entities first
+	bool operator<(const HeartbeatCandidate & other) const {
+		return overdue > other.overdue;
+	}
+	
+};
+
+} // anonymous namespace
+
+static void ARX_SCRIPT_SendHeartbeat(Entity * io, unsigned long now) {
+	
+	if(io->heartbeat_time != 0 && now > io->heartbeat_time) {
+		float rate = 1000.f / float(now - io->heartbeat_time);
+		if(io->heartbeat_rate == 0.f) {
+			io->heartbeat_rate = rate;
+		} else {
+			io->heartbeat_rate = io->heartbeat_rate * 0.9f + rate * 0.1f;
+		}
+	}
+	io->heartbeat_time = now;
+	
+	if(!io->mainevent.empty()) {
+		
+		// Copy the even name to a local variable as it may change during execution
+		// and cause unexpected behavior in SendIOScriptEvent
+		std::string event = io->mainevent;
+		
+		SendIOScriptEvent(io, SM_NULL, std::string(), event);
+		
+	} else {
+		SendIOScriptEvent(io, SM_MAIN);
+	}
+}
+
 void ARX_SCRIPT_AllowInterScriptExec() {
 	
+	ARX_PROFILE_FUNC();
+	
 	// FIXME static local variable
-	static long ppos = 0;
+	static std::vector<HeartbeatCandidate> candidates;
 	
 	if(arxtime.is_paused()) {
 		return;
@@ -238,32 +297,53 @@ void ARX_SCRIPT_AllowInterScriptExec() {
 	
 	EVENT_SENDER = NULL;
 	
-	long heartbeat_count = std::min(long(entities.size()), 10l);
+	unsigned long now = arxtime.get_updated_ul();
 	
-	for(long n = 0; n < heartbeat_count; n++) {
-		
-		EntityHandle i = EntityHandle(ppos++);
-		if(i >= long(entities.size())){
-			ppos = 0;
-			return;
-		}
+	candidates.clear();
+	for(size_t i = 0; i < entities.size(); i++) {
+		const EntityHandle handle = EntityHandle(i);
+		Entity * io = entities[handle];
 		
-		if(entities[i] == NULL || !(entities[i]->gameFlags & GFLAG_ISINTREATZONE)) {
+		if(!io || !(io->gameFlags & GFLAG_ISINTREATZONE)) {
 			continue;
 		}
 		
-		if(!entities[i]->mainevent.empty()) {
-			
-			// Copy the even name to a local variable as it may change during execution
-			// and cause unexpected behavior in SendIOScriptEvent
-			std::string event = entities[i]->mainevent;
-			
-			SendIOScriptEvent(entities[i], SM_NULL, std::string(), event);
-			
+		float interval = HEARTBEAT_INTERVAL_MIN
+		                 + fdist(io->pos, player.pos) * HEARTBEAT_INTERVAL_PER_DISTANCE;
+		interval = std::min(interval, HEARTBEAT_INTERVAL_MAX);
+		
+		float overdue;
+		if(io->heartbeat_time == 0 || now < io->heartbeat_time) {
+			// Never run or game time was reset (level change, savegame load)
+			overdue = std::numeric_limits<float>::max();
 		} else {
-			SendIOScriptEvent(entities[i], SM_MAIN);
+			overdue = float(now - io->heartbeat_time) / interval;
+		}
+		
+		if(overdue >= 1.f) {
+			candidates.push_back(HeartbeatCandidate(handle, overdue));
 		}
 	}
+	
+	std::sort(candidates.begin(), candidates.end());
+	
+	u64 startTime = platform::getTimeUs();
+	
+	for(size_t n = 0; n < candidates.size(); n++) {
+		
+		if(n >= HEARTBEAT_MIN_COUNT
+		   && platform::getElapsedUs(startTime) >= HEARTBEAT_BUDGET) {
+			break;
+		}
+		
+		// Scripts run by earlier heartbeats may have destroyed the entity
+		Entity * io = entities[candidates[n].handle];
+		if(!io || !(io->gameFlags & GFLAG_ISINTREATZONE)) {
+			continue;
+		}
+		
+		ARX_SCRIPT_SendHeartbeat(io, now);
+	}
 }
 
 static void ARX_SCRIPT_ReleaseLabels(EERIE_SCRIPT * es) {
@@ -288,8 +368,8 @@ void ReleaseScript(EERIE_SCRIPT * es) {
 	
 	es->lvar.clear();
 	
-	free(es->data);
 	es->data = NULL;
+	es->size = 0;
 	
 	ARX_SCRIPT_ReleaseLabels(es);
 	memset(es->shortcut, 0, sizeof(long) * MAX_SHORTCUT);
@@ -1893,6 +1973,7 @@ void ARX_SCRIPT_Timer_Check() {
 void ARX_SCRIPT_Init_Event_Stats() {
 	
 	ScriptEvent::totalCount = 0;
+	ScriptEvent::totalCommands = 0;
 	
 	for(size_t i = 0; i < entities.size(); i++) {
 		const EntityHandle handle = EntityHandle(i);
@@ -2021,12 +2102,10 @@ void loadScript(EERIE_SCRIPT & script, PakFile * file) {
 		return;
 	}
 	
-	free(script.data);
-	
-	script.data = file->readAlloc();
-	script.size = file->size();
+	const CachedScript * cached = getCachedScript(file);
 	
-	std::transform(script.data, script.data + script.size, script.data, ::tolower);
+	script.data = cached->data;
+	script.size = cached->size;
 	
 	script.allowevents = 0;
 	
@@ -2038,6 +2117,6 @@ void loadScript(EERIE_SCRIPT & script, PakFile * file) {
 		script.timers[j] = 0;
 	}
 	
-	ARX_SCRIPT_ComputeShortcuts(script);
+	std::copy(cached->shortcut, cached->shortcut + MAX_SHORTCUT, script.shortcut);
 	
 }
@@ -112,7 +112,7 @@ typedef std::vector<SCRIPT_VAR> SCRIPT_VARIABLES;
 
 struct EERIE_SCRIPT {
 	size_t size;
-	char * data;
+	const char * data; //!< Shared with other instances, see \ref getCachedScript()
 	SCRIPT_VARIABLES lvar;
 	unsigned long lastcall;
 	unsigned long timers[MAX_SCRIPTTIMERS];
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "script/ScriptCache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+#include "io/log/Logger.h"
+#include "io/resource/PakEntry.h"
+#include "platform/Lock.h"
+#include "platform/Thread.h"
+
+namespace {
+
+//! Number of worker threads used to preprocess scripts
+const size_t SCRIPT_LOADER_THREADS = 4;
+
+//! Don't bother starting threads for less than this many scripts
+const size_t SCRIPT_LOADER_MIN_PARALLEL = 8;
+
+typedef std::map<PakFile *, CachedScript *> ScriptCache;
+ScriptCache cache;
+
+void prepareScript(CachedScript & script, PakFile * file, Lock * readLock) {
+	
+	if(readLock) {
+		// Archives share a single stream per .pak file
+		Autolock lock(readLock);
+		script.data = file->readAlloc();
+	} else {
+		script.data = file->readAlloc();
+	}
+	script.size = file->size();
+	
+	std::transform(script.data, script.data + script.size, script.data, ::tolower);
+	
+	EERIE_SCRIPT es;
+	es.data = script.data;
+	es.size = script.size;
+	ARX_SCRIPT_ComputeShortcuts(es);
+	std::copy(es.shortcut, es.shortcut + MAX_SHORTCUT, script.shortcut);
+	
+}
+
+struct ScriptJob {
+	PakFile * file;
+	CachedScript * script;
+};
+
+class ScriptLoaderThread : public Thread {
+	
+	std::vector<ScriptJob> & m_jobs;
+	size_t & m_next;
+	Lock & m_jobLock;
+	Lock & m_readLock;
+	
+public:
+	
+	ScriptLoaderThread(std::vector<ScriptJob> & jobs, size_t & next,
+	                   Lock & jobLock, Lock & readLock)
+		: m_jobs(jobs), m_next(next), m_jobLock(jobLock), m_readLock(readLock) {
+		setThreadName("Script Loader");
+	}
+	
+protected:
+	
+	void run() {
+		while(true) {
+			
+			size_t i;
+			{
+				Autolock lock(m_jobLock);
+				if(m_next == m_jobs.size()) {
+					return;
+				}
+				i = m_next++;
+			}
+			
+			prepareScript(*m_jobs[i].script, m_jobs[i].file, &m_readLock);
+		}
+	}
+	
+};
+
+} // anonymous namespace
+
+const CachedScript * getCachedScript(PakFile * file) {
+	
+	if(!file) {
+		return NULL;
+	}
+	
+	ScriptCache::const_iterator it = cache.find(file);
+	if(it != cache.end()) {
+		return it->second;
+	}
+	
+	CachedScript * script = new CachedScript;
+	prepareScript(*script, file, NULL);
+	cache[file] = script;
+	
+	return script;
+}
+
+void preloadScripts(const std::vector<PakFile *> & files) {
+	
+	std::vector<ScriptJob> jobs;
+	jobs.reserve(files.size());
+	for(size_t i = 0; i < files.size(); i++) {
+		if(files[i] && cache.find(files[i]) == cache.end()) {
+			CachedScript * script = new CachedScript;
+			cache[files[i]] = script;
+			ScriptJob job = { files[i], script };
+			jobs.push_back(job);
+		}
+	}
+	
+	if(jobs.empty()) {
+		return;
+	}
+	
+	size_t threadCount = std::min(SCRIPT_LOADER_THREADS, jobs.size() / SCRIPT_LOADER_MIN_PARALLEL);
+	if(threadCount <= 1) {
+		for(size_t i = 0; i < jobs.size(); i++) {
+			prepareScript(*jobs[i].script, jobs[i].file, NULL);
+		}
+	} else {
+		
+		size_t next = 0;
+		Lock jobLock;
+		Lock readLock;
+		
+		std::vector<ScriptLoaderThread *> threads;
+		for(size_t i = 0; i < threadCount; i++) {
+			threads.push_back(new ScriptLoaderThread(jobs, next, jobLock, readLock));
+			threads.back()->start();
+		}
+		
+		for(size_t i = 0; i < threads.size(); i++) {
+			threads[i]->waitForCompletion();
+			delete threads[i];
+		}
+		
+	}
+	
+	LogDebug("preloaded " << jobs.size() << " scripts using " << threadCount << " threads");
+}
+
+void releaseScriptCache() {
+	
+	for(ScriptCache::iterator it = cache.begin(); it != cache.end(); ++it) {
+		free(it->second->data);
+		delete it->second;
+	}
+	
+	cache.clear();
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_SCRIPT_SCRIPTCACHE_H
+#define ARX_SCRIPT_SCRIPTCACHE_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "script/Script.h"
+
+class PakFile;
+
+/*!
+ * Preprocessed script text that is shared by all entities using the same script file.
+ * Instances only keep a pointer to the data, which must never be modified.
+ */
+struct CachedScript {
+	
+	size_t size;
+	char * data; //!< Lowercase script text
+	long shortcut[MAX_SHORTCUT]; //!< Position of each event handler or -1
+	
+	CachedScript() : size(0), data(NULL) { }
+	
+};
+
+/*!
+ * Get the preprocessed script for a file, loading it if it is not yet cached.
+ * The returned script stays valid until \ref releaseScriptCache() is called.
+ */
+const CachedScript * getCachedScript(PakFile * file);
+
+/*!
+ * Load and preprocess all scripts that are not yet cached using worker threads.
+ * Duplicate and \c NULL entries in the list are ignored.
+ */
+void preloadScripts(const std::vector<PakFile *> & files);
+
+//! Free all cached scripts - no entity may use a script after this
+void releaseScriptCache();
+
+#endif // ARX_SCRIPT_SCRIPTCACHE_H
@@ -70,6 +70,7 @@ ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
 
 
 long ScriptEvent::totalCount = 0;
+long ScriptEvent::totalCommands = 0;
 
 SCRIPT_EVENT AS_EVENT[] = {
 	SCRIPT_EVENT("on null"),
@@ -397,6 +398,8 @@ ScriptResult ScriptEvent::send(EERIE_SCRIPT * es, ScriptMessage msg, const std::
 			
 			script::Command & command = *(it->second);
 			
+			totalCommands++;
+			
 			script::Command::Result res;
 			if(command.getEntityFlags()
 			   && (!io || (command.getEntityFlags() != script::Command::AnyEntity
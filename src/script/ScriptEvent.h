@@ -45,6 +45,7 @@ public:
 	static std::string getName(ScriptMessage msg, const std::string & eventname);
 	
 	static long totalCount;
+	static long totalCommands; //!< Number of commands executed by all events
 	
 	ScriptEvent();
 	virtual ~ScriptEvent();
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tests/graphics/CullingKernelsTest.h"
+
+#include <vector>
+
+#include <cppunit/TestAssert.h>
+
+#include "graphics/CullingKernels.h"
+#include "graphics/data/Mesh.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CullingKernelsTest);
+
+/*
+ * The SIMD kernels must return exactly the same results as the scalar versions.
+ * Random spheres and frustums are generated with a fixed seed so that failures
+ * can be reproduced.
+ */
+
+static unsigned seed = 1;
+
+static float random(float min, float max) {
+	seed = seed * 1103515245u + 12345u;
+	return min + (max - min) * float((seed >> 8) & 0xffff) * (1.f / 0xffff);
+}
+
+static EERIE_FRUSTRUM_PLANE randomPlane() {
+	
+	Vec3f normal = glm::normalize(Vec3f(random(-1.f, 1.f), random(-1.f, 1.f),
+	                                    random(-1.f, 1.f)) + Vec3f(0.f, 0.f, 0.01f));
+	
+	EERIE_FRUSTRUM_PLANE plane;
+	plane.a = normal.x;
+	plane.b = normal.y;
+	plane.c = normal.z;
+	plane.d = random(-500.f, 500.f);
+	
+	return plane;
+}
+
+static EERIE_FRUSTRUM randomFrustum() {
+	EERIE_FRUSTRUM frustum;
+	for(size_t i = 0; i < 4; i++) {
+		frustum.plane[i] = randomPlane();
+	}
+	return frustum;
+}
+
+static Vec3f randomPosition() {
+	return Vec3f(random(-1000.f, 1000.f), random(-1000.f, 1000.f), random(-1000.f, 1000.f));
+}
+
+void CullingKernelsTest::sphereInFrustumTest() {
+	
+	for(size_t i = 0; i < 1000; i++) {
+		
+		EERIE_FRUSTRUM frustum = randomFrustum();
+		
+		for(size_t j = 0; j < 100; j++) {
+			Vec3f center = randomPosition();
+			float radius = (j % 10 == 0) ? 0.f : random(0.f, 600.f);
+			CPPUNIT_ASSERT_EQUAL(isSphereInFrustumScalar(center, radius, frustum),
+			                     isSphereInFrustum(center, radius, frustum));
+		}
+		
+	}
+	
+}
+
+void CullingKernelsTest::cullSpheresTest() {
+	
+	BoundingSpheres spheres;
+	EERIE_FRUSTRUM_DATA frustums;
+	std::vector<u32> expected;
+	std::vector<u32> visible;
+	
+	for(size_t i = 0; i < 500; i++) {
+		
+		// Include sphere counts that are not a multiple of the SIMD width
+		spheres.clear();
+		size_t count = i % 67;
+		for(size_t j = 0; j < count; j++) {
+			spheres.add(randomPosition(), random(0.f, 600.f));
+		}
+		
+		frustums.nb_frustrums = long(i % MAX_FRUSTRUMS) + 1;
+		for(long j = 0; j < frustums.nb_frustrums; j++) {
+			frustums.frustrums[j] = randomFrustum();
+		}
+		
+		EERIE_FRUSTRUM_PLANE near = randomPlane();
+		
+		expected.clear();
+		cullSpheresScalar(spheres, frustums, near, expected);
+		
+		visible.clear();
+		cullSpheres(spheres, frustums, near, visible);
+		
+		CPPUNIT_ASSERT(visible == expected);
+	}
+	
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tests/physics/PhysicsKernelsTest.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <cppunit/TestAssert.h>
+
+#include "graphics/GraphicsTypes.h"
+#include "graphics/data/Mesh.h"
+#include "physics/BackgroundCollision.h"
+#include "physics/CollisionKernels.h"
+#include "physics/SpringKernels.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(PhysicsKernelsTest);
+
+/*
+ * The SIMD kernels must return exactly the same results as the scalar versions.
+ * Random polygons and volumes are generated with a fixed seed so that failures
+ * can be reproduced.
+ */
+
+static unsigned seed = 1;
+
+static float random(float min, float max) {
+	seed = seed * 1103515245u + 12345u;
+	return min + (max - min) * float((seed >> 8) & 0xffff) * (1.f / 0xffff);
+}
+
+static Vec3f randomVector(float size) {
+	return Vec3f(random(-size, size), random(-size, size), random(-size, size));
+}
+
+//! Size of the area containing the test polygons
+static const float AREA_SIZE = 600.f;
+
+static const size_t POLY_COUNT = 1000;
+
+static EERIE_BACKGROUND * background = NULL;
+static BackgroundCollision * collision = NULL;
+
+//! Polygons of all sizes so that every precision level of the cylinder tests is used
+static void randomPoly(EERIEPOLY & ep) {
+	
+	memset(&ep, 0, sizeof(EERIEPOLY));
+	
+	const PolyType types[] = { 0, POLY_QUAD, POLY_WATER, POLY_QUAD | POLY_TRANS, POLY_NOCOL };
+	ep.type = types[size_t(random(0.f, 4.99f))];
+	
+	float size = random(5.f, 120.f);
+	Vec3f origin(random(0.f, AREA_SIZE), random(-100.f, 100.f), random(0.f, AREA_SIZE));
+	ep.v[0].p = origin;
+	ep.v[1].p = origin + Vec3f(size, random(-size, size), random(-10.f, 10.f));
+	ep.v[2].p = origin + Vec3f(random(-10.f, 10.f), random(-size, size), size);
+	ep.v[3].p = origin + Vec3f(size, random(-size, size), size);
+	
+	long count = (ep.type & POLY_QUAD) ? 4 : 3;
+	ep.min = ep.max = ep.center = ep.v[0].p;
+	for(long n = 1; n < count; n++) {
+		ep.min = glm::min(ep.min, ep.v[n].p);
+		ep.max = glm::max(ep.max, ep.v[n].p);
+		ep.center += ep.v[n].p;
+	}
+	ep.center /= float(count);
+	
+	Vec3f normal = glm::cross(ep.v[1].p - ep.v[0].p, ep.v[2].p - ep.v[0].p);
+	ep.norm = glm::normalize(normal);
+	ep.area = glm::length(normal) * 0.5f;
+	if(count == 4) {
+		ep.area += glm::length(glm::cross(ep.v[1].p - ep.v[3].p, ep.v[2].p - ep.v[3].p)) * 0.5f;
+	}
+}
+
+void PhysicsKernelsTest::setUp() {
+	
+	seed = 1;
+	
+	background = new EERIE_BACKGROUND;
+	background->Xsize = 1;
+	background->Zsize = 1;
+	
+	EERIE_BKG_INFO & tile = background->fastdata[0][0];
+	tile.polydata = new EERIEPOLY[POLY_COUNT];
+	tile.nbpoly = short(POLY_COUNT);
+	for(size_t i = 0; i < POLY_COUNT; i++) {
+		randomPoly(tile.polydata[i]);
+	}
+	
+	collision = new BackgroundCollision;
+	collision->build(*background);
+}
+
+void PhysicsKernelsTest::tearDown() {
+	delete collision, collision = NULL;
+	delete[] background->fastdata[0][0].polydata;
+	delete background, background = NULL;
+}
+
+void PhysicsKernelsTest::springForcesTest() {
+	
+	PHYSVERT vert[SpringForces::MaxVertices];
+	SpringForces expected;
+	SpringForces result;
+	
+	for(size_t i = 0; i < 2000; i++) {
+		
+		size_t count = i % SpringForces::MaxVertices + 1;
+		for(size_t j = 0; j < count; j++) {
+			vert[j].initpos = randomVector(50.f);
+			vert[j].pos = vert[j].initpos + randomVector(5.f);
+			vert[j].velocity = randomVector(1.f);
+		}
+		
+		// Springs shorter than the minimum length are clamped
+		if(count > 2 && i % 7 == 0) {
+			vert[1].pos = vert[0].pos + randomVector(0.000001f);
+		}
+		
+		float stiffness = random(0.f, 1.f);
+		float damping = random(0.f, 1.f);
+		
+		computeSpringForcesScalar(vert, count, stiffness, damping, expected);
+		computeSpringForces(vert, count, stiffness, damping, result);
+		
+		for(size_t a = 0; a < count; a++) {
+			for(size_t b = a + 1; b < count; b++) {
+				CPPUNIT_ASSERT_EQUAL(expected.x[a][b], result.x[a][b]);
+				CPPUNIT_ASSERT_EQUAL(expected.y[a][b], result.y[a][b]);
+				CPPUNIT_ASSERT_EQUAL(expected.z[a][b], result.z[a][b]);
+			}
+		}
+		
+	}
+	
+}
+
+void PhysicsKernelsTest::cylinderBatchTest() {
+	
+	CollisionBatch expected;
+	CollisionBatch result;
+	
+	for(size_t i = 0; i < 2000; i++) {
+		
+		// Thin, short and large cylinders take different paths in the tests
+		Cylinder cyl;
+		cyl.origin = Vec3f(random(0.f, AREA_SIZE), random(-100.f, 200.f), random(0.f, AREA_SIZE));
+		cyl.radius = random(10.f, 150.f);
+		cyl.height = random(-250.f, -20.f);
+		
+		bool precise = (i % 3 == 0);
+		CylinderTestMode mode = (i % 2) ? CylinderTestAnchor : CylinderTestCollision;
+		PolyType ignore = (i % 5 == 0) ? PolyType(POLY_WATER | POLY_NOCOL) : PolyType(0);
+		
+		// Batches that do not start or end at a multiple of the SIMD width
+		size_t begin = i % 13;
+		while(begin < POLY_COUNT) {
+			
+			size_t end = std::min(begin + CollisionBatch::MaxSize - (begin % 5), POLY_COUNT);
+			
+			batchPolyInCylinderScalar(*collision, begin, end, cyl, precise, mode, ignore, expected);
+			batchPolyInCylinder(*collision, begin, end, cyl, precise, mode, ignore, result);
+			
+			CPPUNIT_ASSERT_EQUAL(expected.hits, result.hits);
+			CPPUNIT_ASSERT_EQUAL(expected.minHeight, result.minHeight);
+			for(size_t j = 0; j < end - begin; j++) {
+				CPPUNIT_ASSERT_EQUAL(expected.height[j], result.height[j]);
+			}
+			
+			begin = end;
+		}
+		
+	}
+	
+}
+
+void PhysicsKernelsTest::sphereBatchTest() {
+	
+	CollisionBatch expected;
+	CollisionBatch result;
+	
+	for(size_t i = 0; i < 2000; i++) {
+		
+		Vec3f origin(random(0.f, AREA_SIZE), random(-100.f, 200.f), random(0.f, AREA_SIZE));
+		Sphere sphere(origin, random(5.f, 150.f));
+		
+		PolyType ignore = (i % 5 == 0) ? PolyType(POLY_WATER | POLY_NOCOL) : PolyType(0);
+		
+		size_t begin = i % 13;
+		while(begin < POLY_COUNT) {
+			
+			size_t end = std::min(begin + CollisionBatch::MaxSize - (begin % 5), POLY_COUNT);
+			
+			batchPolyInSphereScalar(*collision, begin, end, sphere, ignore, expected);
+			batchPolyInSphere(*collision, begin, end, sphere, ignore, result);
+			
+			CPPUNIT_ASSERT_EQUAL(expected.hits, result.hits);
+			
+			begin = end;
+		}
+		
+	}
+	
+}
@@ -23,8 +23,10 @@
 #include <cppunit/extensions/HelperMacros.h>
 
 #include "graphics/ColorTest.h"
+#include "graphics/CullingKernelsTest.h"
 #include "io/IniTest.h"
 #include "math/LegacyMathTest.h"
+#include "physics/PhysicsKernelsTest.h"
 
 int main(int argc, char *argv[]) {
 	ARX_UNUSED(argc);
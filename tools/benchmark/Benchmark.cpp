@@ -0,0 +1,228 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark/Benchmark.h"
+
+#include "Configure.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#if ARX_HAVE_PERF_EVENTS
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "ai/PathFinderManager.h"
+#include "io/fs/FilePath.h"
+#include "io/fs/Filesystem.h"
+#include "io/log/Logger.h"
+#include "io/resource/PakReader.h"
+#include "math/Random.h"
+#include "platform/Environment.h"
+#include "platform/Time.h"
+
+#include "benchmark/CollisionBenchmark.h"
+#include "benchmark/PathFinderBenchmark.h"
+#include "benchmark/PhysicsBenchmark.h"
+#include "benchmark/RaycastBenchmark.h"
+#include "benchmark/ScriptBenchmark.h"
+#include "benchmark/VisibilityBenchmark.h"
+
+using std::string;
+using std::cout;
+using std::endl;
+
+namespace benchmark {
+
+u64 Samples::total() const {
+	u64 sum = 0;
+	for(size_t i = 0; i < m_samples.size(); i++) {
+		sum += m_samples[i];
+	}
+	return sum;
+}
+
+double Samples::mean() const {
+	return m_samples.empty() ? 0.0 : double(total()) / double(m_samples.size());
+}
+
+u64 Samples::percentile(double p) {
+	
+	if(m_samples.empty()) {
+		return 0;
+	}
+	
+	if(!m_sorted) {
+		std::sort(m_samples.begin(), m_samples.end());
+		m_sorted = true;
+	}
+	
+	size_t i = size_t(p / 100.0 * double(m_samples.size() - 1) + 0.5);
+	return m_samples[std::min(i, m_samples.size() - 1)];
+}
+
+CacheMissCounter::CacheMissCounter() : m_fd(-1), m_start(0) {
+	
+#if ARX_HAVE_PERF_EVENTS
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	m_fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+	
+}
+
+CacheMissCounter::~CacheMissCounter() {
+#if ARX_HAVE_PERF_EVENTS
+	if(m_fd >= 0) {
+		close(m_fd);
+	}
+#endif
+}
+
+u64 CacheMissCounter::read() const {
+	
+#if ARX_HAVE_PERF_EVENTS
+	u64 count;
+	if(m_fd >= 0 && ::read(m_fd, &count, sizeof(count)) == ssize_t(sizeof(count))) {
+		return count;
+	}
+#endif
+	
+	return 0;
+}
+
+void report(const string & benchmark, const string & metric, double value,
+            const string & unit) {
+	cout << benchmark << ' ' << metric << ' ' << value;
+	if(!unit.empty()) {
+		cout << ' ' << unit;
+	}
+	cout << endl;
+}
+
+void report(const string & benchmark, const string & metric, Samples & samples,
+            const string & unit) {
+	report(benchmark, metric + ".count", double(samples.count()));
+	report(benchmark, metric + ".mean", samples.mean(), unit);
+	report(benchmark, metric + ".p50", double(samples.percentile(50)), unit);
+	report(benchmark, metric + ".p90", double(samples.percentile(90)), unit);
+	report(benchmark, metric + ".p99", double(samples.percentile(99)), unit);
+	report(benchmark, metric + ".max", double(samples.percentile(100)), unit);
+}
+
+} // namespace benchmark
+
+static void print_help() {
+	cout << "usage: arxbench <command> <datadir> [<options>...]" << endl;
+	cout << "<datadir> is the directory containing the Arx Fatalis .pak files" << endl;
+	cout << "any directory can be used if only the synthetic level is benchmarked" << endl;
+	cout << "commands are:" << endl;
+	cout << " - collision [<queries> [<level>...]]" << endl;
+	cout << " - pathfinder [--record|--check <golden>] [<searches> [<level>...]]" << endl;
+	cout << " - physics [<queries> [<level>|synthetic...]]" << endl;
+	cout << " - raycast [<rays> [<level>...]]" << endl;
+	cout << " - script [<iterations>] [<script>...]" << endl;
+	cout << " - visibility [--user-dir <dir>] [<samples> [<level>...]]" << endl;
+}
+
+//! Mount all .pak files and patch directories in dir, like the game does
+static bool addResources(const fs::path & dir) {
+	
+	resources = new PakReader;
+	
+	bool found = false;
+	for(fs::directory_iterator it(dir); !it.end(); ++it) {
+		fs::path file = dir / it.name();
+		if(it.is_regular_file() && file.has_ext("pak")) {
+			found |= resources->addArchive(file);
+		}
+	}
+	
+	const char * const patches[] = { "editor", "game", "graph", "localisation", "misc" };
+	for(size_t i = 0; i < ARRAY_SIZE(patches); i++) {
+		if(fs::is_directory(dir / patches[i])) {
+			resources->addFiles(dir / patches[i], patches[i]);
+		}
+	}
+	
+	return found;
+}
+
+int main(int argc, char ** argv) {
+	
+	Logger::initialize();
+	
+	if(argc < 3) {
+		print_help();
+		return 1;
+	}
+	
+	platform::initializeEnvironment(argv[0]);
+	platform::initializeTime();
+	
+	// Fixed seed so that runs are comparable
+	Random::seed(0);
+	
+	string command = argv[1];
+	
+	// The synthetic level does not need any data, loading real levels or scripts
+	// will fail in the individual benchmarks
+	if(!addResources(argv[2])) {
+		LogWarning << "Could not load any data files from " << argv[2]
+		           << ", only the synthetic level is available";
+	}
+	
+	argc -= 3;
+	argv += 3;
+	
+	int ret = -1;
+	if(command == "collision") {
+		ret = main_collision(argc, argv);
+	} else if(command == "pathfinder") {
+		ret = main_pathfinder(argc, argv);
+	} else if(command == "physics") {
+		ret = main_physics(argc, argv);
+	} else if(command == "raycast") {
+		ret = main_raycast(argc, argv);
+	} else if(command == "script") {
+		ret = main_script(argc, argv);
+	} else if(command == "visibility") {
+		ret = main_visibility(argc, argv);
+	}
+	
+	if(ret == -1) {
+		print_help();
+	}
+	
+	// Loading a level starts the pathfinder thread
+	EERIE_PATHFINDER_Release();
+	
+	Logger::shutdown();
+	
+	return ret;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_TOOLS_BENCHMARK_BENCHMARK_H
+#define ARX_TOOLS_BENCHMARK_BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+#include "platform/Platform.h"
+
+namespace benchmark {
+
+/*!
+ * Collects timing samples and prints machine-readable results.
+ *
+ * Each result is printed on its own line as
+ *   <benchmark> <metric> <value> <unit>
+ * so that the output can be diffed and tracked across commits.
+ */
+class Samples {
+	
+public:
+	
+	Samples() : m_sorted(true) { }
+	
+	void add(u64 value) { m_samples.push_back(value), m_sorted = false; }
+	
+	size_t count() const { return m_samples.size(); }
+	
+	u64 total() const;
+	
+	double mean() const;
+	
+	//! \param p percentile in the range [0, 100]
+	u64 percentile(double p);
+	
+	void clear() { m_samples.clear(), m_sorted = true; }
+	
+private:
+	
+	std::vector<u64> m_samples;
+	bool m_sorted;
+	
+};
+
+/*!
+ * Counts hardware cache misses of the calling thread.
+ *
+ * This uses performance counters where the OS provides them - if not, \ref available()
+ * returns false and all counts are zero.
+ */
+class CacheMissCounter {
+	
+public:
+	
+	CacheMissCounter();
+	~CacheMissCounter();
+	
+	bool available() const { return m_fd >= 0; }
+	
+	void start() { m_start = read(); }
+	
+	//! \return the number of cache misses since \ref start() was called
+	u64 stop() { return read() - m_start; }
+	
+private:
+	
+	u64 read() const;
+	
+	int m_fd;
+	u64 m_start;
+	
+};
+
+void report(const std::string & benchmark, const std::string & metric,
+            double value, const std::string & unit = std::string());
+
+//! Report the count, mean and the 50th, 90th, 99th percentiles and maximum
+void report(const std::string & benchmark, const std::string & metric, Samples & samples,
+            const std::string & unit = "us");
+
+} // namespace benchmark
+
+#endif // ARX_TOOLS_BENCHMARK_BENCHMARK_H
@@ -0,0 +1,686 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark/CollisionBenchmark.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include "benchmark/Benchmark.h"
+#include "benchmark/Level.h"
+
+#include "graphics/GraphicsTypes.h"
+#include "graphics/Math.h"
+#include "graphics/data/Mesh.h"
+#include "io/log/Logger.h"
+#include "math/Random.h"
+#include "physics/BackgroundCollision.h"
+#include "physics/CollisionKernels.h"
+#include "physics/Collisions.h"
+#include "platform/Time.h"
+
+namespace {
+
+/*
+ * The reference functions below run the queries on the original polygons,
+ * as CheckInPoly(), CheckAnythingInCylinder() and CheckBackgroundInSphere()
+ * used to be implemented before the compact collision data was added.
+ */
+
+EERIEPOLY * referenceCheckInPoly(const Vec3f & poss, float * needY) {
+	
+	long px = poss.x * ACTIVEBKG->Xmul;
+	long pz = poss.z * ACTIVEBKG->Zmul;
+	
+	if(pz <= 0 || pz >= ACTIVEBKG->Zsize - 1 || px <= 0 || px >= ACTIVEBKG->Xsize - 1) {
+		return NULL;
+	}
+	
+	float rx = poss.x - ((float)px * ACTIVEBKG->Xdiv);
+	float rz = poss.z - ((float)pz * ACTIVEBKG->Zdiv);
+	
+	short pzi, pza, pxi, pxa;
+	
+	if(rz < -40.f) {
+		pzi = pza = short(pz - 1);
+	} else if(rz < 40.f) {
+		pzi = short(pz - 1), pza = short(pz);
+	} else if(rz > 60.f) {
+		pzi = short(pz), pza = short(pz + 1);
+	} else {
+		pzi = pza = short(pz);
+	}
+	
+	if(rx < -40.f) {
+		pxi = pxa = short(px - 1);
+	} else if(rx < 40.f) {
+		pxi = short(px - 1), pxa = short(px);
+	} else if(rx > 60.f) {
+		pxi = short(px), pxa = short(px + 1);
+	} else {
+		pxi = pxa = short(px);
+	}
+	
+	EERIEPOLY * found = NULL;
+	float foundY = 0.f;
+	
+	for(short z = pzi; z <= pza; z++)
+	for(short x = pxi; x <= pxa; x++) {
+		EERIE_BKG_INFO * feg = &ACTIVEBKG->fastdata[x][z];
+		for(short k = 0; k < feg->nbpolyin; k++) {
+			EERIEPOLY * ep = feg->polyin[k];
+			if(poss.x >= ep->min.x
+			   && poss.x <= ep->max.x
+			   && poss.z >= ep->min.z
+			   && poss.z <= ep->max.z
+			   && !(ep->type & (POLY_WATER | POLY_TRANS | POLY_NOCOL))
+			   && ep->max.y >= poss.y
+			   && ep != found
+			   && PointIn2DPolyXZ(ep, poss.x, poss.z)
+			   && GetTruePolyY(ep, poss, &rz)
+			   && rz >= poss.y
+			   && (!found || rz <= foundY)) {
+				found = ep;
+				foundY = rz;
+			}
+		}
+	}
+	
+	*needY = foundY;
+	
+	return found;
+}
+
+float referenceIsPolyInCylinder(const EERIEPOLY * ep, const Cylinder & cyl, long flags) {
+	
+	float minf = cyl.origin.y + cyl.height;
+	float maxf = cyl.origin.y;
+	
+	if(minf > ep->max.y || maxf < ep->min.y) {
+		return 999999.f;
+	}
+	
+	long to = (ep->type & POLY_QUAD) ? 4 : 3;
+	
+	float nearest = 99999999.f;
+	for(long num = 0; num < to; num++) {
+		float dd = fdist(Vec2f(ep->v[num].p.x, ep->v[num].p.z), Vec2f(cyl.origin.x, cyl.origin.z));
+		if(dd < nearest) {
+			nearest = dd;
+		}
+	}
+	
+	if(nearest > std::max(82.f, cyl.radius)) {
+		return 999999.f;
+	}
+	
+	if(cyl.radius < 30.f || cyl.height > -80.f || ep->area > 5000.f) {
+		flags |= CFLAG_EXTRA_PRECISION;
+	}
+	
+	bool precise = (flags & CFLAG_EXTRA_PRECISION) != 0;
+	
+	if(!precise && ep->area < 100.f) {
+		return 999999.f;
+	}
+	
+	float anything = 999999.f;
+	
+	if(PointInCylinder(cyl, &ep->center)) {
+		anything = std::min(anything, (ep->norm.y < 0.5f) ? ep->min.y : ep->center.y);
+		if(!precise) {
+			return anything;
+		}
+	}
+	
+	long r = to - 1;
+	Vec3f center;
+	for(long n = 0; n < to; n++) {
+		
+		if(precise) {
+			for(long o = 0; o < 5; o++) {
+				float p = (float)o * (1.f/5);
+				center = ep->v[n].p * p + ep->center * (1.f - p);
+				if(PointInCylinder(cyl, &center)) {
+					anything = std::min(anything, center.y);
+				}
+			}
+		}
+		
+		if(ep->area > 2000.f || precise) {
+			center = (ep->v[n].p + ep->v[r].p) * 0.5f;
+			if(PointInCylinder(cyl, &center)) {
+				anything = std::min(anything, center.y);
+				if(!precise) {
+					return anything;
+				}
+			}
+			if(ep->area > 4000.f || precise) {
+				center = (ep->v[n].p + ep->center) * 0.5f;
+				if(PointInCylinder(cyl, &center)) {
+					anything = std::min(anything, center.y);
+					if(!precise) {
+						return anything;
+					}
+				}
+			}
+			if(ep->area > 6000.f || precise) {
+				center = (center + ep->v[n].p) * 0.5f;
+				if(PointInCylinder(cyl, &center)) {
+					anything = std::min(anything, center.y);
+					if(!precise) {
+						return anything;
+					}
+				}
+			}
+		}
+		
+		if(PointInCylinder(cyl, &ep->v[n].p)) {
+			anything = std::min(anything, ep->v[n].p.y);
+			if(!precise) {
+				return anything;
+			}
+		}
+		
+		r++;
+		if(r >= to) {
+			r = 0;
+		}
+	}
+	
+	if(anything != 999999.f && ep->norm.y < 0.1f && ep->norm.y > -0.1f) {
+		anything = std::min(anything, ep->min.y);
+	}
+	
+	return anything;
+}
+
+//! Background part of CheckAnythingInCylinder()
+float referenceCheckInCylinder(const Cylinder & cyl, long flags) {
+	
+	long rad = (cyl.radius + 100) * ACTIVEBKG->Xmul;
+	long px = cyl.origin.x * ACTIVEBKG->Xmul;
+	long pz = cyl.origin.z * ACTIVEBKG->Zmul;
+	
+	if(px > ACTIVEBKG->Xsize - 2 - rad || px < 1 + rad
+	   || pz > ACTIVEBKG->Zsize - 2 - rad || pz < 1 + rad) {
+		return 0.f;
+	}
+	
+	float anything = 999999.f;
+	
+	for(short z = pz - rad; z <= pz + rad; z++)
+	for(short x = px - rad; x <= px + rad; x++) {
+		
+		float nearest = 99999999.f;
+		for(long num = 0; num < 4; num++) {
+			float nearx = static_cast<float>(x * 100);
+			float nearz = static_cast<float>(z * 100);
+			if(num == 1 || num == 2) {
+				nearx += 100;
+			}
+			if(num == 2 || num == 3) {
+				nearz += 100;
+			}
+			nearest = std::min(nearest, fdist(Vec2f(nearx, nearz), Vec2f(cyl.origin.x, cyl.origin.z)));
+		}
+		if(nearest > std::max(82.f, cyl.radius)) {
+			continue;
+		}
+		
+		EERIE_BKG_INFO * feg = &ACTIVEBKG->fastdata[x][z];
+		for(long k = 0; k < feg->nbpoly; k++) {
+			const EERIEPOLY * ep = &feg->polydata[k];
+			if(ep->type & (POLY_WATER | POLY_TRANS | POLY_NOCOL)) {
+				continue;
+			}
+			if(ep->min.y < anything) {
+				anything = std::min(anything, referenceIsPolyInCylinder(ep, cyl, flags));
+			}
+		}
+	}
+	
+	float tempo;
+	if(referenceCheckInPoly(cyl.origin + Vec3f(0.f, cyl.height, 0.f), &tempo)) {
+		anything = std::min(anything, tempo);
+	}
+	
+	if(anything == 999999.f) {
+		return 0.f;
+	}
+	
+	return anything - cyl.origin.y;
+}
+
+bool referenceIsPolyInSphere(const EERIEPOLY & ep, const Sphere & sph) {
+	
+	if(ep.area < 100.f) {
+		return false;
+	}
+	
+	long to = (ep.type & POLY_QUAD) ? 4 : 3;
+	long r = to - 1;
+	Vec3f center;
+	for(long n = 0; n < to; n++) {
+		if(ep.area > 2000.f) {
+			center = (ep.v[n].p + ep.v[r].p) * 0.5f;
+			if(sph.contains(center)) {
+				return true;
+			}
+			if(ep.area > 4000.f) {
+				center = (ep.v[n].p + ep.center) * 0.5f;
+				if(sph.contains(center)) {
+					return true;
+				}
+			}
+			if(ep.area > 6000.f) {
+				center = (center + ep.v[n].p) * 0.5f;
+				if(sph.contains(center)) {
+					return true;
+				}
+			}
+		}
+		if(sph.contains(ep.v[n].p)) {
+			return true;
+		}
+		r++;
+		if(r >= to) {
+			r = 0;
+		}
+	}
+	
+	return false;
+}
+
+const EERIEPOLY * referenceCheckBackgroundInSphere(const Sphere & sphere) {
+	
+	short tilex = sphere.origin.x * ACTIVEBKG->Xmul;
+	short tilez = sphere.origin.z * ACTIVEBKG->Zmul;
+	short radius = (sphere.radius * ACTIVEBKG->Xmul) + 2;
+	
+	short minx = std::max(tilex - radius, 0);
+	short maxx = std::min(tilex + radius, ACTIVEBKG->Xsize - 1);
+	short minz = std::max(tilez - radius, 0);
+	short maxz = std::min(tilez + radius, ACTIVEBKG->Zsize - 1);
+	
+	for(short z = minz; z <= maxz; z++)
+	for(short x = minx; x <= maxx; x++) {
+		const EERIE_BKG_INFO & feg = ACTIVEBKG->fastdata[x][z];
+		for(long k = 0; k < feg.nbpoly; k++) {
+			const EERIEPOLY & ep = feg.polydata[k];
+			if(ep.type & (POLY_WATER | POLY_TRANS | POLY_NOCOL)) {
+				continue;
+			}
+			if(referenceIsPolyInSphere(ep, sphere)) {
+				return &ep;
+			}
+		}
+	}
+	
+	return NULL;
+}
+
+enum QueryType {
+	QueryInPoly,
+	QueryCylinder,
+	QuerySphere,
+	QueryTypeCount
+};
+
+const char * const queryNames[QueryTypeCount] = { "inpoly", "cylinder", "sphere" };
+
+struct Query {
+	Vec3f pos;
+	float radius;
+	long flags;
+};
+
+struct QueryResult {
+	
+	const EERIEPOLY * poly;
+	float value;
+	
+	bool operator!=(const QueryResult & o) const {
+		return poly != o.poly || value != o.value;
+	}
+	
+};
+
+QueryResult runQuery(QueryType type, const Query & query, bool reference) {
+	
+	QueryResult result = { NULL, 0.f };
+	
+	switch(type) {
+		
+		case QueryInPoly: {
+			if(reference) {
+				result.poly = referenceCheckInPoly(query.pos, &result.value);
+			} else {
+				result.poly = CheckInPoly(query.pos, &result.value);
+			}
+			break;
+		}
+		
+		case QueryCylinder: {
+			Cylinder cyl;
+			cyl.origin = query.pos;
+			cyl.radius = query.radius;
+			cyl.height = -160.f;
+			if(reference) {
+				result.value = referenceCheckInCylinder(cyl, query.flags);
+			} else {
+				result.value = CheckAnythingInCylinder(cyl, NULL, query.flags);
+			}
+			break;
+		}
+		
+		case QuerySphere: {
+			Sphere sphere;
+			sphere.origin = query.pos;
+			sphere.radius = query.radius;
+			if(reference) {
+				result.poly = referenceCheckBackgroundInSphere(sphere);
+			} else {
+				result.poly = CheckBackgroundInSphere(sphere);
+			}
+			break;
+		}
+		
+		case QueryTypeCount: ARX_DEAD_CODE();
+	}
+	
+	return result;
+}
+
+/*!
+ * Run all queries either on the compact collision data or on the original polygons
+ * and report the time and cache misses as <prefix>time and <prefix>cache_misses
+ */
+void runQueries(const std::string & name, QueryType type, const std::vector<Query> & queries,
+                bool reference, std::vector<QueryResult> & results) {
+	
+	results.resize(queries.size());
+	
+	benchmark::CacheMissCounter misses;
+	
+	misses.start();
+	u64 start = platform::getTimeUs();
+	for(size_t i = 0; i < queries.size(); i++) {
+		results[i] = runQuery(type, queries[i], reference);
+	}
+	u64 time = platform::getElapsedUs(start);
+	u64 missCount = misses.stop();
+	
+	std::string prefix = reference ? "reference." : "";
+	benchmark::report(name, prefix + "time", double(time), "us");
+	benchmark::report(name, prefix + "time_per_query",
+	                  double(time) * 1000.0 / double(queries.size()), "ns");
+	if(misses.available()) {
+		benchmark::report(name, prefix + "cache_misses", double(missCount));
+		benchmark::report(name, prefix + "cache_misses_per_query",
+		                  double(missCount) / double(queries.size()));
+	}
+}
+
+enum KernelType {
+	KernelCylinder,
+	KernelAnchorCylinder,
+	KernelSphere,
+	KernelTypeCount
+};
+
+const char * const kernelNames[KernelTypeCount] = { "cylinder", "anchor_cylinder", "sphere" };
+
+struct KernelBatch {
+	size_t query;
+	size_t begin;
+	size_t end;
+};
+
+void runKernel(KernelType type, const Query & query, const KernelBatch & batch, bool scalar,
+               CollisionBatch & result) {
+	
+	const BackgroundCollision & bc = backgroundCollision;
+	const PolyType ignore = POLY_WATER | POLY_TRANS | POLY_NOCOL;
+	
+	if(type == KernelSphere) {
+		Sphere sphere(query.pos, query.radius);
+		if(scalar) {
+			batchPolyInSphereScalar(bc, batch.begin, batch.end, sphere, ignore, result);
+		} else {
+			batchPolyInSphere(bc, batch.begin, batch.end, sphere, ignore, result);
+		}
+		return;
+	}
+	
+	Cylinder cyl;
+	cyl.origin = query.pos;
+	cyl.radius = query.radius;
+	cyl.height = -160.f;
+	bool precise = (query.flags & CFLAG_EXTRA_PRECISION) != 0;
+	CylinderTestMode mode = (type == KernelAnchorCylinder) ? CylinderTestAnchor
+	                                                       : CylinderTestCollision;
+	if(scalar) {
+		batchPolyInCylinderScalar(bc, batch.begin, batch.end, cyl, precise, mode, ignore, result);
+	} else {
+		batchPolyInCylinder(bc, batch.begin, batch.end, cyl, precise, mode, ignore, result);
+	}
+}
+
+void runKernels(const std::string & name, KernelType type, const std::vector<Query> & queries,
+                const std::vector<KernelBatch> & batches, bool scalar,
+                std::vector<CollisionBatch> & results) {
+	
+	results.resize(batches.size());
+	
+	u64 start = platform::getTimeUs();
+	for(size_t i = 0; i < batches.size(); i++) {
+		runKernel(type, queries[batches[i].query], batches[i], scalar, results[i]);
+	}
+	u64 time = platform::getElapsedUs(start);
+	
+	std::string prefix = scalar ? "scalar." : "";
+	benchmark::report(name, prefix + "time", double(time), "us");
+	if(!batches.empty()) {
+		benchmark::report(name, prefix + "time_per_batch",
+		                  double(time) * 1000.0 / double(batches.size()), "ns");
+	}
+}
+
+/*!
+ * Run the batch polygon tests on the tiles around each query, both with the SIMD
+ * kernels and one polygon at a time, and check that the results are identical.
+ */
+size_t benchmarkKernel(const std::string & levelName, KernelType type,
+                       const std::vector<Query> & queries) {
+	
+	const BackgroundCollision & bc = backgroundCollision;
+	
+	std::vector<KernelBatch> batches;
+	size_t polygons = 0;
+	for(size_t i = 0; i < queries.size(); i++) {
+		long px = long(queries[i].pos.x * ACTIVEBKG->Xmul);
+		long pz = long(queries[i].pos.z * ACTIVEBKG->Zmul);
+		for(long x = std::max(px - 1, 0l); x <= std::min(px + 1, long(ACTIVEBKG->Xsize) - 1); x++) {
+			for(long z = std::max(pz - 1, 0l); z <= std::min(pz + 1, long(ACTIVEBKG->Zsize) - 1); z++) {
+				const BackgroundCollision::Range & polys = bc.getPolys(x, z);
+				for(size_t begin = polys.begin; begin < polys.end; begin += CollisionBatch::MaxSize) {
+					KernelBatch batch;
+					batch.query = i;
+					batch.begin = begin;
+					batch.end = std::min(polys.end, begin + CollisionBatch::MaxSize);
+					batches.push_back(batch);
+					polygons += batch.end - batch.begin;
+				}
+			}
+		}
+	}
+	
+	std::string name = "collision." + levelName + ".kernel." + kernelNames[type];
+	benchmark::report(name, "batches", double(batches.size()));
+	benchmark::report(name, "polygons", double(polygons));
+	
+	std::vector<CollisionBatch> scalar;
+	runKernels(name, type, queries, batches, true, scalar);
+	
+	std::vector<CollisionBatch> results;
+	runKernels(name, type, queries, batches, false, results);
+	
+	size_t mismatches = 0;
+	for(size_t i = 0; i < batches.size(); i++) {
+		bool same = (results[i].hits == scalar[i].hits);
+		if(type != KernelSphere) {
+			same = same && results[i].minHeight == scalar[i].minHeight;
+			for(size_t j = 0; j < batches[i].end - batches[i].begin; j++) {
+				same = same && results[i].height[j] == scalar[i].height[j];
+			}
+		}
+		if(!same) {
+			mismatches++;
+		}
+	}
+	
+	benchmark::report(name, "mismatches", double(mismatches));
+	
+	return mismatches;
+}
+
+size_t benchmarkLevel(long level, size_t count) {
+	
+	if(!benchmark::loadLevel(level)) {
+		return 0;
+	}
+	
+	std::string levelName = benchmark::getLevelName(level);
+	
+	// Query around the polygons so that most queries actually hit something
+	std::vector<Vec3f> centers;
+	for(long x = 0; x < ACTIVEBKG->Xsize; x++) {
+		for(long z = 0; z < ACTIVEBKG->Zsize; z++) {
+			const EERIE_BKG_INFO & eg = ACTIVEBKG->fastdata[x][z];
+			for(long i = 0; i < eg.nbpoly; i++) {
+				centers.push_back(eg.polydata[i].center);
+			}
+		}
+	}
+	
+	benchmark::report("collision." + levelName, "polygons", double(centers.size()));
+	benchmark::report("collision." + levelName, "reference.polygon_size",
+	                  double(sizeof(EERIEPOLY)), "bytes");
+	// type, minY, maxY, boundsXZ, poly, 12 vertex coordinates, center, area, normY and plane
+	benchmark::report("collision." + levelName, "polygon_size",
+	                  double(sizeof(PolyType) + 2 * sizeof(float) + sizeof(Vec4f)
+	                         + sizeof(EERIEPOLY *) + 17 * sizeof(float) + sizeof(Vec4f)), "bytes");
+	
+	if(centers.empty()) {
+		return 0;
+	}
+	
+	// Seed per level so that the queries don't depend on which levels are benchmarked
+	Random::seed(unsigned(level));
+	
+	size_t mismatches = 0;
+	
+	for(size_t t = 0; t < QueryTypeCount; t++) {
+		
+		QueryType type = QueryType(t);
+		std::string name = "collision." + levelName + "." + queryNames[t];
+		
+		std::vector<Query> queries(count);
+		for(size_t i = 0; i < count; i++) {
+			Query & query = queries[i];
+			query.pos = centers[Random::get(size_t(0), centers.size() - 1)];
+			query.pos += Vec3f(Random::getf(-50.f, 50.f), Random::getf(-200.f, 20.f),
+			                   Random::getf(-50.f, 50.f));
+			query.radius = Random::getf(10.f, 80.f);
+			query.flags = CFLAG_NO_INTERCOL;
+			if(Random::get(0, 1)) {
+				query.flags |= CFLAG_EXTRA_PRECISION;
+			}
+		}
+		
+		std::vector<QueryResult> reference;
+		runQueries(name, type, queries, true, reference);
+		
+		std::vector<QueryResult> results;
+		runQueries(name, type, queries, false, results);
+		
+		size_t typeMismatches = 0;
+		for(size_t i = 0; i < count; i++) {
+			if(results[i] != reference[i]) {
+				typeMismatches++;
+			}
+		}
+		
+		benchmark::report(name, "queries", double(count));
+		benchmark::report(name, "mismatches", double(typeMismatches));
+		mismatches += typeMismatches;
+		
+		if(type == QueryCylinder) {
+			mismatches += benchmarkKernel(levelName, KernelCylinder, queries);
+			mismatches += benchmarkKernel(levelName, KernelAnchorCylinder, queries);
+		} else if(type == QuerySphere) {
+			mismatches += benchmarkKernel(levelName, KernelSphere, queries);
+		}
+	}
+	
+	return mismatches;
+}
+
+} // anonymous namespace
+
+int main_collision(int argc, char ** argv) {
+	
+	size_t queries = 100000;
+	if(argc > 0) {
+		try {
+			queries = boost::lexical_cast<size_t>(argv[0]);
+		} catch(...) {
+			return -1;
+		}
+		argc--, argv++;
+	}
+	
+	std::vector<long> levels;
+	if(!benchmark::getLevels(argc, argv, levels)) {
+		return -1;
+	}
+	
+	if(levels.empty()) {
+		LogError << "No levels found";
+		return 2;
+	}
+	
+	LogInfo << "Using " << getCollisionKernelName() << " collision kernels";
+	
+	size_t mismatches = 0;
+	for(size_t i = 0; i < levels.size(); i++) {
+		mismatches += benchmarkLevel(levels[i], queries);
+	}
+	
+	if(mismatches > 0) {
+		LogError << mismatches << " queries differ from the original implementation";
+		return 1;
+	}
+	
+	return 0;
+}
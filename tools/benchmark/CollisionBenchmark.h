@@ -0,0 +1,37 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_TOOLS_BENCHMARK_COLLISIONBENCHMARK_H
+#define ARX_TOOLS_BENCHMARK_COLLISIONBENCHMARK_H
+
+/*!
+ * Run random background collision queries on real levels.
+ *
+ * Each query is run both on the compact collision data used by the game and on the
+ * original polygons, the way the queries used to be implemented. Timings and cache
+ * misses are reported for both and the results must be identical.
+ * The batch polygon kernels are also run on the tiles around each query, both with
+ * SIMD instructions and one polygon at a time, and must return the same results.
+ *
+ * Arguments: [<queries> [<level>...]]
+ * If no levels are given, all levels are used.
+ */
+int main_collision(int argc, char ** argv);
+
+#endif // ARX_TOOLS_BENCHMARK_COLLISIONBENCHMARK_H
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark/Level.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include "game/Levels.h"
+#include "graphics/Math.h"
+#include "graphics/data/Mesh.h"
+#include "io/log/Logger.h"
+#include "io/resource/PakReader.h"
+#include "io/resource/ResourcePath.h"
+#include "math/Random.h"
+
+namespace benchmark {
+
+static const long MAX_LEVEL = 32;
+
+static EERIE_BACKGROUND background;
+
+static res::path getLevelPath(long level) {
+	
+	char name[64];
+	GetLevelNameByNum(level, name);
+	if(!strcmp(name, "none")) {
+		return res::path();
+	}
+	
+	return res::path("graph/levels") / (std::string("level") + name);
+}
+
+bool getLevels(int argc, char ** argv, std::vector<long> & levels) {
+	
+	for(int i = 0; i < argc; i++) {
+		if(!strcmp(argv[i], "synthetic")) {
+			levels.push_back(SYNTHETIC_LEVEL);
+			continue;
+		}
+		try {
+			levels.push_back(boost::lexical_cast<long>(argv[i]));
+		} catch(...) {
+			return false;
+		}
+	}
+	
+	if(argc == 0) {
+		for(long level = 0; level < MAX_LEVEL; level++) {
+			res::path path = getLevelPath(level);
+			if(!path.empty() && resources->getFile("game" / path / "fast.fts")) {
+				levels.push_back(level);
+			}
+		}
+	}
+	
+	return true;
+}
+
+std::string getLevelName(long level) {
+	
+	if(level == SYNTHETIC_LEVEL) {
+		return "synthetic";
+	}
+	
+	return getLevelPath(level).filename();
+}
+
+//! Size of the generated level in tiles
+static const short SYNTHETIC_SIZE = 96;
+
+//! Floor polygons per tile side - real levels have polygons of about this size
+static const long SYNTHETIC_SUBDIVISION = 2;
+
+//! Ground height at a point: rolling hills with some noise
+static float getSyntheticHeight(float x, float z, const std::vector<float> & noise) {
+	
+	long size = SYNTHETIC_SIZE * SYNTHETIC_SUBDIVISION + 1;
+	long nx = glm::clamp(long(x * SYNTHETIC_SUBDIVISION / BKG_SIZX), 0l, size - 1);
+	long nz = glm::clamp(long(z * SYNTHETIC_SUBDIVISION / BKG_SIZZ), 0l, size - 1);
+	
+	return 100.f + std::sin(x * 0.004f) * 60.f + std::cos(z * 0.005f) * 60.f
+	       + noise[nz * size + nx];
+}
+
+static EERIEPOLY * addSyntheticPoly(EERIE_BKG_INFO & tile, const Vec3f & p0, const Vec3f & p1,
+                                    const Vec3f & p2, const Vec3f & p3, PolyType type) {
+	
+	tile.polydata = (EERIEPOLY *)realloc(tile.polydata, sizeof(EERIEPOLY) * (tile.nbpoly + 1));
+	EERIEPOLY & ep = tile.polydata[tile.nbpoly++];
+	memset(&ep, 0, sizeof(EERIEPOLY));
+	
+	ep.type = type | POLY_QUAD;
+	ep.v[0].p = p0;
+	ep.v[1].p = p1;
+	ep.v[2].p = p2;
+	ep.v[3].p = p3;
+	
+	ep.center = (p0 + p1 + p2 + p3) * 0.25f;
+	ep.min = glm::min(glm::min(p0, p1), glm::min(p2, p3));
+	ep.max = glm::max(glm::max(p0, p1), glm::max(p2, p3));
+	
+	CalcFaceNormal(&ep, ep.v);
+	ep.norm2 = ep.norm;
+	
+	// Vertices are in triangle strip order
+	ep.area = glm::length(glm::cross(p1 - p0, p2 - p0)) * 0.5f
+	          + glm::length(glm::cross(p1 - p3, p2 - p3)) * 0.5f;
+	
+	float radius = 0.f;
+	for(long i = 0; i < 4; i++) {
+		radius = std::max(radius, fdist(ep.v[i].p, ep.center));
+	}
+	ep.v[0].rhw = radius;
+	
+	return &ep;
+}
+
+static void createSyntheticLevel() {
+	
+	InitBkg(ACTIVEBKG, SYNTHETIC_SIZE, SYNTHETIC_SIZE, BKG_SIZX, BKG_SIZZ);
+	
+	Random::seed(0);
+	
+	long size = SYNTHETIC_SIZE * SYNTHETIC_SUBDIVISION + 1;
+	std::vector<float> noise(size * size);
+	for(size_t i = 0; i < noise.size(); i++) {
+		noise[i] = Random::getf(-8.f, 8.f);
+	}
+	
+	const float step = float(BKG_SIZX) / SYNTHETIC_SUBDIVISION;
+	
+	// Leave an empty border like real levels
+	for(short z = 2; z < SYNTHETIC_SIZE - 2; z++)
+	for(short x = 2; x < SYNTHETIC_SIZE - 2; x++) {
+		
+		EERIE_BKG_INFO & tile = ACTIVEBKG->fastdata[x][z];
+		float x0 = float(x * BKG_SIZX);
+		float z0 = float(z * BKG_SIZZ);
+		
+		for(long j = 0; j < SYNTHETIC_SUBDIVISION; j++)
+		for(long i = 0; i < SYNTHETIC_SUBDIVISION; i++) {
+			float xa = x0 + float(i) * step, xb = xa + step;
+			float za = z0 + float(j) * step, zb = za + step;
+			PolyType type = PolyType();
+			if(Random::getf() < 0.02f) {
+				type = POLY_WATER;
+			} else if(Random::getf() < 0.02f) {
+				type = POLY_LAVA;
+			}
+			addSyntheticPoly(tile,
+			                 Vec3f(xa, getSyntheticHeight(xa, za, noise), za),
+			                 Vec3f(xb, getSyntheticHeight(xb, za, noise), za),
+			                 Vec3f(xa, getSyntheticHeight(xa, zb, noise), zb),
+			                 Vec3f(xb, getSyntheticHeight(xb, zb, noise), zb), type);
+		}
+		
+		float floor = getSyntheticHeight(x0 + BKG_SIZX * 0.5f, z0 + BKG_SIZZ * 0.5f, noise);
+		
+		// Walls along the tile edges - up is -y
+		if(Random::getf() < 0.1f) {
+			float height = Random::getf(50.f, 300.f);
+			PolyType type = (Random::getf() < 0.2f) ? PolyType(POLY_CLIMB) : PolyType();
+			float bottom = floor + 20.f;
+			addSyntheticPoly(tile, Vec3f(x0, bottom - height, z0), Vec3f(x0 + BKG_SIZX, bottom - height, z0),
+			                 Vec3f(x0, bottom, z0), Vec3f(x0 + BKG_SIZX, bottom, z0), type);
+		}
+		if(Random::getf() < 0.1f) {
+			float height = Random::getf(50.f, 300.f);
+			float bottom = floor + 20.f;
+			addSyntheticPoly(tile, Vec3f(x0, bottom - height, z0), Vec3f(x0, bottom - height, z0 + BKG_SIZZ),
+			                 Vec3f(x0, bottom, z0), Vec3f(x0, bottom, z0 + BKG_SIZZ), PolyType());
+		}
+		
+		// Ceilings and platforms
+		if(Random::getf() < 0.2f) {
+			float y = floor - Random::getf(100.f, 400.f);
+			addSyntheticPoly(tile, Vec3f(x0, y, z0), Vec3f(x0, y, z0 + BKG_SIZZ),
+			                 Vec3f(x0 + BKG_SIZX, y, z0), Vec3f(x0 + BKG_SIZX, y, z0 + BKG_SIZZ),
+			                 PolyType());
+		}
+		
+	}
+	
+	EERIEPOLY_Compute_PolyIn();
+}
+
+bool loadLevel(long level) {
+	
+	ACTIVEBKG = &background;
+	
+	if(level == SYNTHETIC_LEVEL) {
+		createSyntheticLevel();
+		return true;
+	}
+	
+	res::path path = getLevelPath(level);
+	if(path.empty() || !FastSceneLoad(path)) {
+		LogError << "Could not load level " << level;
+		return false;
+	}
+	
+	return true;
+}
+
+} // namespace benchmark
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_TOOLS_BENCHMARK_LEVEL_H
+#define ARX_TOOLS_BENCHMARK_LEVEL_H
+
+#include <string>
+#include <vector>
+
+namespace benchmark {
+
+/*!
+ * Level number for a generated level with random terrain, walls and ceilings.
+ * It is selected with the "synthetic" argument and does not need any game data.
+ */
+const long SYNTHETIC_LEVEL = -1;
+
+/*!
+ * Get the levels to run a benchmark on.
+ * If no arguments are given, all levels with scene data are used.
+ * \return false if an argument is not a valid level number or "synthetic".
+ */
+bool getLevels(int argc, char ** argv, std::vector<long> & levels);
+
+//! \return the name of a level for use in benchmark results, e.g. "level1"
+std::string getLevelName(long level);
+
+/*!
+ * Load the scene geometry, anchors and portals of a level into ACTIVEBKG.
+ * Textures, lights and entities are not loaded.
+ * The synthetic level is generated the same way every time and has no anchors or portals.
+ */
+bool loadLevel(long level);
+
+} // namespace benchmark
+
+#endif // ARX_TOOLS_BENCHMARK_LEVEL_H
@@ -0,0 +1,709 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark/PathFinderBenchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include <glm/gtx/norm.hpp>
+
+#include "benchmark/Benchmark.h"
+#include "benchmark/Level.h"
+
+#include "ai/PathFinder.h"
+#include "ai/PathHierarchy.h"
+#include "graphics/Math.h"
+#include "graphics/data/Mesh.h"
+#include "io/fs/FilePath.h"
+#include "io/fs/FileStream.h"
+#include "io/log/Logger.h"
+#include "math/Random.h"
+#include "physics/AnchorIndex.h"
+#include "physics/Anchors.h"
+#include "platform/Time.h"
+
+namespace {
+
+//! Heuristics used by the pathfinder thread for short and long paths
+const float heuristics[] = { 0.2f, PathFinder::HEURISTIC_MAX };
+
+//! Searches requested by NPC behaviors
+enum QueryType {
+	QueryMove,
+	QueryFlee,
+	QueryWander,
+	QueryLookFor,
+	QueryTypeCount
+};
+
+const char * const queryNames[QueryTypeCount] = { "move", "flee", "wander", "lookfor" };
+
+//! Relative difference in path cost that is not reported as a golden mismatch
+const float GOLDEN_TOLERANCE = 0.0001f;
+
+enum GoldenMode {
+	GoldenNone,
+	GoldenRecord,
+	GoldenCheck
+};
+
+struct GoldenResult {
+	bool found;
+	float cost;
+};
+
+/*!
+ * Expected results of the seeded queries.
+ *
+ * The results are stored as text with one query per line so that changes are easy to review:
+ *   <level> <query type> <query index> <found> <path cost>
+ */
+class GoldenResults {
+	
+	typedef std::map<std::string, GoldenResult> Results;
+	
+	Results m_results;
+	
+	static std::string getKey(const std::string & level, QueryType type, size_t index) {
+		std::ostringstream oss;
+		oss << level << ' ' << queryNames[type] << ' ' << index;
+		return oss.str();
+	}
+	
+public:
+	
+	bool load(const fs::path & file) {
+		
+		fs::ifstream ifs(file);
+		if(!ifs.is_open()) {
+			return false;
+		}
+		
+		std::string level, type;
+		size_t index;
+		GoldenResult result;
+		while(ifs >> level >> type >> index >> result.found >> result.cost) {
+			m_results[level + ' ' + type + ' ' + boost::lexical_cast<std::string>(index)] = result;
+		}
+		
+		return ifs.eof();
+	}
+	
+	bool save(const fs::path & file) const {
+		
+		fs::ofstream ofs(file);
+		if(!ofs.is_open()) {
+			return false;
+		}
+		
+		ofs << std::setprecision(9);
+		for(Results::const_iterator i = m_results.begin(); i != m_results.end(); ++i) {
+			ofs << i->first << ' ' << i->second.found << ' ' << i->second.cost << '\n';
+		}
+		
+		return !ofs.fail();
+	}
+	
+	void set(const std::string & level, QueryType type, size_t index, const GoldenResult & result) {
+		m_results[getKey(level, type, index)] = result;
+	}
+	
+	//! \return the expected result or NULL if none was recorded
+	const GoldenResult * get(const std::string & level, QueryType type, size_t index) const {
+		Results::const_iterator it = m_results.find(getKey(level, type, index));
+		return (it == m_results.end()) ? NULL : &it->second;
+	}
+	
+};
+
+float getPathLength(const ANCHOR_DATA * anchors, const PathFinder::Result & path) {
+	float length = 0.f;
+	for(size_t i = 1; i < path.size(); i++) {
+		length += fdist(anchors[path[i - 1]].pos, anchors[path[i]].pos);
+	}
+	return length;
+}
+
+/*!
+ * Check that a path starts at from, ends at to (unless to is -1) and only uses linked
+ * anchors that are usable with the default cylinder.
+ * Paths from wanderAround() and lookFor() are made of several searches, so an anchor
+ * may be repeated.
+ */
+bool isValidPath(const EERIE_BACKGROUND * eb, PathFinder::NodeId from, long to,
+                 const PathFinder::Result & path) {
+	
+	if(path.empty() || path.front() != from || (to >= 0 && path.back() != PathFinder::NodeId(to))) {
+		return false;
+	}
+	
+	for(size_t i = 1; i < path.size(); i++) {
+		
+		if(path[i] >= PathFinder::NodeId(eb->nbanchors)) {
+			return false;
+		}
+		
+		const ANCHOR_DATA & ad = eb->anchors[path[i]];
+		if((ad.flags & ANCHOR_FLAG_BLOCKED) || ad.height > PathFinder::HEIGHT_DEFAULT
+		   || ad.radius < PathFinder::RADIUS_DEFAULT) {
+			return false;
+		}
+		
+		if(path[i] == path[i - 1]) {
+			continue;
+		}
+		
+		const ANCHOR_DATA & previous = eb->anchors[path[i - 1]];
+		const long * begin = previous.linked;
+		const long * end = begin + previous.nblinked;
+		if(std::find(begin, end, long(path[i])) == end) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+/*!
+ * A* with linear open and closed lists, as PathFinder::move() used to be implemented.
+ * Used as a reference to check that optimizations don't change the resulting paths.
+ */
+class ReferencePathFinder {
+	
+	typedef PathFinder::NodeId NodeId;
+	
+	struct Node {
+		
+		NodeId id;
+		const Node * parent;
+		float cost;
+		float distance;
+		
+		Node(NodeId _id, const Node * _parent, float _distance, float _remaining)
+			: id(_id), parent(_parent), cost(_distance + _remaining), distance(_distance) { }
+		
+	};
+	
+	typedef std::vector<Node *> NodeList;
+	
+	const ANCHOR_DATA * map_d;
+	float heuristic;
+	
+	static bool contains(const NodeList & list, NodeId id) {
+		for(NodeList::const_iterator i = list.begin(); i != list.end(); ++i) {
+			if((*i)->id == id) {
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	static void add(NodeList & open, NodeId id, const Node * parent, float distance,
+	                float remaining) {
+		for(NodeList::iterator i = open.begin(); i != open.end(); ++i) {
+			if((*i)->id == id) {
+				if((*i)->distance > distance) {
+					(*i)->parent = parent;
+					(*i)->cost = (*i)->cost - (*i)->distance + distance;
+					(*i)->distance = distance;
+				}
+				return;
+			}
+		}
+		open.push_back(new Node(id, parent, distance, remaining));
+	}
+	
+	static Node * extractBestNode(NodeList & open) {
+		
+		if(open.empty()) {
+			return NULL;
+		}
+		
+		NodeList::iterator best = open.begin();
+		float cost = std::numeric_limits<float>::max();
+		for(NodeList::iterator i = open.begin(); i != open.end(); ++i) {
+			if((*i)->cost < cost) {
+				cost = (*i)->cost;
+				best = i;
+			}
+		}
+		
+		Node * node = *best;
+		open.erase(best);
+		return node;
+	}
+	
+	static void release(NodeList & list) {
+		for(NodeList::iterator i = list.begin(); i != list.end(); ++i) {
+			delete *i;
+		}
+	}
+	
+public:
+	
+	ReferencePathFinder(const ANCHOR_DATA * map_data, float _heuristic)
+		: map_d(map_data), heuristic(_heuristic) { }
+	
+	bool move(NodeId from, NodeId to, PathFinder::Result & rlist) const {
+		
+		if(from == to) {
+			rlist.push_back(to);
+			return true;
+		}
+		
+		NodeList open;
+		NodeList close;
+		
+		Node * node = new Node(from, NULL, 0.0f, 0.0f);
+		bool found = false;
+		do {
+			
+			close.push_back(node);
+			
+			NodeId nid = node->id;
+			if(nid == to) {
+				size_t s = rlist.size();
+				for(const Node * next = node; next; next = next->parent) {
+					rlist.push_back(next->id);
+				}
+				std::reverse(rlist.begin() + s, rlist.end());
+				found = true;
+				break;
+			}
+			
+			for(short i = 0; i < map_d[nid].nblinked; i++) {
+				
+				NodeId cid = map_d[nid].linked[i];
+				
+				if((map_d[cid].flags & ANCHOR_FLAG_BLOCKED)
+				   || map_d[cid].height > PathFinder::HEIGHT_DEFAULT
+				   || map_d[cid].radius < PathFinder::RADIUS_DEFAULT) {
+					continue;
+				}
+				
+				if(contains(close, cid)) {
+					continue;
+				}
+				
+				float distance = fdist(map_d[cid].pos, map_d[nid].pos);
+				distance *= heuristic;
+				distance += node->distance;
+				
+				float remaining = (1.0f - heuristic) * fdist(map_d[cid].pos, map_d[to].pos);
+				
+				add(open, cid, node, distance, remaining);
+			}
+			
+			node = extractBestNode(open);
+		} while(node);
+		
+		release(open);
+		release(close);
+		
+		return found;
+	}
+	
+};
+
+//! Linear scan over all anchors, as used by NPCs before the anchor index was added
+long getNearestReference(const EERIE_BACKGROUND * eb, const Vec3f & pos, float radius,
+                         float height) {
+	
+	long best = -1;
+	float distance = std::numeric_limits<float>::max();
+	
+	for(long i = 0; i < eb->nbanchors; i++) {
+		const ANCHOR_DATA & ad = eb->anchors[i];
+		if(!ad.nblinked) {
+			continue;
+		}
+		float dist = glm::distance2(ad.pos, pos);
+		if(dist < distance && ad.height <= height && ad.radius >= radius
+		   && !(ad.flags & ANCHOR_FLAG_BLOCKED)) {
+			best = i;
+			distance = dist;
+		}
+	}
+	
+	return best;
+}
+
+//! \return the number of queries where the index and the reference differ
+size_t benchmarkNearest(const std::string & name, const std::vector<PathFinder::NodeId> & anchors,
+                        size_t queries) {
+	
+	const EERIE_BACKGROUND * eb = ACTIVEBKG;
+	
+	u64 buildStart = platform::getTimeUs();
+	AnchorIndex index(eb->nbanchors, eb->anchors);
+	u64 buildTime = platform::getElapsedUs(buildStart);
+	
+	benchmark::Samples samples;
+	benchmark::Samples referenceSamples;
+	size_t mismatches = 0;
+	
+	for(size_t i = 0; i < queries; i++) {
+		
+		// Positions near the anchors with the cylinder of an NPC that fits some anchor
+		const ANCHOR_DATA & ad = eb->anchors[anchors[Random::get(size_t(0), anchors.size() - 1)]];
+		Vec3f pos = ad.pos + randomVec(-1.f, 1.f) * 500.f;
+		float radius = ad.radius;
+		float height = ad.height;
+		
+		u64 start = platform::getTimeUs();
+		long nearest = index.getNearest(pos, radius, height);
+		samples.add(platform::getElapsedUs(start));
+		
+		start = platform::getTimeUs();
+		long reference = getNearestReference(eb, pos, radius, height);
+		referenceSamples.add(platform::getElapsedUs(start));
+		
+		if(nearest != reference) {
+			LogWarning << name << ": different nearest anchor for " << pos.x << ' ' << pos.y
+			           << ' ' << pos.z;
+			mismatches++;
+		}
+	}
+	
+	benchmark::report(name, "nearest.build", double(buildTime), "us");
+	benchmark::report(name, "nearest.mismatches", double(mismatches));
+	benchmark::report(name, "nearest.time", samples);
+	benchmark::report(name, "nearest.reference.time", referenceSamples);
+	if(samples.total() > 0) {
+		benchmark::report(name, "nearest.speedup",
+		                  double(referenceSamples.total()) / double(samples.total()));
+	}
+	
+	return mismatches;
+}
+
+/*!
+ * Run seeded queries of all types using the same setup as the pathfinder thread.
+ * \return the number of results that differ from the golden results
+ */
+size_t benchmarkQueries(const std::string & name, long level,
+                        const std::vector<PathFinder::NodeId> & anchors,
+                        const PathHierarchy & hierarchy, size_t queries,
+                        GoldenMode mode, GoldenResults & golden) {
+	
+	const EERIE_BACKGROUND * eb = ACTIVEBKG;
+	
+	AnchorIndex index(eb->nbanchors, eb->anchors);
+	
+	PathFinder pathfinder(eb->nbanchors, eb->anchors);
+	pathfinder.setHierarchy(&hierarchy);
+	pathfinder.setAnchorIndex(&index);
+	
+	// Queries only depend on the level so that golden results can be checked for any level
+	Random::seed(unsigned(level));
+	
+	const std::string levelName = benchmark::getLevelName(level);
+	
+	benchmark::Samples samples[QueryTypeCount];
+	benchmark::Samples expanded[QueryTypeCount];
+	size_t found[QueryTypeCount] = { 0 };
+	size_t invalid[QueryTypeCount] = { 0 };
+	size_t mismatches[QueryTypeCount] = { 0 };
+	size_t missing = 0;
+	
+	for(size_t i = 0; i < queries; i++) {
+		
+		QueryType type = QueryType(i % QueryTypeCount);
+		pathfinder.setHeuristic(heuristics[(i / QueryTypeCount) % ARRAY_SIZE(heuristics)]);
+		
+		// Generate all parameters for every query so that each type gets the same anchors
+		PathFinder::NodeId from = anchors[Random::get(size_t(0), anchors.size() - 1)];
+		PathFinder::NodeId to = anchors[Random::get(size_t(0), anchors.size() - 1)];
+		const Vec3f & target = eb->anchors[to].pos;
+		float distance = Random::getf(200.f, 1000.f);
+		
+		PathFinder::Result path;
+		bool success = false;
+		long end = -1;
+		
+		size_t expandedBefore = pathfinder.getExpandedNodes();
+		u64 start = platform::getTimeUs();
+		switch(type) {
+			case QueryMove: {
+				success = pathfinder.move(from, to, path);
+				end = long(to);
+				break;
+			}
+			case QueryFlee: {
+				// Like an NPC fleeing from an entity at the target
+				float safeDistance = distance + fdist(eb->anchors[from].pos, target);
+				success = pathfinder.flee(from, target, safeDistance, path);
+				break;
+			}
+			case QueryWander: {
+				success = pathfinder.wanderAround(from, distance, path);
+				end = long(from);
+				break;
+			}
+			case QueryLookFor: {
+				success = pathfinder.lookFor(from, target, distance, path);
+				break;
+			}
+			case QueryTypeCount: ARX_DEAD_CODE();
+		}
+		samples[type].add(platform::getElapsedUs(start));
+		expanded[type].add(pathfinder.getExpandedNodes() - expandedBefore);
+		
+		GoldenResult result;
+		result.found = success;
+		result.cost = 0.f;
+		if(success) {
+			found[type]++;
+			result.cost = getPathLength(eb->anchors, path);
+			if(!isValidPath(eb, from, end, path)) {
+				LogWarning << name << ": invalid " << queryNames[type] << " path for query " << i;
+				invalid[type]++;
+			}
+		}
+		
+		if(mode == GoldenRecord) {
+			golden.set(levelName, type, i, result);
+		} else if(mode == GoldenCheck) {
+			const GoldenResult * expected = golden.get(levelName, type, i);
+			if(!expected) {
+				missing++;
+			} else if(expected->found != result.found
+			          || std::fabs(expected->cost - result.cost)
+			             > GOLDEN_TOLERANCE * std::max(1.f, expected->cost)) {
+				LogWarning << name << ": " << queryNames[type] << " query " << i << " changed from "
+				           << expected->found << ' ' << expected->cost << " to "
+				           << result.found << ' ' << result.cost;
+				mismatches[type]++;
+			}
+		}
+	}
+	
+	size_t totalMismatches = 0;
+	for(size_t type = 0; type < QueryTypeCount; type++) {
+		std::string query = name + '.' + queryNames[type];
+		benchmark::report(query, "queries", double(samples[type].count()));
+		benchmark::report(query, "found", double(found[type]));
+		benchmark::report(query, "invalid", double(invalid[type]));
+		benchmark::report(query, "time", samples[type]);
+		benchmark::report(query, "expanded", expanded[type], "nodes");
+		if(mode == GoldenCheck) {
+			benchmark::report(query, "golden.mismatches", double(mismatches[type]));
+		}
+		totalMismatches += mismatches[type];
+	}
+	
+	if(missing) {
+		LogWarning << name << ": no golden results for " << missing << " queries";
+	}
+	
+	return totalMismatches;
+}
+
+/*!
+ * Compare the pathfinder against the reference implementation, the hierarchy and
+ * the golden results.
+ * \return the number of results that differ
+ */
+size_t benchmarkLevel(long level, size_t searches, GoldenMode mode, GoldenResults & golden) {
+	
+	if(!benchmark::loadLevel(level)) {
+		return 0;
+	}
+	
+	const std::string name = benchmark::getLevelName(level) + ".pathfinder";
+	
+	const EERIE_BACKGROUND * eb = ACTIVEBKG;
+	
+	std::vector<PathFinder::NodeId> anchors;
+	for(long i = 0; i < eb->nbanchors; i++) {
+		if(eb->anchors[i].nblinked > 0) {
+			anchors.push_back(i);
+		}
+	}
+	
+	benchmark::report(name, "anchors", double(anchors.size()));
+	if(anchors.size() < 2) {
+		return 0;
+	}
+	
+	PathFinder pathfinder(eb->nbanchors, eb->anchors);
+	
+	u64 buildStart = platform::getTimeUs();
+	PathHierarchy hierarchy(eb->nbanchors, eb->anchors);
+	u64 buildTime = platform::getElapsedUs(buildStart);
+	
+	PathFinder hierarchical(eb->nbanchors, eb->anchors);
+	hierarchical.setHierarchy(&hierarchy);
+	
+	benchmark::Samples samples;
+	benchmark::Samples referenceSamples;
+	benchmark::Samples hierarchySamples;
+	size_t found = 0;
+	size_t length = 0;
+	size_t mismatches = 0;
+	size_t hierarchyMismatches = 0;
+	float flatCost = 0.f;
+	float hierarchyCost = 0.f;
+	
+	for(size_t i = 0; i < searches; i++) {
+		
+		PathFinder::NodeId from = anchors[Random::get(size_t(0), anchors.size() - 1)];
+		PathFinder::NodeId to = anchors[Random::get(size_t(0), anchors.size() - 1)];
+		
+		for(size_t h = 0; h < ARRAY_SIZE(heuristics); h++) {
+			
+			pathfinder.setHeuristic(heuristics[h]);
+			ReferencePathFinder reference(eb->anchors, heuristics[h]);
+			
+			PathFinder::Result result;
+			u64 start = platform::getTimeUs();
+			bool success = pathfinder.move(from, to, result);
+			samples.add(platform::getElapsedUs(start));
+			
+			PathFinder::Result referenceResult;
+			start = platform::getTimeUs();
+			bool referenceSuccess = reference.move(from, to, referenceResult);
+			referenceSamples.add(platform::getElapsedUs(start));
+			
+			if(success != referenceSuccess || result != referenceResult) {
+				LogWarning << name << ": different path from " << from << " to " << to
+				           << " with heuristic " << heuristics[h];
+				mismatches++;
+			}
+			
+			hierarchical.setHeuristic(heuristics[h]);
+			PathFinder::Result hierarchyResult;
+			start = platform::getTimeUs();
+			bool hierarchySuccess = hierarchical.move(from, to, hierarchyResult);
+			hierarchySamples.add(platform::getElapsedUs(start));
+			
+			// Paths may differ but must be found for exactly the same anchor pairs
+			if(success != hierarchySuccess) {
+				LogWarning << name << ": hierarchy changed result from " << from << " to " << to
+				           << " with heuristic " << heuristics[h];
+				hierarchyMismatches++;
+			}
+			
+			if(success) {
+				found++;
+				length += result.size();
+				if(hierarchySuccess) {
+					flatCost += getPathLength(eb->anchors, result);
+					hierarchyCost += getPathLength(eb->anchors, hierarchyResult);
+				}
+			}
+		}
+	}
+	
+	benchmark::report(name, "searches", double(samples.count()));
+	benchmark::report(name, "found", double(found));
+	benchmark::report(name, "length", double(length));
+	benchmark::report(name, "mismatches", double(mismatches));
+	benchmark::report(name, "time", samples);
+	benchmark::report(name, "reference.time", referenceSamples);
+	if(samples.total() > 0) {
+		benchmark::report(name, "speedup", double(referenceSamples.total()) / double(samples.total()));
+	}
+	
+	benchmark::report(name, "hierarchy.clusters", double(hierarchy.getClusterCount()));
+	benchmark::report(name, "hierarchy.build", double(buildTime), "us");
+	benchmark::report(name, "hierarchy.mismatches", double(hierarchyMismatches));
+	benchmark::report(name, "hierarchy.time", hierarchySamples);
+	if(hierarchySamples.total() > 0) {
+		benchmark::report(name, "hierarchy.speedup",
+		                  double(samples.total()) / double(hierarchySamples.total()));
+	}
+	if(flatCost > 0.f) {
+		// Relative length of the paths found using the hierarchy, 1 is optimal
+		benchmark::report(name, "hierarchy.length", double(hierarchyCost / flatCost));
+	}
+	
+	mismatches += hierarchyMismatches;
+	mismatches += benchmarkNearest(name, anchors, searches);
+	
+	return mismatches + benchmarkQueries(name, level, anchors, hierarchy, searches, mode, golden);
+}
+
+} // anonymous namespace
+
+int main_pathfinder(int argc, char ** argv) {
+	
+	GoldenMode mode = GoldenNone;
+	fs::path goldenFile;
+	if(argc > 0 && (std::string(argv[0]) == "--record" || std::string(argv[0]) == "--check")) {
+		if(argc < 2) {
+			return -1;
+		}
+		mode = (std::string(argv[0]) == "--record") ? GoldenRecord : GoldenCheck;
+		goldenFile = fs::path(argv[1]);
+		argc -= 2, argv += 2;
+	}
+	
+	GoldenResults golden;
+	if(mode == GoldenCheck && !golden.load(goldenFile)) {
+		LogError << "Could not load golden results from " << goldenFile;
+		return 2;
+	}
+	
+	size_t searches = 1000;
+	if(argc > 0) {
+		try {
+			searches = boost::lexical_cast<size_t>(argv[0]);
+		} catch(...) {
+			return -1;
+		}
+		argc--, argv++;
+	}
+	
+	std::vector<long> levels;
+	if(!benchmark::getLevels(argc, argv, levels)) {
+		return -1;
+	}
+	
+	if(levels.empty()) {
+		LogError << "No levels found";
+		return 2;
+	}
+	
+	size_t mismatches = 0;
+	for(size_t i = 0; i < levels.size(); i++) {
+		mismatches += benchmarkLevel(levels[i], searches, mode, golden);
+	}
+	
+	if(mode == GoldenRecord && !golden.save(goldenFile)) {
+		LogError << "Could not save golden results to " << goldenFile;
+		return 2;
+	}
+	
+	if(mismatches > 0) {
+		LogError << mismatches << " queries differ from the reference or golden results";
+		return 1;
+	}
+	
+	return 0;
+}
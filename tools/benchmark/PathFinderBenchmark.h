@@ -0,0 +1,35 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_TOOLS_BENCHMARK_PATHFINDERBENCHMARK_H
+#define ARX_TOOLS_BENCHMARK_PATHFINDERBENCHMARK_H
+
+/*!
+ * Run random searches on the anchor graphs of real levels and compare the results
+ * against a straightforward A* implementation.
+ *
+ * Also runs seeded move, flee, wander and look for queries like NPCs do. Their results
+ * can be recorded to a golden file with --record and later compared with --check.
+ *
+ * Arguments: [--record|--check <golden>] [<searches> [<level>...]]
+ * If no levels are given, all levels are used.
+ */
+int main_pathfinder(int argc, char ** argv);
+
+#endif // ARX_TOOLS_BENCHMARK_PATHFINDERBENCHMARK_H
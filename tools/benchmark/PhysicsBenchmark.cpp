@@ -0,0 +1,312 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark/PhysicsBenchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include "benchmark/Benchmark.h"
+#include "benchmark/Level.h"
+
+#include "game/Entity.h"
+#include "game/EntityManager.h"
+#include "game/NPC.h"
+#include "graphics/GraphicsTypes.h"
+#include "graphics/Math.h"
+#include "graphics/data/Mesh.h"
+#include "io/log/Logger.h"
+#include "math/Random.h"
+#include "physics/Collisions.h"
+#include "physics/Raycast.h"
+#include "platform/Time.h"
+
+namespace {
+
+enum QueryType {
+	QueryInPoly,
+	QueryTruePolyY,
+	QueryCylinder,
+	QueryValidPos,
+	QueryMoveCylinder,
+	QueryRaycast,
+	QueryTypeCount
+};
+
+const char * const queryNames[QueryTypeCount] = {
+	"inpoly", "truepolyy", "cylinder", "validpos", "move_cylinder", "raycast"
+};
+
+struct Query {
+	Vec3f pos;
+	Vec3f target; //!< Where to move the cylinder or end the ray
+	float radius;
+	const EERIEPOLY * poly; //!< Polygon for GetTruePolyY()
+};
+
+//! NPC without a mesh or script that is moved around by the cylinder queries
+Entity * npc = NULL;
+
+//! Hash of query results to detect changes in behavior between commits
+class Checksum {
+	
+	u32 m_hash;
+	
+public:
+	
+	Checksum() : m_hash(2166136261u) { }
+	
+	void add(const void * data, size_t size) {
+		const unsigned char * bytes = static_cast<const unsigned char *>(data);
+		for(size_t i = 0; i < size; i++) {
+			m_hash = (m_hash ^ bytes[i]) * 16777619u;
+		}
+	}
+	
+	void add(u32 value) { add(&value, sizeof(value)); }
+	
+	void add(float value) { add(&value, sizeof(value)); }
+	
+	void add(const Vec3f & value) { add(value.x), add(value.y), add(value.z); }
+	
+	u32 get() const { return m_hash; }
+	
+};
+
+Cylinder getCylinder(const Query & query) {
+	Cylinder cyl;
+	cyl.origin = query.pos;
+	cyl.radius = query.radius;
+	cyl.height = -160.f;
+	return cyl;
+}
+
+/*!
+ * Run one query and add its result to the checksum
+ *
+ * \return true if the query hit anything: a polygon for inpoly, truepolyy and raycast,
+ *         a blocked position for cylinder, validpos and move_cylinder
+ */
+bool runQuery(QueryType type, const Query & query, Checksum & checksum) {
+	
+	switch(type) {
+		
+		case QueryInPoly: {
+			float y = 0.f;
+			bool hit = (CheckInPoly(query.pos, &y) != NULL);
+			checksum.add(u32(hit)), checksum.add(y);
+			return hit;
+		}
+		
+		case QueryTruePolyY: {
+			float y = 0.f;
+			bool hit = GetTruePolyY(query.poly, query.pos, &y);
+			checksum.add(u32(hit)), checksum.add(hit ? y : 0.f);
+			return hit;
+		}
+		
+		case QueryCylinder: {
+			float anything = CheckAnythingInCylinder(getCylinder(query), NULL, CFLAG_NO_INTERCOL);
+			checksum.add(anything);
+			return anything < 0.f;
+		}
+		
+		case QueryValidPos: {
+			Cylinder cyl = getCylinder(query);
+			bool valid = AttemptValidCylinderPos(cyl, npc, CFLAG_NO_INTERCOL | CFLAG_NPC
+			                                     | CFLAG_JUST_TEST | CFLAG_RETURN_HEIGHT);
+			checksum.add(u32(valid)), checksum.add(cyl.origin.y);
+			return !valid;
+		}
+		
+		case QueryMoveCylinder: {
+			npc->_npcdata->climb_count = 0.f;
+			IO_PHYSICS phys;
+			phys.cyl = getCylinder(query);
+			phys.startpos = query.pos;
+			phys.targetpos = query.target;
+			phys.velocity = phys.forces = Vec3f_ZERO;
+			// Same step size and flags as NPC movement
+			bool moved = ARX_COLLISION_Move_Cylinder(&phys, npc, 40, CFLAG_NO_INTERCOL | CFLAG_NPC);
+			checksum.add(u32(moved)), checksum.add(phys.cyl.origin);
+			return !moved;
+		}
+		
+		case QueryRaycast: {
+			RaycastResult result = raycastBackground(query.pos, query.target,
+			                                         POLY_WATER | POLY_TRANS | POLY_NOCOL);
+			checksum.add(u32(result.type)), checksum.add(result.pos);
+			return result.type != RaycastResult::Miss;
+		}
+		
+		case QueryTypeCount: ARX_DEAD_CODE();
+	}
+	
+	return false;
+}
+
+void runQueries(const std::string & name, QueryType type, const std::vector<Query> & queries) {
+	
+	Checksum checksum;
+	size_t hits = 0;
+	
+	benchmark::CacheMissCounter misses;
+	
+	misses.start();
+	u64 start = platform::getTimeUs();
+	for(size_t i = 0; i < queries.size(); i++) {
+		if(runQuery(type, queries[i], checksum)) {
+			hits++;
+		}
+	}
+	u64 time = platform::getElapsedUs(start);
+	u64 missCount = misses.stop();
+	
+	benchmark::report(name, "queries", double(queries.size()));
+	benchmark::report(name, "hits", double(hits));
+	benchmark::report(name, "checksum", double(checksum.get()));
+	benchmark::report(name, "time", double(time), "us");
+	benchmark::report(name, "time_per_query", double(time) * 1000.0 / double(queries.size()), "ns");
+	if(misses.available()) {
+		benchmark::report(name, "cache_misses", double(missCount));
+		benchmark::report(name, "cache_misses_per_query",
+		                  double(missCount) / double(queries.size()));
+	}
+}
+
+void benchmarkLevel(long level, size_t count) {
+	
+	if(!benchmark::loadLevel(level)) {
+		return;
+	}
+	
+	std::string levelName = benchmark::getLevelName(level);
+	
+	// Query around the polygons so that most queries actually hit something
+	std::vector<const EERIEPOLY *> polys;
+	for(long x = 0; x < ACTIVEBKG->Xsize; x++) {
+		for(long z = 0; z < ACTIVEBKG->Zsize; z++) {
+			const EERIE_BKG_INFO & eg = ACTIVEBKG->fastdata[x][z];
+			for(long i = 0; i < eg.nbpoly; i++) {
+				polys.push_back(&eg.polydata[i]);
+			}
+		}
+	}
+	
+	benchmark::report("physics." + levelName, "polygons", double(polys.size()));
+	
+	if(polys.empty()) {
+		return;
+	}
+	
+	// Seed per level so that the queries don't depend on which levels are benchmarked
+	Random::seed(unsigned(level));
+	
+	for(size_t t = 0; t < QueryTypeCount; t++) {
+		
+		QueryType type = QueryType(t);
+		std::string name = "physics." + levelName + "." + queryNames[t];
+		
+		std::vector<Query> queries(count);
+		for(size_t i = 0; i < count; i++) {
+			
+			Query & query = queries[i];
+			query.poly = polys[Random::get(size_t(0), polys.size() - 1)];
+			query.radius = Random::getf(20.f, 60.f);
+			
+			if(type == QueryTruePolyY) {
+				// Points above the polygon bounds, most of them inside the polygon
+				query.pos = Vec3f(Random::getf(query.poly->min.x, query.poly->max.x),
+				                  query.poly->min.y - 10.f,
+				                  Random::getf(query.poly->min.z, query.poly->max.z));
+				continue;
+			}
+			
+			query.pos = query.poly->center;
+			query.pos += Vec3f(Random::getf(-50.f, 50.f), Random::getf(-200.f, 20.f),
+			                   Random::getf(-50.f, 50.f));
+			
+			if(type == QueryRaycast) {
+				// Between points above the polygons, like NPC eyes and missiles
+				const float maxLength = 2000.f;
+				query.target = polys[Random::get(size_t(0), polys.size() - 1)]->center;
+				query.target += Vec3f(Random::getf(-50.f, 50.f), Random::getf(-200.f, -20.f),
+				                      Random::getf(-50.f, 50.f));
+				float length = fdist(query.pos, query.target);
+				if(length > maxLength) {
+					query.target = query.pos + (query.target - query.pos) * (maxLength / length);
+				}
+			} else {
+				// About one frame of NPC movement up to a fast run at a low frame rate
+				float angle = Random::getf(0.f, 360.f);
+				float distance = Random::getf(5.f, 150.f);
+				query.target = query.pos + Vec3f(std::sin(glm::radians(angle)) * distance,
+				                                 Random::getf(-10.f, 10.f),
+				                                 std::cos(glm::radians(angle)) * distance);
+			}
+		}
+		
+		runQueries(name, type, queries);
+	}
+	
+}
+
+} // anonymous namespace
+
+int main_physics(int argc, char ** argv) {
+	
+	size_t queries = 100000;
+	if(argc > 0) {
+		try {
+			queries = boost::lexical_cast<size_t>(argv[0]);
+		} catch(...) {
+			return -1;
+		}
+		argc--, argv++;
+	}
+	
+	std::vector<long> levels;
+	if(argc == 0) {
+		levels.push_back(benchmark::SYNTHETIC_LEVEL);
+	}
+	if(!benchmark::getLevels(argc, argv, levels)) {
+		return -1;
+	}
+	
+	// The cylinder queries only test against the background
+	const char * const components[] = { "game", "physics" };
+	for(size_t i = 0; i < ARRAY_SIZE(components); i++) {
+		Logger::set(components[i], Logger::Error);
+	}
+	
+	entities.init();
+	npc = new Entity("graph/obj3d/interactive/npc/benchmark/benchmark", EntityInstance(0));
+	npc->ioflags = IO_NPC;
+	npc->_npcdata = new IO_NPCDATA;
+	
+	for(size_t i = 0; i < levels.size(); i++) {
+		benchmarkLevel(levels[i], queries);
+	}
+	
+	return 0;
+}
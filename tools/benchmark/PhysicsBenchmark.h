@@ -0,0 +1,37 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_TOOLS_BENCHMARK_PHYSICSBENCHMARK_H
+#define ARX_TOOLS_BENCHMARK_PHYSICSBENCHMARK_H
+
+/*!
+ * Time the collision and movement queries used by the physics code.
+ *
+ * CheckInPoly(), GetTruePolyY(), CheckAnythingInCylinder(), AttemptValidCylinderPos(),
+ * ARX_COLLISION_Move_Cylinder() and background ray casts are run with random
+ * parameters from a fixed seed, on a generated level and on real levels.
+ * Besides the timings, a checksum of the results is reported for each query so that
+ * changes in behavior show up when comparing the output of different commits.
+ *
+ * Arguments: [<queries> [<level>|synthetic...]]
+ * If no levels are given, the synthetic level and all real levels are used.
+ */
+int main_physics(int argc, char ** argv);
+
+#endif // ARX_TOOLS_BENCHMARK_PHYSICSBENCHMARK_H
@@ -0,0 +1,485 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark/RaycastBenchmark.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include "benchmark/Benchmark.h"
+#include "benchmark/Level.h"
+
+#include "core/Core.h"
+#include "game/Camera.h"
+#include "graphics/GraphicsTypes.h"
+#include "graphics/Math.h"
+#include "graphics/data/Mesh.h"
+#include "io/log/Logger.h"
+#include "math/Random.h"
+#include "physics/Raycast.h"
+#include "platform/Time.h"
+
+namespace {
+
+/*
+ * The reference functions below march along the ray in fixed steps and test the
+ * polygons near each step, as Visible(), IO_Visible() and EERIELaunchRay3() used to be
+ * implemented before the tile grid ray caster was added.
+ */
+
+//! Camera looking along the ray, polygons are hit if they cover the screen center
+EERIE_CAMERA referenceCamera;
+
+void referenceProject(const Vec3f & in, TexturedVertex * out, const EERIE_CAMERA & cam) {
+	
+	const Vec3f rt = Vec3f(cam.orgTrans.worldToView * Vec4f(in, 1.0f));
+	
+	if(rt.z <= 0.f) {
+		out->rhw = 1.f - rt.z;
+	} else {
+		out->rhw = 1.f / rt.z;
+	}
+	
+	const float rhw = (cam.focal * g_sizeRatio.x) * out->rhw;
+	out->p.z = rt.z * (1.f / (cam.cdepth * 1.2f));
+	out->p.x = cam.orgTrans.mod.x + (rt.x * rhw);
+	out->p.y = cam.orgTrans.mod.y + (rt.y * rhw);
+}
+
+int referencePointIn2DPoly(const EERIEPOLY & ep, float x, float y) {
+	
+	int c = 0;
+	
+	for(int i = 0, j = 2; i < 3; j = i++) {
+		if((((ep.tv[i].p.y <= y) && (y < ep.tv[j].p.y)) || ((ep.tv[j].p.y <= y) && (y < ep.tv[i].p.y)))
+		   && (x < (ep.tv[j].p.x - ep.tv[i].p.x) * (y - ep.tv[i].p.y) / (ep.tv[j].p.y - ep.tv[i].p.y) + ep.tv[i].p.x)) {
+			c = !c;
+		}
+	}
+	
+	if(c) {
+		return c;
+	}
+	
+	if(ep.type & POLY_QUAD) {
+		for(int i = 1, j = 3; i < 4; j = i++) {
+			if((((ep.tv[i].p.y <= y) && (y < ep.tv[j].p.y)) || ((ep.tv[j].p.y <= y) && (y < ep.tv[i].p.y)))
+			   && (x < (ep.tv[j].p.x - ep.tv[i].p.x) * (y - ep.tv[i].p.y) / (ep.tv[j].p.y - ep.tv[i].p.y) + ep.tv[i].p.x)) {
+				c = !c;
+			}
+		}
+	}
+	
+	return c;
+}
+
+//! RayIn3DPolyNoCull()
+bool referenceRayInPoly(const Vec3f & orgn, const Vec3f & dest, const EERIEPOLY * epp) {
+	
+	EERIEPOLY ep = *epp;
+	
+	referenceCamera.orgTrans.pos = orgn;
+	referenceCamera.setTargetCamera(dest);
+	SP_PrepareCamera(&referenceCamera);
+	
+	long to = (ep.type & POLY_QUAD) ? 4 : 3;
+	for(long n = 0; n < to; n++) {
+		referenceProject(ep.v[n].p, &ep.tv[n], referenceCamera);
+	}
+	
+	return referencePointIn2DPoly(ep, 320.f, 320.f) != 0;
+}
+
+//! RayCollidingPoly()
+bool referenceRayCollidingPoly(const Vec3f & orgn, const Vec3f & dest, const EERIEPOLY * ep,
+                               Vec3f * hit) {
+	
+	Vec3f v = dest - orgn;
+	
+	float d = glm::dot(v, ep->norm);
+	if(d == 0.f) {
+		return false;
+	}
+	
+	d = glm::dot(ep->center - dest, ep->norm) / d;
+	*hit = (v * d) + dest;
+	
+	return referenceRayInPoly(orgn, dest, ep);
+}
+
+//! Visible(), or the background part of IO_Visible() with ignored polygon types
+bool referenceVisible(const Vec3f & orgn, const Vec3f & dest, PolyType ignored, Vec3f * hit) {
+	
+	float pas = 35.f;
+	
+	float nearest = fdist(orgn, dest);
+	if(nearest < pas) {
+		pas = nearest * .5f;
+	}
+	
+	Vec3f d = dest - orgn;
+	Vec3f ad = glm::abs(d);
+	
+	Vec3f i;
+	float iter;
+	if(ad.x >= ad.y && ad.x >= ad.z) {
+		i.x = (ad.x != d.x) ? -pas : pas;
+		iter = ad.x / pas;
+		i.y = d.y * (1.f / iter);
+		i.z = d.z * (1.f / iter);
+	} else if(ad.y >= ad.x && ad.y >= ad.z) {
+		i.y = (ad.y != d.y) ? -pas : pas;
+		iter = ad.y / pas;
+		i.x = d.x * (1.f / iter);
+		i.z = d.z * (1.f / iter);
+	} else {
+		i.z = (ad.z != d.z) ? -pas : pas;
+		iter = ad.z / pas;
+		i.x = d.x * (1.f / iter);
+		i.y = d.y * (1.f / iter);
+	}
+	
+	const EERIEPOLY * found = NULL;
+	Vec3f foundHit(0.f);
+	
+	Vec3f p = orgn - i;
+	while(iter > 0.f) {
+		iter -= 1.f;
+		p += i;
+		
+		long px = long(p.x * ACTIVEBKG->Xmul);
+		long pz = long(p.z * ACTIVEBKG->Zmul);
+		if(px < 0 || px > ACTIVEBKG->Xsize - 1 || pz < 0 || pz > ACTIVEBKG->Zsize - 1) {
+			break;
+		}
+		
+		const EERIE_BKG_INFO & eg = ACTIVEBKG->fastdata[px][pz];
+		for(long k = 0; k < eg.nbpolyin; k++) {
+			const EERIEPOLY * ep = eg.polyin[k];
+			if(!(ep->type & ignored)
+			   && ep->min.y - pas < p.y && ep->max.y + pas > p.y
+			   && ep->min.x - pas < p.x && ep->max.x + pas > p.x
+			   && ep->min.z - pas < p.z && ep->max.z + pas > p.z
+			   && referenceRayCollidingPoly(orgn, dest, ep, hit)) {
+				float dd = fdist(orgn, *hit);
+				if(dd < nearest) {
+					nearest = dd;
+					found = ep;
+					foundHit = *hit;
+				}
+			}
+		}
+	}
+	
+	if(!found) {
+		return true;
+	}
+	
+	*hit = foundHit;
+	
+	return false;
+}
+
+//! EERIELaunchRay3() without a polygon to ignore
+int referenceLaunchRay(const Vec3f & orgn, const Vec3f & dest, Vec3f * hit) {
+	
+	const float pas = 1.5f;
+	const float maxstepp = 20000.f / pas;
+	
+	Vec3f d = dest - orgn;
+	Vec3f ad = glm::abs(d);
+	
+	Vec3f i;
+	if(ad.x >= ad.y && ad.x >= ad.z) {
+		i = Vec3f((ad.x != d.x) ? -pas : pas, d.y / (ad.x / pas), d.z / (ad.x / pas));
+	} else if(ad.y >= ad.x && ad.y >= ad.z) {
+		i = Vec3f(d.x / (ad.y / pas), (ad.y != d.y) ? -pas : pas, d.z / (ad.y / pas));
+	} else {
+		i = Vec3f(d.x / (ad.z / pas), d.y / (ad.z / pas), (ad.z != d.z) ? -pas : pas);
+	}
+	
+	Vec3f p = orgn;
+	long steps = 0;
+	
+	for(;;) {
+		
+		p += i;
+		*hit = p;
+		
+		if((i.x == -pas && p.x <= dest.x) || (i.x == pas && p.x >= dest.x)
+		   || (i.y == -pas && p.y <= dest.y) || (i.y == pas && p.y >= dest.y)
+		   || (i.z == -pas && p.z <= dest.z) || (i.z == pas && p.z >= dest.z)) {
+			return 0;
+		}
+		
+		steps++;
+		if(steps > maxstepp) {
+			return -1;
+		}
+		
+		long tilex = long(p.x * ACTIVEBKG->Xmul);
+		long tilez = long(p.z * ACTIVEBKG->Zmul);
+		if(tilex < 0 || tilex > ACTIVEBKG->Xsize - 1 || tilez < 0 || tilez > ACTIVEBKG->Zsize - 1) {
+			return -1;
+		}
+		
+		if(ACTIVEBKG->fastdata[tilex][tilez].nbpoly == 0) {
+			return 1;
+		}
+		
+		long minx = std::max(tilex - 1, 0l);
+		long maxx = std::min(tilex + 1, ACTIVEBKG->Xsize - 1l);
+		long minz = std::max(tilez - 1, 0l);
+		long maxz = std::min(tilez + 1, ACTIVEBKG->Zsize - 1l);
+		
+		for(long z = minz; z < maxz; z++)
+		for(long x = minx; x < maxx; x++) {
+			const EERIE_BKG_INFO & eg = ACTIVEBKG->fastdata[x][z];
+			for(long k = 0; k < eg.nbpoly; k++) {
+				const EERIEPOLY * ep = &eg.polydata[k];
+				if(!(ep->type & POLY_TRANS)
+				   && p.y >= ep->min.y - 10.f && p.y <= ep->max.y + 10.f
+				   && p.x >= ep->min.x - 10.f && p.x <= ep->max.x + 10.f
+				   && p.z >= ep->min.z - 10.f && p.z <= ep->max.z + 10.f
+				   && referenceRayInPoly(orgn, dest, ep)) {
+					return 1;
+				}
+			}
+		}
+	}
+}
+
+enum RayType {
+	RayVisible,
+	RayIOVisible,
+	RayLaunch,
+	RayTypeCount
+};
+
+const char * const rayNames[RayTypeCount] = { "visible", "io_visible", "launch" };
+
+struct Ray {
+	Vec3f start;
+	Vec3f end;
+};
+
+struct RayResult {
+	int value; //!< 0 if the ray was not blocked, otherwise the EERIELaunchRay3() result or 1
+	Vec3f hit;
+};
+
+RayResult castRay(RayType type, const Ray & ray, bool reference) {
+	
+	RayResult result = { 0, ray.end };
+	
+	switch(type) {
+		
+		case RayVisible: {
+			bool visible;
+			if(reference) {
+				visible = referenceVisible(ray.start, ray.end, PolyType(), &result.hit);
+			} else {
+				visible = Visible(ray.start, ray.end, NULL, &result.hit);
+			}
+			result.value = visible ? 0 : 1;
+			break;
+		}
+		
+		case RayIOVisible: {
+			// Entities are not loaded, so IO_Visible() would only test the background
+			PolyType ignored = POLY_WATER | POLY_TRANS | POLY_NOCOL;
+			if(reference) {
+				result.value = referenceVisible(ray.start, ray.end, ignored, &result.hit) ? 0 : 1;
+			} else {
+				RaycastResult hit = raycastBackground(ray.start, ray.end, ignored);
+				result.value = (hit.type == RaycastResult::Polygon) ? 1 : 0;
+				result.hit = hit.pos;
+			}
+			break;
+		}
+		
+		case RayLaunch: {
+			if(reference) {
+				result.value = referenceLaunchRay(ray.start, ray.end, &result.hit);
+			} else {
+				result.value = EERIELaunchRay3(ray.start, ray.end, &result.hit, NULL);
+			}
+			break;
+		}
+		
+		case RayTypeCount: ARX_DEAD_CODE();
+	}
+	
+	return result;
+}
+
+/*!
+ * Cast all rays either with the tile grid ray caster or with the old ray marching
+ * and report the time and cache misses as <prefix>time and <prefix>cache_misses
+ */
+void castRays(const std::string & name, RayType type, const std::vector<Ray> & rays,
+              bool reference, std::vector<RayResult> & results) {
+	
+	results.resize(rays.size());
+	
+	benchmark::CacheMissCounter misses;
+	
+	misses.start();
+	u64 start = platform::getTimeUs();
+	for(size_t i = 0; i < rays.size(); i++) {
+		results[i] = castRay(type, rays[i], reference);
+	}
+	u64 time = platform::getElapsedUs(start);
+	u64 missCount = misses.stop();
+	
+	size_t blocked = 0;
+	for(size_t i = 0; i < results.size(); i++) {
+		if(results[i].value != 0) {
+			blocked++;
+		}
+	}
+	
+	std::string prefix = reference ? "reference." : "";
+	benchmark::report(name, prefix + "blocked", double(blocked));
+	benchmark::report(name, prefix + "time", double(time), "us");
+	benchmark::report(name, prefix + "time_per_ray",
+	                  double(time) * 1000.0 / double(rays.size()), "ns");
+	if(misses.available()) {
+		benchmark::report(name, prefix + "cache_misses", double(missCount));
+		benchmark::report(name, prefix + "cache_misses_per_ray",
+		                  double(missCount) / double(rays.size()));
+	}
+}
+
+void benchmarkLevel(long level, size_t count) {
+	
+	if(!benchmark::loadLevel(level)) {
+		return;
+	}
+	
+	std::string levelName = benchmark::getLevelName(level);
+	
+	// Cast rays between points above the polygons, like NPC eyes and missiles
+	std::vector<Vec3f> centers;
+	for(long x = 0; x < ACTIVEBKG->Xsize; x++) {
+		for(long z = 0; z < ACTIVEBKG->Zsize; z++) {
+			const EERIE_BKG_INFO & eg = ACTIVEBKG->fastdata[x][z];
+			for(long i = 0; i < eg.nbpoly; i++) {
+				centers.push_back(eg.polydata[i].center);
+			}
+		}
+	}
+	
+	if(centers.empty()) {
+		return;
+	}
+	
+	// Seed per level so that the rays don't depend on which levels are benchmarked
+	Random::seed(unsigned(level));
+	
+	const float maxLength = 2000.f;
+	
+	std::vector<Ray> rays(count);
+	for(size_t i = 0; i < count; i++) {
+		Ray & ray = rays[i];
+		ray.start = centers[Random::get(size_t(0), centers.size() - 1)];
+		ray.start += Vec3f(Random::getf(-50.f, 50.f), Random::getf(-200.f, -20.f),
+		                   Random::getf(-50.f, 50.f));
+		ray.end = centers[Random::get(size_t(0), centers.size() - 1)];
+		ray.end += Vec3f(Random::getf(-50.f, 50.f), Random::getf(-200.f, -20.f),
+		                 Random::getf(-50.f, 50.f));
+		float length = fdist(ray.start, ray.end);
+		if(length > maxLength) {
+			ray.end = ray.start + (ray.end - ray.start) * (maxLength / length);
+		}
+	}
+	
+	for(size_t t = 0; t < RayTypeCount; t++) {
+		
+		RayType type = RayType(t);
+		std::string name = "raycast." + levelName + "." + rayNames[t];
+		
+		std::vector<RayResult> reference;
+		castRays(name, type, rays, true, reference);
+		
+		std::vector<RayResult> results;
+		castRays(name, type, rays, false, results);
+		
+		size_t mismatches = 0;
+		size_t bothBlocked = 0;
+		double distanceError = 0.0;
+		for(size_t i = 0; i < count; i++) {
+			if(results[i].value != reference[i].value) {
+				mismatches++;
+			} else if(results[i].value != 0) {
+				bothBlocked++;
+				distanceError += glm::abs(fdist(rays[i].start, results[i].hit)
+				                          - fdist(rays[i].start, reference[i].hit));
+			}
+		}
+		
+		benchmark::report(name, "rays", double(count));
+		benchmark::report(name, "mismatches", double(mismatches));
+		if(bothBlocked > 0) {
+			benchmark::report(name, "hit_distance_error", distanceError / double(bothBlocked));
+		}
+	}
+	
+}
+
+} // anonymous namespace
+
+int main_raycast(int argc, char ** argv) {
+	
+	size_t rays = 10000;
+	if(argc > 0) {
+		try {
+			rays = boost::lexical_cast<size_t>(argv[0]);
+		} catch(...) {
+			return -1;
+		}
+		argc--, argv++;
+	}
+	
+	std::vector<long> levels;
+	if(!benchmark::getLevels(argc, argv, levels)) {
+		return -1;
+	}
+	
+	if(levels.empty()) {
+		LogError << "No levels found";
+		return 2;
+	}
+	
+	// Same setup as the ray camera the game used for this
+	referenceCamera.clip = Rect(0, 0, 640, 640);
+	referenceCamera.center = referenceCamera.clip.center();
+	referenceCamera.focal = 310.f;
+	referenceCamera.cdepth = 2100.f;
+	referenceCamera.angle = Anglef::ZERO;
+	
+	for(size_t i = 0; i < levels.size(); i++) {
+		benchmarkLevel(levels[i], rays);
+	}
+	
+	return 0;
+}
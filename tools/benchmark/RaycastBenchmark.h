@@ -0,0 +1,37 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_TOOLS_BENCHMARK_RAYCASTBENCHMARK_H
+#define ARX_TOOLS_BENCHMARK_RAYCASTBENCHMARK_H
+
+/*!
+ * Cast random rays on real levels with the tile grid ray caster and with the old
+ * fixed-step ray marching used by Visible(), IO_Visible() and EERIELaunchRay3().
+ *
+ * The old code only tested polygons near regular samples along the ray and could
+ * report hits slightly outside of the segment, so the results are not expected to be
+ * identical. The number of rays where only one of them was blocked is reported
+ * together with the timings.
+ *
+ * Arguments: [<rays> [<level>...]]
+ * If no levels are given, all levels are used.
+ */
+int main_raycast(int argc, char ** argv);
+
+#endif // ARX_TOOLS_BENCHMARK_RAYCASTBENCHMARK_H
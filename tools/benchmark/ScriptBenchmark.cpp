@@ -0,0 +1,256 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark/ScriptBenchmark.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include "benchmark/Benchmark.h"
+
+#include "core/GameTime.h"
+#include "game/Entity.h"
+#include "game/EntityManager.h"
+#include "game/Item.h"
+#include "game/NPC.h"
+#include "game/Player.h"
+#include "io/log/Logger.h"
+#include "io/resource/PakEntry.h"
+#include "io/resource/PakReader.h"
+#include "io/resource/ResourcePath.h"
+#include "platform/Time.h"
+#include "script/Script.h"
+#include "script/ScriptCache.h"
+#include "script/ScriptEvent.h"
+
+namespace {
+
+struct BenchmarkEvent {
+	ScriptMessage msg;
+	const char * name;
+};
+
+//! Representative events sent to every entity in each iteration
+const BenchmarkEvent events[] = {
+	{ SM_INIT, "init" },
+	{ SM_MAIN, "main" },
+	{ SM_COLLIDE_NPC, "collide_npc" },
+	{ SM_CHAT, "chat" },
+};
+
+void collectScripts(PakDirectory * dir, const res::path & path,
+                    std::vector<res::path> & scripts) {
+	
+	for(PakDirectory::files_iterator i = dir->files_begin(); i != dir->files_end(); ++i) {
+		res::path file = path / i->first;
+		if(file.has_ext("asl")) {
+			scripts.push_back(file);
+		}
+	}
+	
+	for(PakDirectory::dirs_iterator i = dir->dirs_begin(); i != dir->dirs_end(); ++i) {
+		collectScripts(&i->second, path / i->first, scripts);
+	}
+	
+}
+
+/*!
+ * Create an entity for a script without loading any meshes, textures or sounds.
+ * The entity type is guessed from the script location.
+ */
+Entity * createStubEntity(const res::path & script, EntityInstance instance) {
+	
+	res::path classPath = res::path(script).remove_ext();
+	
+	Entity * io = new Entity(classPath, instance);
+	
+	const std::string & str = script.string();
+	if(str.find("/npc/") != std::string::npos) {
+		io->ioflags = IO_NPC;
+		io->_npcdata = new IO_NPCDATA;
+		io->_npcdata->lifePool.current = io->_npcdata->lifePool.max = 100.f;
+	} else if(str.find("/items/") != std::string::npos) {
+		io->ioflags = IO_ITEM;
+		io->_itemdata = (IO_ITEMDATA *)malloc(sizeof(IO_ITEMDATA));
+		memset(io->_itemdata, 0, sizeof(IO_ITEMDATA));
+		io->_itemdata->count = io->_itemdata->maxcount = 1;
+		io->_itemdata->playerstacksize = 1;
+	} else {
+		io->ioflags = IO_FIX;
+		io->_fixdata = (IO_FIXDATA *)malloc(sizeof(IO_FIXDATA));
+		memset(io->_fixdata, 0, sizeof(IO_FIXDATA));
+		io->_fixdata->trapvalue = -1;
+	}
+	
+	io->gameFlags |= GFLAG_ISINTREATZONE;
+	
+	loadScript(io->script, resources->getFile(script));
+	
+	return io;
+}
+
+} // anonymous namespace
+
+int main_script(int argc, char ** argv) {
+	
+	size_t iterations = 100;
+	if(argc > 0) {
+		try {
+			iterations = boost::lexical_cast<size_t>(argv[0]);
+		} catch(...) {
+			return -1;
+		}
+		argc--, argv++;
+	}
+	
+	std::vector<res::path> scripts;
+	if(argc > 0) {
+		for(int i = 0; i < argc; i++) {
+			scripts.push_back(res::path::load(argv[i]));
+		}
+	} else {
+		res::path base = "graph/obj3d/interactive";
+		PakDirectory * dir = resources->getDirectory(base);
+		if(dir) {
+			collectScripts(dir, base, scripts);
+		}
+	}
+	
+	if(scripts.empty()) {
+		LogError << "No scripts found";
+		return 2;
+	}
+	
+	// Scripts trigger lots of warnings without a loaded level - we don't care about them
+	const char * const components[] = { "script", "game", "scene", "graphics", "audio" };
+	for(size_t i = 0; i < ARRAY_SIZE(components); i++) {
+		Logger::set(components[i], Logger::Error);
+	}
+	
+	arxtime.init();
+	ScriptEvent::init();
+	ARX_SCRIPT_EventStackInit();
+	ARX_SCRIPT_Timer_FirstInit(512);
+	entities.init();
+	ARX_PLAYER_InitPlayer();
+	
+	// Load the player entity first so that it gets the player handle
+	Entity * playerEntity = createStubEntity("graph/obj3d/interactive/player/player.asl",
+	                                         EntityInstance(-1));
+	arx_assert(playerEntity == entities.player());
+	ARX_UNUSED(playerEntity);
+	
+	u64 preloadStart = platform::getTimeUs();
+	std::vector<PakFile *> files;
+	for(size_t i = 0; i < scripts.size(); i++) {
+		files.push_back(resources->getFile(scripts[i]));
+	}
+	preloadScripts(files);
+	u64 preloadTime = platform::getElapsedUs(preloadStart);
+	
+	u64 loadStart = platform::getTimeUs();
+	std::vector<Entity *> stubs;
+	for(size_t i = 0; i < scripts.size(); i++) {
+		Entity * io = createStubEntity(scripts[i], EntityInstance(i + 1));
+		if(io->script.data) {
+			stubs.push_back(io);
+		}
+	}
+	u64 loadTime = platform::getElapsedUs(loadStart);
+	
+	benchmark::report("script", "scripts", double(stubs.size()));
+	benchmark::report("script", "load.preload", double(preloadTime), "us");
+	benchmark::report("script", "load.total", double(loadTime), "us");
+	
+	u64 totalTime = 0;
+	long totalEvents = 0;
+	long totalCommands = 0;
+	
+	for(size_t e = 0; e < ARRAY_SIZE(events); e++) {
+		
+		ScriptEvent::totalCount = 0;
+		ScriptEvent::totalCommands = 0;
+		
+		// Accept / refuse counts make it easy to spot behavior changes
+		long accepted = 0;
+		long refused = 0;
+		
+		// Most events take less than a microsecond, so time whole iterations
+		// including the events queued by the scripts and divide by the event count
+		benchmark::Samples samples;
+		for(size_t n = 0; n < iterations; n++) {
+			
+			u64 start = platform::getTimeUs();
+			
+			for(size_t i = 0; i < stubs.size(); i++) {
+				
+				ScriptResult ret = SendIOScriptEvent(stubs[i], events[e].msg);
+				
+				if(ret == REFUSE) {
+					refused++;
+				} else {
+					accepted++;
+				}
+				
+			}
+			ARX_SCRIPT_EventStackExecuteAll();
+			
+			samples.add(platform::getElapsedUs(start));
+		}
+		
+		std::string name = std::string("script.") + events[e].name;
+		u64 time = samples.total();
+		benchmark::report(name, "events", double(ScriptEvent::totalCount));
+		benchmark::report(name, "commands", double(ScriptEvent::totalCommands));
+		benchmark::report(name, "accepted", double(accepted));
+		benchmark::report(name, "refused", double(refused));
+		benchmark::report(name, "iteration_time", samples, "us");
+		if(time > 0) {
+			benchmark::report(name, "events_per_second",
+			                  double(ScriptEvent::totalCount) * 1000000.0 / double(time));
+		}
+		if(ScriptEvent::totalCount > 0) {
+			benchmark::report(name, "time_per_event",
+			                  double(time) * 1000.0 / double(ScriptEvent::totalCount), "ns");
+		}
+		if(ScriptEvent::totalCommands > 0) {
+			benchmark::report(name, "time_per_command",
+			                  double(time) * 1000.0 / double(ScriptEvent::totalCommands), "ns");
+		}
+		
+		totalTime += time;
+		totalEvents += ScriptEvent::totalCount;
+		totalCommands += ScriptEvent::totalCommands;
+	}
+	
+	if(totalTime > 0) {
+		benchmark::report("script", "events_per_second",
+		                  double(totalEvents) * 1000000.0 / double(totalTime));
+	}
+	if(totalCommands > 0) {
+		benchmark::report("script", "time_per_command",
+		                  double(totalTime) * 1000.0 / double(totalCommands), "ns");
+	}
+	
+	return 0;
+}
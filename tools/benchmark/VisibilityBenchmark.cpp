@@ -0,0 +1,214 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark/VisibilityBenchmark.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include "benchmark/Benchmark.h"
+#include "benchmark/Level.h"
+
+#include "graphics/GraphicsTypes.h"
+#include "graphics/data/Mesh.h"
+#include "io/fs/FilePath.h"
+#include "io/fs/SystemPaths.h"
+#include "io/log/Logger.h"
+#include "math/Random.h"
+#include "platform/Time.h"
+#include "scene/RoomVisibility.h"
+
+namespace {
+
+/*!
+ * Find all rooms the portal traversal in ARX_SCENE_Update() could reach for a camera
+ * at the given position if nothing was clipped by the frustums.
+ */
+void getReachableRooms(const EERIE_PORTAL_DATA & data, size_t start, const Vec3f & camera,
+                       std::vector<bool> & reached) {
+	
+	reached.assign(data.rooms.size(), false);
+	reached[start] = true;
+	
+	std::vector<size_t> stack(1, start);
+	while(!stack.empty()) {
+		
+		size_t roomIndex = stack.back();
+		stack.pop_back();
+		
+		const EERIE_ROOM_DATA & room = data.rooms[roomIndex];
+		for(long i = 0; i < room.nb_portals; i++) {
+			
+			const EERIE_PORTALS & po = data.portals[room.portals[i]];
+			
+			// Same test as ARX_PORTALS_Frustrum_ComputeRoom()
+			bool cull = !(glm::dot(po.poly.center - camera, po.poly.norm) < 0.f);
+			size_t next;
+			if(po.room_1 == roomIndex && !cull) {
+				next = po.room_2;
+			} else if(po.room_2 == roomIndex && cull) {
+				next = po.room_1;
+			} else {
+				continue;
+			}
+			
+			if(!reached[next]) {
+				reached[next] = true;
+				stack.push_back(next);
+			}
+		}
+		
+	}
+	
+}
+
+//! \return the number of problems found
+size_t validateLevel(long level, size_t samples) {
+	
+	if(level == benchmark::SYNTHETIC_LEVEL) {
+		LogWarning << "The synthetic level has no portals";
+		return 0;
+	}
+	
+	if(!benchmark::loadLevel(level) || !portals) {
+		return 1;
+	}
+	
+	std::string name = "visibility." + benchmark::getLevelName(level);
+	
+	RoomVisibility visibility;
+	visibility.computeBounds(*portals, *ACTIVEBKG);
+	u64 start = platform::getTimeUs();
+	visibility.compute(*portals);
+	u64 time = platform::getElapsedUs(start);
+	
+	bool upToDate = (visibility == roomVisibility);
+	if(!upToDate) {
+		LogError << "Loaded room visibility for level " << level << " is not up to date";
+	}
+	
+	size_t rooms = visibility.getRoomCount();
+	size_t visible = 0;
+	for(size_t i = 0; i < rooms; i++) {
+		visible += visibility.getVisibleCount(i);
+	}
+	
+	benchmark::report(name, "rooms", double(rooms));
+	benchmark::report(name, "portals", double(portals->portals.size()));
+	benchmark::report(name, "build_time", double(time), "us");
+	benchmark::report(name, "up_to_date", upToDate ? 1.0 : 0.0);
+	if(rooms > 0) {
+		benchmark::report(name, "visible_rooms", double(visible) / double(rooms));
+	}
+	
+	// Seed per level so that the samples don't depend on which levels are validated
+	Random::seed(unsigned(level));
+	
+	size_t checked = 0;
+	size_t reachable = 0;
+	size_t missing = 0;
+	std::vector<bool> reached;
+	for(size_t room = 0; room < rooms; room++) {
+		
+		const EERIE_3D_BBOX & bounds = visibility.getViewerBounds(room);
+		if(!bounds.valid()) {
+			continue;
+		}
+		
+		for(size_t i = 0; i < samples; i++) {
+			
+			Vec3f camera(Random::getf(bounds.min.x, bounds.max.x),
+			             Random::getf(bounds.min.y, bounds.max.y),
+			             Random::getf(bounds.min.z, bounds.max.z));
+			
+			getReachableRooms(*portals, room, camera, reached);
+			
+			for(size_t other = 0; other < rooms; other++) {
+				if(!reached[other]) {
+					continue;
+				}
+				reachable++;
+				if(!visibility.isVisible(room, other)) {
+					LogError << "Room " << other << " is reachable from room " << room
+					         << " at (" << camera.x << ", " << camera.y << ", " << camera.z
+					         << ") but not in the visible set";
+					missing++;
+				}
+			}
+			
+			checked++;
+		}
+	}
+	
+	benchmark::report(name, "samples", double(checked));
+	if(checked > 0) {
+		// Compare with visible_rooms to see how conservative the sets are
+		benchmark::report(name, "reachable_rooms", double(reachable) / double(checked));
+	}
+	benchmark::report(name, "missing", double(missing));
+	
+	return missing + (upToDate ? 0 : 1);
+}
+
+} // anonymous namespace
+
+int main_visibility(int argc, char ** argv) {
+	
+	if(argc > 0 && std::string(argv[0]) == "--user-dir") {
+		if(argc < 2) {
+			return -1;
+		}
+		fs::paths.user = fs::path(argv[1]);
+		argc -= 2, argv += 2;
+	}
+	
+	size_t samples = 100;
+	if(argc > 0) {
+		try {
+			samples = boost::lexical_cast<size_t>(argv[0]);
+		} catch(...) {
+			return -1;
+		}
+		argc--, argv++;
+	}
+	
+	std::vector<long> levels;
+	if(!benchmark::getLevels(argc, argv, levels)) {
+		return -1;
+	}
+	
+	if(levels.empty()) {
+		LogError << "No levels found";
+		return 2;
+	}
+	
+	size_t problems = 0;
+	for(size_t i = 0; i < levels.size(); i++) {
+		problems += validateLevel(levels[i], samples);
+	}
+	
+	if(problems > 0) {
+		LogError << problems << " problems found in the room visibility";
+		return 1;
+	}
+	
+	return 0;
+}
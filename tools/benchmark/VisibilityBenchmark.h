@@ -0,0 +1,39 @@
+/*
+ * Copyright 2014 Arx Libertatis Team (see the AUTHORS file)
+ *
+ * This file is part of Arx Libertatis.
+ *
+ * Arx Libertatis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Arx Libertatis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Arx Libertatis.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARX_TOOLS_BENCHMARK_VISIBILITYBENCHMARK_H
+#define ARX_TOOLS_BENCHMARK_VISIBILITYBENCHMARK_H
+
+/*!
+ * Build and validate the potentially visible rooms of real levels.
+ *
+ * The visible rooms are loaded or computed like in the game and then computed again
+ * to check that the cached data is up to date. Random camera positions in each room are
+ * used to check that every room the portal traversal could reach is in the set.
+ *
+ * With --user-dir, the cache files are read from and written to that directory,
+ * so this can be used to build the cache for the game.
+ *
+ * Arguments: [--user-dir <dir>] [<samples> [<level>...]]
+ * <samples> is the number of camera positions per room.
+ * If no levels are given, all levels are used.
+ */
+int main_visibility(int argc, char ** argv);
+
+#endif // ARX_TOOLS_BENCHMARK_VISIBILITYBENCHMARK_H